@@ -9,34 +9,41 @@
 #include <fsync/search_engine.h>
 #include <fsync/search_engine_sync_agent.h>
 #include <fsync/sync_engine.h>
+#include <fsync/cdc_sync_agent.h>
 #include <fdb/sync/config.h>
 #include <fdb/sync/nodes.h>
 #include <fdb/sync/dirs.h>
 #include <fdb/sync/files.h>
+#include <fdb/sync/shards.h>
 
 static char const *FDB_DATA_SOURCE = "data";
 
 enum
 {
     FDB_MAX_READERS = 1,
-    FDB_MAP_SIZE    = 64 * 1024 * 1024,
-    FDB_MAX_DBS     = 8     // config, nodes
+    FDB_MAP_SIZE    = 64 * 1024 * 1024,   // Initial map size. The map is grown automatically.
+    FDB_MAX_DBS     = 32,   // config, nodes, dirs, files tables for each node
+    FDB_FLAGS       = FDB_NOMETASYNC,
+    FDB_SHARDS      = FDB_SHARDS_PER_NODE,  // Sync tables of each node are in own DB environment
+    FSEARCH_WORKERS = 4     // Number of directory scan workers
 };
 
 struct fcore
 {
     fmsgbus_t        *msgbus;
     fdb_t            *db;
+    fdb_shards_t     *shards;
     filink_t         *ilink;
     fsync_t          *sync;
     fsync_engine_t   *sync_engine;
     fsearch_engine_t *search_engine;
+    fsync_agent_t    *cdc_agent;
     fconfig_t         config;
 };
 
-static fsync_engine_t *fsync_engine_create(fmsgbus_t *pmsgbus, fuuid_t const *uuid)
+static fsync_engine_t *fsync_engine_create(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *uuid)
 {
-    fsync_engine_t *sync_engine = fsync_engine(pmsgbus, uuid);
+    fsync_engine_t *sync_engine = fsync_engine(pmsgbus, db, uuid);
     if (!sync_engine)
         return 0;
 
@@ -68,7 +75,7 @@ fcore_t *fcore_start(char const *addr)
     }
     memset(pcore, 0, sizeof *pcore);
 
-    pcore->db = fdb_open(FDB_DATA_SOURCE, FDB_MAX_DBS, FDB_MAX_READERS, FDB_MAP_SIZE);
+    pcore->db = fdb_open(FDB_DATA_SOURCE, FDB_MAX_DBS, FDB_MAX_READERS, FDB_MAP_SIZE, FDB_FLAGS);
     if (!pcore->db)
     {
         FS_ERR("Unable to open the DB");
@@ -76,6 +83,14 @@ fcore_t *fcore_start(char const *addr)
         return 0;
     }
 
+    pcore->shards = fdb_shards(pcore->db, FDB_DATA_SOURCE, FDB_SHARDS, FDB_FLAGS);
+    if (!pcore->shards)
+    {
+        FS_ERR("Unable to open the DB shards");
+        fcore_stop(pcore);
+        return 0;
+    }
+
     if (!fdb_load_config(pcore->db, &pcore->config))
     {
         if (!addr)
@@ -112,14 +127,14 @@ fcore_t *fcore_start(char const *addr)
         return 0;
     }
 
-    pcore->sync_engine = fsync_engine_create(pcore->msgbus, &pcore->config.uuid);
+    pcore->sync_engine = fsync_engine_create(pcore->msgbus, pcore->db, &pcore->config.uuid);
     if (!pcore->sync_engine)
     {
         fcore_stop(pcore);
         return 0;
     }
 
-    pcore->search_engine = fsearch_engine(pcore->msgbus, pcore->db, &pcore->config.uuid);
+    pcore->search_engine = fsearch_engine(pcore->msgbus, pcore->db, &pcore->config.uuid, FSEARCH_WORKERS);
     if (!pcore->search_engine)
     {
         fcore_stop(pcore);
@@ -140,8 +155,12 @@ void fcore_stop(fcore_t *pcore)
         filink_release(pcore->ilink);
         fsync_release(pcore->sync);
         fsync_engine_release(pcore->sync_engine);
+        if (pcore->cdc_agent)
+            pcore->cdc_agent->release(pcore->cdc_agent);
         fsearch_engine_release(pcore->search_engine);
         fmsgbus_release(pcore->msgbus);
+        if (pcore->shards)
+            fdb_shards_release(pcore->shards);
         fdb_release(pcore->db);
         memset(pcore, 0, sizeof *pcore);
         free(pcore);
@@ -176,7 +195,41 @@ bool fcore_sync(fcore_t *pcore, char const *dir)
     if (pcore->sync)
         fsync_release(pcore->sync);
 
-    pcore->sync = fsync_create(pcore->msgbus, pcore->db, dir, &pcore->config.uuid);
+    pcore->sync = fsync_create(pcore->msgbus, pcore->db, pcore->shards, dir, &pcore->config.uuid);
+
+    // The agent can't be unregistered. It receives files into the first synchronized directory.
+    if (pcore->config.cdc_sync && !pcore->cdc_agent)
+    {
+        pcore->cdc_agent = cdc_sync_agent(pcore->db, dir);
+        if (pcore->cdc_agent
+            && fsync_engine_register_agent(pcore->sync_engine, pcore->cdc_agent) != FSUCCESS)
+        {
+            pcore->cdc_agent->release(pcore->cdc_agent);
+            pcore->cdc_agent = 0;
+        }
+
+        if (!pcore->cdc_agent)
+            FS_ERR("Content defined chunks synchronization wasn't started");
+    }
+
+    return true;
+}
+
+bool fcore_cdc_sync(fcore_t *pcore, bool enable)
+{
+    if (!pcore)
+    {
+        FS_ERR("Invalid argument");
+        return false;
+    }
+
+    pcore->config.cdc_sync = enable;
+
+    if (!fdb_save_config(pcore->db, &pcore->config))
+    {
+        FS_ERR("Current configuration doesn't saved");
+        return false;
+    }
 
     return true;
 }
@@ -24,6 +24,7 @@ fcore_t *fcore_start(char const *addr);
 void    fcore_stop(fcore_t *pcore);
 bool    fcore_connect(fcore_t *pcore, char const *addr);
 bool    fcore_sync(fcore_t *pcore, char const *dir);
+bool    fcore_cdc_sync(fcore_t *pcore, bool enable);   // The switch is saved in config. The agent is registered by the next fcore_sync.
 bool    fcore_index(fcore_t *pcore, char const *dir);
 bool    fcore_find(fcore_t *pcore, char const *file, fuuid_t *uuid);
 
@@ -9,6 +9,8 @@ static void fhelp()
     printf("  help - print help\n");
     printf("  connect IP:port - connect to other node\n");
     printf("  sync path - synchronize directories\n");
+    printf("  cdc on|off - receive files with deduplication of content defined chunks\n"
+           "              (it is enabled by the next sync and disabled after restart)\n");
     printf("  index path - calculate index for files in directory for search\n"
            "             or shows indexed directories list (if it was called without arg)\n");
     printf("  find - search file in indexed directories\n");
@@ -33,6 +35,17 @@ static void fsync(fcore_t *core, char *cmd)
     fcore_sync(core, cmd);
 }
 
+static void fcdc(fcore_t *core, char *cmd)
+{
+    for(; *cmd && isspace(*cmd); ++cmd);
+    char *c = cmd;
+    for(; *c && !isspace(*c); ++c);
+    *c = 0;
+    if (strcasecmp(cmd, "on") == 0)         fcore_cdc_sync(core, true);
+    else if (strcasecmp(cmd, "off") == 0)   fcore_cdc_sync(core, false);
+    else                                    printf("Usage: cdc on|off\n");
+}
+
 static void findex(fcore_t *core, char *cmd)
 {
     for(; *cmd && isspace(*cmd); ++cmd);
@@ -91,6 +104,7 @@ static const char CMD_EXIT[4]    = "exit";
 static const char CMD_HELP[4]    = "help";
 static const char CMD_CONNECT[7] = "connect";
 static const char CMD_SYNC[4]    = "sync";
+static const char CMD_CDC[3]     = "cdc";
 static const char CMD_INDEX[5]   = "index";
 static const char CMD_NODES[5]   = "nodes";
 static const char CMD_FIND[4]    = "find";
@@ -113,6 +127,7 @@ int main(int argc, char **argv)
             else if (strncasecmp(cmd, CMD_HELP, sizeof CMD_HELP) == 0)          fhelp();
             else if (strncasecmp(cmd, CMD_CONNECT, sizeof CMD_CONNECT) == 0)    fconnect(core, cmd + sizeof CMD_CONNECT);
             else if (strncasecmp(cmd, CMD_SYNC, sizeof CMD_SYNC) == 0)          fsync(core, cmd + sizeof CMD_SYNC);
+            else if (strncasecmp(cmd, CMD_CDC, sizeof CMD_CDC) == 0)            fcdc(core, cmd + sizeof CMD_CDC);
             else if (strncasecmp(cmd, CMD_INDEX, sizeof CMD_INDEX) == 0)        findex(core, cmd + sizeof CMD_INDEX);
             else if (strncasecmp(cmd, CMD_NODES, sizeof CMD_NODES) == 0)        fnodes(core);
             else if (strncasecmp(cmd, CMD_FIND, sizeof CMD_FIND) == 0)          ffind(core, cmd + sizeof CMD_FIND);
@@ -6,7 +6,8 @@ enum
     FMAX_CONNECTIONS_NUM        = 128,      // Maximum allowed connections
     FMSGBUS_THREADS_NUM         = 8,        // Threads number for messages handling
     FMSGBUS_MAX_THREADS         = 16,       // Maximum allowed threads number for messages handling
-    FDATA_SYNC_THREADS_NUM      = 4,        // Threads number for data synchronization
+    FDATA_SYNC_THREADS_NUM      = 4,        // Workers number for data synchronization steps (per direction)
+    FSYNC_ACTIVE_MAX            = 4096,     // Maximum number of concurrent synchronizations (per direction)
     FMAX_PATH                   = 1024,     // Max file path length
     FMAX_FILENAME               = 260,      // Max file name length
     FMAX_DIR_DEPTH              = 512,      // Max directories depth
@@ -18,6 +19,7 @@ enum
     FMAX_ADDR                   = 1024,     // Max address length
     FMAX_METAINF_SIZE           = 512,      // Maximum size of meta information
     FMAX_ERROR_MSG_LEN          = 256,      // Maximum length of error message
+    FSYNC_SKETCH_SIZE           = 32,       // Number of feature hashes in data sketch
 };
 
 #endif
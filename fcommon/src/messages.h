@@ -31,6 +31,12 @@ typedef enum
     FSYNC_FAILED,                   // sync_failed
     FSYNC_CANCEL,                   // sync_cancel
     FSYNC_OK,                       // sync_ok
+    FSYNC_LITERAL,                  // sync_literal
+    FSYNC_APPEND,                   // sync_append
+    FSYNC_APPEND_REJECT,            // sync_append_reject
+    FSYNC_SKETCH_REQUEST,           // sync_sketch_request
+    FSYNC_SKETCH,                   // sync_sketch
+    FSYNC_SIGNATURE_VALID,          // sync_signature_valid
 } fmessage_t;
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -97,12 +103,14 @@ FMSG_DEF(stream_accept,
 
 FMSG_DEF(stream_failed,
     uint32_t                stream_id;                      // stream id
+    fuuid_t                 source;                         // stream source (writer). Streams in opposite directions may have equal ids.
     uint32_t                err;                            // error code
     char                    msg[FMAX_ERROR_MSG_LEN];        // error message
 )
 
 FMSG_DEF(stream_closed,
     uint32_t                stream_id;                      // stream id
+    fuuid_t                 source;                         // stream source
     uint64_t                data_size;                      // total received/sent size
 )
 
@@ -119,6 +127,11 @@ FMSG_DEF(stream_data,
 FMSG_DEF(sync_request,
     uint32_t                agent_id;                       // synchronization agent id
     uint32_t                sync_id;                        // synchronization id
+    uint32_t                block_len;                      // signature block length (0 - default)
+    uint32_t                strong_len;                     // signature strong sum length (0 - full)
+    uint64_t                size;                           // data size (0 - unknown)
+    fmd5_t                  digest;                         // data digest (zero - unknown)
+    fmd5_t                  base_digest;                    // digest of dst data whose signature is known by src (zero - unknown)
     uint32_t                metainf_size;                   // meta information size
     uint8_t                 metainf[FMAX_METAINF_SIZE];     // meta information
 )
@@ -139,4 +152,36 @@ FMSG_DEF(sync_ok,
     uint32_t                sync_id;                        // synchronization id
 )
 
+// Data is requested without signature
+FMSG_DEF(sync_literal,
+    uint32_t                sync_id;                        // synchronization id
+)
+
+// Local data is a prefix of the source data. Only the tail is requested.
+FMSG_DEF(sync_append,
+    uint32_t                sync_id;                        // synchronization id
+    uint64_t                offset;                         // local data size
+    fmd5_t                  digest;                         // digest of the whole local data
+)
+
+// Source data doesn't start with the local data. Signature is required.
+FMSG_DEF(sync_append_reject,
+    uint32_t                sync_id;                        // synchronization id
+)
+
+// Destination has no local data. Sketch of the source data is requested to find a similar local file.
+FMSG_DEF(sync_sketch_request,
+    uint32_t                sync_id;                        // synchronization id
+)
+
+FMSG_DEF(sync_sketch,
+    uint32_t                sync_id;                        // synchronization id
+    uint64_t                hashes[FSYNC_SKETCH_SIZE];      // the smallest feature hashes of data, UINT64_MAX for unused
+)
+
+// Local data wasn't changed. The signature which is known by src is valid.
+FMSG_DEF(sync_signature_valid,
+    uint32_t                sync_id;                        // synchronization id
+)
+
 #endif
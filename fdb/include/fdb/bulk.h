@@ -0,0 +1 @@
+#include "../../src/bulk.h"
\ No newline at end of file
@@ -0,0 +1 @@
+#include "../../../src/sync/bitmaps.h"
\ No newline at end of file
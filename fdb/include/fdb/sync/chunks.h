@@ -0,0 +1 @@
+#include "../../../src/sync/chunks.h"
\ No newline at end of file
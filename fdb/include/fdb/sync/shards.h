@@ -0,0 +1 @@
+#include "../../../src/sync/shards.h"
\ No newline at end of file
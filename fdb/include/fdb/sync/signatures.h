@@ -0,0 +1 @@
+#include "../../../src/sync/signatures.h"
\ No newline at end of file
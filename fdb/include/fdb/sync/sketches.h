@@ -0,0 +1 @@
+#include "../../../src/sync/sketches.h"
\ No newline at end of file
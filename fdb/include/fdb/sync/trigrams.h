@@ -0,0 +1 @@
+#include "../../../src/sync/trigrams.h"
\ No newline at end of file
@@ -0,0 +1,446 @@
+#include "bulk.h"
+#include <futils/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+enum
+{
+    FDB_BULK_MAX_RUNS       = 64,           // Maximum number of sorted runs in temporary files
+    FDB_BULK_MIN_MEM        = 64 * 1024,    // Minimum memory for items
+    FDB_BULK_INDEX_GROWTH   = 1024
+};
+
+// Record is stored in memory and in temporary files as the header followed by key and value data.
+typedef struct
+{
+    uint32_t key_size;
+    uint32_t value_size;
+} fdb_bulk_record_t;
+
+typedef struct
+{
+    FILE   *file;
+    uint8_t*buf;            // Current record
+    size_t  buf_size;
+    bool    is_valid;
+} fdb_bulk_run_t;
+
+struct fdb_bulk_loader
+{
+    fdb_map_t          *pmap;
+    fdb_transaction_t  *transaction;
+    size_t              mem_limit;
+
+    uint8_t            *buf;            // Records
+    size_t              buf_size;
+    size_t              buf_capacity;
+
+    size_t             *items;          // Offsets of records in buf
+    size_t             *tmp_items;      // Temporary array for sorting
+    size_t              items_num;
+    size_t              items_capacity;
+
+    fdb_bulk_run_t      runs[FDB_BULK_MAX_RUNS + 1];   // The last run is for the data remaining at flush
+    size_t              runs_num;
+
+    size_t              size;           // Number of accumulated items (including items in runs)
+
+    // Insertion state
+    bool                append_mode;
+    bool                is_first;
+    uint8_t            *pending;        // The record which is waiting for insertion
+    size_t              pending_capacity;
+    bool                has_pending;
+};
+
+static void fdb_bulk_record_data(uint8_t const *record, fdb_data_t *key, fdb_data_t *value)
+{
+    fdb_bulk_record_t hdr;
+    memcpy(&hdr, record, sizeof hdr);
+    key->size = hdr.key_size;
+    key->data = (void*)(record + sizeof hdr);
+    value->size = hdr.value_size;
+    value->data = (void*)(record + sizeof hdr + hdr.key_size);
+}
+
+static size_t fdb_bulk_record_size(uint8_t const *record)
+{
+    fdb_bulk_record_t hdr;
+    memcpy(&hdr, record, sizeof hdr);
+    return sizeof hdr + hdr.key_size + hdr.value_size;
+}
+
+static int fdb_bulk_record_cmp(fdb_bulk_loader_t *loader, uint8_t const *lhs, uint8_t const *rhs)
+{
+    fdb_data_t key_1, value_1, key_2, value_2;
+    fdb_bulk_record_data(lhs, &key_1, &value_1);
+    fdb_bulk_record_data(rhs, &key_2, &value_2);
+    return fdb_map_cmp(loader->pmap, loader->transaction, &key_1, &value_1, &key_2, &value_2);
+}
+
+fdb_bulk_loader_t *fdb_bulk_loader(fdb_map_t *pmap, fdb_transaction_t *transaction, size_t mem_limit)
+{
+    if (!pmap || !transaction)
+    {
+        FS_ERR("Invalid arguments");
+        return 0;
+    }
+
+    fdb_bulk_loader_t *loader = malloc(sizeof(fdb_bulk_loader_t));
+    if (!loader)
+    {
+        FS_ERR("Unable to allocate memory for bulk loader");
+        return 0;
+    }
+    memset(loader, 0, sizeof *loader);
+
+    loader->pmap = pmap;
+    loader->transaction = transaction;
+    loader->mem_limit = mem_limit < FDB_BULK_MIN_MEM ? FDB_BULK_MIN_MEM : mem_limit;
+
+    return loader;
+}
+
+static void fdb_bulk_runs_close(fdb_bulk_loader_t *loader)
+{
+    for (size_t i = 0; i < loader->runs_num; ++i)
+    {
+        if (loader->runs[i].file)
+            fclose(loader->runs[i].file);
+        free(loader->runs[i].buf);
+    }
+    memset(loader->runs, 0, sizeof loader->runs);
+    loader->runs_num = 0;
+}
+
+void fdb_bulk_loader_free(fdb_bulk_loader_t *loader)
+{
+    if (loader)
+    {
+        fdb_bulk_runs_close(loader);
+        free(loader->buf);
+        free(loader->items);
+        free(loader->tmp_items);
+        free(loader->pending);
+        free(loader);
+    }
+}
+
+size_t fdb_bulk_loader_size(fdb_bulk_loader_t const *loader)
+{
+    return loader ? loader->size : 0;
+}
+
+// Stable merge sort. The order of items with equal keys is kept, so the last added item is the last one.
+static void fdb_bulk_sort(fdb_bulk_loader_t *loader, size_t *items, size_t *tmp, size_t num)
+{
+    if (num < 2)
+        return;
+
+    size_t const half = num / 2;
+    fdb_bulk_sort(loader, items, tmp, half);
+    fdb_bulk_sort(loader, items + half, tmp, num - half);
+
+    if (fdb_bulk_record_cmp(loader, loader->buf + items[half - 1], loader->buf + items[half]) <= 0)
+        return;
+
+    memcpy(tmp, items, half * sizeof *items);
+
+    size_t i = 0, j = half, k = 0;
+    while (i < half && j < num)
+    {
+        if (fdb_bulk_record_cmp(loader, loader->buf + items[j], loader->buf + tmp[i]) < 0)
+            items[k++] = items[j++];
+        else
+            items[k++] = tmp[i++];
+    }
+
+    while (i < half)
+        items[k++] = tmp[i++];
+}
+
+static bool fdb_bulk_insert(fdb_bulk_loader_t *loader, uint8_t const *record)
+{
+    fdb_data_t key, value;
+    fdb_bulk_record_data(record, &key, &value);
+
+    if (loader->is_first)
+    {
+        loader->is_first = false;
+        loader->append_mode = true;
+
+        // MDB_APPEND is possible only if the first key is greater than the last key in the map
+        fdb_cursor_t cursor = { 0 };
+        if (fdb_cursor_open(loader->pmap, loader->transaction, &cursor))
+        {
+            fdb_data_t last_key = { 0 }, last_value = { 0 };
+            if (fdb_cursor_get(&cursor, &last_key, &last_value, FDB_LAST))
+                loader->append_mode = fdb_map_cmp(loader->pmap, loader->transaction, &key, &value, &last_key, &last_value) > 0;
+            fdb_cursor_close(&cursor);
+        }
+        else
+            loader->append_mode = false;
+    }
+
+    return loader->append_mode
+            ? fdb_map_append(loader->pmap, loader->transaction, &key, &value)
+            : fdb_map_put(loader->pmap, loader->transaction, &key, &value);
+}
+
+// Records come in the map order. Only the last record of equal ones is inserted.
+static bool fdb_bulk_emit(fdb_bulk_loader_t *loader, uint8_t const *record)
+{
+    if (loader->has_pending
+        && fdb_bulk_record_cmp(loader, loader->pending, record) != 0
+        && !fdb_bulk_insert(loader, loader->pending))
+        return false;
+
+    size_t const size = fdb_bulk_record_size(record);
+    if (size > loader->pending_capacity)
+    {
+        uint8_t *pending = realloc(loader->pending, size);
+        if (!pending)
+        {
+            FS_ERR("Unable to allocate memory for record");
+            return false;
+        }
+        loader->pending = pending;
+        loader->pending_capacity = size;
+    }
+
+    memcpy(loader->pending, record, size);
+    loader->has_pending = true;
+
+    return true;
+}
+
+static bool fdb_bulk_emit_finish(fdb_bulk_loader_t *loader)
+{
+    bool ret = true;
+    if (loader->has_pending)
+        ret = fdb_bulk_insert(loader, loader->pending);
+    loader->has_pending = false;
+    return ret;
+}
+
+static void fdb_bulk_buf_reset(fdb_bulk_loader_t *loader)
+{
+    loader->buf_size = 0;
+    loader->items_num = 0;
+}
+
+static bool fdb_bulk_spill(fdb_bulk_loader_t *loader)
+{
+    fdb_bulk_sort(loader, loader->items, loader->tmp_items, loader->items_num);
+
+    fdb_bulk_run_t *run = &loader->runs[loader->runs_num];
+
+    run->file = tmpfile();
+    if (!run->file)
+    {
+        FS_ERR("Unable to create temporary file");
+        return false;
+    }
+    loader->runs_num++;
+
+    for (size_t i = 0; i < loader->items_num; ++i)
+    {
+        uint8_t const *record = loader->buf + loader->items[i];
+        size_t const size = fdb_bulk_record_size(record);
+        if (fwrite(record, 1, size, run->file) != size)
+        {
+            FS_ERR("Unable to write sorted run into temporary file");
+            return false;
+        }
+    }
+
+    fdb_bulk_buf_reset(loader);
+
+    return true;
+}
+
+static bool fdb_bulk_insert_sorted(fdb_bulk_loader_t *loader)
+{
+    fdb_bulk_sort(loader, loader->items, loader->tmp_items, loader->items_num);
+
+    for (size_t i = 0; i < loader->items_num; ++i)
+    {
+        if (!fdb_bulk_emit(loader, loader->buf + loader->items[i]))
+            return false;
+    }
+
+    return fdb_bulk_emit_finish(loader);
+}
+
+static bool fdb_bulk_run_read(fdb_bulk_run_t *run)
+{
+    fdb_bulk_record_t hdr;
+
+    run->is_valid = false;
+
+    if (fread(&hdr, sizeof hdr, 1, run->file) != 1)
+        return feof(run->file) != 0;
+
+    size_t const size = sizeof hdr + hdr.key_size + hdr.value_size;
+    if (size > run->buf_size)
+    {
+        uint8_t *buf = realloc(run->buf, size);
+        if (!buf)
+        {
+            FS_ERR("Unable to allocate memory for record");
+            return false;
+        }
+        run->buf = buf;
+        run->buf_size = size;
+    }
+
+    memcpy(run->buf, &hdr, sizeof hdr);
+    if (size > sizeof hdr
+        && fread(run->buf + sizeof hdr, size - sizeof hdr, 1, run->file) != 1)
+    {
+        FS_ERR("Unable to read sorted run from temporary file");
+        return false;
+    }
+
+    run->is_valid = true;
+
+    return true;
+}
+
+// k-way merge of sorted runs. For equal records the earliest run goes first, so the last added record wins.
+static bool fdb_bulk_merge_runs(fdb_bulk_loader_t *loader)
+{
+    for (size_t i = 0; i < loader->runs_num; ++i)
+    {
+        rewind(loader->runs[i].file);
+        if (!fdb_bulk_run_read(&loader->runs[i]))
+            return false;
+    }
+
+    for(;;)
+    {
+        fdb_bulk_run_t *min_run = 0;
+
+        for (size_t i = 0; i < loader->runs_num; ++i)
+        {
+            fdb_bulk_run_t *run = &loader->runs[i];
+            if (run->is_valid
+                && (!min_run || fdb_bulk_record_cmp(loader, run->buf, min_run->buf) < 0))
+                min_run = run;
+        }
+
+        if (!min_run)
+            break;
+
+        if (!fdb_bulk_emit(loader, min_run->buf)
+            || !fdb_bulk_run_read(min_run))
+            return false;
+    }
+
+    return fdb_bulk_emit_finish(loader);
+}
+
+bool fdb_bulk_loader_flush(fdb_bulk_loader_t *loader)
+{
+    if (!loader)
+        return false;
+
+    loader->is_first = true;
+    loader->has_pending = false;
+
+    bool ret = true;
+
+    if (!loader->runs_num)
+        ret = fdb_bulk_insert_sorted(loader);
+    else
+    {
+        ret = (!loader->items_num || fdb_bulk_spill(loader))
+              && fdb_bulk_merge_runs(loader);
+        fdb_bulk_runs_close(loader);
+    }
+
+    fdb_bulk_buf_reset(loader);
+    loader->size = 0;
+
+    return ret;
+}
+
+static bool fdb_bulk_reserve(fdb_bulk_loader_t *loader, size_t size)
+{
+    if (loader->buf_size + size > loader->buf_capacity)
+    {
+        size_t capacity = loader->buf_capacity ? loader->buf_capacity * 2 : FDB_BULK_MIN_MEM;
+        while (capacity < loader->buf_size + size)
+            capacity *= 2;
+
+        uint8_t *buf = realloc(loader->buf, capacity);
+        if (!buf)
+        {
+            FS_ERR("Unable to allocate memory for bulk loader");
+            return false;
+        }
+        loader->buf = buf;
+        loader->buf_capacity = capacity;
+    }
+
+    if (loader->items_num == loader->items_capacity)
+    {
+        size_t const capacity = loader->items_capacity + FDB_BULK_INDEX_GROWTH;
+
+        size_t *items = realloc(loader->items, capacity * sizeof *items);
+        if (!items)
+        {
+            FS_ERR("Unable to allocate memory for bulk loader");
+            return false;
+        }
+        loader->items = items;
+
+        size_t *tmp_items = realloc(loader->tmp_items, capacity * sizeof *tmp_items);
+        if (!tmp_items)
+        {
+            FS_ERR("Unable to allocate memory for bulk loader");
+            return false;
+        }
+        loader->tmp_items = tmp_items;
+
+        loader->items_capacity = capacity;
+    }
+
+    return true;
+}
+
+bool fdb_bulk_loader_add(fdb_bulk_loader_t *loader, fdb_data_t const *key, fdb_data_t const *value)
+{
+    if (!loader || !key || !value)
+        return false;
+
+    if (loader->buf_size >= loader->mem_limit)
+    {
+        // Too many runs. Accumulated data is inserted and the loader starts again.
+        if (loader->runs_num >= FDB_BULK_MAX_RUNS)
+        {
+            if (!fdb_bulk_loader_flush(loader))
+                return false;
+        }
+        else if (!fdb_bulk_spill(loader))
+            return false;
+    }
+
+    fdb_bulk_record_t const hdr = { (uint32_t)key->size, (uint32_t)value->size };
+    size_t const size = sizeof hdr + key->size + value->size;
+
+    if (!fdb_bulk_reserve(loader, size))
+        return false;
+
+    uint8_t *record = loader->buf + loader->buf_size;
+    memcpy(record, &hdr, sizeof hdr);
+    memcpy(record + sizeof hdr, key->data, key->size);
+    memcpy(record + sizeof hdr + key->size, value->data, value->size);
+
+    loader->items[loader->items_num++] = loader->buf_size;
+    loader->buf_size += size;
+    loader->size++;
+
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef BULK_H_FDB
+#define BULK_H_FDB
+#include "db.h"
+
+/*
+ * Bulk loader accumulates key/value pairs, sorts them by the map order and inserts them in order.
+ * If all keys are greater than keys in the map, MDB_APPEND mode is used (no page splits).
+ * When the data doesn't fit into the memory limit, sorted runs are spilled into temporary files and merged.
+ * For duplicate keys the last added value wins (except FDB_MAP_MULTI maps).
+ */
+
+typedef struct fdb_bulk_loader fdb_bulk_loader_t;
+
+fdb_bulk_loader_t *fdb_bulk_loader(fdb_map_t *pmap, fdb_transaction_t *transaction, size_t mem_limit);
+void               fdb_bulk_loader_free(fdb_bulk_loader_t *);
+bool               fdb_bulk_loader_add(fdb_bulk_loader_t *, fdb_data_t const *key, fdb_data_t const *value);
+bool               fdb_bulk_loader_flush(fdb_bulk_loader_t *);        // Inserts all accumulated data into the map
+size_t             fdb_bulk_loader_size(fdb_bulk_loader_t const *);   // Number of accumulated items
+
+#endif
@@ -1,4 +1,5 @@
 #include "db.h"
+#include "sync/ids.h"
 #include <stdint.h>
 #include <futils/log.h>
 #include <futils/static_assert.h>
@@ -8,15 +9,31 @@
 #include <lmdb.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 #ifdef _WIN32
 #include <io.h>
 #endif
 
+enum
+{
+    FDB_MAP_FILL_LIMIT = 80,                // The map is grown when it is filled more than this percent
+    FDB_MAP_GROWTH_FACTOR = 2,              // New map size = current map size * FDB_MAP_GROWTH_FACTOR
+    FDB_SYNC_PERIOD = 5,                    // Period of data flushing for FDB_NOSYNC mode (in seconds)
+    FDB_FREE_DBI = 0                        // LMDB keeps the free pages list in the database with this handle
+};
+
 struct fdb
 {
     volatile uint32_t ref_counter;
-    MDB_env *env;
+    MDB_env          *env;
+    uint32_t          flags;
+    pthread_mutex_t   txn_mutex;            // LMDB serializes write transactions. This mutex is used for map resizing between transactions.
+    volatile bool     grow_map;
+    volatile bool     map_full;             // A transaction was lost because the map was full
+    time_t            sync_time;
+    fdb_ids_cache_t  *ids_caches;
 };
 
 #define FDB_CALL(pdb, expr)                                                             \
@@ -47,7 +64,19 @@ static bool make_dir(const char *path)
     return errno == EEXIST;
 }
 
-fdb_t* fdb_open(char const *path, uint32_t max_dbs, uint32_t readers, uint32_t size)
+static uint32_t fdb_env_flags(uint32_t flags)
+{
+    uint32_t mdb_flags = 0;
+    if (flags & FDB_NOMETASYNC) mdb_flags |= MDB_NOMETASYNC;
+    if (flags & FDB_NOSYNC)     mdb_flags |= MDB_NOSYNC;
+    if (flags & FDB_WRITEMAP)   mdb_flags |= MDB_WRITEMAP;
+    if ((flags & FDB_WRITEMAP)
+        && (flags & FDB_NOSYNC))
+        mdb_flags |= MDB_MAPASYNC;
+    return mdb_flags;
+}
+
+fdb_t* fdb_open(char const *path, uint32_t max_dbs, uint32_t readers, uint32_t size, uint32_t flags)
 {
     int rc;
 
@@ -69,12 +98,17 @@ fdb_t* fdb_open(char const *path, uint32_t max_dbs, uint32_t readers, uint32_t s
     memset(pdb, 0, sizeof(fdb_t));
 
     pdb->ref_counter = 1;
+    pdb->flags = flags;
+    pdb->sync_time = time(0);
+
+    static pthread_mutex_t const mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
+    pdb->txn_mutex = mutex_initializer;
 
     FDB_CALL(pdb, mdb_env_create(&pdb->env));
     FDB_CALL(pdb, mdb_env_set_maxreaders(pdb->env, readers));
     FDB_CALL(pdb, mdb_env_set_mapsize(pdb->env, size));
     FDB_CALL(pdb, mdb_env_set_maxdbs(pdb->env, max_dbs));
-    FDB_CALL(pdb, mdb_env_open(pdb->env, path, 0, 0664));
+    FDB_CALL(pdb, mdb_env_open(pdb->env, path, fdb_env_flags(flags), 0664));
 
     return pdb;
 }
@@ -94,9 +128,18 @@ void fdb_release(fdb_t *pdb)
     {
         if (!pdb->ref_counter)
             FS_ERR("Invalid DB handler");
-        else if (!--pdb->ref_counter)
+        else if (pdb->ref_counter == 1 && pdb->ids_caches)
+            fdb_ids_caches_free(pdb);               // The last reference. Transactions retain the handler, so it's still alive here.
+
+        if (pdb->ref_counter && !--pdb->ref_counter)
         {
-            mdb_env_close(pdb->env);
+            if (pdb->env)
+            {
+                if (pdb->flags & FDB_NOSYNC)
+                    mdb_env_sync(pdb->env, 1);
+                mdb_env_close(pdb->env);
+            }
+            pthread_mutex_destroy(&pdb->txn_mutex);
             free(pdb);
         }
     }
@@ -104,15 +147,166 @@ void fdb_release(fdb_t *pdb)
         FS_ERR("Invalid DB handler");
 }
 
+fdb_ids_cache_t **fdb_ids_caches(fdb_t *pdb)
+{
+    return &pdb->ids_caches;
+}
+
+bool fdb_sync(fdb_t *pdb)
+{
+    if (!pdb)
+    {
+        FS_ERR("Invalid DB handler");
+        return false;
+    }
+
+    int rc = mdb_env_sync(pdb->env, 1);
+    if (rc != MDB_SUCCESS)
+    {
+        FS_ERR("The LMDB data wasn't flushed: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    pdb->sync_time = time(0);
+    return true;
+}
+
+bool fdb_durability_set(fdb_t *pdb, uint32_t flags)
+{
+    if (!pdb)
+    {
+        FS_ERR("Invalid DB handler");
+        return false;
+    }
+
+    if ((flags & FDB_WRITEMAP) != (pdb->flags & FDB_WRITEMAP))
+    {
+        FS_ERR("The FDB_WRITEMAP flag can't be changed for opened DB");
+        return false;
+    }
+
+    int rc = mdb_env_set_flags(pdb->env, MDB_NOMETASYNC, (flags & FDB_NOMETASYNC) ? 1 : 0);
+    if (rc == MDB_SUCCESS)
+        rc = mdb_env_set_flags(pdb->env, MDB_NOSYNC, (flags & FDB_NOSYNC) ? 1 : 0);
+    if (rc == MDB_SUCCESS && (flags & FDB_WRITEMAP))
+        rc = mdb_env_set_flags(pdb->env, MDB_MAPASYNC, (flags & FDB_NOSYNC) ? 1 : 0);
+    if (rc != MDB_SUCCESS)
+    {
+        FS_ERR("The LMDB flags wasn't changed: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    bool const flush = (pdb->flags & FDB_NOSYNC) && !(flags & FDB_NOSYNC);
+    pdb->flags = flags;
+
+    // Data committed in FDB_NOSYNC mode should be flushed
+    return flush ? fdb_sync(pdb) : true;
+}
+
+bool fdb_copy(fdb_t *pdb, char const *path, bool compact)
+{
+    if (!pdb || !path)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    if (!is_dir_exist(path) && !make_dir(path))
+    {
+        FS_ERR("Unable to create the directory \'%s\'", path);
+        return false;
+    }
+
+    int rc = mdb_env_copy2(pdb->env, path, compact ? MDB_CP_COMPACT : 0);
+    if (rc != MDB_SUCCESS)
+    {
+        FS_ERR("Unable to copy the LMDB environment: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    return true;
+}
+
+static bool fdb_map_grow(fdb_t *pdb)
+{
+    MDB_envinfo info;
+    int rc = mdb_env_info(pdb->env, &info);
+    if (rc == MDB_SUCCESS)
+    {
+        size_t const map_size = info.me_mapsize * FDB_MAP_GROWTH_FACTOR;
+        rc = mdb_env_set_mapsize(pdb->env, map_size);
+        if (rc == MDB_SUCCESS)
+        {
+            FS_INFO("The LMDB map size was increased up to %zu bytes", map_size);
+            pdb->grow_map = false;
+            pdb->map_full = false;
+        }
+    }
+
+    if (rc != MDB_SUCCESS)
+        FS_ERR("The LMDB map size wasn't increased: \'%s\'", mdb_strerror(rc));
+
+    return rc == MDB_SUCCESS;
+}
+
+// The map is grown before the next transaction. The current one is failed by LMDB and should be repeated.
+static void fdb_transaction_map_full(fdb_transaction_t *transaction)
+{
+    transaction->pdb->grow_map = true;
+    transaction->pdb->map_full = true;
+    transaction->error = FERR_AGAIN;
+}
+
+static void fdb_map_usage_check(fdb_t *pdb)
+{
+    MDB_envinfo info;
+    MDB_stat stat;
+    if (mdb_env_info(pdb->env, &info) == MDB_SUCCESS
+        && mdb_env_stat(pdb->env, &stat) == MDB_SUCCESS)
+    {
+        size_t const used_size = (info.me_last_pgno + 1) * stat.ms_psize;
+        if (used_size / FDB_MAP_FILL_LIMIT >= info.me_mapsize / 100)
+            pdb->grow_map = true;
+    }
+}
+
 bool fdb_transaction_start(fdb_t *pdb, fdb_transaction_t *ptransaction)
 {
     if (!pdb || !ptransaction)
         return false;
+
+    ptransaction->error = FSUCCESS;
+
+    if (pthread_mutex_lock(&pdb->txn_mutex))
+    {
+        FS_ERR("The mutex locking is failed");
+        return false;
+    }
+
+    // The map size may be changed only when there are no active transactions.
+    // The lost transaction isn't repeated until the map is grown, otherwise it fails again.
+    if (pdb->grow_map
+        && !fdb_map_grow(pdb)
+        && pdb->map_full)
+    {
+        pthread_mutex_unlock(&pdb->txn_mutex);
+        return false;
+    }
+
     MDB_txn *txn;
     int rc = mdb_txn_begin(pdb->env, 0, 0, &txn);
+    if (rc == MDB_MAP_RESIZED)
+    {
+        // The map size was changed by another process
+        rc = mdb_env_set_mapsize(pdb->env, 0);
+        if (rc == MDB_SUCCESS)
+            rc = mdb_txn_begin(pdb->env, 0, 0, &txn);
+    }
+
     if(rc != MDB_SUCCESS)
     {
         FS_ERR("The LMDB transaction wasn't started: \'%s\'", mdb_strerror(rc));
+        pthread_mutex_unlock(&pdb->txn_mutex);
         return false;
     }
     ptransaction->pdb = fdb_retain(pdb);
@@ -121,17 +315,44 @@ bool fdb_transaction_start(fdb_t *pdb, fdb_transaction_t *ptransaction)
     return true;
 }
 
-void fdb_transaction_commit(fdb_transaction_t *transaction)
+bool fdb_transaction_commit(fdb_transaction_t *transaction)
 {
+    bool ret = false;
     MDB_txn *txn = (MDB_txn*)transaction->ptransaction;
     if (txn)
     {
-        int rc = mdb_txn_commit(txn);
-        if(rc != MDB_SUCCESS)
+        fdb_t *pdb = transaction->pdb;
+
+        int rc = MDB_MAP_FULL;
+        if (transaction->error == FERR_AGAIN)
+            mdb_txn_abort(txn);
+        else
+            rc = mdb_txn_commit(txn);
+
+        if(rc == MDB_SUCCESS)
+        {
+            ret = true;
+            fdb_map_usage_check(pdb);
+            if ((pdb->flags & FDB_NOSYNC)
+                && time(0) - pdb->sync_time >= FDB_SYNC_PERIOD)
+                fdb_sync(pdb);
+        }
+        else
+        {
+            if (rc == MDB_MAP_FULL)
+                fdb_transaction_map_full(transaction);
             FS_ERR("The LMDB transaction wasn't committed: \'%s\'", mdb_strerror(rc));
-        fdb_release(transaction->pdb);
+        }
+
+        fdb_ids_caches_end(pdb, ret);
+        pthread_mutex_unlock(&pdb->txn_mutex);
+        fdb_release(pdb);
+
+        ferr_t const error = transaction->error;
         memset(transaction, 0, sizeof *transaction);
+        transaction->error = error;
     }
+    return ret;
 }
 
 void fdb_transaction_abort(fdb_transaction_t *transaction)
@@ -139,12 +360,68 @@ void fdb_transaction_abort(fdb_transaction_t *transaction)
     MDB_txn *txn = (MDB_txn*)transaction->ptransaction;
     if (txn)
     {
+        fdb_t *pdb = transaction->pdb;
         mdb_txn_abort(txn);
-        fdb_release(transaction->pdb);
+        fdb_ids_caches_end(pdb, false);
+        pthread_mutex_unlock(&pdb->txn_mutex);
+        fdb_release(pdb);
+
+        ferr_t const error = transaction->error;
         memset(transaction, 0, sizeof *transaction);
+        transaction->error = error;
     }
 }
 
+bool fdb_stat(fdb_transaction_t *transaction, fdb_stat_t *stat)
+{
+    if (!transaction || !stat)
+        return false;
+
+    MDB_txn *txn = (MDB_txn*)transaction->ptransaction;
+    MDB_env *env = transaction->pdb->env;
+
+    MDB_envinfo info;
+    MDB_stat mst;
+
+    int rc = mdb_env_info(env, &info);
+    if (rc == MDB_SUCCESS)
+        rc = mdb_env_stat(env, &mst);
+    if (rc != MDB_SUCCESS)
+    {
+        FS_ERR("Unable to get the LMDB environment statistics: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    memset(stat, 0, sizeof *stat);
+    stat->map_size = info.me_mapsize;
+    stat->page_size = mst.ms_psize;
+    stat->pages = info.me_last_pgno + 1;
+    stat->last_txn = info.me_last_txnid;
+    stat->max_readers = info.me_maxreaders;
+    stat->readers = info.me_numreaders;
+
+    // Each record of the free list is a page numbers list. The first item is the list size.
+    MDB_cursor *cursor = 0;
+    rc = mdb_cursor_open(txn, FDB_FREE_DBI, &cursor);
+    if (rc != MDB_SUCCESS)
+    {
+        FS_ERR("Unable to open the free pages list: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    MDB_val key, value;
+    while ((rc = mdb_cursor_get(cursor, &key, &value, MDB_NEXT)) == MDB_SUCCESS)
+    {
+        size_t pages_num;
+        memcpy(&pages_num, value.mv_data, sizeof pages_num);
+        stat->free_pages += pages_num;
+    }
+
+    mdb_cursor_close(cursor);
+
+    return rc == MDB_NOTFOUND;
+}
+
 bool fdb_map_open(fdb_transaction_t *transaction, char const *name, uint32_t flags, fdb_map_t *pmap)
 {
     if (!transaction || !pmap)
@@ -160,8 +437,15 @@ bool fdb_map_open(fdb_transaction_t *transaction, char const *name, uint32_t fla
     MDB_txn *txn = (MDB_txn*)transaction->ptransaction;
     MDB_dbi dbi;
     int rc = mdb_dbi_open(txn, name, mdb_flags, &dbi);
+
+    // The map which isn't created yet
+    if (rc == MDB_NOTFOUND && !(flags & FDB_MAP_CREATE))
+        return false;
+
     if(rc != MDB_SUCCESS)
     {
+        if (rc == MDB_MAP_FULL)
+            fdb_transaction_map_full(transaction);
         FS_ERR("Unable to open the LMDB database: \'%s\'", mdb_strerror(rc));
         return false;
     }
@@ -172,6 +456,28 @@ bool fdb_map_open(fdb_transaction_t *transaction, char const *name, uint32_t fla
     return true;
 }
 
+bool fdb_map_stat(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_map_stat_t *stat)
+{
+    if (!pmap || !transaction || !stat)
+        return false;
+
+    MDB_stat mst;
+    int rc = mdb_stat((MDB_txn*)transaction->ptransaction, (MDB_dbi)pmap->dbmap, &mst);
+    if (rc != MDB_SUCCESS)
+    {
+        FS_ERR("Unable to get the LMDB database statistics: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    stat->depth = mst.ms_depth;
+    stat->branch_pages = mst.ms_branch_pages;
+    stat->leaf_pages = mst.ms_leaf_pages;
+    stat->overflow_pages = mst.ms_overflow_pages;
+    stat->entries = mst.ms_entries;
+
+    return true;
+}
+
 void fdb_map_close(fdb_map_t *pmap)
 {
     if (pmap)
@@ -186,6 +492,27 @@ void fdb_map_close(fdb_map_t *pmap)
     }
 }
 
+bool fdb_map_drop(fdb_map_t *pmap, fdb_transaction_t *transaction)
+{
+    if (!pmap || !transaction || !pmap->pdb)
+        return false;
+
+    int rc = mdb_drop((MDB_txn*)transaction->ptransaction, (MDB_dbi)pmap->dbmap, 1);
+    if (rc != MDB_SUCCESS)
+    {
+        if (rc == MDB_MAP_FULL)
+            fdb_transaction_map_full(transaction);
+        FS_ERR("Unable to delete the LMDB database: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    fdb_release(pmap->pdb);
+    pmap->pdb = 0;
+    pmap->dbmap = 0;
+
+    return true;
+}
+
 FSTATIC_ASSERT(sizeof(fdb_data_t) == sizeof(MDB_val));
 FSTATIC_ASSERT(offsetof(fdb_data_t, size) == offsetof(MDB_val, mv_size));
 FSTATIC_ASSERT(offsetof(fdb_data_t, data) == offsetof(MDB_val, mv_data));
@@ -206,6 +533,8 @@ bool fdb_map_put(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t con
     int rc = mdb_put(txn, dbi, (MDB_val*)key, (MDB_val*)value, 0);
     if(rc != MDB_SUCCESS)
     {
+        if (rc == MDB_MAP_FULL)
+            fdb_transaction_map_full(transaction);
         FS_ERR("Unable to put data into the LMDB database: \'%s\'", mdb_strerror(rc));
         return false;
     }
@@ -240,6 +569,8 @@ bool fdb_map_put_unique(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_dat
 
     if(rc != MDB_SUCCESS)
     {
+        if (rc == MDB_MAP_FULL)
+            fdb_transaction_map_full(transaction);
         FS_ERR("Unable to put data into the LMDB database: \'%s\'", mdb_strerror(rc));
         return false;
     }
@@ -307,6 +638,8 @@ bool fdb_map_del(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t con
 
     if(rc != MDB_SUCCESS)
     {
+        if (rc == MDB_MAP_FULL)
+            fdb_transaction_map_full(transaction);
         FS_ERR("Unable to delete data from LMDB database: \'%s\'", mdb_strerror(rc));
         return false;
     }
@@ -314,6 +647,61 @@ bool fdb_map_del(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t con
     return true;
 }
 
+bool fdb_map_append(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t const *key, fdb_data_t const *value)
+{
+    if (!pmap || !key || !value || !transaction)
+        return false;
+    MDB_txn *txn = (MDB_txn*)transaction->ptransaction;
+    MDB_dbi dbi = (MDB_dbi)pmap->dbmap;
+
+    if (!txn)
+    {
+        FS_ERR("Invalid operation. The data should be inserted in transaction.");
+        return false;
+    }
+
+    unsigned int dbi_flags = 0;
+    int rc = mdb_dbi_flags(txn, dbi, &dbi_flags);
+    if (rc == MDB_SUCCESS)
+    {
+        if (dbi_flags & MDB_DUPSORT)
+        {
+            rc = mdb_put(txn, dbi, (MDB_val*)key, (MDB_val*)value, MDB_APPEND | MDB_APPENDDUP);
+            if (rc == MDB_KEYEXIST)     // The key is equal to the last one. The value is appended to the duplicates.
+                rc = mdb_put(txn, dbi, (MDB_val*)key, (MDB_val*)value, MDB_APPENDDUP);
+        }
+        else
+            rc = mdb_put(txn, dbi, (MDB_val*)key, (MDB_val*)value, MDB_APPEND);
+    }
+
+    if(rc != MDB_SUCCESS)
+    {
+        if (rc == MDB_MAP_FULL)
+            fdb_transaction_map_full(transaction);
+        FS_ERR("Unable to append data into the LMDB database: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    return true;
+}
+
+int fdb_map_cmp(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t const *key_1, fdb_data_t const *value_1, fdb_data_t const *key_2, fdb_data_t const *value_2)
+{
+    MDB_txn *txn = (MDB_txn*)transaction->ptransaction;
+    MDB_dbi dbi = (MDB_dbi)pmap->dbmap;
+
+    int ret = mdb_cmp(txn, dbi, (MDB_val const *)key_1, (MDB_val const *)key_2);
+    if (ret || !value_1 || !value_2)
+        return ret;
+
+    unsigned int dbi_flags = 0;
+    if (mdb_dbi_flags(txn, dbi, &dbi_flags) == MDB_SUCCESS
+        && (dbi_flags & MDB_DUPSORT))
+        ret = mdb_dcmp(txn, dbi, (MDB_val const *)value_1, (MDB_val const *)value_2);
+
+    return ret;
+}
+
 bool fdb_cursor_open(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_cursor_t *pcursor)
 {
     if (!transaction || !pmap || !pcursor)
@@ -362,6 +750,8 @@ bool fdb_cursor_get(fdb_cursor_t *pcursor, fdb_data_t *key, fdb_data_t *value, f
                                     op == FDB_NEXT_DUP ? MDB_NEXT_DUP :
                                     op == FDB_PREV ? MDB_PREV :
                                     op == FDB_SET ? MDB_SET :
+                                    op == FDB_SET_RANGE ? MDB_SET_RANGE :
+                                    op == FDB_GET_BOTH_RANGE ? MDB_GET_BOTH_RANGE :
                                     MDB_FIRST;
     MDB_cursor *cursor = (MDB_cursor *)pcursor->pcursor;
 
@@ -378,3 +768,59 @@ bool fdb_cursor_get(fdb_cursor_t *pcursor, fdb_data_t *key, fdb_data_t *value, f
     FS_ERR("Unable to get data by cursor: \'%s\'", mdb_strerror(rc));
     return false;
 }
+
+bool fdb_cursor_get_multiple(fdb_cursor_t *pcursor, fdb_data_t *key, fdb_data_t *values, fdb_cursor_op_t op)
+{
+    if (!pcursor || !key || !values)
+        return false;
+
+    MDB_cursor *cursor = (MDB_cursor *)pcursor->pcursor;
+    int rc;
+
+    switch(op)
+    {
+        case FDB_SET:
+        case FDB_CURRENT:
+        {
+            rc = mdb_cursor_get(cursor, (MDB_val*)key, (MDB_val*)values, op == FDB_SET ? MDB_SET : MDB_GET_CURRENT);
+            // The single data item isn't stored as duplicate. It is left in values as is.
+            if (rc == MDB_SUCCESS)
+                rc = mdb_cursor_get(cursor, (MDB_val*)key, (MDB_val*)values, MDB_GET_MULTIPLE);
+            break;
+        }
+
+        case FDB_NEXT_DUP:
+            rc = mdb_cursor_get(cursor, (MDB_val*)key, (MDB_val*)values, MDB_NEXT_MULTIPLE);
+            break;
+
+        default:
+            FS_ERR("Unsupported cursor operation");
+            return false;
+    }
+
+    switch(rc)
+    {
+        case MDB_SUCCESS:
+            return true;
+        case MDB_NOTFOUND:
+            return false;
+    }
+
+    FS_ERR("Unable to get multiple data items by cursor: \'%s\'", mdb_strerror(rc));
+    return false;
+}
+
+bool fdb_cursor_count(fdb_cursor_t *pcursor, size_t *count)
+{
+    if (!pcursor || !count)
+        return false;
+
+    int rc = mdb_cursor_count((MDB_cursor *)pcursor->pcursor, count);
+    if (rc != MDB_SUCCESS)
+    {
+        FS_ERR("Unable to count data items: \'%s\'", mdb_strerror(rc));
+        return false;
+    }
+
+    return true;
+}
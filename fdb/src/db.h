@@ -3,13 +3,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <futils/errno.h>
 
 typedef struct fdb fdb_t;
 
 typedef struct
 {
-    fdb_t *pdb;
-    void  *ptransaction;
+    fdb_t  *pdb;
+    void   *ptransaction;
+    ferr_t  error;                          // FERR_AGAIN - the map was full, the transaction was lost and should be repeated
 } fdb_transaction_t;
 
 typedef struct
@@ -37,14 +39,45 @@ typedef struct fdb_data
     void  *data;
 } fdb_data_t;
 
-fdb_t* fdb_open(char const *path, uint32_t max_dbs, uint32_t readers, uint32_t size);
+enum fdb_flags
+{
+    FDB_DURABLE                 = 0,        // Every commit is flushed to disk (data and meta pages)
+    FDB_NOMETASYNC              = 1 << 0,   // Meta page is not flushed on commit. The last transaction may be lost after crash.
+    FDB_NOSYNC                  = 1 << 1,   // Commits are not flushed. The data are flushed periodically and by fdb_sync() call.
+    FDB_WRITEMAP                = 1 << 2    // Use a writeable memory map (faster writes, no protection against stray pointers)
+};
+
+fdb_t* fdb_open(char const *path, uint32_t max_dbs, uint32_t readers, uint32_t size, uint32_t flags);
 fdb_t* fdb_retain(fdb_t *pdb);
 void fdb_release(fdb_t *pdb);
+bool fdb_sync(fdb_t *pdb);
+bool fdb_durability_set(fdb_t *pdb, uint32_t flags);      // Only FDB_NOMETASYNC and FDB_NOSYNC may be changed for opened DB
+bool fdb_copy(fdb_t *pdb, char const *path, bool compact);  // Copy DB into the directory. Free pages are omitted and the data is renumbered for compact copy.
 
+typedef struct fdb_ids_cache fdb_ids_cache_t;
+fdb_ids_cache_t **fdb_ids_caches(fdb_t *pdb);              // Caches of ids tables (see sync/ids.c). They are kept while the DB is opened.
+
+typedef struct
+{
+    size_t   map_size;                      // Size of the memory map
+    size_t   page_size;                     // Size of DB page
+    size_t   pages;                         // Number of used pages
+    size_t   free_pages;                    // Number of pages in the free list
+    size_t   last_txn;                      // Id of the last committed transaction
+    uint32_t max_readers;
+    uint32_t readers;
+} fdb_stat_t;
+
+/*
+ * The transaction can't be continued when the map is full. Such transaction isn't committed and transaction->error
+ * is FERR_AGAIN after commit or abort. The map is grown before the next transaction, so the caller repeats the work.
+ */
 bool fdb_transaction_start(fdb_t *pdb, fdb_transaction_t *ptransaction);
-void fdb_transaction_commit(fdb_transaction_t *transaction);
+bool fdb_transaction_commit(fdb_transaction_t *transaction);
 void fdb_transaction_abort(fdb_transaction_t *transaction);
 
+bool fdb_stat(fdb_transaction_t *transaction, fdb_stat_t *stat);
+
 enum fdb_map_flags
 {
     FDB_MAP_CREATE              = 1 << 0,   // Create the map if it doesn't exist
@@ -63,20 +96,46 @@ typedef enum fdb_cursor_op
     FDB_NEXT,                               // Position at next data item
     FDB_NEXT_DUP,                           // Position at next data item of current key. Only for MDB_DUPSORT
     FDB_PREV,                               // Position at previous data item
-    FDB_SET                                 // Position at specified key
+    FDB_SET,                                // Position at specified key
+    FDB_SET_RANGE,                          // Position at first key greater than or equal to specified key
+    FDB_GET_BOTH_RANGE                      // Position at key, nearest data. Only for MDB_DUPSORT
 } fdb_cursor_op_t;
 
+typedef struct
+{
+    uint32_t depth;                         // Depth of the B-tree
+    size_t   branch_pages;                  // Number of internal pages
+    size_t   leaf_pages;                    // Number of leaf pages
+    size_t   overflow_pages;                // Number of overflow pages
+    size_t   entries;                       // Number of data items
+} fdb_map_stat_t;
+
 bool fdb_map_open(fdb_transaction_t *transaction, char const *name, uint32_t flags, fdb_map_t *pmap);
+bool fdb_map_stat(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_map_stat_t *stat);
 void fdb_map_close(fdb_map_t *pmap);
+bool fdb_map_drop(fdb_map_t *pmap, fdb_transaction_t *transaction);                                                        // Delete the map with all data. The map is closed.
 bool fdb_map_put(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t const *key, fdb_data_t const *value);
 bool fdb_map_put_value(fdb_map_t *pmap, fdb_transaction_t *transaction, char const *key, void const *value, size_t size);
 bool fdb_map_put_unique(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t const *key, fdb_data_t const *value);
 bool fdb_map_get(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t const *key, fdb_data_t *value);
 bool fdb_map_get_value(fdb_map_t *pmap, fdb_transaction_t *transaction, char const *key, void *value, size_t size);
 bool fdb_map_del(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t const *key, fdb_data_t const *value);
+bool fdb_map_append(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t const *key, fdb_data_t const *value);     // Keys (and values for FDB_MAP_MULTI) should be greater than existing ones
+int  fdb_map_cmp(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_data_t const *key_1, fdb_data_t const *value_1, fdb_data_t const *key_2, fdb_data_t const *value_2);
 
 bool fdb_cursor_open(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_cursor_t *pcursor);
 void fdb_cursor_close(fdb_cursor_t *pcursor);
 bool fdb_cursor_get(fdb_cursor_t *pcursor, fdb_data_t *key, fdb_data_t *value, fdb_cursor_op_t op);
+bool fdb_cursor_count(fdb_cursor_t *pcursor, size_t *count);             // Number of duplicates for the current key
+
+/*
+ * Get up to a page of data items for the key. Only for FDB_MAP_FIXED_SIZE_VALUE maps.
+ * The values are placed contiguously, values->size is a multiple of the item size.
+ *   FDB_SET      - position at the specified key and get the first page
+ *   FDB_CURRENT  - get the page which contains the current data item
+ *   FDB_NEXT_DUP - get the next page of the current key
+ * The cursor is positioned at the last item of the returned page.
+ */
+bool fdb_cursor_get_multiple(fdb_cursor_t *pcursor, fdb_data_t *key, fdb_data_t *values, fdb_cursor_op_t op);
 
 #endif
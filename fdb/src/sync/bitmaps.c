@@ -0,0 +1,376 @@
+#include "bitmaps.h"
+#include <futils/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+enum
+{
+    FDB_BITMAP_CHUNK_IDS    = 1 << 16,                  // Number of ids in one chunk
+    FDB_BITMAP_ARRAY_MAX    = 4096,                     // Maximum number of ids in array container
+    FDB_BITMAP_WORDS        = FDB_BITMAP_CHUNK_IDS / 64 // Number of words in bitmap container
+};
+
+// Key is (status bit, chunk) in big-endian byte order. All chunks of one status bit are adjacent.
+typedef struct
+{
+    uint8_t bit;
+    uint8_t chunk[2];
+} fdb_bitmap_key_t;
+
+typedef struct
+{
+    uint32_t cardinality;
+    union
+    {
+        uint16_t array[FDB_BITMAP_ARRAY_MAX];           // cardinality <= FDB_BITMAP_ARRAY_MAX
+        uint64_t bitmap[FDB_BITMAP_WORDS];              // cardinality > FDB_BITMAP_ARRAY_MAX
+    } ids;
+} fdb_bitmap_container_t;
+
+static void fdb_bitmap_key(fdb_bitmap_key_t *key, uint32_t bit, uint32_t id)
+{
+    key->bit = (uint8_t)bit;
+    key->chunk[0] = (uint8_t)(id >> 24);
+    key->chunk[1] = (uint8_t)(id >> 16);
+}
+
+static uint32_t fdb_bitmap_key_chunk(fdb_bitmap_key_t const *key)
+{
+    return ((uint32_t)key->chunk[0] << 24) | ((uint32_t)key->chunk[1] << 16);
+}
+
+static bool fdb_bitmap_container_is_array(fdb_bitmap_container_t const *container)
+{
+    return container->cardinality <= FDB_BITMAP_ARRAY_MAX;
+}
+
+static size_t fdb_bitmap_container_size(fdb_bitmap_container_t const *container)
+{
+    return offsetof(fdb_bitmap_container_t, ids)
+            + (fdb_bitmap_container_is_array(container)
+                ? container->cardinality * sizeof container->ids.array[0]
+                : sizeof container->ids.bitmap);
+}
+
+// LMDB values aren't aligned. The container is copied.
+static bool fdb_bitmap_container_load(fdb_bitmap_container_t *container, fdb_data_t const *value)
+{
+    if (value->size < offsetof(fdb_bitmap_container_t, ids)
+        || value->size > sizeof *container)
+    {
+        FS_ERR("Invalid bitmap container");
+        return false;
+    }
+    memcpy(container, value->data, value->size);
+    if (fdb_bitmap_container_size(container) != value->size)
+    {
+        FS_ERR("Invalid bitmap container");
+        return false;
+    }
+    return true;
+}
+
+static size_t fdb_bitmap_array_lower_bound(fdb_bitmap_container_t const *container, uint16_t v)
+{
+    size_t first = 0, last = container->cardinality;
+    while (first < last)
+    {
+        size_t const mid = first + (last - first) / 2;
+        if (container->ids.array[mid] < v)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return first;
+}
+
+static bool fdb_bitmap_container_test(fdb_bitmap_container_t const *container, uint16_t v)
+{
+    if (fdb_bitmap_container_is_array(container))
+    {
+        size_t const i = fdb_bitmap_array_lower_bound(container, v);
+        return i < container->cardinality && container->ids.array[i] == v;
+    }
+    return (container->ids.bitmap[v / 64] & (1ull << (v % 64))) != 0;
+}
+
+static void fdb_bitmap_array2bitmap(fdb_bitmap_container_t *container)
+{
+    uint16_t array[FDB_BITMAP_ARRAY_MAX];
+    memcpy(array, container->ids.array, container->cardinality * sizeof array[0]);
+    memset(container->ids.bitmap, 0, sizeof container->ids.bitmap);
+    for (uint32_t i = 0; i < container->cardinality; ++i)
+        container->ids.bitmap[array[i] / 64] |= 1ull << (array[i] % 64);
+}
+
+static void fdb_bitmap_bitmap2array(fdb_bitmap_container_t *container)
+{
+    uint64_t bitmap[FDB_BITMAP_WORDS];
+    memcpy(bitmap, container->ids.bitmap, sizeof bitmap);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < FDB_BITMAP_WORDS && n < FDB_BITMAP_ARRAY_MAX; ++i)
+    {
+        for (uint64_t w = bitmap[i]; w && n < FDB_BITMAP_ARRAY_MAX; w &= w - 1)
+            container->ids.array[n++] = (uint16_t)(i * 64 + __builtin_ctzll(w));
+    }
+}
+
+// Returns false if the container wasn't changed
+static bool fdb_bitmap_container_set(fdb_bitmap_container_t *container, uint16_t v)
+{
+    if (fdb_bitmap_container_test(container, v))
+        return false;
+
+    if (fdb_bitmap_container_is_array(container))
+    {
+        if (container->cardinality < FDB_BITMAP_ARRAY_MAX)
+        {
+            size_t const i = fdb_bitmap_array_lower_bound(container, v);
+            memmove(container->ids.array + i + 1, container->ids.array + i, (container->cardinality - i) * sizeof container->ids.array[0]);
+            container->ids.array[i] = v;
+            container->cardinality++;
+            return true;
+        }
+        fdb_bitmap_array2bitmap(container);
+    }
+
+    container->ids.bitmap[v / 64] |= 1ull << (v % 64);
+    container->cardinality++;
+    return true;
+}
+
+// Returns false if the container wasn't changed
+static bool fdb_bitmap_container_clear(fdb_bitmap_container_t *container, uint16_t v)
+{
+    if (!fdb_bitmap_container_test(container, v))
+        return false;
+
+    if (fdb_bitmap_container_is_array(container))
+    {
+        size_t const i = fdb_bitmap_array_lower_bound(container, v);
+        memmove(container->ids.array + i, container->ids.array + i + 1, (container->cardinality - i - 1) * sizeof container->ids.array[0]);
+        container->cardinality--;
+        return true;
+    }
+
+    container->ids.bitmap[v / 64] &= ~(1ull << (v % 64));
+    container->cardinality--;
+    if (fdb_bitmap_container_is_array(container))
+        fdb_bitmap_bitmap2array(container);
+    return true;
+}
+
+bool fdb_bitmaps_map_open(fdb_transaction_t *transaction, char const *tbl, fdb_map_t *pmap)
+{
+    if (!transaction || !tbl || !pmap)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    if (!fdb_map_open(transaction, tbl, FDB_MAP_CREATE, pmap))
+    {
+        FS_ERR("Map wasn't created");
+        return false;
+    }
+
+    return true;
+}
+
+static bool fdb_bitmaps_map_update(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status, uint32_t id, bool set)
+{
+    if (!pmap || !transaction)
+        return false;
+
+    fdb_bitmap_container_t container;
+
+    for(uint32_t i = 0; i < sizeof status * 8; ++i)
+    {
+        if (!(status & (1u << i)))
+            continue;
+
+        fdb_bitmap_key_t bitmap_key;
+        fdb_bitmap_key(&bitmap_key, i, id);
+
+        fdb_data_t const key = { sizeof bitmap_key, &bitmap_key };
+        fdb_data_t value = { 0 };
+
+        if (fdb_map_get(pmap, transaction, &key, &value))
+        {
+            if (!fdb_bitmap_container_load(&container, &value))
+                return false;
+        }
+        else
+            container.cardinality = 0;
+
+        if (set ? !fdb_bitmap_container_set(&container, (uint16_t)id)
+                : !fdb_bitmap_container_clear(&container, (uint16_t)id))
+            continue;
+
+        if (container.cardinality)
+        {
+            value.size = fdb_bitmap_container_size(&container);
+            value.data = &container;
+            if (!fdb_map_put(pmap, transaction, &key, &value))
+                return false;
+        }
+        else if (!fdb_map_del(pmap, transaction, &key, 0))
+            return false;
+    }
+
+    return true;
+}
+
+bool fdb_bitmaps_map_set(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status, uint32_t id)
+{
+    return fdb_bitmaps_map_update(pmap, transaction, status, id, true);
+}
+
+bool fdb_bitmaps_map_clear(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status, uint32_t id)
+{
+    return fdb_bitmaps_map_update(pmap, transaction, status, id, false);
+}
+
+bool fdb_bitmaps_map_test(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status, uint32_t id)
+{
+    if (!pmap || !transaction || !status)
+        return false;
+
+    fdb_bitmap_container_t container;
+
+    for(uint32_t i = 0; i < sizeof status * 8; ++i)
+    {
+        if (!(status & (1u << i)))
+            continue;
+
+        fdb_bitmap_key_t bitmap_key;
+        fdb_bitmap_key(&bitmap_key, i, id);
+
+        fdb_data_t const key = { sizeof bitmap_key, &bitmap_key };
+        fdb_data_t value = { 0 };
+
+        if (!fdb_map_get(pmap, transaction, &key, &value)
+            || !fdb_bitmap_container_load(&container, &value)
+            || !fdb_bitmap_container_test(&container, (uint16_t)id))
+            return false;
+    }
+
+    return true;
+}
+
+struct fdb_bitmaps_map_iterator
+{
+    fdb_transaction_t      *transaction;
+    fdb_cursor_t            cursor;
+    uint32_t                bit;
+    uint32_t                chunk;      // High bits of ids in current container
+    uint32_t                pos;        // Position in current container
+    fdb_bitmap_container_t  container;
+};
+
+fdb_bitmaps_map_iterator_t *fdb_bitmaps_map_iterator(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status)
+{
+    if (!pmap || !transaction || !status)
+        return 0;
+
+    fdb_bitmaps_map_iterator_t *piterator = malloc(sizeof(fdb_bitmaps_map_iterator_t));
+    if (!piterator)
+    {
+        FS_ERR("Unable to allocate memory for iterator");
+        return 0;
+    }
+    memset(piterator, 0, sizeof *piterator);
+
+    piterator->transaction = transaction;
+    piterator->bit = __builtin_ctz(status);
+
+    if (!fdb_cursor_open(pmap, transaction, &piterator->cursor))
+    {
+        fdb_bitmaps_map_iterator_free(piterator);
+        return 0;
+    }
+
+    return piterator;
+}
+
+void fdb_bitmaps_map_iterator_free(fdb_bitmaps_map_iterator_t *piterator)
+{
+    if (piterator)
+    {
+        fdb_cursor_close(&piterator->cursor);
+        free(piterator);
+    }
+}
+
+static bool fdb_bitmaps_map_iterator_load(fdb_bitmaps_map_iterator_t *piterator, fdb_data_t const *key, fdb_data_t const *value)
+{
+    fdb_bitmap_key_t const *bitmap_key = (fdb_bitmap_key_t const *)key->data;
+    if (key->size != sizeof *bitmap_key
+        || bitmap_key->bit != piterator->bit
+        || !fdb_bitmap_container_load(&piterator->container, value))
+        return false;
+    piterator->chunk = fdb_bitmap_key_chunk(bitmap_key);
+    piterator->pos = 0;
+    return true;
+}
+
+static bool fdb_bitmaps_map_iterator_get(fdb_bitmaps_map_iterator_t *piterator, uint32_t *id)
+{
+    fdb_bitmap_container_t const *container = &piterator->container;
+
+    for(;;)
+    {
+        if (fdb_bitmap_container_is_array(container))
+        {
+            if (piterator->pos < container->cardinality)
+            {
+                *id = piterator->chunk | container->ids.array[piterator->pos++];
+                return true;
+            }
+        }
+        else
+        {
+            for (; piterator->pos < FDB_BITMAP_CHUNK_IDS; piterator->pos = (piterator->pos | 63) + 1)
+            {
+                uint64_t const w = container->ids.bitmap[piterator->pos / 64] >> (piterator->pos % 64);
+                if (w)
+                {
+                    piterator->pos += __builtin_ctzll(w);
+                    *id = piterator->chunk | piterator->pos++;
+                    return true;
+                }
+            }
+        }
+
+        fdb_data_t key = { 0 };
+        fdb_data_t value = { 0 };
+
+        if (!fdb_cursor_get(&piterator->cursor, &key, &value, FDB_NEXT)
+            || !fdb_bitmaps_map_iterator_load(piterator, &key, &value))
+            return false;
+    }
+}
+
+bool fdb_bitmaps_map_iterator_first(fdb_bitmaps_map_iterator_t *piterator, uint32_t *id)
+{
+    if (!piterator || !id)
+        return false;
+
+    fdb_bitmap_key_t bitmap_key;
+    fdb_bitmap_key(&bitmap_key, piterator->bit, 0);
+
+    fdb_data_t key = { sizeof bitmap_key, &bitmap_key };
+    fdb_data_t value = { 0 };
+
+    return fdb_cursor_get(&piterator->cursor, &key, &value, FDB_SET_RANGE)
+            && fdb_bitmaps_map_iterator_load(piterator, &key, &value)
+            && fdb_bitmaps_map_iterator_get(piterator, id);
+}
+
+bool fdb_bitmaps_map_iterator_next(fdb_bitmaps_map_iterator_t *piterator, uint32_t *id)
+{
+    if (!piterator || !id)
+        return false;
+    return fdb_bitmaps_map_iterator_get(piterator, id);
+}
@@ -0,0 +1,25 @@
+#ifndef FSYNC_BITMAPS_H_FDB
+#define FSYNC_BITMAPS_H_FDB
+#include "../db.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Compressed bitmaps of ids for each status bit.
+ * Ids are split into chunks by high 16 bits. Each chunk is stored as one value:
+ * sorted array of low 16 bits for sparse chunks or plain bitmap for dense ones.
+ */
+
+typedef struct fdb_bitmaps_map_iterator fdb_bitmaps_map_iterator_t;
+
+bool fdb_bitmaps_map_open(fdb_transaction_t *transaction, char const *tbl, fdb_map_t *pmap);
+bool fdb_bitmaps_map_set(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status, uint32_t id);
+bool fdb_bitmaps_map_clear(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status, uint32_t id);
+bool fdb_bitmaps_map_test(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status, uint32_t id);     // true if all status bits are set for id
+
+fdb_bitmaps_map_iterator_t *fdb_bitmaps_map_iterator(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t status); // status should contain one bit
+void                        fdb_bitmaps_map_iterator_free(fdb_bitmaps_map_iterator_t *);
+bool                        fdb_bitmaps_map_iterator_first(fdb_bitmaps_map_iterator_t *, uint32_t *id);
+bool                        fdb_bitmaps_map_iterator_next(fdb_bitmaps_map_iterator_t *, uint32_t *id);
+
+#endif
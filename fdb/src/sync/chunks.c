@@ -0,0 +1,74 @@
+#include "chunks.h"
+#include <futils/log.h>
+#include <string.h>
+
+static char const TBL_CHUNKS[] = "/chunks";
+
+// Location is stored as offset, size and path without the terminating zero
+typedef struct
+{
+    uint64_t offset;
+    uint32_t size;
+} fdb_chunk_location_hdr_t;
+
+bool fdb_chunks_map_open(fdb_transaction_t *transaction, fdb_map_t *pmap)
+{
+    if (!transaction || !pmap)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    if (!fdb_map_open(transaction, TBL_CHUNKS, FDB_MAP_CREATE, pmap))
+    {
+        FS_ERR("Map wasn't created");
+        return false;
+    }
+
+    return true;
+}
+
+bool fdb_chunk_get(fdb_map_t *pmap, fdb_transaction_t *transaction, fmd5_t const *digest, fdb_chunk_location_t *location)
+{
+    if (!pmap || !transaction || !digest || !location)
+        return false;
+
+    fdb_data_t const key = { sizeof digest->data, (void *)digest->data };
+    fdb_data_t value = { 0 };
+
+    if (!fdb_map_get(pmap, transaction, &key, &value))
+        return false;
+
+    size_t const path_len = value.size - sizeof(fdb_chunk_location_hdr_t);
+    if (value.size < sizeof(fdb_chunk_location_hdr_t)
+        || path_len >= sizeof location->path)
+        return false;
+
+    fdb_chunk_location_hdr_t hdr;
+    memcpy(&hdr, value.data, sizeof hdr);
+
+    location->offset = hdr.offset;
+    location->size = hdr.size;
+    memcpy(location->path, (char const *)value.data + sizeof hdr, path_len);
+    location->path[path_len] = 0;
+
+    return true;
+}
+
+bool fdb_chunk_put(fdb_map_t *pmap, fdb_transaction_t *transaction, fmd5_t const *digest, fdb_chunk_location_t const *location)
+{
+    if (!pmap || !transaction || !digest || !location)
+        return false;
+
+    size_t const path_len = strnlen(location->path, sizeof location->path);
+
+    char buf[sizeof(fdb_chunk_location_hdr_t) + sizeof location->path];
+    fdb_chunk_location_hdr_t const hdr = { location->offset, location->size };
+    memcpy(buf, &hdr, sizeof hdr);
+    memcpy(buf + sizeof hdr, location->path, path_len);
+
+    fdb_data_t const key = { sizeof digest->data, (void *)digest->data };
+    fdb_data_t const value = { sizeof hdr + path_len, buf };
+
+    return fdb_map_put(pmap, transaction, &key, &value);
+}
@@ -0,0 +1,26 @@
+#ifndef CHUNKS_H_FDB
+#define CHUNKS_H_FDB
+#include <futils/md5.h>
+#include <fcommon/limits.h>
+#include "../db.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Index of content defined chunks of local files (chunk digest -> location).
+ * Only the last location of each chunk is kept. Locations of changed files aren't removed,
+ * so the chunk data should be verified by reader.
+ */
+
+typedef struct
+{
+    char     path[FMAX_PATH];   // File path
+    uint64_t offset;            // Chunk offset in file
+    uint32_t size;              // Chunk size
+} fdb_chunk_location_t;
+
+bool fdb_chunks_map_open(fdb_transaction_t *transaction, fdb_map_t *pmap);
+bool fdb_chunk_get(fdb_map_t *pmap, fdb_transaction_t *transaction, fmd5_t const *digest, fdb_chunk_location_t *location);
+bool fdb_chunk_put(fdb_map_t *pmap, fdb_transaction_t *transaction, fmd5_t const *digest, fdb_chunk_location_t const *location);
+
+#endif
@@ -5,6 +5,7 @@ static char const *TBL_CONFIG = "sys/config";
 static char const *CFG_UUID = "uuid";
 static char const *CFG_ADDRESS = "address";
 static char const *CFG_SYNC_DIR = "dir";
+static char const *CFG_CDC_SYNC = "cdc_sync";
 
 bool fdb_load_config(fdb_t *pdb, fconfig_t *config)
 {
@@ -22,6 +23,7 @@ bool fdb_load_config(fdb_t *pdb, fconfig_t *config)
             ret = fdb_map_get_value(&map, &transaction, CFG_UUID, &config->uuid, sizeof config->uuid);
             ret &= fdb_map_get_value(&map, &transaction, CFG_ADDRESS, &config->address, sizeof config->address);
             fdb_map_get_value(&map, &transaction, CFG_SYNC_DIR, &config->sync_dir, sizeof config->sync_dir);
+            fdb_map_get_value(&map, &transaction, CFG_CDC_SYNC, &config->cdc_sync, sizeof config->cdc_sync);
             fdb_map_close(&map);
         }
         fdb_transaction_abort(&transaction);
@@ -38,18 +40,24 @@ bool fdb_save_config(fdb_t *pdb, fconfig_t const *config)
     bool ret = false;
 
     fdb_transaction_t transaction = { 0 };
-    if (fdb_transaction_start(pdb, &transaction))
+    do
     {
-        fdb_map_t map = {0};
-        if (fdb_map_open(&transaction, TBL_CONFIG, FDB_MAP_CREATE, &map))
+        if (fdb_transaction_start(pdb, &transaction))
         {
-            ret = fdb_map_put_value(&map, &transaction, CFG_UUID, &config->uuid, sizeof config->uuid);
-            ret &= fdb_map_put_value(&map, &transaction, CFG_ADDRESS, config->address, strlen(config->address));
-            ret &= fdb_map_put_value(&map, &transaction, CFG_SYNC_DIR, config->sync_dir, strlen(config->sync_dir));
-            fdb_transaction_commit(&transaction);
-            fdb_map_close(&map);
+            fdb_map_t map = {0};
+            if (fdb_map_open(&transaction, TBL_CONFIG, FDB_MAP_CREATE, &map))
+            {
+                ret = fdb_map_put_value(&map, &transaction, CFG_UUID, &config->uuid, sizeof config->uuid);
+                ret &= fdb_map_put_value(&map, &transaction, CFG_ADDRESS, config->address, strlen(config->address));
+                ret &= fdb_map_put_value(&map, &transaction, CFG_SYNC_DIR, config->sync_dir, strlen(config->sync_dir));
+                ret &= fdb_map_put_value(&map, &transaction, CFG_CDC_SYNC, &config->cdc_sync, sizeof config->cdc_sync);
+                fdb_transaction_commit(&transaction);
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
         }
     }
+    while (transaction.error == FERR_AGAIN);
 
     return ret;
 }
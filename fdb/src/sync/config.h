@@ -9,6 +9,7 @@ typedef struct
     fuuid_t uuid;
     char address[FMAX_ADDR];
     char sync_dir[FMAX_PATH];
+    bool cdc_sync;                  // Files are received with deduplication of content defined chunks
 } fconfig_t;
 
 bool fdb_load_config(fdb_t *pdb, fconfig_t *config);
@@ -267,6 +267,9 @@ static binn * fdb_dir_scan_status_marshal(fdir_scan_status_t const *info)
     {
         binn_object_set_uint32(obj, "id", info->id);
         binn_object_set_str(obj, "spos", (char*)info->path);
+        // Statuses are deleted by value, so the whole dir statuses are stored as before
+        if (info->subtree[0])
+            binn_object_set_str(obj, "sub", (char*)info->subtree);
     }
     return obj;
 }
@@ -280,6 +283,11 @@ static bool fdb_dir_scan_status_unmarshal(fdir_scan_status_t *info, void const *
         return false;
     info->id = binn_object_uint32(obj, "id");
     strncpy(info->path, binn_object_str(obj, "spos"), sizeof info->path);
+    char const *subtree = binn_object_str(obj, "sub");
+    if (subtree)
+        strncpy(info->subtree, subtree, sizeof info->subtree);
+    else
+        info->subtree[0] = 0;
     binn_free(obj);
     return true;
 }
@@ -399,3 +407,64 @@ bool fdb_dirs_scan_status_update(fdb_dirs_scan_status_t *pdirs, fdb_transaction_
     return fdb_dirs_scan_status_del(pdirs, transaction, scan_status)
            && fdb_dirs_scan_status_add(pdirs, transaction, new_scan_status);
 }
+
+struct fdb_dirs_scan_status_iterator
+{
+    fdb_dirs_scan_status_t      *pdirs;
+    fdb_statuses_map_iterator_t *statuses_iterator;
+};
+
+fdb_dirs_scan_status_iterator_t *fdb_dirs_scan_status_iterator(fdb_dirs_scan_status_t *pdirs, fdb_transaction_t *transaction)
+{
+    if (!pdirs || !transaction)
+        return 0;
+
+    fdb_dirs_scan_status_iterator_t *piterator = malloc(sizeof(fdb_dirs_scan_status_iterator_t));
+    if (!piterator)
+    {
+        FS_ERR("Unable to allocate memory for scan statuses iterator");
+        return 0;
+    }
+    memset(piterator, 0, sizeof *piterator);
+
+    piterator->pdirs = fdb_dirs_scan_status_retain(pdirs);
+    piterator->statuses_iterator = fdb_statuses_map_iterator(&pdirs->statuses, transaction, FDIR_IS_NOT_EXIST);
+
+    if (!piterator->statuses_iterator)
+    {
+        fdb_dirs_scan_status_iterator_free(piterator);
+        return 0;
+    }
+
+    return piterator;
+}
+
+void fdb_dirs_scan_status_iterator_free(fdb_dirs_scan_status_iterator_t *piterator)
+{
+    if (piterator)
+    {
+        fdb_statuses_map_iterator_free(piterator->statuses_iterator);
+        fdb_dirs_scan_status_release(piterator->pdirs);
+        free(piterator);
+    }
+}
+
+bool fdb_dirs_scan_status_iterator_first(fdb_dirs_scan_status_iterator_t *piterator, fdir_scan_status_t *scan_status)
+{
+    if (!piterator || !scan_status)
+        return false;
+
+    fdb_data_t status_data = { 0 };
+    return fdb_statuses_map_iterator_first(piterator->statuses_iterator, &status_data)
+           && fdb_dir_scan_status_unmarshal(scan_status, status_data.data);
+}
+
+bool fdb_dirs_scan_status_iterator_next(fdb_dirs_scan_status_iterator_t *piterator, fdir_scan_status_t *scan_status)
+{
+    if (!piterator || !scan_status)
+        return false;
+
+    fdb_data_t status_data = { 0 };
+    return fdb_statuses_map_iterator_next(piterator->statuses_iterator, &status_data)
+           && fdb_dir_scan_status_unmarshal(scan_status, status_data.data);
+}
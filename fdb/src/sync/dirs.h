@@ -8,6 +8,7 @@
 typedef struct fdb_dirs fdb_dirs_t;
 typedef struct fdb_dirs_scan_status fdb_dirs_scan_status_t;
 typedef struct fdb_dirs_iterator fdb_dirs_iterator_t;
+typedef struct fdb_dirs_scan_status_iterator fdb_dirs_scan_status_iterator_t;
 
 typedef struct
 {
@@ -28,7 +29,12 @@ void                 fdb_dirs_iterator_free(fdb_dirs_iterator_t *);
 bool                 fdb_dirs_iterator_first(fdb_dirs_iterator_t *, fdir_info_t *);
 bool                 fdb_dirs_iterator_next(fdb_dirs_iterator_t *, fdir_info_t *);
 
-typedef fdir_info_t fdir_scan_status_t;
+typedef struct
+{
+    uint32_t id;                    // Dir id
+    char     path[FMAX_PATH];       // Scan position. Path of the last scanned directory relative to subtree.
+    char     subtree[FMAX_PATH];    // Scanned subtree relative to the dir. Empty for the whole dir.
+} fdir_scan_status_t;
 
 fdb_dirs_scan_status_t *fdb_dirs_scan_status(fdb_transaction_t *transaction);
 fdb_dirs_scan_status_t *fdb_dirs_scan_status_retain(fdb_dirs_scan_status_t *pdirs);
@@ -38,4 +44,9 @@ bool                    fdb_dirs_scan_status_get(fdb_dirs_scan_status_t *pdirs,
 bool                    fdb_dirs_scan_status_del(fdb_dirs_scan_status_t *pdirs, fdb_transaction_t *transaction, fdir_scan_status_t const *scan_status);
 bool                    fdb_dirs_scan_status_update(fdb_dirs_scan_status_t *pdirs, fdb_transaction_t *transaction, fdir_scan_status_t const *scan_status, fdir_scan_status_t const *new_scan_status);
 
+fdb_dirs_scan_status_iterator_t *fdb_dirs_scan_status_iterator(fdb_dirs_scan_status_t *pdirs, fdb_transaction_t *transaction);
+void                             fdb_dirs_scan_status_iterator_free(fdb_dirs_scan_status_iterator_t *);
+bool                             fdb_dirs_scan_status_iterator_first(fdb_dirs_scan_status_iterator_t *, fdir_scan_status_t *);
+bool                             fdb_dirs_scan_status_iterator_next(fdb_dirs_scan_status_iterator_t *, fdir_scan_status_t *);
+
 #endif
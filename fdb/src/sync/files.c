@@ -1,15 +1,29 @@
 #include "files.h"
+#include "ids.h"
+#include "trigrams.h"
+#include "../bulk.h"
 #include <futils/log.h>
 #include <stdlib.h>
 #include <string.h>
 #include <binn.h>
 
-static char const TBL_FILE_INFO[] = "/file/info";
+static char const TBL_FILE_INFO[]     = "/file/info";
+static char const TBL_FILE_ID[]       = "/file/id";
+static char const TBL_FILE_PATH[]     = "/file/path";
+static char const TBL_FILE_TRIGRAMS[] = "/file/trigrams";
+
+enum
+{
+    FDB_FILES_BULK_MEM = 8 * 1024 * 1024   // Memory limit for bulk loader
+};
 
 struct fdb_files
 {
     volatile uint32_t   ref_counter;
     fdb_map_t           files_map;
+    fdb_map_t           ids_map;
+    fdb_map_t           paths_map;
+    fdb_map_t           trigrams_map;
 };
 
 static char const *fdb_tbl_name(fuuid_t const *uuid, char *buf, size_t size, char const *tbl)
@@ -26,11 +40,13 @@ static char const *fdb_tbl_name(fuuid_t const *uuid, char *buf, size_t size, cha
 }
 
 static char STR_SIZE[] = "s";
+static char STR_ID[] = "i";
 
-static binn * fdb_file_info_marshal(ffile_info_t const *info)
+static binn * fdb_file_info_marshal(ffile_info_t const *info, uint32_t id)
 {
     binn *obj = binn_object();
-    if (!binn_object_set_uint64(obj, STR_SIZE, info->size))
+    if (!binn_object_set_uint64(obj, STR_SIZE, info->size)
+        || !binn_object_set_uint32(obj, STR_ID, id))
     {
         binn_free(obj);
         obj = 0;
@@ -38,19 +54,21 @@ static binn * fdb_file_info_marshal(ffile_info_t const *info)
     return obj;
 }
 
-/* unused
-static bool fdb_file_info_unmarshal(ffile_info_t *info, void const *data)
+// Files were stored without ids by previous versions. Such files aren't indexed.
+static bool fdb_file_info_unmarshal(ffile_info_t *info, uint32_t *id, void const *data)
 {
-    if (!info || !data)
+    if (!info || !id || !data)
         return false;
     binn *obj = binn_open((void *)data);
     if (!obj)
         return false;
     info->size = binn_object_uint64(obj, STR_SIZE);
+    uint32_t file_id = FINVALID_ID;
+    bool ret = binn_object_get_uint32(obj, STR_ID, &file_id);
+    *id = file_id;
     binn_free(obj);
-    return true;
+    return ret;
 }
-*/
 
 fdb_files_t *fdb_files(fdb_transaction_t *transaction, fuuid_t const *uuid)
 {
@@ -83,6 +101,42 @@ fdb_files_t *fdb_files(fdb_transaction_t *transaction, fuuid_t const *uuid)
         return 0;
     }
 
+    // ids
+    char ids_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_FILE_ID] = { 0 };
+    fdb_tbl_name(uuid, ids_tbl_name, sizeof ids_tbl_name, TBL_FILE_ID);
+
+    if (!fdb_ids_map_open(transaction, ids_tbl_name, &files->ids_map))
+    {
+        FS_ERR("Map wasn't created");
+        fdb_transaction_abort(transaction);
+        fdb_files_release(files);
+        return 0;
+    }
+
+    // id->path
+    char paths_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_FILE_PATH] = { 0 };
+    fdb_tbl_name(uuid, paths_tbl_name, sizeof paths_tbl_name, TBL_FILE_PATH);
+
+    if (!fdb_map_open(transaction, paths_tbl_name, FDB_MAP_CREATE | FDB_MAP_INTEGERKEY, &files->paths_map))
+    {
+        FS_ERR("Map wasn't created");
+        fdb_transaction_abort(transaction);
+        fdb_files_release(files);
+        return 0;
+    }
+
+    // trigram->ids
+    char trigrams_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_FILE_TRIGRAMS] = { 0 };
+    fdb_tbl_name(uuid, trigrams_tbl_name, sizeof trigrams_tbl_name, TBL_FILE_TRIGRAMS);
+
+    if (!fdb_trigrams_map_open(transaction, trigrams_tbl_name, &files->trigrams_map))
+    {
+        FS_ERR("Map wasn't created");
+        fdb_transaction_abort(transaction);
+        fdb_files_release(files);
+        return 0;
+    }
+
     return files;
 }
 
@@ -104,6 +158,9 @@ void fdb_files_release(fdb_files_t *files)
         else if (!--files->ref_counter)
         {
             fdb_map_close(&files->files_map);
+            fdb_map_close(&files->ids_map);
+            fdb_map_close(&files->paths_map);
+            fdb_map_close(&files->trigrams_map);
             free(files);
         }
     }
@@ -111,15 +168,41 @@ void fdb_files_release(fdb_files_t *files)
         FS_ERR("Invalid files map");
 }
 
+// Returns true if the file is new and should be indexed
+static bool fdb_files_id(fdb_files_t *files, fdb_transaction_t *transaction, fdb_data_t const *file_path, uint32_t *id)
+{
+    fdb_data_t file_info = { 0 };
+    ffile_info_t info;
+
+    if (fdb_map_get(&files->files_map, transaction, file_path, &file_info)
+        && fdb_file_info_unmarshal(&info, id, file_info.data))
+        return false;
+
+    return fdb_id_generate(&files->ids_map, transaction, id);
+}
+
 bool fdb_files_add(fdb_files_t *files, fdb_transaction_t *transaction, ffile_info_t const *info)
 {
     if (!files || !transaction || !info)
         return false;
 
-    binn *obj = fdb_file_info_marshal(info);
+    fdb_data_t const file_path = { strlen(info->path), (char*)info->path };
+    uint32_t id = FINVALID_ID;
+
+    if (fdb_files_id(files, transaction, &file_path, &id))
+    {
+        fdb_data_t const file_id = { sizeof id, &id };
+        if (!fdb_map_put(&files->paths_map, transaction, &file_id, &file_path)
+            || !fdb_trigrams_map_add(&files->trigrams_map, transaction, id, file_path.data, file_path.size))
+            return false;
+    }
+
+    if (id == FINVALID_ID)
+        return false;
+
+    binn *obj = fdb_file_info_marshal(info, id);
     if (obj)
     {
-        fdb_data_t const file_path = { strlen(info->path), (char*)info->path };
         fdb_data_t const file_info = { binn_size(obj), binn_ptr(obj) };
         bool ret = fdb_map_put(&files->files_map, transaction, &file_path, &file_info);
         binn_free(obj);
@@ -129,32 +212,271 @@ bool fdb_files_add(fdb_files_t *files, fdb_transaction_t *transaction, ffile_inf
     return false;
 }
 
-bool fdb_files_find(fdb_files_t *files, fdb_transaction_t *transaction, char const *file)
+typedef struct
+{
+    fdb_bulk_loader_t *files;
+    fdb_bulk_loader_t *paths;
+    fdb_bulk_loader_t *trigrams;
+} fdb_files_loaders_t;
+
+static bool fdb_files_bulk_add(fdb_files_t *files, fdb_transaction_t *transaction, fdb_files_loaders_t *loaders, ffile_info_t const *info)
 {
-    if (!files || !file)
+    fdb_data_t const file_path = { strlen(info->path), (char*)info->path };
+    uint32_t id = FINVALID_ID;
+
+    if (fdb_files_id(files, transaction, &file_path, &id))
     {
-        FS_ERR("Invalid argument");
-        return false;
+        fdb_data_t const file_id = { sizeof id, &id };
+        if (!fdb_bulk_loader_add(loaders->paths, &file_id, &file_path))
+            return false;
+
+        fdb_trigram_t trigrams[FMAX_PATH];
+        size_t const trigrams_num = fdb_trigrams_split(file_path.data, file_path.size, trigrams, sizeof trigrams / sizeof *trigrams);
+        for (size_t i = 0; i < trigrams_num; ++i)
+        {
+            fdb_data_t const trigram = { sizeof trigrams[i].data, trigrams[i].data };
+            if (!fdb_bulk_loader_add(loaders->trigrams, &trigram, &file_id))
+                return false;
+        }
     }
 
+    if (id == FINVALID_ID)
+        return false;
+
     bool ret = false;
 
-    fdb_cursor_t cursor = { 0 };
-    if (fdb_cursor_open(&files->files_map, transaction, &cursor))
+    binn *obj = fdb_file_info_marshal(info, id);
+    if (obj)
+    {
+        fdb_data_t const file_info = { binn_size(obj), binn_ptr(obj) };
+        ret = fdb_bulk_loader_add(loaders->files, &file_path, &file_info);
+        binn_free(obj);
+    }
+
+    return ret;
+}
+
+bool fdb_files_add_all(fdb_files_t *files, fdb_transaction_t *transaction, ffile_info_t const *infos, size_t num)
+{
+    if (!files || !transaction || (!infos && num))
+        return false;
+
+    fdb_files_loaders_t loaders =
+    {
+        fdb_bulk_loader(&files->files_map, transaction, FDB_FILES_BULK_MEM),
+        fdb_bulk_loader(&files->paths_map, transaction, FDB_FILES_BULK_MEM),
+        fdb_bulk_loader(&files->trigrams_map, transaction, FDB_FILES_BULK_MEM)
+    };
+
+    bool ret = loaders.files && loaders.paths && loaders.trigrams;
+
+    for (size_t i = 0; ret && i < num; ++i)
+        ret = fdb_files_bulk_add(files, transaction, &loaders, infos + i);
+
+    ret = ret
+          && fdb_bulk_loader_flush(loaders.files)
+          && fdb_bulk_loader_flush(loaders.paths)
+          && fdb_bulk_loader_flush(loaders.trigrams);
+
+    fdb_bulk_loader_free(loaders.files);
+    fdb_bulk_loader_free(loaders.paths);
+    fdb_bulk_loader_free(loaders.trigrams);
+
+    return ret;
+}
+
+// '*' matches any sequence of characters, '?' matches any character
+static bool fdb_files_glob_match(char const *pattern, char const *str, size_t len)
+{
+    char const *star = 0;
+    size_t star_pos = 0;
+    size_t pos = 0;
+
+    while (pos < len)
+    {
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            star_pos = pos;
+        }
+        else if (*pattern && (*pattern == '?' || *pattern == str[pos]))
+        {
+            ++pattern;
+            ++pos;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            pos = ++star_pos;
+        }
+        else
+            return false;
+    }
+
+    while (*pattern == '*')
+        ++pattern;
+
+    return !*pattern;
+}
+
+static bool fdb_files_substr_match(char const *pattern, size_t pattern_len, char const *str, size_t len)
+{
+    for (size_t i = 0; i + pattern_len <= len; ++i)
+    {
+        if (memcmp(str + i, pattern, pattern_len) == 0)
+            return true;
+    }
+    return false;
+}
+
+struct fdb_files_iterator
+{
+    fdb_files_t                 *files;
+    fdb_transaction_t           *transaction;
+    char                         pattern[FMAX_PATH];
+    size_t                       pattern_len;
+    bool                         is_glob;
+    fdb_trigrams_map_iterator_t *trigrams_iterator;    // Candidates from the trigrams index
+    fdb_cursor_t                 cursor;               // Full scan for short patterns
+};
+
+fdb_files_iterator_t *fdb_files_find_iterator(fdb_files_t *files, fdb_transaction_t *transaction, char const *pattern)
+{
+    if (!files || !transaction || !pattern)
+    {
+        FS_ERR("Invalid argument");
+        return 0;
+    }
+
+    size_t const pattern_len = strlen(pattern);
+    if (pattern_len >= FMAX_PATH)
+    {
+        FS_ERR("Pattern is too long");
+        return 0;
+    }
+
+    fdb_files_iterator_t *piterator = malloc(sizeof(fdb_files_iterator_t));
+    if (!piterator)
+    {
+        FS_ERR("Unable to allocate memory for iterator");
+        return 0;
+    }
+    memset(piterator, 0, sizeof *piterator);
+
+    piterator->files = fdb_files_retain(files);
+    piterator->transaction = transaction;
+    memcpy(piterator->pattern, pattern, pattern_len + 1);
+    piterator->pattern_len = pattern_len;
+    piterator->is_glob = strpbrk(pattern, "*?") != 0;
+
+    // Trigrams of literal parts of pattern
+    fdb_trigram_t trigrams[FMAX_PATH];
+    size_t trigrams_num = 0;
+
+    for (char const *literal = pattern; *literal;)
+    {
+        size_t const literal_len = strcspn(literal, "*?");
+        trigrams_num += fdb_trigrams_split(literal, literal_len, trigrams + trigrams_num, sizeof trigrams / sizeof *trigrams - trigrams_num);
+        literal += literal_len;
+        if (*literal)
+            ++literal;
+    }
+
+    bool ret = trigrams_num
+                ? (piterator->trigrams_iterator = fdb_trigrams_map_iterator(&files->trigrams_map, transaction, trigrams, trigrams_num)) != 0
+                : fdb_cursor_open(&files->files_map, transaction, &piterator->cursor);
+
+    if (!ret)
     {
-        fdb_data_t file_path = { 0 };
-        fdb_data_t file_info = { 0 };
-        for(bool st = fdb_cursor_get(&cursor, &file_path, &file_info, FDB_FIRST);
-            st;
-            st = fdb_cursor_get(&cursor, &file_path, &file_info, FDB_NEXT))
+        fdb_files_iterator_free(piterator);
+        return 0;
+    }
+
+    return piterator;
+}
+
+void fdb_files_iterator_free(fdb_files_iterator_t *piterator)
+{
+    if (piterator)
+    {
+        fdb_trigrams_map_iterator_free(piterator->trigrams_iterator);
+        fdb_cursor_close(&piterator->cursor);
+        fdb_files_release(piterator->files);
+        free(piterator);
+    }
+}
+
+static bool fdb_files_iterator_match(fdb_files_iterator_t *piterator, fdb_data_t const *file_path)
+{
+    if (!piterator->is_glob)
+        return fdb_files_substr_match(piterator->pattern, piterator->pattern_len, file_path->data, file_path->size);
+    return fdb_files_glob_match(piterator->pattern, file_path->data, file_path->size);
+}
+
+static bool fdb_files_iterator_get(fdb_files_iterator_t *piterator, ffile_info_t *info, bool first)
+{
+    fdb_data_t file_path = { 0 };
+    fdb_data_t file_info = { 0 };
+
+    if (piterator->trigrams_iterator)
+    {
+        uint32_t id = FINVALID_ID;
+
+        for (bool st = first ? fdb_trigrams_map_iterator_first(piterator->trigrams_iterator, &id)
+                             : fdb_trigrams_map_iterator_next(piterator->trigrams_iterator, &id);
+             st;
+             st = fdb_trigrams_map_iterator_next(piterator->trigrams_iterator, &id))
+        {
+            fdb_data_t const file_id = { sizeof id, &id };
+            if (fdb_map_get(&piterator->files->paths_map, piterator->transaction, &file_id, &file_path)
+                && fdb_files_iterator_match(piterator, &file_path)
+                && fdb_map_get(&piterator->files->files_map, piterator->transaction, &file_path, &file_info))
+                break;
+            file_path.size = 0;
+        }
+    }
+    else
+    {
+        for (bool st = fdb_cursor_get(&piterator->cursor, &file_path, &file_info, first ? FDB_FIRST : FDB_NEXT);
+             st;
+             st = fdb_cursor_get(&piterator->cursor, &file_path, &file_info, FDB_NEXT))
         {
-            char path[2 * FMAX_PATH] = { 0 };
-            strncpy(path, file_path.data, file_path.size);
-            ret = strstr(path, file) != 0;
-            if (ret) break;
+            if (fdb_files_iterator_match(piterator, &file_path))
+                break;
+            file_path.size = 0;
         }
-        fdb_cursor_close(&cursor);
     }
 
+    if (!file_path.size || file_path.size >= sizeof info->path)
+        return false;
+
+    uint32_t id;
+    fdb_file_info_unmarshal(info, &id, file_info.data);
+    memcpy(info->path, file_path.data, file_path.size);
+    info->path[file_path.size] = 0;
+
+    return true;
+}
+
+bool fdb_files_iterator_first(fdb_files_iterator_t *piterator, ffile_info_t *info)
+{
+    if (!piterator || !info)
+        return false;
+    return fdb_files_iterator_get(piterator, info, true);
+}
+
+bool fdb_files_iterator_next(fdb_files_iterator_t *piterator, ffile_info_t *info)
+{
+    if (!piterator || !info)
+        return false;
+    return fdb_files_iterator_get(piterator, info, false);
+}
+
+bool fdb_files_find(fdb_files_t *files, fdb_transaction_t *transaction, char const *file)
+{
+    ffile_info_t info;
+    fdb_files_iterator_t *it = fdb_files_find_iterator(files, transaction, file);
+    bool ret = fdb_files_iterator_first(it, &info);
+    fdb_files_iterator_free(it);
     return ret;
 }
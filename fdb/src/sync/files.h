@@ -6,6 +6,7 @@
 #include <stdbool.h>
 
 typedef struct fdb_files fdb_files_t;
+typedef struct fdb_files_iterator fdb_files_iterator_t;
 
 typedef struct
 {
@@ -17,6 +18,16 @@ fdb_files_t *fdb_files(fdb_transaction_t *transaction, fuuid_t const *uuid);
 fdb_files_t *fdb_files_retain(fdb_files_t *files);
 void         fdb_files_release(fdb_files_t *files);
 bool         fdb_files_add(fdb_files_t *files, fdb_transaction_t *transaction, ffile_info_t const *info);
+bool         fdb_files_add_all(fdb_files_t *files, fdb_transaction_t *transaction, ffile_info_t const *infos, size_t num);   // Sorted insertion of many files
 bool         fdb_files_find(fdb_files_t *files, fdb_transaction_t *transaction, char const *file);
 
+/*
+ * Files search by substring or glob pattern ('*', '?'). Glob pattern should match the whole path.
+ * Candidates are taken from the trigrams index and verified. Patterns without trigrams require full scan.
+ */
+fdb_files_iterator_t *fdb_files_find_iterator(fdb_files_t *files, fdb_transaction_t *transaction, char const *pattern);
+void                  fdb_files_iterator_free(fdb_files_iterator_t *);
+bool                  fdb_files_iterator_first(fdb_files_iterator_t *, ffile_info_t *);
+bool                  fdb_files_iterator_next(fdb_files_iterator_t *, ffile_info_t *);
+
 #endif
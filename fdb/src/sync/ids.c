@@ -5,6 +5,60 @@
 
 static char FLD_USED[4] = "used";
 static char FLD_FREE[4] = "free";
+static char FLD_NEXT[4] = "next";
+
+enum
+{
+    FDB_IDS_BLOCK_SIZE      = 4096,     // Number of ids reserved at once
+    FDB_IDS_TBL_NAME_MAX    = 64
+};
+
+/*
+ * Ids are reserved by blocks and handed out from memory.
+ *   next - the first id which wasn't reserved yet
+ *   free - released ids. These ids are recycled by blocks too.
+ * Each ids table has a cache in the DB handler. Transactions of DB are serialized, so the caches are used without locks.
+ * The reservation of aborted transaction is discarded. Unused ids are returned to DB when the DB handler is released.
+ */
+struct fdb_ids_cache
+{
+    fdb_ids_cache_t *next_cache;
+    unsigned int     dbmap;
+    char             tbl[FDB_IDS_TBL_NAME_MAX];
+    bool             is_reserved;                   // Ids were reserved by the current transaction
+    uint32_t         next;                          // Next id in reserved range
+    uint32_t         end;                           // End of reserved range
+    uint32_t         free_num;                      // Number of recycled ids
+    uint32_t         free_ids[FDB_IDS_BLOCK_SIZE];  // Recycled ids
+};
+
+static fdb_ids_cache_t *fdb_ids_cache(fdb_map_t const *pmap, char const *tbl)
+{
+    fdb_ids_cache_t **caches = fdb_ids_caches(pmap->pdb);
+
+    for (fdb_ids_cache_t *cache = *caches; cache; cache = cache->next_cache)
+    {
+        if (tbl ? strncmp(cache->tbl, tbl, sizeof cache->tbl) == 0 : cache->dbmap == pmap->dbmap)
+            return cache;
+    }
+
+    if (!tbl)
+        return 0;
+
+    fdb_ids_cache_t *cache = malloc(sizeof(fdb_ids_cache_t));
+    if (!cache)
+    {
+        FS_ERR("Unable to allocate memory for ids cache");
+        return 0;
+    }
+    memset(cache, 0, sizeof *cache);
+
+    strncpy(cache->tbl, tbl, sizeof cache->tbl - 1);
+    cache->next_cache = *caches;
+    *caches = cache;
+
+    return cache;
+}
 
 bool fdb_ids_map_open(fdb_transaction_t *transaction, char const *tbl, fdb_map_t *pmap)
 {
@@ -14,55 +68,172 @@ bool fdb_ids_map_open(fdb_transaction_t *transaction, char const *tbl, fdb_map_t
         return false;
     }
 
+    if (strlen(tbl) >= FDB_IDS_TBL_NAME_MAX)
+    {
+        FS_ERR("Table name is too long");
+        return false;
+    }
+
     if (!fdb_map_open(transaction, tbl, FDB_MAP_CREATE | FDB_MAP_MULTI | FDB_MAP_FIXED_SIZE_VALUE | FDB_MAP_INTEGERVAL, pmap))
     {
         FS_ERR("Map wasn't created");
         return false;
     }
 
+    // The map handle may be changed after reopening
+    fdb_ids_cache_t *cache = fdb_ids_cache(pmap, tbl);
+    if (!cache)
+    {
+        fdb_map_close(pmap);
+        return false;
+    }
+    cache->dbmap = pmap->dbmap;
+
     return true;
 }
 
-bool fdb_id_generate(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t *id)
+static bool fdb_ids_value_get(fdb_map_t *pmap, fdb_transaction_t *transaction, char *fld, size_t size, uint32_t *value)
 {
-    if (!pmap || !transaction || !id)
+    fdb_data_t const key = { size, fld };
+    fdb_data_t data = { 0 };
+    if (!fdb_map_get(pmap, transaction, &key, &data))
+        return false;
+    *value = *(uint32_t*)data.data;
+    return true;
+}
+
+static bool fdb_ids_value_set(fdb_map_t *pmap, fdb_transaction_t *transaction, char *fld, size_t size, uint32_t value)
+{
+    fdb_data_t const key = { size, fld };
+    fdb_data_t const data = { sizeof value, &value };
+    fdb_map_del(pmap, transaction, &key, 0);
+    return fdb_map_put(pmap, transaction, &key, &data);
+}
+
+// Ids were generated one by one and stored in 'used' list by previous versions
+static uint32_t fdb_ids_legacy_next(fdb_map_t *pmap, fdb_transaction_t *transaction)
+{
+    uint32_t last_id = FINVALID_ID;
+
+    fdb_cursor_t cursor = { 0 };
+    if (fdb_cursor_open(pmap, transaction, &cursor))
+    {
+        fdb_data_t key = { sizeof FLD_USED, FLD_USED };
+        fdb_data_t value = { 0 };
+        if (fdb_cursor_get(&cursor, &key, &value, FDB_SET))
+        {
+            if (fdb_cursor_get(&cursor, &key, &value, FDB_LAST_DUP))
+                last_id = *(uint32_t*)value.data;
+        }
+        fdb_cursor_close(&cursor);
+    }
+
+    return last_id == FINVALID_ID ? 0 : last_id + 1;
+}
+
+static bool fdb_ids_recycle(fdb_ids_cache_t *cache, fdb_map_t *pmap, fdb_transaction_t *transaction)
+{
+    fdb_cursor_t cursor = { 0 };
+    if (!fdb_cursor_open(pmap, transaction, &cursor))
         return false;
 
-    fdb_data_t const used_key = { sizeof FLD_USED, FLD_USED };
+    fdb_data_t key = { sizeof FLD_FREE, FLD_FREE };
+    fdb_data_t values = { 0 };
+    bool is_last = true;
+
+    // Free ids are read by pages
+    for (bool st = fdb_cursor_get_multiple(&cursor, &key, &values, FDB_SET); st; st = fdb_cursor_get_multiple(&cursor, &key, &values, FDB_NEXT_DUP))
+    {
+        size_t const num = values.size / sizeof(uint32_t);
+        size_t const n = num < FDB_IDS_BLOCK_SIZE - cache->free_num ? num : FDB_IDS_BLOCK_SIZE - cache->free_num;
+
+        memcpy(cache->free_ids + cache->free_num, values.data, n * sizeof(uint32_t));
+        cache->free_num += n;
+
+        if (n < num)
+        {
+            is_last = false;
+            break;
+        }
+    }
+
+    fdb_cursor_close(&cursor);
+
+    if (!cache->free_num)
+        return true;
+
     fdb_data_t const free_key = { sizeof FLD_FREE, FLD_FREE };
-    fdb_data_t value = { 0 };
 
-    if (fdb_map_get(pmap, transaction, &free_key, &value))
+    // All free ids are taken at once
+    if (is_last)
+        return fdb_map_del(pmap, transaction, &free_key, 0);
+
+    for (uint32_t i = 0; i < cache->free_num; ++i)
     {
-        *id = *(uint32_t*)value.data;
-        if (fdb_map_del(pmap, transaction, &free_key, &value))
-            return fdb_map_put(pmap, transaction, &used_key, &value);
+        fdb_data_t const id = { sizeof cache->free_ids[i], cache->free_ids + i };
+        if (!fdb_map_del(pmap, transaction, &free_key, &id))
+            return false;
     }
-    else
+
+    return true;
+}
+
+static bool fdb_ids_reserve(fdb_ids_cache_t *cache, fdb_map_t *pmap, fdb_transaction_t *transaction)
+{
+    cache->next = cache->end = 0;
+    cache->free_num = 0;
+
+    if (!fdb_ids_recycle(cache, pmap, transaction))
+    {
+        cache->free_num = 0;
+        return false;
+    }
+
+    if (!cache->free_num)
     {
-        uint32_t last_id = FINVALID_ID;
+        uint32_t next = 0;
+        if (!fdb_ids_value_get(pmap, transaction, FLD_NEXT, sizeof FLD_NEXT, &next))
+            next = fdb_ids_legacy_next(pmap, transaction);
 
-        fdb_cursor_t cursor = { 0 };
-        if (fdb_cursor_open(pmap, transaction, &cursor))
+        uint32_t const end = next < FINVALID_ID - FDB_IDS_BLOCK_SIZE ? next + FDB_IDS_BLOCK_SIZE : FINVALID_ID;
+        if (next == end)
         {
-            fdb_data_t key = { sizeof FLD_USED, FLD_USED };
-            if (fdb_cursor_get(&cursor, &key, &value, FDB_SET))
-            {
-                if (fdb_cursor_get(&cursor, &key, &value, FDB_LAST_DUP))
-                    last_id = *(uint32_t*)value.data;
-            }
-            fdb_cursor_close(&cursor);
+            FS_ERR("No free ids");
+            return false;
         }
 
-        *id = last_id == FINVALID_ID ? 0 : ++last_id;
+        if (!fdb_ids_value_set(pmap, transaction, FLD_NEXT, sizeof FLD_NEXT, end))
+            return false;
+
+        cache->next = next;
+        cache->end = end;
+    }
+
+    cache->is_reserved = true;
+
+    return true;
+}
 
-        value.data = id;
-        value.size = sizeof(*id);
+bool fdb_id_generate(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t *id)
+{
+    if (!pmap || !transaction || !id)
+        return false;
 
-        return fdb_map_put(pmap, transaction, &used_key, &value);
+    fdb_ids_cache_t *cache = fdb_ids_cache(pmap, 0);
+    if (!cache)
+    {
+        FS_ERR("Ids map wasn't opened by fdb_ids_map_open");
+        return false;
     }
 
-    return false;
+    if (!cache->free_num
+        && cache->next >= cache->end
+        && !fdb_ids_reserve(cache, pmap, transaction))
+        return false;
+
+    *id = cache->free_num ? cache->free_ids[--cache->free_num] : cache->next++;
+
+    return true;
 }
 
 bool fdb_id_free(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t id)
@@ -70,11 +241,74 @@ bool fdb_id_free(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t id)
     if (!pmap || !transaction)
         return false;
 
-    fdb_data_t const used_key = { sizeof FLD_USED, FLD_USED };
     fdb_data_t const free_key = { sizeof FLD_FREE, FLD_FREE };
     fdb_data_t value = { sizeof id, &id };
 
-    if (fdb_map_del(pmap, transaction, &used_key, &value))
-        return fdb_map_put(pmap, transaction, &free_key, &value);
-    return false;
+    return fdb_map_put(pmap, transaction, &free_key, &value);
+}
+
+void fdb_ids_caches_end(fdb_t *pdb, bool is_committed)
+{
+    for (fdb_ids_cache_t *cache = *fdb_ids_caches(pdb); cache; cache = cache->next_cache)
+    {
+        if (cache->is_reserved && !is_committed)
+            cache->next = cache->end = cache->free_num = 0;
+        cache->is_reserved = false;
+    }
+}
+
+// Recycled ids are put back to the free list. The rest of reserved range is given back if nothing was reserved after it.
+static bool fdb_ids_return(fdb_ids_cache_t *cache, fdb_map_t *pmap, fdb_transaction_t *transaction)
+{
+    fdb_data_t const free_key = { sizeof FLD_FREE, FLD_FREE };
+
+    for (uint32_t i = 0; i < cache->free_num; ++i)
+    {
+        fdb_data_t const id = { sizeof cache->free_ids[i], cache->free_ids + i };
+        if (!fdb_map_put(pmap, transaction, &free_key, &id))
+            return false;
+    }
+
+    uint32_t next = 0;
+    if (cache->next < cache->end
+        && fdb_ids_value_get(pmap, transaction, FLD_NEXT, sizeof FLD_NEXT, &next)
+        && next == cache->end)
+        return fdb_ids_value_set(pmap, transaction, FLD_NEXT, sizeof FLD_NEXT, cache->next);
+
+    return true;
+}
+
+void fdb_ids_caches_free(fdb_t *pdb)
+{
+    fdb_ids_cache_t **caches = fdb_ids_caches(pdb);
+    fdb_ids_cache_t *list = *caches;
+    *caches = 0;
+
+    if (!list)
+        return;
+
+    fdb_transaction_t transaction = { 0 };
+    do
+    {
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            bool ret = true;
+            for (fdb_ids_cache_t *cache = list; cache && ret; cache = cache->next_cache)
+            {
+                fdb_map_t map = { pdb, cache->dbmap };
+                ret = fdb_ids_return(cache, &map, &transaction);
+            }
+            if (!ret || !fdb_transaction_commit(&transaction))
+                FS_ERR("Unused ids weren't returned");
+            fdb_transaction_abort(&transaction);
+        }
+    }
+    while (transaction.error == FERR_AGAIN);
+
+    while (list)
+    {
+        fdb_ids_cache_t *cache = list;
+        list = list->next_cache;
+        free(cache);
+    }
 }
@@ -10,4 +10,8 @@ bool fdb_ids_map_open(fdb_transaction_t *transaction, char const *tbl, fdb_map_t
 bool fdb_id_generate(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t *id);
 bool fdb_id_free(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t id);
 
+// Called by the DB handler
+void fdb_ids_caches_end(fdb_t *pdb, bool is_committed);     // The transaction is finished. Ids reserved by aborted transaction are discarded.
+void fdb_ids_caches_free(fdb_t *pdb);                       // Unused ids are returned to DB
+
 #endif
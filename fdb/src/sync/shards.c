@@ -0,0 +1,174 @@
+#include "shards.h"
+#include <futils/log.h>
+#include <futils/mutex.h>
+#include <fcommon/limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+enum
+{
+    FDB_SHARD_MAX_DBS       = 16,                   // sync/file and sync/dir tables of one or a few nodes
+    FDB_SHARD_MAX_READERS   = 1,
+    FDB_SHARD_MAP_SIZE      = 16 * 1024 * 1024,     // Initial map size. The map is grown automatically.
+    FDB_SHARD_NAME_MAX      = 2 * sizeof(fuuid_t) + 1
+};
+
+typedef struct fdb_shard fdb_shard_t;
+
+struct fdb_shard
+{
+    fdb_shard_t *next;
+    char         name[FDB_SHARD_NAME_MAX];
+    fdb_t       *pdb;
+};
+
+struct fdb_shards
+{
+    volatile uint32_t   ref_counter;
+    fdb_t              *pdb;                        // Main DB
+    char                path[FMAX_PATH];
+    uint32_t            buckets_num;
+    uint32_t            flags;
+    pthread_mutex_t     mutex;
+    fdb_shard_t        *shards;                     // Opened shards
+};
+
+fdb_shards_t *fdb_shards(fdb_t *pdb, char const *path, uint32_t buckets_num, uint32_t flags)
+{
+    if (!pdb || !path)
+    {
+        FS_ERR("Invalid arguments");
+        return 0;
+    }
+
+    if (strlen(path) + FDB_SHARD_NAME_MAX + 1 >= FMAX_PATH)
+    {
+        FS_ERR("DB path is too long");
+        return 0;
+    }
+
+    fdb_shards_t *shards = malloc(sizeof(fdb_shards_t));
+    if (!shards)
+    {
+        FS_ERR("No free space of memory");
+        return 0;
+    }
+
+    memset(shards, 0, sizeof *shards);
+
+    static pthread_mutex_t const mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
+
+    shards->ref_counter = 1;
+    shards->pdb = fdb_retain(pdb);
+    strncpy(shards->path, path, sizeof shards->path - 1);
+    shards->buckets_num = buckets_num;
+    shards->flags = flags;
+    shards->mutex = mutex_initializer;
+
+    return shards;
+}
+
+fdb_shards_t *fdb_shards_retain(fdb_shards_t *shards)
+{
+    if (shards)
+        shards->ref_counter++;
+    else
+        FS_ERR("Invalid DB shards");
+    return shards;
+}
+
+void fdb_shards_release(fdb_shards_t *shards)
+{
+    if (shards)
+    {
+        if (!shards->ref_counter)
+            FS_ERR("Invalid DB shards");
+        else if (!--shards->ref_counter)
+        {
+            for (fdb_shard_t *shard = shards->shards; shard;)
+            {
+                fdb_shard_t *next = shard->next;
+                fdb_release(shard->pdb);
+                free(shard);
+                shard = next;
+            }
+            fdb_release(shards->pdb);
+            pthread_mutex_destroy(&shards->mutex);
+            free(shards);
+        }
+    }
+    else
+        FS_ERR("Invalid DB shards");
+}
+
+// FNV-1a hash of uuid
+static uint32_t fdb_shard_bucket(fuuid_t const *uuid, uint32_t buckets_num)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof uuid->data.u8; ++i)
+        hash = (hash ^ uuid->data.u8[i]) * 16777619u;
+    return hash % buckets_num;
+}
+
+static fdb_t *fdb_shard_open(fdb_shards_t *shards, char const *name)
+{
+    for (fdb_shard_t *shard = shards->shards; shard; shard = shard->next)
+    {
+        if (strcmp(shard->name, name) == 0)
+            return fdb_retain(shard->pdb);
+    }
+
+    fdb_shard_t *shard = malloc(sizeof(fdb_shard_t));
+    if (!shard)
+    {
+        FS_ERR("No free space of memory");
+        return 0;
+    }
+    memset(shard, 0, sizeof *shard);
+
+    strncpy(shard->name, name, sizeof shard->name - 1);
+
+    char path[FMAX_PATH];
+    snprintf(path, sizeof path, "%s/%s", shards->path, name);
+
+    shard->pdb = fdb_open(path, FDB_SHARD_MAX_DBS, FDB_SHARD_MAX_READERS, FDB_SHARD_MAP_SIZE, shards->flags);
+    if (!shard->pdb)
+    {
+        FS_ERR("Unable to open the DB shard \'%s\'", path);
+        free(shard);
+        return 0;
+    }
+
+    shard->next = shards->shards;
+    shards->shards = shard;
+
+    return fdb_retain(shard->pdb);
+}
+
+fdb_t *fdb_shard(fdb_shards_t *shards, fuuid_t const *uuid)
+{
+    if (!shards || !uuid)
+    {
+        FS_ERR("Invalid arguments");
+        return 0;
+    }
+
+    if (shards->buckets_num == FDB_SHARDS_NONE)
+        return fdb_retain(shards->pdb);
+
+    char name[FDB_SHARD_NAME_MAX] = { 0 };
+
+    if (shards->buckets_num == FDB_SHARDS_PER_NODE)
+        fuuid2str(uuid, name, sizeof name);
+    else
+        snprintf(name, sizeof name, "shard%u", fdb_shard_bucket(uuid, shards->buckets_num));
+
+    fdb_t *pdb = 0;
+
+    fpush_lock(shards->mutex);
+    pdb = fdb_shard_open(shards, name);
+    fpop_lock();
+
+    return pdb;
+}
@@ -0,0 +1,28 @@
+#ifndef FSYNC_SHARDS_H_FDB
+#define FSYNC_SHARDS_H_FDB
+#include <futils/uuid.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../db.h"
+
+/*
+ * Sync tables of nodes may be kept in separate LMDB environments (shards).
+ * Each environment has own writer lock, so transactions of different shards are committed in parallel.
+ * Shards are opened on demand in subdirectories of the main DB directory.
+ * If two shards are used at once, the shard of the local node should be locked first.
+ */
+
+enum
+{
+    FDB_SHARDS_PER_NODE = 0,    // Separate environment for each node
+    FDB_SHARDS_NONE     = 1     // Sync tables of all nodes are kept in the main DB
+};
+
+typedef struct fdb_shards fdb_shards_t;
+
+fdb_shards_t *fdb_shards(fdb_t *pdb, char const *path, uint32_t buckets_num, uint32_t flags);   // buckets_num - FDB_SHARDS_PER_NODE, FDB_SHARDS_NONE or number of uuid hash buckets
+fdb_shards_t *fdb_shards_retain(fdb_shards_t *shards);
+void          fdb_shards_release(fdb_shards_t *shards);
+fdb_t        *fdb_shard(fdb_shards_t *shards, fuuid_t const *uuid);                            // Retained DB for sync tables of the node. It should be released by fdb_release.
+
+#endif
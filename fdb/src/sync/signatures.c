@@ -0,0 +1,238 @@
+#include "signatures.h"
+#include <futils/log.h>
+#include <string.h>
+#include <binn.h>
+
+static char const TBL_SIGNATURES[] = "/signatures";
+static char const TBL_REMOTE_SIGNATURES[] = "/remote_signatures";
+
+static char STR_PATH[] = "path";
+static char STR_SIZE[] = "size";
+static char STR_MTIME[] = "mtime";
+static char STR_DIGEST[] = "digest";
+static char STR_BLOCK_LEN[] = "block_len";
+static char STR_STRONG_LEN[] = "strong_len";
+static char STR_SIGNATURE[] = "signature";
+
+// Paths may be longer than max key length. MD5 sum of path is used as key.
+static void fdb_signature_path_key(char const *path, fmd5_t *key)
+{
+    fmd5_context_t ctx;
+    fmd5_init(&ctx);
+    fmd5_update(&ctx, path, (uint32_t)strlen(path));
+    fmd5_final(&ctx, key);
+}
+
+static char const *fdb_tbl_name(fuuid_t const *uuid, char *buf, size_t size, char const *tbl)
+{
+    if (size < sizeof(fuuid_t) * 2 + strlen(tbl) + 1)
+        return 0;
+    char *ret = buf;
+    fuuid2str(uuid, buf, size);
+    size_t uuid_len = strlen(buf);
+    buf += uuid_len;
+    size -= uuid_len;
+    strncpy(buf, tbl, size);
+    return ret;
+}
+
+bool fdb_signatures_map_open(fdb_transaction_t *transaction, fdb_map_t *pmap)
+{
+    if (!transaction || !pmap)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    if (!fdb_map_open(transaction, TBL_SIGNATURES, FDB_MAP_CREATE, pmap))
+    {
+        FS_ERR("Map wasn't created");
+        return false;
+    }
+
+    return true;
+}
+
+bool fdb_signature_get(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_signature_key_t const *key, fdb_data_t *signature)
+{
+    if (!pmap || !transaction || !key || !signature)
+        return false;
+
+    fmd5_t path_key;
+    fdb_signature_path_key(key->path, &path_key);
+
+    fdb_data_t const data_key = { sizeof path_key.data, path_key.data };
+    fdb_data_t data = { 0 };
+
+    if (!fdb_map_get(pmap, transaction, &data_key, &data))
+        return false;
+
+    binn *obj = binn_open(data.data);
+    if (!obj)
+        return false;
+
+    int digest_size = 0;
+    int signature_size = 0;
+    char const *path = binn_object_str(obj, STR_PATH);
+    void const *digest = binn_object_blob(obj, STR_DIGEST, &digest_size);
+    void *sig = binn_object_blob(obj, STR_SIGNATURE, &signature_size);
+
+    // The file was changed after the signature calculation
+    bool const is_valid = path && strncmp(path, key->path, sizeof key->path) == 0
+                            && binn_object_uint64(obj, STR_SIZE) == key->size
+                            && (time_t)binn_object_uint64(obj, STR_MTIME) == key->mod_time
+                            && digest && digest_size == sizeof key->digest.data
+                            && memcmp(digest, key->digest.data, sizeof key->digest.data) == 0
+                            && binn_object_uint32(obj, STR_BLOCK_LEN) == key->block_len
+                            && binn_object_uint32(obj, STR_STRONG_LEN) == key->strong_len
+                            && sig;
+
+    if (is_valid)
+    {
+        signature->size = (size_t)signature_size;
+        signature->data = sig;
+    }
+
+    binn_free(obj);
+
+    return is_valid;
+}
+
+bool fdb_signature_put(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_signature_key_t const *key, void const *signature, size_t size)
+{
+    if (!pmap || !transaction || !key || !signature)
+        return false;
+
+    binn *obj = binn_object();
+    if (!obj)
+        return false;
+
+    if (!binn_object_set_str(obj, STR_PATH, (char *)key->path)
+        || !binn_object_set_uint64(obj, STR_SIZE, key->size)
+        || !binn_object_set_uint64(obj, STR_MTIME, (uint64_t)key->mod_time)
+        || !binn_object_set_blob(obj, STR_DIGEST, (void *)key->digest.data, sizeof key->digest.data)
+        || !binn_object_set_uint32(obj, STR_BLOCK_LEN, key->block_len)
+        || !binn_object_set_uint32(obj, STR_STRONG_LEN, key->strong_len)
+        || !binn_object_set_blob(obj, STR_SIGNATURE, (void *)signature, (int)size))
+    {
+        binn_free(obj);
+        return false;
+    }
+
+    fmd5_t path_key;
+    fdb_signature_path_key(key->path, &path_key);
+
+    fdb_data_t const data_key = { sizeof path_key.data, path_key.data };
+    fdb_data_t const value = { binn_size(obj), binn_ptr(obj) };
+
+    bool ret = fdb_map_put(pmap, transaction, &data_key, &value);
+
+    binn_free(obj);
+
+    return ret;
+}
+
+bool fdb_signature_del(fdb_map_t *pmap, fdb_transaction_t *transaction, char const *path)
+{
+    if (!pmap || !transaction || !path)
+        return false;
+
+    fmd5_t path_key;
+    fdb_signature_path_key(path, &path_key);
+
+    fdb_data_t const data_key = { sizeof path_key.data, path_key.data };
+
+    return fdb_map_del(pmap, transaction, &data_key, 0);
+}
+
+bool fdb_remote_signatures_map_open(fdb_transaction_t *transaction, fuuid_t const *peer, fdb_map_t *pmap)
+{
+    if (!transaction || !peer || !pmap)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    char tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_REMOTE_SIGNATURES] = { 0 };
+
+    if (!fdb_map_open(transaction, fdb_tbl_name(peer, tbl_name, sizeof tbl_name, TBL_REMOTE_SIGNATURES), FDB_MAP_CREATE, pmap))
+    {
+        FS_ERR("Map wasn't created");
+        return false;
+    }
+
+    return true;
+}
+
+bool fdb_remote_signature_get(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_remote_signature_key_t *key, fdb_data_t *signature)
+{
+    if (!pmap || !transaction || !key)
+        return false;
+
+    fmd5_t path_key;
+    fdb_signature_path_key(key->path, &path_key);
+
+    fdb_data_t const data_key = { sizeof path_key.data, path_key.data };
+    fdb_data_t data = { 0 };
+
+    if (!fdb_map_get(pmap, transaction, &data_key, &data))
+        return false;
+
+    binn *obj = binn_open(data.data);
+    if (!obj)
+        return false;
+
+    int digest_size = 0;
+    int signature_size = 0;
+    char const *path = binn_object_str(obj, STR_PATH);
+    void const *digest = binn_object_blob(obj, STR_DIGEST, &digest_size);
+    void *sig = binn_object_blob(obj, STR_SIGNATURE, &signature_size);
+
+    bool const is_valid = path && strncmp(path, key->path, sizeof key->path) == 0
+                            && digest && digest_size == sizeof key->digest.data
+                            && sig;
+
+    if (is_valid)
+    {
+        memcpy(key->digest.data, digest, sizeof key->digest.data);
+        if (signature)
+        {
+            signature->size = (size_t)signature_size;
+            signature->data = sig;
+        }
+    }
+
+    binn_free(obj);
+
+    return is_valid;
+}
+
+bool fdb_remote_signature_put(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_remote_signature_key_t const *key, void const *signature, size_t size)
+{
+    if (!pmap || !transaction || !key || !signature)
+        return false;
+
+    binn *obj = binn_object();
+    if (!obj)
+        return false;
+
+    if (!binn_object_set_str(obj, STR_PATH, (char *)key->path)
+        || !binn_object_set_blob(obj, STR_DIGEST, (void *)key->digest.data, sizeof key->digest.data)
+        || !binn_object_set_blob(obj, STR_SIGNATURE, (void *)signature, (int)size))
+    {
+        binn_free(obj);
+        return false;
+    }
+
+    fmd5_t path_key;
+    fdb_signature_path_key(key->path, &path_key);
+
+    fdb_data_t const data_key = { sizeof path_key.data, path_key.data };
+    fdb_data_t const value = { binn_size(obj), binn_ptr(obj) };
+
+    bool ret = fdb_map_put(pmap, transaction, &data_key, &value);
+
+    binn_free(obj);
+
+    return ret;
+}
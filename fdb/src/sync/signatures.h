@@ -0,0 +1,46 @@
+#ifndef SIGNATURES_H_FDB
+#define SIGNATURES_H_FDB
+#include <futils/md5.h>
+#include <futils/uuid.h>
+#include <fcommon/limits.h>
+#include <time.h>
+#include "../db.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Cache of rsync signatures of local files. The signature is valid while the file identity isn't changed.
+ * Only the last signature of each path is kept.
+ */
+
+typedef struct
+{
+    char     path[FMAX_PATH];   // Path
+    uint64_t size;              // File size
+    time_t   mod_time;          // Modification time
+    fmd5_t   digest;            // MD5 sum
+    uint32_t block_len;         // Block length of signature
+    uint32_t strong_len;        // Strong sum length of signature
+} fdb_signature_key_t;
+
+bool fdb_signatures_map_open(fdb_transaction_t *transaction, fdb_map_t *pmap);
+bool fdb_signature_get(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_signature_key_t const *key, fdb_data_t *signature);     // Signature is valid until the transaction end
+bool fdb_signature_put(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_signature_key_t const *key, void const *signature, size_t size);
+bool fdb_signature_del(fdb_map_t *pmap, fdb_transaction_t *transaction, char const *path);
+
+/*
+ * Signatures of remote files which were received from the peer. Each signature is stored by path of the local file
+ * which was synchronized with the remote one. The signature is valid while the remote file digest isn't changed.
+ */
+
+typedef struct
+{
+    char     path[FMAX_PATH];   // Path of the local file
+    fmd5_t   digest;            // MD5 sum of the remote file
+} fdb_remote_signature_key_t;
+
+bool fdb_remote_signatures_map_open(fdb_transaction_t *transaction, fuuid_t const *peer, fdb_map_t *pmap);
+bool fdb_remote_signature_get(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_remote_signature_key_t *key, fdb_data_t *signature);     // Digest is found by path. Signature is optional and valid until the transaction end.
+bool fdb_remote_signature_put(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_remote_signature_key_t const *key, void const *signature, size_t size);
+
+#endif
@@ -0,0 +1,285 @@
+#include "sketches.h"
+#include <futils/log.h>
+#include <futils/md5.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char const TBL_SKETCH_FEATURES[] = "/sketch_features";
+static char const TBL_SKETCH_FILES[] = "/sketch_files";
+
+enum
+{
+    FDB_SKETCH_POSTING_MAX      = 256,  // Only the first files of the frequent feature are considered
+    FDB_SKETCH_CANDIDATES_MAX   = 256,  // Maximum number of candidates
+    FDB_SKETCH_VERIFY_MAX       = 8     // Sketches of the best candidates are compared
+};
+
+typedef struct
+{
+    fmd5_t   key;                       // MD5 sum of path
+    uint32_t hits;                      // Number of common features
+} fdb_sketch_candidate_t;
+
+// Paths may be longer than max key length. MD5 sum of path is used as key.
+static void fdb_sketch_path_key(char const *path, fmd5_t *key)
+{
+    fmd5_context_t ctx;
+    fmd5_init(&ctx);
+    fmd5_update(&ctx, path, (uint32_t)strlen(path));
+    fmd5_final(&ctx, key);
+}
+
+uint32_t fdb_sketch_similarity(fdb_sketch_t const *lhs, fdb_sketch_t const *rhs)
+{
+    if (!lhs || !rhs)
+        return 0;
+
+    // The bottom-k of union is taken, the ratio of the common hashes in it estimates the Jaccard index
+    size_t i = 0, j = 0, num = 0, common = 0;
+
+    while (num < FSYNC_SKETCH_SIZE)
+    {
+        uint64_t const l = i < FSYNC_SKETCH_SIZE ? lhs->hashes[i] : UINT64_MAX;
+        uint64_t const r = j < FSYNC_SKETCH_SIZE ? rhs->hashes[j] : UINT64_MAX;
+
+        if (l == UINT64_MAX && r == UINT64_MAX)
+            break;
+
+        if (l == r)
+        {
+            ++common;
+            ++i;
+            ++j;
+        }
+        else if (l < r)
+            ++i;
+        else
+            ++j;
+
+        ++num;
+    }
+
+    return num ? (uint32_t)(common * 100 / num) : 0;
+}
+
+bool fdb_sketches_open(fdb_transaction_t *transaction, fdb_sketches_t *psketches)
+{
+    if (!transaction || !psketches)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    memset(psketches, 0, sizeof *psketches);
+
+    if (!fdb_map_open(transaction, TBL_SKETCH_FEATURES, FDB_MAP_CREATE | FDB_MAP_MULTI | FDB_MAP_FIXED_SIZE_VALUE, &psketches->features))
+    {
+        FS_ERR("Map wasn't created");
+        return false;
+    }
+
+    if (!fdb_map_open(transaction, TBL_SKETCH_FILES, FDB_MAP_CREATE, &psketches->files))
+    {
+        FS_ERR("Map wasn't created");
+        fdb_map_close(&psketches->features);
+        return false;
+    }
+
+    return true;
+}
+
+void fdb_sketches_close(fdb_sketches_t *psketches)
+{
+    if (psketches)
+    {
+        fdb_map_close(&psketches->files);
+        fdb_map_close(&psketches->features);
+    }
+}
+
+// File is stored as sketch and path without the terminating zero
+static bool fdb_sketch_file_get(fdb_sketches_t *psketches, fdb_transaction_t *transaction, fmd5_t const *path_key, fdb_sketch_t *sketch, char *path, size_t size)
+{
+    fdb_data_t const key = { sizeof path_key->data, (void *)path_key->data };
+    fdb_data_t value = { 0 };
+
+    if (!fdb_map_get(&psketches->files, transaction, &key, &value)
+        || value.size < sizeof *sketch)
+        return false;
+
+    memcpy(sketch, value.data, sizeof *sketch);
+
+    if (path)
+    {
+        size_t const path_len = value.size - sizeof *sketch;
+        if (path_len >= size)
+            return false;
+        memcpy(path, (char const *)value.data + sizeof *sketch, path_len);
+        path[path_len] = 0;
+    }
+
+    return true;
+}
+
+static void fdb_sketch_features_del(fdb_sketches_t *psketches, fdb_transaction_t *transaction, fmd5_t const *path_key)
+{
+    fdb_sketch_t sketch;
+    if (!fdb_sketch_file_get(psketches, transaction, path_key, &sketch, 0, 0))
+        return;
+
+    fdb_data_t const value = { sizeof path_key->data, (void *)path_key->data };
+
+    for (size_t i = 0; i < FSYNC_SKETCH_SIZE && sketch.hashes[i] != UINT64_MAX; ++i)
+    {
+        fdb_data_t const key = { sizeof sketch.hashes[i], &sketch.hashes[i] };
+        fdb_map_del(&psketches->features, transaction, &key, &value);
+    }
+}
+
+bool fdb_sketch_put(fdb_sketches_t *psketches, fdb_transaction_t *transaction, char const *path, fdb_sketch_t const *sketch)
+{
+    if (!psketches || !transaction || !path || !sketch)
+        return false;
+
+    size_t const path_len = strnlen(path, FMAX_PATH);
+    if (path_len >= FMAX_PATH)
+        return false;
+
+    fmd5_t path_key;
+    fdb_sketch_path_key(path, &path_key);
+
+    fdb_sketch_features_del(psketches, transaction, &path_key);
+
+    fdb_data_t const value = { sizeof path_key.data, path_key.data };
+
+    for (size_t i = 0; i < FSYNC_SKETCH_SIZE && sketch->hashes[i] != UINT64_MAX; ++i)
+    {
+        fdb_data_t const key = { sizeof sketch->hashes[i], (void *)&sketch->hashes[i] };
+        if (!fdb_map_put(&psketches->features, transaction, &key, &value))
+            return false;
+    }
+
+    char buf[sizeof *sketch + FMAX_PATH];
+    memcpy(buf, sketch, sizeof *sketch);
+    memcpy(buf + sizeof *sketch, path, path_len);
+
+    fdb_data_t const file_key = { sizeof path_key.data, path_key.data };
+    fdb_data_t const file = { sizeof *sketch + path_len, buf };
+
+    return fdb_map_put(&psketches->files, transaction, &file_key, &file);
+}
+
+bool fdb_sketch_del(fdb_sketches_t *psketches, fdb_transaction_t *transaction, char const *path)
+{
+    if (!psketches || !transaction || !path)
+        return false;
+
+    fmd5_t path_key;
+    fdb_sketch_path_key(path, &path_key);
+
+    fdb_sketch_features_del(psketches, transaction, &path_key);
+
+    fdb_data_t const key = { sizeof path_key.data, path_key.data };
+
+    return fdb_map_del(&psketches->files, transaction, &key, 0);
+}
+
+static void fdb_sketch_candidate_hit(fdb_sketch_candidate_t *candidates, size_t *num, fmd5_t const *key)
+{
+    for (size_t i = 0; i < *num; ++i)
+    {
+        if (memcmp(candidates[i].key.data, key->data, sizeof key->data) == 0)
+        {
+            candidates[i].hits++;
+            return;
+        }
+    }
+
+    if (*num < FDB_SKETCH_CANDIDATES_MAX)
+    {
+        candidates[*num].key = *key;
+        candidates[*num].hits = 1;
+        ++*num;
+    }
+}
+
+static int fdb_sketch_candidate_cmp(void const *lhs, void const *rhs)
+{
+    uint32_t const lhits = ((fdb_sketch_candidate_t const *)lhs)->hits;
+    uint32_t const rhits = ((fdb_sketch_candidate_t const *)rhs)->hits;
+    return lhits > rhits ? -1 : lhits < rhits;
+}
+
+bool fdb_sketch_find(fdb_sketches_t *psketches, fdb_transaction_t *transaction, fdb_sketch_t const *sketch, char *path, size_t size, uint32_t *similarity)
+{
+    if (!psketches || !transaction || !sketch || !path || !size || !similarity)
+        return false;
+
+    fdb_sketch_candidate_t *candidates = malloc(FDB_SKETCH_CANDIDATES_MAX * sizeof *candidates);
+    if (!candidates)
+    {
+        FS_ERR("Unable to allocate memory for candidates");
+        return false;
+    }
+
+    size_t num = 0;
+
+    fdb_cursor_t cursor;
+    if (!fdb_cursor_open(&psketches->features, transaction, &cursor))
+    {
+        free(candidates);
+        return false;
+    }
+
+    // Files are counted by the number of common features
+    for (size_t i = 0; i < FSYNC_SKETCH_SIZE && sketch->hashes[i] != UINT64_MAX; ++i)
+    {
+        fdb_data_t key = { sizeof sketch->hashes[i], (void *)&sketch->hashes[i] };
+        fdb_data_t values = { 0 };
+        size_t posting_size = 0;
+
+        for (fdb_cursor_op_t op = FDB_SET;
+             posting_size < FDB_SKETCH_POSTING_MAX && fdb_cursor_get_multiple(&cursor, &key, &values, op);
+             op = FDB_NEXT_DUP)
+        {
+            fmd5_t const *keys = (fmd5_t const *)values.data;
+            size_t const keys_num = values.size / sizeof *keys;
+
+            for (size_t j = 0; j < keys_num && posting_size < FDB_SKETCH_POSTING_MAX; ++j, ++posting_size)
+            {
+                fmd5_t path_key;
+                memcpy(&path_key, keys + j, sizeof path_key);
+                fdb_sketch_candidate_hit(candidates, &num, &path_key);
+            }
+        }
+    }
+
+    fdb_cursor_close(&cursor);
+
+    qsort(candidates, num, sizeof *candidates, fdb_sketch_candidate_cmp);
+
+    bool ret = false;
+    *similarity = 0;
+
+    for (size_t i = 0; i < num && i < FDB_SKETCH_VERIFY_MAX; ++i)
+    {
+        fdb_sketch_t candidate;
+        char candidate_path[FMAX_PATH];
+
+        if (fdb_sketch_file_get(psketches, transaction, &candidates[i].key, &candidate, candidate_path, sizeof candidate_path))
+        {
+            uint32_t const candidate_similarity = fdb_sketch_similarity(sketch, &candidate);
+            if (candidate_similarity > *similarity
+                && strlen(candidate_path) < size)
+            {
+                strcpy(path, candidate_path);
+                *similarity = candidate_similarity;
+                ret = true;
+            }
+        }
+    }
+
+    free(candidates);
+
+    return ret;
+}
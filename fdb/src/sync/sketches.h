@@ -0,0 +1,34 @@
+#ifndef SKETCHES_H_FDB
+#define SKETCHES_H_FDB
+#include <fcommon/limits.h>
+#include "../db.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Similarity index of local files. Each file is described by the sketch (the smallest feature hashes of data).
+ * Feature hash -> files which contain it, file -> sketch.
+ * Only the last sketch of each path is kept. The found file may be changed, so it is used as a hint only.
+ */
+
+typedef struct
+{
+    uint64_t hashes[FSYNC_SKETCH_SIZE];     // Sorted feature hashes, UINT64_MAX for unused
+} fdb_sketch_t;
+
+typedef struct
+{
+    fdb_map_t features;                     // feature hash -> MD5 sum of path
+    fdb_map_t files;                        // MD5 sum of path -> sketch and path
+} fdb_sketches_t;
+
+uint32_t fdb_sketch_similarity(fdb_sketch_t const *lhs, fdb_sketch_t const *rhs);     // Estimated similarity of data in percents
+
+bool fdb_sketches_open(fdb_transaction_t *transaction, fdb_sketches_t *psketches);
+void fdb_sketches_close(fdb_sketches_t *psketches);
+bool fdb_sketch_put(fdb_sketches_t *psketches, fdb_transaction_t *transaction, char const *path, fdb_sketch_t const *sketch);
+bool fdb_sketch_del(fdb_sketches_t *psketches, fdb_transaction_t *transaction, char const *path);
+bool fdb_sketch_find(fdb_sketches_t *psketches, fdb_transaction_t *transaction, fdb_sketch_t const *sketch, char *path, size_t size, uint32_t *similarity);  // The most similar file
+
+#endif
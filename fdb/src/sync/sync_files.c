@@ -1,5 +1,6 @@
 #include "sync_files.h"
-#include "statuses.h"
+#include "bitmaps.h"
+#include "../bulk.h"
 #include <futils/md5.h>
 #include <futils/log.h>
 #include <string.h>
@@ -7,11 +8,21 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <binn.h>
+#include <futils/vector.h>
 
 static char const TBL_SYNC_FILE_INFO[]    = "/sync/file/info";
-static char const TBL_SYNC_FILE_PATH_ID[] = "/sync/file/path/id";
+static char const TBL_SYNC_FILE_NAME_ID[] = "/sync/file/name/id";
 static char const TBL_SYNC_FILE_ID[]      = "/sync/file/id";
-static char const TBL_SYNC_FILE_STATUS[]  = "/sync/file/status";
+static char const TBL_SYNC_FILE_STATUS[]  = "/sync/file/statuses";
+static char const TBL_SYNC_DIR_TREE[]     = "/sync/dir/tree";
+static char const TBL_SYNC_DIR_INFO[]     = "/sync/dir/info";
+static char const TBL_SYNC_DIR_ID[]       = "/sync/dir/id";
+static char const TBL_SYNC_FILE_PATH_ID[] = "/sync/file/path/id";     // path->id of previous versions
+
+enum
+{
+    FDB_SYNC_FILES_BULK_MEM = 16 * 1024 * 1024     // Memory limit for each bulk loader
+};
 
 static char const *fdb_tbl_name(fuuid_t const *uuid, char *buf, size_t size, char const *tbl)
 {
@@ -26,14 +37,189 @@ static char const *fdb_tbl_name(fuuid_t const *uuid, char *buf, size_t size, cha
     return ret;
 }
 
+/*
+ * Name keys of the bulk mode. The loaders aren't searchable until they are flushed,
+ * so the same path added twice gets the id which was given first.
+ * Open addressing hash table, keys are stored in one buffer.
+ */
+typedef struct
+{
+    uint32_t    hash;
+    uint32_t    id;                         // FINVALID_ID - free slot
+    size_t      offset;                     // key offset in the keys buffer
+    size_t      size;                       // key size
+} fdb_sync_pending_key_t;
+
+typedef struct
+{
+    fdb_sync_pending_key_t *slots;
+    size_t                  capacity;       // number of slots (power of two)
+    size_t                  size;           // number of keys
+    uint8_t                *keys;
+    size_t                  keys_size;
+    size_t                  keys_capacity;
+} fdb_sync_pending_keys_t;
+
+static uint32_t fdb_sync_pending_hash(uint8_t const *data, size_t size)
+{
+    uint32_t hash = 2166136261u;            // FNV-1a
+    for(size_t i = 0; i < size; ++i)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+static fdb_sync_pending_key_t *fdb_sync_pending_slot(fdb_sync_pending_keys_t const *pending, uint8_t const *data, size_t size, uint32_t hash)
+{
+    for(size_t i = hash & (pending->capacity - 1);; i = (i + 1) & (pending->capacity - 1))
+    {
+        fdb_sync_pending_key_t *slot = pending->slots + i;
+        if (slot->id == FINVALID_ID
+            || (slot->hash == hash
+                && slot->size == size
+                && memcmp(pending->keys + slot->offset, data, size) == 0))
+            return slot;
+    }
+}
+
+static bool fdb_sync_pending_find(fdb_sync_pending_keys_t const *pending, uint8_t const *data, size_t size, uint32_t *id)
+{
+    if (!pending->size)
+        return false;
+    fdb_sync_pending_key_t const *slot = fdb_sync_pending_slot(pending, data, size, fdb_sync_pending_hash(data, size));
+    if (slot->id == FINVALID_ID)
+        return false;
+    *id = slot->id;
+    return true;
+}
+
+static bool fdb_sync_pending_grow(fdb_sync_pending_keys_t *pending)
+{
+    size_t const capacity = pending->capacity ? pending->capacity * 2 : 1024;
+    fdb_sync_pending_key_t *slots = malloc(capacity * sizeof *slots);
+    if (!slots)
+        return false;
+
+    for(size_t i = 0; i < capacity; ++i)
+        slots[i].id = FINVALID_ID;
+
+    fdb_sync_pending_keys_t const old = *pending;
+    pending->slots = slots;
+    pending->capacity = capacity;
+
+    for(size_t i = 0; i < old.capacity; ++i)
+    {
+        if (old.slots[i].id != FINVALID_ID)
+            *fdb_sync_pending_slot(pending, pending->keys + old.slots[i].offset, old.slots[i].size, old.slots[i].hash) = old.slots[i];
+    }
+
+    free(old.slots);
+    return true;
+}
+
+static bool fdb_sync_pending_put(fdb_sync_pending_keys_t *pending, uint8_t const *data, size_t size, uint32_t id)
+{
+    // Load factor is kept below 1/2
+    if ((pending->size + 1) * 2 > pending->capacity
+        && !fdb_sync_pending_grow(pending))
+    {
+        FS_ERR("No free space of memory");
+        return false;
+    }
+
+    uint32_t const hash = fdb_sync_pending_hash(data, size);
+    fdb_sync_pending_key_t *slot = fdb_sync_pending_slot(pending, data, size, hash);
+    if (slot->id != FINVALID_ID)
+    {
+        slot->id = id;
+        return true;
+    }
+
+    if (pending->keys_size + size > pending->keys_capacity)
+    {
+        size_t capacity = pending->keys_capacity ? pending->keys_capacity * 2 : 64 * 1024;
+        while (capacity < pending->keys_size + size)
+            capacity *= 2;
+        uint8_t *keys = realloc(pending->keys, capacity);
+        if (!keys)
+        {
+            FS_ERR("No free space of memory");
+            return false;
+        }
+        pending->keys = keys;
+        pending->keys_capacity = capacity;
+    }
+
+    memcpy(pending->keys + pending->keys_size, data, size);
+    slot->hash = hash;
+    slot->id = id;
+    slot->offset = pending->keys_size;
+    slot->size = size;
+    pending->keys_size += size;
+    pending->size++;
+
+    return true;
+}
+
+static void fdb_sync_pending_free(fdb_sync_pending_keys_t *pending)
+{
+    free(pending->slots);
+    free(pending->keys);
+    memset(pending, 0, sizeof *pending);
+}
+
+/*
+ * Paths aren't stored as is. Each directory has own id and a file is identified by (dir_id, name) pair.
+ *   dir_tree_map:  (parent_dir_id, name) -> dir_id
+ *   dirs_map:      dir_id -> (parent_dir_id, name)
+ *   name_ids_map:  (dir_id, name) -> file_id
+ *   files_map:     file_id -> file_info
+ * Directory id is stored in big-endian byte order, so all entries of one directory are adjacent in maps.
+ */
 struct fdb_sync_files_map
 {
     volatile uint32_t   ref_counter;
     fdb_map_t           files_map;
-    fdb_map_t           path_ids_map;
+    fdb_map_t           name_ids_map;
     fdb_map_t           ids_map;
+    fdb_map_t           dir_tree_map;
+    fdb_map_t           dirs_map;
+    fdb_map_t           dir_ids_map;
+    fdb_transaction_t  *bulk_transaction;   // Transaction of bulk mode
+    fdb_bulk_loader_t  *files_loader;
+    fdb_bulk_loader_t  *name_ids_loader;
+    fdb_sync_pending_keys_t pending_keys;   // Name keys which are added in bulk mode
 };
 
+typedef struct
+{
+    uint8_t data[sizeof(uint32_t) + FMAX_FILENAME];
+    size_t  size;
+} fdb_name_key_t;
+
+static bool fdb_name_key(fdb_name_key_t *key, uint32_t dir_id, char const *name, size_t len)
+{
+    if (len > FMAX_FILENAME)
+    {
+        FS_ERR("File name is too long");
+        return false;
+    }
+    key->data[0] = (uint8_t)(dir_id >> 24);
+    key->data[1] = (uint8_t)(dir_id >> 16);
+    key->data[2] = (uint8_t)(dir_id >> 8);
+    key->data[3] = (uint8_t)dir_id;
+    memcpy(key->data + sizeof dir_id, name, len);
+    key->size = sizeof dir_id + len;
+    return true;
+}
+
+static uint32_t fdb_name_key_dir(fdb_data_t const *key)
+{
+    uint8_t const *data = (uint8_t const *)key->data;
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static bool fdb_sync_files_migrate(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fuuid_t const *uuid);
+
 fdb_sync_files_map_t *fdb_sync_files_ex(fdb_transaction_t *transaction, fuuid_t const *uuid, bool ids_generator)
 {
     if (!transaction || !uuid)
@@ -65,11 +251,47 @@ fdb_sync_files_map_t *fdb_sync_files_ex(fdb_transaction_t *transaction, fuuid_t
         return 0;
     }
 
-    // path->id
-    char path_ids_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_SYNC_FILE_PATH_ID] = { 0 };
-    fdb_tbl_name(uuid, path_ids_tbl_name, sizeof path_ids_tbl_name, TBL_SYNC_FILE_PATH_ID);
+    // (dir_id, name)->id
+    char name_ids_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_SYNC_FILE_NAME_ID] = { 0 };
+    fdb_tbl_name(uuid, name_ids_tbl_name, sizeof name_ids_tbl_name, TBL_SYNC_FILE_NAME_ID);
 
-    if (!fdb_map_open(transaction, path_ids_tbl_name, FDB_MAP_CREATE, &files_map->path_ids_map))
+    if (!fdb_map_open(transaction, name_ids_tbl_name, FDB_MAP_CREATE, &files_map->name_ids_map))
+    {
+        FS_ERR("Map wasn't created");
+        fdb_transaction_abort(transaction);
+        fdb_sync_files_release(files_map);
+        return 0;
+    }
+
+    // (parent_dir_id, name)->dir_id
+    char dir_tree_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_SYNC_DIR_TREE] = { 0 };
+    fdb_tbl_name(uuid, dir_tree_tbl_name, sizeof dir_tree_tbl_name, TBL_SYNC_DIR_TREE);
+
+    if (!fdb_map_open(transaction, dir_tree_tbl_name, FDB_MAP_CREATE, &files_map->dir_tree_map))
+    {
+        FS_ERR("Map wasn't created");
+        fdb_transaction_abort(transaction);
+        fdb_sync_files_release(files_map);
+        return 0;
+    }
+
+    // dir_id->(parent_dir_id, name)
+    char dirs_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_SYNC_DIR_INFO] = { 0 };
+    fdb_tbl_name(uuid, dirs_tbl_name, sizeof dirs_tbl_name, TBL_SYNC_DIR_INFO);
+
+    if (!fdb_map_open(transaction, dirs_tbl_name, FDB_MAP_CREATE | FDB_MAP_INTEGERKEY, &files_map->dirs_map))
+    {
+        FS_ERR("Map wasn't created");
+        fdb_transaction_abort(transaction);
+        fdb_sync_files_release(files_map);
+        return 0;
+    }
+
+    // directory ids
+    char dir_ids_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_SYNC_DIR_ID] = { 0 };
+    fdb_tbl_name(uuid, dir_ids_tbl_name, sizeof dir_ids_tbl_name, TBL_SYNC_DIR_ID);
+
+    if (!fdb_ids_map_open(transaction, dir_ids_tbl_name, &files_map->dir_ids_map))
     {
         FS_ERR("Map wasn't created");
         fdb_transaction_abort(transaction);
@@ -92,6 +314,14 @@ fdb_sync_files_map_t *fdb_sync_files_ex(fdb_transaction_t *transaction, fuuid_t
         }
     }
 
+    if (!fdb_sync_files_migrate(files_map, transaction, uuid))
+    {
+        FS_ERR("Sync files weren't migrated");
+        fdb_transaction_abort(transaction);
+        fdb_sync_files_release(files_map);
+        return 0;
+    }
+
     return files_map;
 }
 
@@ -117,9 +347,15 @@ void fdb_sync_files_release(fdb_sync_files_map_t *files_map)
             FS_ERR("Invalid files map");
         else if (!--files_map->ref_counter)
         {
+            fdb_bulk_loader_free(files_map->files_loader);
+            fdb_bulk_loader_free(files_map->name_ids_loader);
+            fdb_sync_pending_free(&files_map->pending_keys);
             fdb_map_close(&files_map->files_map);
             fdb_map_close(&files_map->ids_map);
-            fdb_map_close(&files_map->path_ids_map);
+            fdb_map_close(&files_map->name_ids_map);
+            fdb_map_close(&files_map->dir_tree_map);
+            fdb_map_close(&files_map->dirs_map);
+            fdb_map_close(&files_map->dir_ids_map);
             free(files_map);
         }
     }
@@ -127,6 +363,68 @@ void fdb_sync_files_release(fdb_sync_files_map_t *files_map)
         FS_ERR("Invalid files map");
 }
 
+bool fdb_sync_files_bulk_start(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction)
+{
+    if (!files_map || !transaction)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    if (files_map->bulk_transaction)
+    {
+        FS_ERR("Bulk mode is already started");
+        return false;
+    }
+
+    files_map->files_loader = fdb_bulk_loader(&files_map->files_map, transaction, FDB_SYNC_FILES_BULK_MEM);
+    files_map->name_ids_loader = fdb_bulk_loader(&files_map->name_ids_map, transaction, FDB_SYNC_FILES_BULK_MEM);
+
+    if (!files_map->files_loader || !files_map->name_ids_loader)
+    {
+        fdb_bulk_loader_free(files_map->files_loader);
+        fdb_bulk_loader_free(files_map->name_ids_loader);
+        files_map->files_loader = 0;
+        files_map->name_ids_loader = 0;
+        return false;
+    }
+
+    files_map->bulk_transaction = transaction;
+
+    return true;
+}
+
+bool fdb_sync_files_bulk_finish(fdb_sync_files_map_t *files_map)
+{
+    if (!files_map || !files_map->bulk_transaction)
+    {
+        FS_ERR("Bulk mode isn't started");
+        return false;
+    }
+
+    bool ret = fdb_bulk_loader_flush(files_map->files_loader)
+                && fdb_bulk_loader_flush(files_map->name_ids_loader);
+
+    fdb_bulk_loader_free(files_map->files_loader);
+    fdb_bulk_loader_free(files_map->name_ids_loader);
+    files_map->files_loader = 0;
+    files_map->name_ids_loader = 0;
+    files_map->bulk_transaction = 0;
+    fdb_sync_pending_free(&files_map->pending_keys);
+
+    return ret;
+}
+
+bool fdb_sync_files_is_empty(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction)
+{
+    if (!files_map || !transaction)
+        return false;
+
+    fdb_map_stat_t stat = { 0 };
+    return fdb_map_stat(&files_map->files_map, transaction, &stat)
+            && !stat.entries;
+}
+
 bool fdb_sync_files_statuses(fdb_transaction_t *transaction, fuuid_t const *uuid, fdb_map_t *pmap)
 {
     if (!transaction || !uuid || !pmap)
@@ -138,20 +436,23 @@ bool fdb_sync_files_statuses(fdb_transaction_t *transaction, fuuid_t const *uuid
     char file_status_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_SYNC_FILE_STATUS] = { 0 };
     fdb_tbl_name(uuid, file_status_tbl_name, sizeof file_status_tbl_name, TBL_SYNC_FILE_STATUS);
 
-    return fdb_statuses_map_open(transaction, file_status_tbl_name, pmap);
+    return fdb_bitmaps_map_open(transaction, file_status_tbl_name, pmap);
 }
 
-static char STR_PATH[] = "path";
+static char STR_PATH[] = "path";         // Full path of previous versions
+static char STR_DIR[] = "dir";
+static char STR_NAME[] = "name";
 static char STR_MTIME[] = "mtime";
 static char STR_STIME[] = "stime";
 static char STR_DIGEST[] = "digest";
 static char STR_SIZE[] = "size";
 static char STR_STATUS[] = "status";
 
-static binn * fdb_file_info_marshal(fsync_file_info_t const *info)
+static binn * fdb_file_info_marshal(fsync_file_info_t const *info, uint32_t dir_id, char const *name)
 {
     binn *obj = binn_object();
-    if (!binn_object_set_str(obj, STR_PATH, (char *)info->path)
+    if (!binn_object_set_uint32(obj, STR_DIR, dir_id)
+         || !binn_object_set_str(obj, STR_NAME, (char *)name)
          || !binn_object_set_uint64(obj, STR_MTIME, (uint64_t)info->mod_time)
          || !binn_object_set_uint64(obj, STR_STIME, (uint64_t)info->sync_time)
          || !binn_object_set_blob(obj, STR_DIGEST, (void *)info->digest.data, sizeof info->digest.data)
@@ -164,16 +465,20 @@ static binn * fdb_file_info_marshal(fsync_file_info_t const *info)
     return obj;
 }
 
-static bool fdb_file_info_unmarshal(fsync_file_info_t *info, void const *data)
+// The file name is unmarshaled into info->path. Files of previous versions have the full path and the root directory.
+static bool fdb_file_info_unmarshal(fsync_file_info_t *info, uint32_t *dir_id, void const *data)
 {
-    if (!info || !data)
+    if (!info || !dir_id || !data)
         return false;
     int digest_size = 0;
     binn *obj = binn_open((void *)data);
     if (!obj)
         return false;
-    char const *path = binn_object_str(obj, STR_PATH);
-    if (path) strncpy(info->path, path, sizeof info->path);
+    *dir_id = FDB_ROOT_DIR_ID;
+    binn_object_get_uint32(obj, STR_DIR, dir_id);
+    char const *name = binn_object_str(obj, STR_NAME);
+    if (!name) name = binn_object_str(obj, STR_PATH);
+    if (name) strncpy(info->path, name, sizeof info->path);
     info->mod_time = (time_t)binn_object_uint64(obj, STR_MTIME);
     info->sync_time = (time_t)binn_object_uint64(obj, STR_STIME);
     memcpy(info->digest.data, binn_object_blob(obj, STR_DIGEST, &digest_size), sizeof info->digest.data);
@@ -183,64 +488,327 @@ static bool fdb_file_info_unmarshal(fsync_file_info_t *info, void const *data)
     return true;
 }
 
-bool fdb_sync_file_add(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fsync_file_info_t *info)
+static bool fdb_sync_subdir(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, uint32_t parent_id, char const *name, size_t len, bool create, uint32_t *dir_id)
 {
-    if (!files_map || !transaction || !info)
+    fdb_name_key_t key;
+    if (!fdb_name_key(&key, parent_id, name, len))
+        return false;
+
+    fdb_data_t const dir_key = { key.size, key.data };
+    fdb_data_t value = { 0 };
+
+    if (fdb_map_get(&files_map->dir_tree_map, transaction, &dir_key, &value))
+    {
+        *dir_id = *(uint32_t*)value.data;
+        return true;
+    }
+
+    if (!create
+        || !fdb_id_generate(&files_map->dir_ids_map, transaction, dir_id))
         return false;
 
-    fsync_file_info_t old_info = { 0 };
+    fdb_data_t const id = { sizeof *dir_id, dir_id };
 
-    if (!fdb_sync_file_get_by_path(files_map, transaction, info->path, strlen(info->path), &old_info))
+    return fdb_map_put(&files_map->dir_tree_map, transaction, &dir_key, &id)
+            && fdb_map_put(&files_map->dirs_map, transaction, &id, &dir_key);
+}
+
+// Checks whether the map has entries of the directory
+static bool fdb_sync_dir_has_entries(fdb_map_t *map, fdb_transaction_t *transaction, uint32_t dir_id, bool *has_entries)
+{
+    fdb_cursor_t cursor = { 0 };
+    if (!fdb_cursor_open(map, transaction, &cursor))
+        return false;
+
+    fdb_name_key_t key;
+    fdb_name_key(&key, dir_id, "", 0);
+
+    fdb_data_t entry_key = { key.size, key.data };
+    fdb_data_t value = { 0 };
+
+    *has_entries = fdb_cursor_get(&cursor, &entry_key, &value, FDB_SET_RANGE)
+                    && fdb_name_key_dir(&entry_key) == dir_id;
+
+    fdb_cursor_close(&cursor);
+
+    return true;
+}
+
+/*
+ * Deletes the directory if it has no files and subdirectories. The same is done for its parents.
+ * Files added in bulk mode aren't in maps yet, so directories are kept until the bulk is finished.
+ */
+static bool fdb_sync_dir_collect(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, uint32_t dir_id)
+{
+    if (files_map->bulk_transaction == transaction)
+        return true;
+
+    while (dir_id != FDB_ROOT_DIR_ID)
     {
-        if (info->id == FINVALID_ID
-            && !fdb_id_generate(&files_map->ids_map, transaction, &info->id))
+        bool has_files = true, has_subdirs = true;
+
+        if (!fdb_sync_dir_has_entries(&files_map->name_ids_map, transaction, dir_id, &has_files)
+            || !fdb_sync_dir_has_entries(&files_map->dir_tree_map, transaction, dir_id, &has_subdirs))
+            return false;
+
+        if (has_files || has_subdirs)
+            break;
+
+        fdb_data_t const id = { sizeof dir_id, &dir_id };
+        fdb_data_t value = { 0 };
+        fdb_name_key_t key;
+
+        if (!fdb_map_get(&files_map->dirs_map, transaction, &id, &value)
+            || value.size > sizeof key.data)
+        {
+            FS_ERR("DB consistency is broken");
+            return false;
+        }
+
+        // The entry is copied because it's deleted below
+        memcpy(key.data, value.data, value.size);
+        key.size = value.size;
+
+        fdb_data_t const dir_key = { key.size, key.data };
+
+        if (!fdb_map_del(&files_map->dir_tree_map, transaction, &dir_key, 0)
+            || !fdb_map_del(&files_map->dirs_map, transaction, &id, 0)
+            || !fdb_id_free(&files_map->dir_ids_map, transaction, dir_id))
             return false;
+
+        dir_id = fdb_name_key_dir(&dir_key);
     }
-    else
-        info->id = old_info.id;
 
-    binn *binfo = fdb_file_info_marshal(info);
+    return true;
+}
+
+// Finds the directory of the path. The last path component is returned as name.
+static bool fdb_sync_path_resolve(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, size_t size, bool create, uint32_t *dir_id, char const **name)
+{
+    uint32_t id = FDB_ROOT_DIR_ID;
+    char const *p = path;
+
+    for (char const *ch = path; ch < path + size; ++ch)
+    {
+        if (*ch != '/' && *ch != '\\')
+            continue;
+        if (ch > p
+            && !fdb_sync_subdir(files_map, transaction, id, p, ch - p, create, &id))
+            return false;
+        p = ch + 1;
+    }
+
+    *dir_id = id;
+    *name = p;
+
+    return true;
+}
+
+// Separators are replaced by '/'. Leading and repeated separators are dropped.
+static size_t fdb_sync_path_normalize(char *path)
+{
+    char *dst = path;
+
+    for (char const *ch = path; *ch; ++ch)
+    {
+        if (*ch != '/' && *ch != '\\')
+            *dst++ = *ch;
+        else if (dst != path && dst[-1] != '/')
+            *dst++ = '/';
+    }
+
+    *dst = 0;
+
+    return dst - path;
+}
+
+// The file path is normalized. The path with the trailing separator has no file name.
+static bool fdb_sync_file_path_normalize(fsync_file_info_t *info, size_t *len)
+{
+    info->path[sizeof info->path - 1] = 0;
+    *len = fdb_sync_path_normalize(info->path);
+
+    if (!*len || info->path[*len - 1] == '/')
+    {
+        FS_ERR("Invalid file path");
+        return false;
+    }
+
+    return true;
+}
+
+// The directory path is normalized. The trailing separator is dropped, the root directory isn't accepted.
+static bool fdb_sync_dir_path_normalize(char const *path, char *buf, size_t size, size_t *len)
+{
+    if (strlen(path) >= size)
+    {
+        FS_ERR("Path is too long");
+        return false;
+    }
+
+    strcpy(buf, path);
+    *len = fdb_sync_path_normalize(buf);
+
+    if (*len && buf[*len - 1] == '/')
+        buf[--*len] = 0;
+
+    if (!*len)
+    {
+        FS_ERR("Invalid directory path");
+        return false;
+    }
+
+    return true;
+}
+
+static bool fdb_sync_file_key(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, size_t size, bool create, uint32_t *dir_id, fdb_name_key_t *key)
+{
+    char const *name = 0;
+    return fdb_sync_path_resolve(files_map, transaction, path, size, create, dir_id, &name)
+            && fdb_name_key(key, *dir_id, name, path + size - name);
+}
+
+static bool fdb_sync_dir_path(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, uint32_t dir_id, char *path, size_t size, size_t *len)
+{
+    if (dir_id == FDB_ROOT_DIR_ID)
+    {
+        *len = 0;
+        return true;
+    }
+
+    fdb_data_t const id = { sizeof dir_id, &dir_id };
+    fdb_data_t dir_key = { 0 };
+
+    if (!fdb_map_get(&files_map->dirs_map, transaction, &id, &dir_key))
+    {
+        FS_ERR("DB consistency is broken");
+        return false;
+    }
+
+    if (!fdb_sync_dir_path(files_map, transaction, fdb_name_key_dir(&dir_key), path, size, len))
+        return false;
+
+    size_t const name_len = dir_key.size - sizeof dir_id;
+    if (*len + name_len + 1 >= size)
+    {
+        FS_ERR("Path is too long");
+        return false;
+    }
+
+    memcpy(path + *len, (char const *)dir_key.data + sizeof dir_id, name_len);
+    *len += name_len;
+    path[(*len)++] = '/';
+    path[*len] = 0;
+
+    return true;
+}
+
+static bool fdb_sync_file_put(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fsync_file_info_t const *info, uint32_t dir_id, fdb_name_key_t const *key)
+{
+    char name[FMAX_FILENAME + 1];
+    size_t const name_len = key->size - sizeof dir_id;
+    memcpy(name, key->data + sizeof dir_id, name_len);
+    name[name_len] = 0;
+
+    binn *binfo = fdb_file_info_marshal(info, dir_id, name);
     if (!binfo)
         return false;
 
-    fdb_data_t const file_id = { sizeof info->id, &info->id };
+    fdb_data_t const file_id = { sizeof info->id, (void*)&info->id };
     fdb_data_t const file_info = { binn_size(binfo), binn_ptr(binfo) };
-    fdb_data_t const file_path = { strlen(info->path), info->path };
+    fdb_data_t const file_key = { key->size, (void*)key->data };
 
-    bool ret = fdb_map_put(&files_map->files_map, transaction, &file_id, &file_info)
-                && fdb_map_put(&files_map->path_ids_map, transaction, &file_path, &file_id);
+    bool ret = files_map->bulk_transaction == transaction
+                ? fdb_bulk_loader_add(files_map->files_loader, &file_id, &file_info)
+                    && fdb_bulk_loader_add(files_map->name_ids_loader, &file_key, &file_id)
+                    && fdb_sync_pending_put(&files_map->pending_keys, key->data, key->size, info->id)
+                : fdb_map_put(&files_map->files_map, transaction, &file_id, &file_info)
+                    && fdb_map_put(&files_map->name_ids_map, transaction, &file_key, &file_id);
 
     binn_free(binfo);
 
     return ret;
 }
 
-bool fdb_sync_file_add_unique(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fsync_file_info_t *info)
+bool fdb_sync_file_add(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fsync_file_info_t *info)
 {
-    if (!files_map || !transaction || !info || info->id != FINVALID_ID)
+    if (!files_map || !transaction || !info)
         return false;
 
-    uint32_t id = FINVALID_ID;
+    uint32_t dir_id = FDB_ROOT_DIR_ID;
+    fdb_name_key_t key;
+    size_t len = 0;
+
+    if (!fdb_sync_file_path_normalize(info, &len)
+        || !fdb_sync_file_key(files_map, transaction, info->path, len, true, &dir_id, &key))
+        return false;
 
-    if (!fdb_sync_file_id(files_map, transaction, info->path, strlen(info->path), &id))
+    fdb_data_t const file_key = { key.size, key.data };
+    fdb_data_t file_id = { 0 };
+    fsync_file_info_t prev_info;
+    uint32_t prev_dir_id = FDB_ROOT_DIR_ID;
+    fdb_name_key_t prev_key;
+    bool is_moved = false;
+    uint32_t pending_id = FINVALID_ID;
+
+    // The file may be added in this bulk already
+    if (files_map->bulk_transaction == transaction
+        && fdb_sync_pending_find(&files_map->pending_keys, key.data, key.size, &pending_id))
+        info->id = pending_id;
+    else if (!fdb_map_get(&files_map->name_ids_map, transaction, &file_key, &file_id))
     {
-        if (!fdb_id_generate(&files_map->ids_map, transaction, &info->id))
-            return false;
+        if (info->id == FINVALID_ID)
+        {
+            if (!fdb_id_generate(&files_map->ids_map, transaction, &info->id))
+                return false;
+        }
+        else    // The known file with the new path was moved. Its previous name entry is deleted.
+            is_moved = fdb_sync_file_get(files_map, transaction, info->id, &prev_info)
+                        && fdb_sync_file_key(files_map, transaction, prev_info.path, strlen(prev_info.path), false, &prev_dir_id, &prev_key);
+    }
+    else
+        info->id = *(uint32_t*)file_id.data;
 
-        binn *binfo = fdb_file_info_marshal(info);
-        if (!binfo)
-            return false;
+    if (!fdb_sync_file_put(files_map, transaction, info, dir_id, &key))
+        return false;
+
+    // Records of previous versions have the same name entry
+    if (!is_moved
+        || (prev_key.size == key.size && memcmp(prev_key.data, key.data, key.size) == 0))
+        return true;
+
+    fdb_data_t const prev_file_key = { prev_key.size, prev_key.data };
 
-        fdb_data_t const file_id = { sizeof info->id, &info->id };
-        fdb_data_t const file_info = { binn_size(binfo), binn_ptr(binfo) };
-        fdb_data_t const file_path = { strlen(info->path), info->path };
+    return fdb_map_del(&files_map->name_ids_map, transaction, &prev_file_key, 0)
+            && fdb_sync_dir_collect(files_map, transaction, prev_dir_id);
+}
 
-        bool ret = fdb_map_put(&files_map->files_map, transaction, &file_id, &file_info)
-                    && fdb_map_put(&files_map->path_ids_map, transaction, &file_path, &file_id);
+bool fdb_sync_file_add_unique(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fsync_file_info_t *info)
+{
+    if (!files_map || !transaction || !info || info->id != FINVALID_ID)
+        return false;
 
-        binn_free(binfo);
+    uint32_t dir_id = FDB_ROOT_DIR_ID;
+    fdb_name_key_t key;
+    size_t len = 0;
 
-        return ret;
+    if (!fdb_sync_file_path_normalize(info, &len)
+        || !fdb_sync_file_key(files_map, transaction, info->path, len, true, &dir_id, &key))
+        return false;
+
+    fdb_data_t const file_key = { key.size, key.data };
+    fdb_data_t file_id = { 0 };
+    uint32_t pending_id = FINVALID_ID;
+
+    if (files_map->bulk_transaction == transaction
+        && fdb_sync_pending_find(&files_map->pending_keys, key.data, key.size, &pending_id))
+        return false;
+
+    if (!fdb_map_get(&files_map->name_ids_map, transaction, &file_key, &file_id))
+    {
+        if (!fdb_id_generate(&files_map->ids_map, transaction, &info->id))
+            return false;
+        return fdb_sync_file_put(files_map, transaction, info, dir_id, &key);
     }
 
     return false;
@@ -252,14 +820,19 @@ bool fdb_sync_file_del(fdb_sync_files_map_t *files_map, fdb_transaction_t *trans
         return false;
 
     fsync_file_info_t info;
-    if (fdb_sync_file_get(files_map, transaction, id, &info))
+    uint32_t dir_id = FDB_ROOT_DIR_ID;
+    fdb_name_key_t key;
+
+    if (fdb_sync_file_get(files_map, transaction, id, &info)
+        && fdb_sync_file_key(files_map, transaction, info.path, strlen(info.path), false, &dir_id, &key))
     {
         fdb_data_t const file_id = { sizeof id, &id };
-        fdb_data_t const file_path = { strlen(info.path), info.path };
+        fdb_data_t const file_key = { key.size, key.data };
 
         return fdb_map_del(&files_map->files_map, transaction, &file_id, 0)
-                && fdb_map_del(&files_map->path_ids_map, transaction, &file_path, 0)
-                && fdb_id_free(&files_map->ids_map, transaction, info.id);
+                && fdb_map_del(&files_map->name_ids_map, transaction, &file_key, 0)
+                && fdb_id_free(&files_map->ids_map, transaction, info.id)
+                && fdb_sync_dir_collect(files_map, transaction, dir_id);
     }
     return false;
 }
@@ -271,17 +844,48 @@ bool fdb_sync_file_get(fdb_sync_files_map_t *files_map, fdb_transaction_t *trans
     info->id = id;
     fdb_data_t const file_id = { sizeof id, &id };
     fdb_data_t file_info = { 0 };
-    return fdb_map_get(&files_map->files_map, transaction, &file_id, &file_info)
-            && fdb_file_info_unmarshal(info, file_info.data);
+    uint32_t dir_id = FDB_ROOT_DIR_ID;
+
+    if (!fdb_map_get(&files_map->files_map, transaction, &file_id, &file_info)
+        || !fdb_file_info_unmarshal(info, &dir_id, file_info.data))
+        return false;
+
+    if (dir_id == FDB_ROOT_DIR_ID)
+        return true;
+
+    char name[FMAX_FILENAME + 1];
+    strncpy(name, info->path, sizeof name);
+    name[sizeof name - 1] = 0;
+
+    size_t len = 0;
+    if (!fdb_sync_dir_path(files_map, transaction, dir_id, info->path, sizeof info->path, &len))
+        return false;
+
+    size_t const name_len = strlen(name);
+    if (len + name_len >= sizeof info->path)
+    {
+        FS_ERR("Path is too long");
+        return false;
+    }
+    memcpy(info->path + len, name, name_len + 1);
+
+    return true;
 }
 
 bool fdb_sync_file_id(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, size_t const size, uint32_t *id)
 {
     if (!files_map || !transaction || !path || !id)
         return false;
-    fdb_data_t const file_path = { size, (void*)path };
+
+    uint32_t dir_id = FDB_ROOT_DIR_ID;
+    fdb_name_key_t key;
+
+    if (!fdb_sync_file_key(files_map, transaction, path, size, false, &dir_id, &key))
+        return false;
+
+    fdb_data_t const file_key = { key.size, key.data };
     fdb_data_t file_id = { 0 };
-    if (fdb_map_get(&files_map->path_ids_map, transaction, &file_path, &file_id))
+    if (fdb_map_get(&files_map->name_ids_map, transaction, &file_key, &file_id))
     {
         *id = *(uint32_t*)file_id.data;
         return true;
@@ -318,16 +922,159 @@ bool fdb_sync_file_path(fdb_sync_files_map_t *files_map, fdb_transaction_t *tran
     return false;
 }
 
+/*
+ * Files were identified by the full path in "/sync/file/path/id" by previous versions.
+ * Such files are moved into the directory tree and the old map is deleted.
+ */
+static bool fdb_sync_files_migrate(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fuuid_t const *uuid)
+{
+    char path_ids_tbl_name[sizeof(fuuid_t) * 2 + sizeof TBL_SYNC_FILE_PATH_ID] = { 0 };
+    fdb_tbl_name(uuid, path_ids_tbl_name, sizeof path_ids_tbl_name, TBL_SYNC_FILE_PATH_ID);
+
+    fdb_map_t path_ids_map = { 0 };
+    if (!fdb_map_open(transaction, path_ids_tbl_name, 0, &path_ids_map))
+        return true;
+
+    fdb_cursor_t cursor = { 0 };
+    bool ret = fdb_cursor_open(&path_ids_map, transaction, &cursor);
+
+    if (ret)
+    {
+        fdb_data_t path = { 0 };
+        fdb_data_t file_id = { 0 };
+
+        for (bool st = fdb_cursor_get(&cursor, &path, &file_id, FDB_FIRST);
+             st && ret;
+             st = fdb_cursor_get(&cursor, &path, &file_id, FDB_NEXT))
+        {
+            fsync_file_info_t info = { 0 };
+            ret = fdb_sync_file_get(files_map, transaction, *(uint32_t*)file_id.data, &info)
+                    && fdb_sync_file_add(files_map, transaction, &info);
+        }
+
+        fdb_cursor_close(&cursor);
+    }
+
+    ret = ret && fdb_map_drop(&path_ids_map, transaction);
+
+    fdb_map_close(&path_ids_map);
+
+    return ret;
+}
+
+bool fdb_sync_dir_id(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, size_t const size, uint32_t *id)
+{
+    if (!files_map || !transaction || !path || !id)
+        return false;
+
+    char const *name = 0;
+    if (!fdb_sync_path_resolve(files_map, transaction, path, size, false, id, &name))
+        return false;
+
+    return name == path + size
+            || fdb_sync_subdir(files_map, transaction, *id, name, path + size - name, false, id);
+}
+
+// The last existing directory of the path. New directories of the path are created under it.
+static uint32_t fdb_sync_path_last_dir(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, size_t size)
+{
+    uint32_t id = FDB_ROOT_DIR_ID;
+    char const *p = path;
+
+    for (char const *ch = path; ch < path + size; ++ch)
+    {
+        if (*ch != '/' && *ch != '\\')
+            continue;
+        if (ch > p
+            && !fdb_sync_subdir(files_map, transaction, id, p, ch - p, false, &id))
+            break;
+        p = ch + 1;
+    }
+
+    return id;
+}
+
+// Checks that the directory is in the subtree. The broken tree is taken as the subtree, so nothing is moved into it.
+static bool fdb_sync_dir_is_in_subtree(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, uint32_t subtree_id, uint32_t dir_id)
+{
+    while (dir_id != subtree_id)
+    {
+        if (dir_id == FDB_ROOT_DIR_ID)
+            return false;
+
+        fdb_data_t const id = { sizeof dir_id, &dir_id };
+        fdb_data_t dir_key = { 0 };
+
+        if (!fdb_map_get(&files_map->dirs_map, transaction, &id, &dir_key))
+        {
+            FS_ERR("DB consistency is broken");
+            return true;
+        }
+
+        dir_id = fdb_name_key_dir(&dir_key);
+    }
+
+    return true;
+}
+
+bool fdb_sync_dir_move(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, char const *new_path)
+{
+    if (!files_map || !transaction || !path || !new_path)
+        return false;
+
+    uint32_t parent_id = FDB_ROOT_DIR_ID;
+    uint32_t new_parent_id = FDB_ROOT_DIR_ID;
+    fdb_name_key_t key, new_key;
+    char dir_path[FMAX_PATH], new_dir_path[FMAX_PATH];
+    size_t len = 0, new_len = 0;
+
+    if (!fdb_sync_dir_path_normalize(path, dir_path, sizeof dir_path, &len)
+        || !fdb_sync_dir_path_normalize(new_path, new_dir_path, sizeof new_dir_path, &new_len)
+        || !fdb_sync_file_key(files_map, transaction, dir_path, len, false, &parent_id, &key))
+        return false;
+
+    fdb_data_t const dir_key = { key.size, key.data };
+    fdb_data_t value = { 0 };
+
+    if (!fdb_map_get(&files_map->dir_tree_map, transaction, &dir_key, &value))
+        return false;
+
+    uint32_t dir_id = *(uint32_t*)value.data;
+    fdb_data_t const id = { sizeof dir_id, &dir_id };
+
+    // The directory can't be moved into own subtree, otherwise the tree gets a cycle
+    if (fdb_sync_dir_is_in_subtree(files_map, transaction, dir_id, fdb_sync_path_last_dir(files_map, transaction, new_dir_path, new_len)))
+    {
+        FS_ERR("Directory can't be moved into own subtree");
+        return false;
+    }
+
+    if (!fdb_sync_file_key(files_map, transaction, new_dir_path, new_len, true, &new_parent_id, &new_key))
+        return false;
+
+    fdb_data_t const new_dir_key = { new_key.size, new_key.data };
+
+    // Files and subdirectories are linked by directory id. Only the directory entry is changed.
+    return fdb_map_put_unique(&files_map->dir_tree_map, transaction, &new_dir_key, &id)
+            && fdb_map_del(&files_map->dir_tree_map, transaction, &dir_key, 0)
+            && fdb_map_put(&files_map->dirs_map, transaction, &id, &new_dir_key)
+            && fdb_sync_dir_collect(files_map, transaction, parent_id);
+}
+
 struct fdb_sync_files_iterator
 {
     fdb_transaction_t       *transaction;
     fdb_sync_files_map_t    *files_map;
     fdb_cursor_t             cursor;
+    fvector_t               *dirs;          // Directories for subtree iteration. It's null for iteration over all files.
+    uint32_t                 root_dir_id;   // Subtree root directory
+    uint32_t                 dir_id;        // Current directory
 };
 
 struct fdb_sync_files_diff_iterator
 {
-    fdb_transaction_t       *transaction;
+    fdb_transaction_t       *transaction_1;
+    fdb_transaction_t       *transaction_2;
     fdb_sync_files_map_t    *files_map_1;
     fdb_sync_files_map_t    *files_map_2;
     fdb_cursor_t             cursor;
@@ -349,8 +1096,33 @@ fdb_sync_files_iterator_t *fdb_sync_files_iterator(fdb_sync_files_map_t *files_m
     piterator->transaction = transaction;
     piterator->files_map = fdb_sync_files_retain(files_map);
 
-    if (!fdb_cursor_open(&files_map->path_ids_map, transaction, &piterator->cursor))
+    if (!fdb_cursor_open(&files_map->name_ids_map, transaction, &piterator->cursor))
+    {
+        fdb_sync_files_iterator_free(piterator);
+        return 0;
+    }
+
+    return piterator;
+}
+
+fdb_sync_files_iterator_t *fdb_sync_files_subtree_iterator(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *dir)
+{
+    if (!files_map || !transaction || !dir)
+        return 0;
+
+    uint32_t dir_id = FDB_ROOT_DIR_ID;
+    if (!fdb_sync_dir_id(files_map, transaction, dir, strlen(dir), &dir_id))
+        return 0;
+
+    fdb_sync_files_iterator_t *piterator = fdb_sync_files_iterator(files_map, transaction);
+    if (!piterator)
+        return 0;
+
+    piterator->root_dir_id = dir_id;
+    piterator->dirs = fvector(sizeof(uint32_t), 0, 64);
+    if (!piterator->dirs)
     {
+        FS_ERR("Unable to allocate memory for sync files iterator");
         fdb_sync_files_iterator_free(piterator);
         return 0;
     }
@@ -364,19 +1136,95 @@ void fdb_sync_files_iterator_free(fdb_sync_files_iterator_t *piterator)
     {
         fdb_sync_files_release(piterator->files_map);
         fdb_cursor_close(&piterator->cursor);
+        if (piterator->dirs)
+            fvector_release(piterator->dirs);
         free(piterator);
     }
 }
 
+// Takes the next directory of subtree and adds its subdirectories into the directories list
+static bool fdb_sync_files_iterator_next_dir(fdb_sync_files_iterator_t *piterator)
+{
+    size_t const dirs_num = fvector_size(piterator->dirs);
+    if (!dirs_num)
+        return false;
+
+    piterator->dir_id = *(uint32_t*)fvector_at(piterator->dirs, dirs_num - 1);
+    fvector_pop_back(&piterator->dirs);
+
+    fdb_cursor_t cursor = { 0 };
+    if (!fdb_cursor_open(&piterator->files_map->dir_tree_map, piterator->transaction, &cursor))
+        return false;
+
+    fdb_name_key_t key;
+    fdb_name_key(&key, piterator->dir_id, "", 0);
+
+    fdb_data_t dir_key = { key.size, key.data };
+    fdb_data_t dir_id = { 0 };
+
+    bool ret = true;
+
+    for (bool st = fdb_cursor_get(&cursor, &dir_key, &dir_id, FDB_SET_RANGE);
+         st && fdb_name_key_dir(&dir_key) == piterator->dir_id;
+         st = fdb_cursor_get(&cursor, &dir_key, &dir_id, FDB_NEXT))
+    {
+        if (!fvector_push_back(&piterator->dirs, dir_id.data))
+        {
+            FS_ERR("Unable to allocate memory for directories list");
+            ret = false;
+            break;
+        }
+    }
+
+    fdb_cursor_close(&cursor);
+
+    return ret;
+}
+
+static bool fdb_sync_files_subtree_iterator_get(fdb_sync_files_iterator_t *piterator, fsync_file_info_t *info, bool first)
+{
+    fdb_data_t file_key = { 0 };
+    fdb_data_t file_id = { 0 };
+
+    bool st = false;
+
+    if (first)
+    {
+        fvector_clear(&piterator->dirs);
+        if (!fvector_push_back(&piterator->dirs, &piterator->root_dir_id))
+            return false;
+    }
+    else
+        st = fdb_cursor_get(&piterator->cursor, &file_key, &file_id, FDB_NEXT);
+
+    while (!st || fdb_name_key_dir(&file_key) != piterator->dir_id)
+    {
+        if (!fdb_sync_files_iterator_next_dir(piterator))
+            return false;
+
+        fdb_name_key_t key;
+        fdb_name_key(&key, piterator->dir_id, "", 0);
+        file_key.size = key.size;
+        file_key.data = key.data;
+
+        st = fdb_cursor_get(&piterator->cursor, &file_key, &file_id, FDB_SET_RANGE);
+    }
+
+    return fdb_sync_file_get(piterator->files_map, piterator->transaction, *(uint32_t*)file_id.data, info);
+}
+
 bool fdb_sync_files_iterator_first(fdb_sync_files_iterator_t *piterator, fsync_file_info_t *info)
 {
     if (!piterator || !info)
         return false;
 
-    fdb_data_t file_path = { 0 };
+    if (piterator->dirs)
+        return fdb_sync_files_subtree_iterator_get(piterator, info, true);
+
+    fdb_data_t file_key = { 0 };
     fdb_data_t file_id = { 0 };
 
-    return fdb_cursor_get(&piterator->cursor, &file_path, &file_id, FDB_FIRST)
+    return fdb_cursor_get(&piterator->cursor, &file_key, &file_id, FDB_FIRST)
             && fdb_sync_file_get(piterator->files_map, piterator->transaction, *(uint32_t*)file_id.data, info);
 }
 
@@ -385,16 +1233,24 @@ bool fdb_sync_files_iterator_next(fdb_sync_files_iterator_t *piterator, fsync_fi
     if (!piterator || !info)
         return false;
 
-    fdb_data_t file_path = { 0 };
+    if (piterator->dirs)
+        return fdb_sync_files_subtree_iterator_get(piterator, info, false);
+
+    fdb_data_t file_key = { 0 };
     fdb_data_t file_id = { 0 };
 
-    return fdb_cursor_get(&piterator->cursor, &file_path, &file_id, FDB_NEXT)
+    return fdb_cursor_get(&piterator->cursor, &file_key, &file_id, FDB_NEXT)
             && fdb_sync_file_get(piterator->files_map, piterator->transaction, *(uint32_t*)file_id.data, info);
 }
 
 fdb_sync_files_diff_iterator_t *fdb_sync_files_diff_iterator(fdb_sync_files_map_t *map_1, fdb_sync_files_map_t *map_2, fdb_transaction_t *transaction)
 {
-    if (!transaction || !map_1 || !map_2)
+    return fdb_sync_files_diff_iterator_ex(map_1, transaction, map_2, transaction);
+}
+
+fdb_sync_files_diff_iterator_t *fdb_sync_files_diff_iterator_ex(fdb_sync_files_map_t *map_1, fdb_transaction_t *transaction_1, fdb_sync_files_map_t *map_2, fdb_transaction_t *transaction_2)
+{
+    if (!transaction_1 || !transaction_2 || !map_1 || !map_2)
         return 0;
 
     fdb_sync_files_diff_iterator_t *piterator = malloc(sizeof(fdb_sync_files_diff_iterator_t));
@@ -405,11 +1261,12 @@ fdb_sync_files_diff_iterator_t *fdb_sync_files_diff_iterator(fdb_sync_files_map_
     }
     memset(piterator, 0, sizeof *piterator);
 
-    piterator->transaction = transaction;
+    piterator->transaction_1 = transaction_1;
+    piterator->transaction_2 = transaction_2;
     piterator->files_map_1 = fdb_sync_files_retain(map_1);
     piterator->files_map_2 = fdb_sync_files_retain(map_2);
 
-    if (!fdb_cursor_open(&map_1->path_ids_map, transaction, &piterator->cursor))
+    if (!fdb_cursor_open(&map_1->name_ids_map, transaction_1, &piterator->cursor))
     {
         fdb_sync_files_diff_iterator_free(piterator);
         return 0;
@@ -429,97 +1286,52 @@ void fdb_sync_files_diff_iterator_free(fdb_sync_files_diff_iterator_t *piterator
     }
 }
 
-bool fdb_sync_files_diff_iterator_first(fdb_sync_files_diff_iterator_t *piterator, fsync_file_info_t *info, fdb_diff_kind_t *diff_kind)
+static bool fdb_sync_files_diff_iterator_get(fdb_sync_files_diff_iterator_t *piterator, fsync_file_info_t *info, fdb_diff_kind_t *diff_kind, fdb_cursor_op_t op)
 {
-    if (!piterator || !info)
-        return false;
-
-    fdb_data_t file_path_1 = { 0 };
+    fdb_data_t file_key_1 = { 0 };
     fdb_data_t file_id_1 = { 0 };
 
-    bool first = true;
-
-    while (fdb_cursor_get(&piterator->cursor, &file_path_1, &file_id_1, first ? FDB_FIRST : FDB_NEXT))
+    while (fdb_cursor_get(&piterator->cursor, &file_key_1, &file_id_1, op))
     {
-        uint32_t id_2 = FINVALID_ID;
+        op = FDB_NEXT;
 
-        if (!fdb_sync_file_id(piterator->files_map_2, piterator->transaction, (char const*)file_path_1.data, file_path_1.size, &id_2))
+        // Directory ids are different for different maps. The file is found by path.
+        if (!fdb_sync_file_get(piterator->files_map_1, piterator->transaction_1, *(uint32_t*)file_id_1.data, info))
+        {
+            FS_ERR("DB consistency is broken");
+            return false;
+        }
+
+        fsync_file_info_t info_2 = { 0 };
+
+        if (!fdb_sync_file_get_by_path(piterator->files_map_2, piterator->transaction_2, info->path, strlen(info->path), &info_2))
         {
-            if (!fdb_sync_file_get(piterator->files_map_1, piterator->transaction, *(uint32_t*)file_id_1.data, info))
-            {
-                FS_ERR("DB consistency is broken");
-                return false;
-            }
             if (diff_kind)
                 *diff_kind = FDB_FILE_ABSENT;
             return true;
         }
-        else
-        {
-            fsync_file_info_t info_2 = { 0 };
 
-            if (!fdb_sync_file_get(piterator->files_map_2, piterator->transaction, id_2, &info_2)
-                || !fdb_sync_file_get(piterator->files_map_1, piterator->transaction, *(uint32_t*)file_id_1.data, info))
-            {
-                FS_ERR("DB consistency is broken");
-                return false;
-            }
-            if (memcmp(&info->digest, &info_2.digest, sizeof info->digest) != 0)
-            {
-                if (diff_kind)
-                    *diff_kind = FDB_DIFF_CONTENT;
-                return true;
-            }
+        if (memcmp(&info->digest, &info_2.digest, sizeof info->digest) != 0)
+        {
+            if (diff_kind)
+                *diff_kind = FDB_DIFF_CONTENT;
+            return true;
         }
-
-        first = false;
     }
 
     return false;
+}
 
+bool fdb_sync_files_diff_iterator_first(fdb_sync_files_diff_iterator_t *piterator, fsync_file_info_t *info, fdb_diff_kind_t *diff_kind)
+{
+    if (!piterator || !info)
+        return false;
+    return fdb_sync_files_diff_iterator_get(piterator, info, diff_kind, FDB_FIRST);
 }
 
 bool fdb_sync_files_diff_iterator_next(fdb_sync_files_diff_iterator_t *piterator, fsync_file_info_t *info, fdb_diff_kind_t *diff_kind)
 {
     if (!piterator || !info)
         return false;
-
-    fdb_data_t file_path_1 = { 0 };
-    fdb_data_t file_id_1 = { 0 };
-
-    while (fdb_cursor_get(&piterator->cursor, &file_path_1, &file_id_1, FDB_NEXT))
-    {
-        uint32_t id_2 = FINVALID_ID;
-
-        if (!fdb_sync_file_id(piterator->files_map_2, piterator->transaction, (char const*)file_path_1.data, file_path_1.size, &id_2))
-        {
-            if (!fdb_sync_file_get(piterator->files_map_1, piterator->transaction, *(uint32_t*)file_id_1.data, info))
-            {
-                FS_ERR("DB consistency is broken");
-                return false;
-            }
-            if (diff_kind)
-                *diff_kind = FDB_FILE_ABSENT;
-            return true;
-        }
-        else
-        {
-            fsync_file_info_t info_2 = { 0 };
-
-            if (!fdb_sync_file_get(piterator->files_map_2, piterator->transaction, id_2, &info_2)
-                || !fdb_sync_file_get(piterator->files_map_1, piterator->transaction, *(uint32_t*)file_id_1.data, info))
-            {
-                FS_ERR("DB consistency is broken");
-                return false;
-            }
-            if (memcmp(&info->digest, &info_2.digest, sizeof info->digest) != 0)
-            {
-                if (diff_kind)
-                    *diff_kind = FDB_DIFF_CONTENT;
-                return true;
-            }
-        }
-    }
-
-    return false;
+    return fdb_sync_files_diff_iterator_get(piterator, info, diff_kind, FDB_NEXT);
 }
@@ -7,6 +7,8 @@
 #include "../db.h"
 #include "ids.h"
 
+#define FDB_ROOT_DIR_ID FINVALID_ID     // The root directory has no record in DB
+
 typedef enum
 {
     FFILE_IS_EXIST              = 1 << 0,
@@ -33,8 +35,21 @@ fdb_sync_files_map_t *fdb_sync_files_ex(fdb_transaction_t *transaction, fuuid_t
 fdb_sync_files_map_t *fdb_sync_files_retain(fdb_sync_files_map_t *files_map);
 void                  fdb_sync_files_release(fdb_sync_files_map_t *files_map);
 
+/*
+ * Bulk mode is used for the initial scan. New files infos are accumulated and inserted in sorted order at finish.
+ * Files added in bulk mode aren't visible in the transaction until finish, only the same path added again gets its id.
+ * Bulk mode should be finished before the transaction commit.
+ */
+bool fdb_sync_files_bulk_start(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction);
+bool fdb_sync_files_bulk_finish(fdb_sync_files_map_t *files_map);
+bool fdb_sync_files_is_empty(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction);
+
 bool fdb_sync_files_statuses(fdb_transaction_t *transaction, fuuid_t const *uuid, fdb_map_t *pmap);
 
+/*
+ * Both '/' and '\\' are path separators. Paths are stored in the normalized form: separators are '/', leading and
+ * repeated separators are dropped. Added files get the normalized path in info->path. Files are found by any form.
+ */
 bool fdb_sync_file_add(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fsync_file_info_t *info);
 bool fdb_sync_file_add_unique(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, fsync_file_info_t *info);
 bool fdb_sync_file_del(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, uint32_t id);
@@ -43,6 +58,8 @@ bool fdb_sync_file_id(fdb_sync_files_map_t *files_map, fdb_transaction_t *transa
 bool fdb_sync_file_get_by_path(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, size_t const size, fsync_file_info_t *info);
 bool fdb_sync_file_del_all(fuuid_t const *uuid);
 bool fdb_sync_file_path(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, uint32_t id, char *path, size_t size);
+bool fdb_sync_dir_id(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, size_t const size, uint32_t *id);
+bool fdb_sync_dir_move(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *path, char const *new_path);  // Paths are normalized, the trailing separator is allowed
 
 typedef enum
 {
@@ -51,11 +68,13 @@ typedef enum
 } fdb_diff_kind_t;
 
 fdb_sync_files_iterator_t *fdb_sync_files_iterator(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction);
+fdb_sync_files_iterator_t *fdb_sync_files_subtree_iterator(fdb_sync_files_map_t *files_map, fdb_transaction_t *transaction, char const *dir);
 void                       fdb_sync_files_iterator_free(fdb_sync_files_iterator_t *);
 bool                       fdb_sync_files_iterator_first(fdb_sync_files_iterator_t *, fsync_file_info_t *);
 bool                       fdb_sync_files_iterator_next(fdb_sync_files_iterator_t *, fsync_file_info_t *);
 
 fdb_sync_files_diff_iterator_t *fdb_sync_files_diff_iterator(fdb_sync_files_map_t *map_1, fdb_sync_files_map_t *map_2, fdb_transaction_t *transaction);
+fdb_sync_files_diff_iterator_t *fdb_sync_files_diff_iterator_ex(fdb_sync_files_map_t *map_1, fdb_transaction_t *transaction_1, fdb_sync_files_map_t *map_2, fdb_transaction_t *transaction_2);   // Maps are in different DB shards
 void                            fdb_sync_files_diff_iterator_free(fdb_sync_files_diff_iterator_t *);
 bool                            fdb_sync_files_diff_iterator_first(fdb_sync_files_diff_iterator_t *, fsync_file_info_t *, fdb_diff_kind_t *);
 bool                            fdb_sync_files_diff_iterator_next(fdb_sync_files_diff_iterator_t *, fsync_file_info_t *, fdb_diff_kind_t *);
@@ -0,0 +1,296 @@
+#include "trigrams.h"
+#include <futils/log.h>
+#include <futils/utils.h>
+#include <fcommon/limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    FDB_TRIGRAMS_QUERY_MAX  = 8     // Only the rarest trigrams of query are intersected
+};
+
+size_t fdb_trigrams_split(char const *str, size_t len, fdb_trigram_t *trigrams, size_t size)
+{
+    size_t num = 0;
+    for (size_t i = 0; i + sizeof trigrams->data <= len && num < size; ++i)
+        memcpy(trigrams[num++].data, str + i, sizeof trigrams->data);
+    return num;
+}
+
+static int fdb_trigram_cmp(void const *lhs, void const *rhs)
+{
+    return memcmp(lhs, rhs, sizeof(fdb_trigram_t));
+}
+
+static size_t fdb_trigrams_unique(fdb_trigram_t *trigrams, size_t num)
+{
+    if (num < 2)
+        return num;
+
+    qsort(trigrams, num, sizeof *trigrams, fdb_trigram_cmp);
+
+    size_t n = 1;
+    for (size_t i = 1; i < num; ++i)
+    {
+        if (fdb_trigram_cmp(trigrams + i, trigrams + n - 1) != 0)
+            trigrams[n++] = trigrams[i];
+    }
+
+    return n;
+}
+
+bool fdb_trigrams_map_open(fdb_transaction_t *transaction, char const *tbl, fdb_map_t *pmap)
+{
+    if (!transaction || !tbl || !pmap)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    if (!fdb_map_open(transaction, tbl, FDB_MAP_CREATE | FDB_MAP_MULTI | FDB_MAP_FIXED_SIZE_VALUE | FDB_MAP_INTEGERVAL, pmap))
+    {
+        FS_ERR("Map wasn't created");
+        return false;
+    }
+
+    return true;
+}
+
+bool fdb_trigrams_map_add(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t id, char const *str, size_t len)
+{
+    if (!pmap || !transaction || !str)
+        return false;
+
+    fdb_trigram_t trigrams[FMAX_PATH];
+    size_t const num = fdb_trigrams_unique(trigrams, fdb_trigrams_split(str, len, trigrams, FARRAY_SIZE(trigrams)));
+
+    fdb_data_t const value = { sizeof id, &id };
+
+    for (size_t i = 0; i < num; ++i)
+    {
+        fdb_data_t const key = { sizeof trigrams[i].data, trigrams[i].data };
+        if (!fdb_map_put(pmap, transaction, &key, &value))
+            return false;
+    }
+
+    return true;
+}
+
+typedef struct
+{
+    fdb_trigram_t   trigram;
+    fdb_cursor_t    cursor;
+    size_t          count;          // Number of ids in the posting list
+    uint32_t const *ids;            // Page of ids which is loaded by the cursor
+    size_t          ids_num;
+    size_t          pos;            // Current id in the page
+} fdb_trigram_posting_t;
+
+struct fdb_trigrams_map_iterator
+{
+    bool                    is_empty;
+    size_t                  num;
+    fdb_trigram_posting_t   postings[FDB_TRIGRAMS_QUERY_MAX];
+};
+
+static int fdb_trigram_posting_cmp(void const *lhs, void const *rhs)
+{
+    size_t const lcount = ((fdb_trigram_posting_t const *)lhs)->count;
+    size_t const rcount = ((fdb_trigram_posting_t const *)rhs)->count;
+    return lcount < rcount ? -1 : lcount > rcount;
+}
+
+fdb_trigrams_map_iterator_t *fdb_trigrams_map_iterator(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_trigram_t const *trigrams, size_t num)
+{
+    if (!pmap || !transaction || !trigrams || !num)
+        return 0;
+
+    fdb_trigram_t *query = malloc(num * sizeof *query);
+    if (!query)
+    {
+        FS_ERR("Unable to allocate memory for query");
+        return 0;
+    }
+    memcpy(query, trigrams, num * sizeof *query);
+    num = fdb_trigrams_unique(query, num);
+
+    fdb_trigrams_map_iterator_t *piterator = malloc(sizeof(fdb_trigrams_map_iterator_t));
+    if (!piterator)
+    {
+        FS_ERR("Unable to allocate memory for iterator");
+        free(query);
+        return 0;
+    }
+    memset(piterator, 0, sizeof *piterator);
+
+    // The rarest trigrams are selected. The shortest posting list drives the intersection.
+    for (size_t i = 0; i < num && !piterator->is_empty; ++i)
+    {
+        fdb_trigram_posting_t posting = { query[i] };
+
+        if (!fdb_cursor_open(pmap, transaction, &posting.cursor))
+        {
+            fdb_trigrams_map_iterator_free(piterator);
+            free(query);
+            return 0;
+        }
+
+        fdb_data_t key = { sizeof posting.trigram.data, posting.trigram.data };
+        fdb_data_t value = { 0 };
+
+        if (!fdb_cursor_get(&posting.cursor, &key, &value, FDB_SET)
+            || !fdb_cursor_count(&posting.cursor, &posting.count))
+        {
+            piterator->is_empty = true;
+            fdb_cursor_close(&posting.cursor);
+            break;
+        }
+
+        if (piterator->num < FDB_TRIGRAMS_QUERY_MAX)
+            piterator->postings[piterator->num++] = posting;
+        else
+        {
+            fdb_trigram_posting_t *most_frequent = &piterator->postings[0];
+            for (size_t j = 1; j < piterator->num; ++j)
+            {
+                if (piterator->postings[j].count > most_frequent->count)
+                    most_frequent = &piterator->postings[j];
+            }
+
+            if (posting.count < most_frequent->count)
+            {
+                fdb_cursor_close(&most_frequent->cursor);
+                *most_frequent = posting;
+            }
+            else
+                fdb_cursor_close(&posting.cursor);
+        }
+    }
+
+    free(query);
+
+    qsort(piterator->postings, piterator->num, sizeof *piterator->postings, fdb_trigram_posting_cmp);
+
+    return piterator;
+}
+
+void fdb_trigrams_map_iterator_free(fdb_trigrams_map_iterator_t *piterator)
+{
+    if (piterator)
+    {
+        for (size_t i = 0; i < piterator->num; ++i)
+            fdb_cursor_close(&piterator->postings[i].cursor);
+        free(piterator);
+    }
+}
+
+static bool fdb_trigram_posting_load(fdb_trigram_posting_t *posting, fdb_cursor_op_t op)
+{
+    fdb_data_t key = { sizeof posting->trigram.data, posting->trigram.data };
+    fdb_data_t values = { 0 };
+
+    if (!fdb_cursor_get_multiple(&posting->cursor, &key, &values, op)
+        || values.size < sizeof *posting->ids)
+        return false;
+
+    posting->ids = (uint32_t const *)values.data;
+    posting->ids_num = values.size / sizeof *posting->ids;
+    posting->pos = 0;
+
+    return true;
+}
+
+static bool fdb_trigram_posting_next(fdb_trigram_posting_t *posting, uint32_t *id)
+{
+    if (++posting->pos >= posting->ids_num
+        && !fdb_trigram_posting_load(posting, FDB_NEXT_DUP))
+        return false;
+    *id = posting->ids[posting->pos];
+    return true;
+}
+
+// Moves to the first id which is greater or equal to the given one
+static bool fdb_trigram_posting_seek(fdb_trigram_posting_t *posting, uint32_t *id)
+{
+    if (!posting->ids_num || posting->ids[posting->ids_num - 1] < *id)
+    {
+        // The id isn't in the loaded page. The cursor is moved to the page which contains it.
+        fdb_data_t key = { sizeof posting->trigram.data, posting->trigram.data };
+        fdb_data_t value = { sizeof *id, id };
+        if (!fdb_cursor_get(&posting->cursor, &key, &value, FDB_GET_BOTH_RANGE)
+            || !fdb_trigram_posting_load(posting, FDB_CURRENT))
+        {
+            posting->ids_num = 0;
+            return false;
+        }
+    }
+
+    // Binary search of id in the page
+    size_t lo = posting->pos, hi = posting->ids_num;
+    while (lo < hi)
+    {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (posting->ids[mid] < *id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo >= posting->ids_num)
+        return false;
+
+    posting->pos = lo;
+    *id = posting->ids[lo];
+
+    return true;
+}
+
+static bool fdb_trigrams_map_iterator_get(fdb_trigrams_map_iterator_t *piterator, uint32_t candidate, uint32_t *id)
+{
+    // Leapfrog intersection of posting lists
+    for (size_t i = 1; i < piterator->num;)
+    {
+        uint32_t next = candidate;
+        if (!fdb_trigram_posting_seek(&piterator->postings[i], &next))
+            return false;
+
+        if (next == candidate)
+        {
+            ++i;
+            continue;
+        }
+
+        if (!fdb_trigram_posting_seek(&piterator->postings[0], &next))
+            return false;
+
+        candidate = next;
+        i = 1;
+    }
+
+    *id = candidate;
+
+    return true;
+}
+
+bool fdb_trigrams_map_iterator_first(fdb_trigrams_map_iterator_t *piterator, uint32_t *id)
+{
+    if (!piterator || !id || piterator->is_empty || !piterator->num)
+        return false;
+
+    fdb_trigram_posting_t *posting = &piterator->postings[0];
+
+    return fdb_trigram_posting_load(posting, FDB_SET)
+            && fdb_trigrams_map_iterator_get(piterator, posting->ids[0], id);
+}
+
+bool fdb_trigrams_map_iterator_next(fdb_trigrams_map_iterator_t *piterator, uint32_t *id)
+{
+    if (!piterator || !id || piterator->is_empty || !piterator->num)
+        return false;
+
+    uint32_t candidate;
+
+    return fdb_trigram_posting_next(&piterator->postings[0], &candidate)
+            && fdb_trigrams_map_iterator_get(piterator, candidate, id);
+}
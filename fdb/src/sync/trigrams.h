@@ -0,0 +1,30 @@
+#ifndef FSYNC_TRIGRAMS_H_FDB
+#define FSYNC_TRIGRAMS_H_FDB
+#include "../db.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Inverted index of trigrams: each 3-byte substring of a string -> sorted list of ids.
+ * Query returns ids which contain all given trigrams. These ids are candidates only, the caller verifies them.
+ */
+
+typedef struct
+{
+    uint8_t data[3];
+} fdb_trigram_t;
+
+typedef struct fdb_trigrams_map_iterator fdb_trigrams_map_iterator_t;
+
+size_t fdb_trigrams_split(char const *str, size_t len, fdb_trigram_t *trigrams, size_t size);    // Returns the number of trigrams
+
+bool fdb_trigrams_map_open(fdb_transaction_t *transaction, char const *tbl, fdb_map_t *pmap);
+bool fdb_trigrams_map_add(fdb_map_t *pmap, fdb_transaction_t *transaction, uint32_t id, char const *str, size_t len);
+
+fdb_trigrams_map_iterator_t *fdb_trigrams_map_iterator(fdb_map_t *pmap, fdb_transaction_t *transaction, fdb_trigram_t const *trigrams, size_t num);
+void                         fdb_trigrams_map_iterator_free(fdb_trigrams_map_iterator_t *);
+bool                         fdb_trigrams_map_iterator_first(fdb_trigrams_map_iterator_t *, uint32_t *id);
+bool                         fdb_trigrams_map_iterator_next(fdb_trigrams_map_iterator_t *, uint32_t *id);
+
+#endif
@@ -57,21 +57,27 @@ static bool filink_add_node2db(filink_t *ilink, fnet_client_t *pclient, fuuid_t
     fdb_node_info_t node_info;
     strncpy(node_info.address, addr, sizeof node_info.address);
 
+    bool ret = false;
+
     fdb_transaction_t transaction = { 0 };
-    if (fdb_transaction_start(ilink->db, &transaction))
+    do
     {
-        fdb_nodes_t *nodes = fdb_nodes(&transaction);
-        if (nodes)
+        if (fdb_transaction_start(ilink->db, &transaction))
         {
-            fdb_node_add(nodes, &transaction, uuid, &node_info);
-            fdb_transaction_commit(&transaction);
-            fdb_nodes_release(nodes);
-            return true;
+            fdb_nodes_t *nodes = fdb_nodes(&transaction);
+            if (nodes)
+            {
+                fdb_node_add(nodes, &transaction, uuid, &node_info);
+                fdb_transaction_commit(&transaction);
+                fdb_nodes_release(nodes);
+                ret = true;
+            }
+            fdb_transaction_abort(&transaction);
         }
-        fdb_transaction_abort(&transaction);
     }
+    while (transaction.error == FERR_AGAIN);
 
-    return false;
+    return ret;
 }
 
 static bool filink_add_node(filink_t *ilink, fnet_client_t *pclient, fuuid_t const *uuid, char const *addr)
@@ -257,10 +263,10 @@ static void filink_msgbus_retain(filink_t *ilink, fmsgbus_t *pmsgbus)
 
 static void filink_msgbus_release(filink_t *ilink)
 {
-    fmsgbus_unsubscribe(ilink->msgbus, FNODE_STATUS,        (fmsg_handler_t)filink_status_handler);
-    fmsgbus_unsubscribe(ilink->msgbus, FSYNC_FILES_LIST,    (fmsg_handler_t)filink_sync_files_list_handler);
-    fmsgbus_unsubscribe(ilink->msgbus, FFILE_PART_REQUEST,  (fmsg_handler_t)filink_file_part_request_handler);
-    fmsgbus_unsubscribe(ilink->msgbus, FFILE_PART,          (fmsg_handler_t)filink_file_part_handler);
+    fmsgbus_unsubscribe(ilink->msgbus, FNODE_STATUS,        (fmsg_handler_t)filink_status_handler, ilink);
+    fmsgbus_unsubscribe(ilink->msgbus, FSYNC_FILES_LIST,    (fmsg_handler_t)filink_sync_files_list_handler, ilink);
+    fmsgbus_unsubscribe(ilink->msgbus, FFILE_PART_REQUEST,  (fmsg_handler_t)filink_file_part_request_handler, ilink);
+    fmsgbus_unsubscribe(ilink->msgbus, FFILE_PART,          (fmsg_handler_t)filink_file_part_handler, ilink);
     fmsgbus_release(ilink->msgbus);
 }
 
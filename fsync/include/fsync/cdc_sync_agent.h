@@ -0,0 +1 @@
+#include "../../src/cdc_sync_agent.h"
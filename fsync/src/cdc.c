@@ -0,0 +1,307 @@
+#include "cdc.h"
+#include <futils/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Normalized chunking. The boundary is harder to find before the average size and easier after it,
+ * so the chunk sizes are concentrated around the average.
+ * The high bits of gear hash depend on the last 64 bytes.
+ */
+static uint64_t const FCDC_MASK_S = 0xFFFFC00000000000ull;     // 18 bits
+static uint64_t const FCDC_MASK_L = 0xFFFC000000000000ull;     // 14 bits
+
+static uint64_t const fcdc_gear[256] =
+{
+    0x63cfc62a2b097592ull, 0xdc0746b419466aecull, 0x08264674f98aa19eull, 0x3ca4eb47b26de7acull,
+    0xa5b384ad339cfcc3ull, 0x08f720d059892bc4ull, 0xfe6675c92d60f3dfull, 0x1d59c7b9c3a56969ull,
+    0xea5685b6014a22c9ull, 0x3935c47ec47e016dull, 0xf72314ef3d87ae57ull, 0xe2c2311ba18cfd93ull,
+    0x509d7011d7bc72c9ull, 0x4cd89b9538c27512ull, 0xa4e38806108a16a3ull, 0x5a469fb3420a4216ull,
+    0x5087cfea06cfae9eull, 0x76efeb82d49fad30ull, 0xa21f990415830cddull, 0xd3cf31c5dd26c237ull,
+    0xb956e4e473a0297full, 0xe297a7e448a0894cull, 0x779da6821d493912ull, 0xd71574055724395dull,
+    0x797e22f607982baeull, 0xfec040b03a7f1e41ull, 0x1f258fad67f64e49ull, 0x4edcddd434469277ull,
+    0xa2053ebd77cb8b08ull, 0x77bf226305265856ull, 0x6de7291eaaa3d085ull, 0x96d7536ea745dffeull,
+    0xf9c6680e94247b49ull, 0xc88219fc9cf0493eull, 0x1e31f2c96f41c928ull, 0x6cfa87ede9c1f270ull,
+    0xa86d434537f8a23aull, 0xa15f376d2bef48d9ull, 0x056617e9f8f42d36ull, 0xf24b9093554cd786ull,
+    0x62d56dafe2bb1e59ull, 0xb06de4502f883955ull, 0xbe4c8d8146c0d0abull, 0x83e66c7205d6af78ull,
+    0x78005fa8d605ded0ull, 0x4b211f6233e98863ull, 0x10451d9d286ab638ull, 0x5bbd90aea8b4b277ull,
+    0x7f7aaeea56d1839aull, 0x65d4894ed4243013ull, 0x6dd3aa78170e9af1ull, 0xd46a9444d3799968ull,
+    0x659a245a5b481f0dull, 0x15652888d3bbc8dfull, 0x8b73fddbce64befaull, 0x0bfca26e4c5fb77aull,
+    0xc4849a2eae8581b2ull, 0xc22dd397e260cd58ull, 0x92f0919f78f49d90ull, 0xecdd8449d5e796dfull,
+    0x7a094a53da9a2011ull, 0x64ff8e701ac6665eull, 0x9a2718ac8690427aull, 0x03fea5f1ffc6cde0ull,
+    0x19b6560a01ad4034ull, 0x896a2ee68edb277aull, 0x6e8e7574571e76e7ull, 0x4f248c2c5923dfb3ull,
+    0xc6a7195479d02d29ull, 0xb78c342f689ed1cdull, 0x3fa86fbc793bcd5cull, 0xc47c1e8411e1296dull,
+    0x5f461bde38862e3cull, 0x15aa1c31a6d3e5d1ull, 0xb59ffeac43eb9bcfull, 0xb33797b80682fb8eull,
+    0x824247e1303df497ull, 0xbda0b7e1a9bd1089ull, 0xa3158ab71d99cd18ull, 0xc25741ecd2ac9fb2ull,
+    0x7173b3d306f6481full, 0x5ff080f221b0ec33ull, 0xb80d9936ef1a2177ull, 0x5bcf5ee0afed6941ull,
+    0x3367cdfc6e91746full, 0x628f06dc67cd8d10ull, 0x9b5d29d3387d8fe0ull, 0x411333c0f55727a3ull,
+    0xe4f21def307bd64aull, 0x654f7e53d53ec6a0ull, 0x6d1c6352b72b2dc1ull, 0xab6b2e6636ab6a4bull,
+    0xb8ac5a495d67c6baull, 0x508634631e16acb4ull, 0xa85baf8d6401dfc2ull, 0x56543e941681858eull,
+    0x13b0bdf6c6aa8016ull, 0x872fe81d3100d87eull, 0x8540d20d3f17e625ull, 0x54bf3b9582ec1c16ull,
+    0xc88ce6672e8b2e5eull, 0x77623f12632777f7ull, 0x7acf9cb3d918c7a5ull, 0xfc7b344706e019a4ull,
+    0xfe4cccc591e759e7ull, 0xc7c8ac08a93f8ab0ull, 0x64e30e0b06f59cf4ull, 0xd92ee107e60c68afull,
+    0x3a61f14615ed3141ull, 0x8526d39f4b866b62ull, 0x2eec4b67d469baeeull, 0x85155e4bb6db5f31ull,
+    0x021329556fd9a48bull, 0xae2f1f8a0c98408dull, 0x5c4abdfdd6b64e09ull, 0x927021ed7998449eull,
+    0x50893fac7a7016fdull, 0x3ba5528718467b16ull, 0x100e72354f14964full, 0x1e951030b91504e8ull,
+    0x58bd6f3415956770ull, 0x4c48f3db2bb9fc97ull, 0xc28ded4d7336172cull, 0xc1c4f6479a92fba1ull,
+    0xedd250179dc037b8ull, 0xa0e9b4476994fe0aull, 0x219722eaa7e134faull, 0x556a34c86b93e559ull,
+    0x9f92cad840db5cd4ull, 0xfa395bc0e72302d7ull, 0xa93864efa11688f6ull, 0x4828b480a7404c16ull,
+    0x009d7b1019146442ull, 0x2aea80dd0fd9a87eull, 0xd2389ae17f520e2dull, 0xcc8b4dc87a435309ull,
+    0x545b2712728e32aeull, 0x01972b2b759f6ca1ull, 0x9af4a0e7048e6ce3ull, 0xcb79e95893453221ull,
+    0xa667c7c7ac044b01ull, 0xc5b96c9e221ffb06ull, 0x3347ca5333568ec8ull, 0x3d4e56d21aa59484ull,
+    0xeae72282cadae561ull, 0x4ab590a506746228ull, 0xd5b666f6221b2e21ull, 0xbc6eb34e99cbe624ull,
+    0x3f5c97563f222382ull, 0x11818c6e8cd33aebull, 0x709257e52d91c95bull, 0x7af8167dd67da46bull,
+    0x6b784107b9444e6aull, 0xe503978988be7f04ull, 0xe6c096a8c4e5cb52ull, 0x2e810f6de7372820ull,
+    0x08815bb43e764d8eull, 0x74c020985b407417ull, 0x9e5bb9d41235ac0cull, 0x69d10c8e2dd755efull,
+    0x206beeee05be9f92ull, 0xed28a35c26976580ull, 0x23fb223998c1dd8dull, 0xe724f92bd60befa0ull,
+    0x39f910450ce8735eull, 0x96865bffb2b5c9bbull, 0xd9d8f838bf600228ull, 0xc900366aafb48b29ull,
+    0xd9d5ec560dc809a8ull, 0xd7d0a6827a0d88a4ull, 0x5e5ee11da7782adcull, 0x741096f1a8fd732bull,
+    0x13f3eca12ff5064aull, 0x974b8dba65a93a66ull, 0x4ea1351f023db3c3ull, 0xda1b38b862ae579bull,
+    0x8ae3429f4a0fab9eull, 0x4cd0b9f748aebc23ull, 0xacb41c40a75220c2ull, 0xecf3d4f5495040b0ull,
+    0xc098556aa4cea858ull, 0x0776c8d915fc64fcull, 0xaaf8ba2cdc7a9d41ull, 0x13262bb0fe9e7bc3ull,
+    0xb2261d77fa704973ull, 0xac195c7faebef934ull, 0xe501763a9bb39601ull, 0x27495d1dd1641751ull,
+    0x119959c9d15cb02eull, 0xd86940cec51602bbull, 0x262826b68c324853ull, 0x1c7a1127e871e1ffull,
+    0x20ca7b07137b11efull, 0xa70a5636b444ce19ull, 0xd8d7f430fb61f097ull, 0x15743fa96d05de00ull,
+    0xa4faf5c42789e8c0ull, 0x8fa54c35ba03f12bull, 0xdbaf39094b328278ull, 0xd7b44dae08633716ull,
+    0xbe8acc13573eaf72ull, 0x415676d069c54cdbull, 0xe24b949be6a04823ull, 0x2c8a22e1dd3ed3e1ull,
+    0x4c27144d40fb62b7ull, 0x463e6279a7b81991ull, 0x604d1ed41aad75dbull, 0xd0432163de9cddd6ull,
+    0xf5c2027b8cd976eeull, 0xb9392320bf1c7771ull, 0x46f091970b73c999ull, 0x9fb9bb13eae132acull,
+    0xe21e99f5a7dbe246ull, 0xe5d30862bd54399cull, 0x868e564b7f8e08e6ull, 0x11ce898c645aff49ull,
+    0xe2f49c19a0015b61ull, 0xf8f99e931a8de3deull, 0x1bdaf88119fd69b7ull, 0xce8783e601c55607ull,
+    0x16cc703cfef765e0ull, 0xef4e3f641578feecull, 0x37b9075045450c0cull, 0x34cc299ac8dc1c30ull,
+    0xa6b0d3b0c86ceddcull, 0xd71694fa3d5e1565ull, 0x077055995940b148ull, 0x59b2da7e56c8d627ull,
+    0x59ff2a088d38836aull, 0x04995a8ab2bf0e6dull, 0x4b47c98bee2b3ee3ull, 0xe57a675401dcf414ull,
+    0xadd6d14802bfade9ull, 0x8beca4e9079b9384ull, 0xa596917bef1f1165ull, 0xa2a0528c085af450ull,
+    0x2b91c70b62ec602bull, 0xba603814703ee279ull, 0x04b0f614f48b56eaull, 0xc6602758585ed9a0ull,
+    0x4ccdfddfad39b91aull, 0xd15fac46dc6ffb91ull, 0x1cf68851db928b8full, 0x0521513088fcf276ull,
+    0x134d10c63384c0e3ull, 0xfd2f46b5ca56299aull, 0xea1d7278d225d8b0ull, 0x22dce3e8a727540eull,
+    0x96f4940d70988c5aull, 0x340a406ccd5405a0ull, 0x14353bd6e3e5914bull, 0x5320667655509344ull,
+    0x2d878acf43dec8e0ull, 0x0d0adcd473afc709ull, 0x7b84eefaa0e98d96ull, 0xced34dd05b9a775aull
+};
+
+size_t fcdc_chunk_size(char const *data, size_t size)
+{
+    if (size <= FCDC_CHUNK_MIN)
+        return size;
+
+    size_t const max_size = size < FCDC_CHUNK_MAX ? size : FCDC_CHUNK_MAX;
+    size_t const normal_size = max_size < FCDC_CHUNK_AVG ? max_size : FCDC_CHUNK_AVG;
+
+    uint8_t const *bytes = (uint8_t const *)data;
+    uint64_t hash = 0;
+    size_t i = FCDC_CHUNK_MIN;
+
+    for (; i < normal_size; ++i)
+    {
+        hash = (hash << 1) + fcdc_gear[bytes[i]];
+        if (!(hash & FCDC_MASK_S))
+            return i + 1;
+    }
+
+    for (; i < max_size; ++i)
+    {
+        hash = (hash << 1) + fcdc_gear[bytes[i]];
+        if (!(hash & FCDC_MASK_L))
+            return i + 1;
+    }
+
+    return max_size;
+}
+
+static bool fcdc_chunk(char const *data, size_t size, uint64_t offset, fcdc_chunk_handler_t handler, void *arg)
+{
+    fcdc_chunk_t chunk = { (uint32_t)size };
+
+    fmd5_context_t ctx;
+    fmd5_init(&ctx);
+    fmd5_update(&ctx, data, (uint32_t)size);
+    fmd5_final(&ctx, &chunk.digest);
+
+    return handler(arg, offset, &chunk);
+}
+
+bool fcdc_chunks(fistream_t *pistream, fcdc_chunk_handler_t handler, void *arg)
+{
+    if (!pistream || !handler)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    uint64_t offset = 0;
+
+    // Memory and mapped data is chunked in place
+    size_t data_size = 0, data_offset = 0;
+    char const *data = fistream_data(pistream, &data_size, &data_offset);
+    if (data)
+    {
+        while (data_offset < data_size)
+        {
+            size_t const size = fcdc_chunk_size(data + data_offset, data_size - data_offset);
+            if (!fcdc_chunk(data + data_offset, size, offset, handler, arg))
+                return false;
+            data_offset += size;
+            offset += size;
+        }
+
+        pistream->seek(pistream, data_size);
+
+        return true;
+    }
+
+    size_t const buf_size = 4 * FCDC_CHUNK_MAX;
+    char *buf = malloc(buf_size);
+    if (!buf)
+    {
+        FS_ERR("Unable to allocate memory for data buffer");
+        return false;
+    }
+
+    bool ret = true;
+    bool is_eof = false;
+    size_t begin = 0, end = 0;
+
+    while (ret && (!is_eof || begin < end))
+    {
+        // The buffer is filled until it contains the maximal chunk
+        if (!is_eof && end - begin < FCDC_CHUNK_MAX)
+        {
+            memmove(buf, buf + begin, end - begin);
+            end -= begin;
+            begin = 0;
+
+            while (!is_eof && end < buf_size)
+            {
+                size_t const read_size = pistream->read(pistream, buf + end, buf_size - end);
+                end += read_size;
+
+                fstream_status_t const status = pistream->status(pistream);
+                if (status == FSTREAM_STATUS_EOF)
+                    is_eof = true;
+                else if (status != FSTREAM_STATUS_OK || !read_size)
+                {
+                    FS_ERR("Data reading was failed");
+                    ret = false;
+                    break;
+                }
+            }
+
+            continue;
+        }
+
+        size_t const size = fcdc_chunk_size(buf + begin, end - begin);
+        ret = fcdc_chunk(buf + begin, size, offset, handler, arg);
+        begin += size;
+        offset += size;
+    }
+
+    free(buf);
+
+    return ret;
+}
+
+/*
+ * The anchor is the position where the high bits of gear hash are zero (one anchor per 256 bytes on average).
+ * The gear hash is mixed because the anchor hashes have the same high bits.
+ */
+static uint64_t const FCDC_SKETCH_ANCHOR_MASK = 0xFF00000000000000ull;
+
+static uint64_t fcdc_mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static void fcdc_sketch_add(fcdc_sketch_t *sketch, uint64_t feature)
+{
+    uint64_t *hashes = sketch->hashes;
+
+    if (feature >= hashes[FSYNC_SKETCH_SIZE - 1])
+        return;
+
+    size_t i = FSYNC_SKETCH_SIZE - 1;
+    while (i > 0 && hashes[i - 1] > feature)
+        --i;
+
+    if (i > 0 && hashes[i - 1] == feature)
+        return;
+
+    memmove(hashes + i + 1, hashes + i, (FSYNC_SKETCH_SIZE - 1 - i) * sizeof *hashes);
+    hashes[i] = feature;
+}
+
+void fcdc_sketch_init(fcdc_sketch_t *sketch)
+{
+    sketch->hash = 0;
+    for (size_t i = 0; i < FSYNC_SKETCH_SIZE; ++i)
+        sketch->hashes[i] = UINT64_MAX;
+}
+
+void fcdc_sketch_update(fcdc_sketch_t *sketch, void const *data, size_t size)
+{
+    uint8_t const *bytes = (uint8_t const *)data;
+    uint64_t hash = sketch->hash;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash << 1) + fcdc_gear[bytes[i]];
+        if (!(hash & FCDC_SKETCH_ANCHOR_MASK))
+            fcdc_sketch_add(sketch, fcdc_mix64(hash));
+    }
+
+    sketch->hash = hash;
+}
+
+bool fcdc_sketch_calculate(fistream_t *pistream, fcdc_sketch_t *sketch)
+{
+    if (!pistream || !sketch)
+    {
+        FS_ERR("Invalid arguments");
+        return false;
+    }
+
+    fcdc_sketch_init(sketch);
+
+    size_t data_size = 0, data_offset = 0;
+    char const *data = fistream_data(pistream, &data_size, &data_offset);
+    if (data)
+    {
+        fcdc_sketch_update(sketch, data + data_offset, data_size - data_offset);
+        pistream->seek(pistream, data_size);
+        return true;
+    }
+
+    size_t const buf_size = FCDC_CHUNK_AVG;
+    char *buf = malloc(buf_size);
+    if (!buf)
+    {
+        FS_ERR("Unable to allocate memory for data buffer");
+        return false;
+    }
+
+    bool ret = true;
+
+    for(;;)
+    {
+        size_t const read_size = pistream->read(pistream, buf, buf_size);
+        fcdc_sketch_update(sketch, buf, read_size);
+
+        fstream_status_t const status = pistream->status(pistream);
+        if (status == FSTREAM_STATUS_EOF)
+            break;
+        else if (status != FSTREAM_STATUS_OK || !read_size)
+        {
+            FS_ERR("Data reading was failed");
+            ret = false;
+            break;
+        }
+    }
+
+    free(buf);
+
+    return ret;
+}
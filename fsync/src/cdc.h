@@ -0,0 +1,48 @@
+#ifndef CDC_H_FSYNC
+#define CDC_H_FSYNC
+#include <futils/stream.h>
+#include <futils/md5.h>
+#include <fcommon/limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Content defined chunking (FastCDC). Chunk boundaries depend on the data content only,
+ * so insertions and deletions change the chunks around them and the rest chunks are kept.
+ */
+
+enum
+{
+    FCDC_CHUNK_MIN = 16 * 1024,     // Minimal chunk size
+    FCDC_CHUNK_AVG = 64 * 1024,     // Average chunk size
+    FCDC_CHUNK_MAX = 256 * 1024     // Maximal chunk size
+};
+
+typedef struct
+{
+    uint32_t    size;               // chunk size
+    fmd5_t      digest;             // chunk digest
+} fcdc_chunk_t;
+
+typedef bool (*fcdc_chunk_handler_t)(void *arg, uint64_t offset, fcdc_chunk_t const *chunk);
+
+size_t fcdc_chunk_size(char const *data, size_t size);                              // Size of the first chunk of data
+bool   fcdc_chunks(fistream_t *pistream, fcdc_chunk_handler_t handler, void *arg);   // Splits the data into chunks. Handler is called for each chunk.
+
+/*
+ * Sketch of data for similarity search (bottom-k MinHash). Features are the content defined anchors of data,
+ * the sketch keeps the smallest feature hashes. Similar data have many common hashes in sketches.
+ */
+
+typedef struct
+{
+    uint64_t    hash;                           // gear hash of the last bytes
+    uint64_t    hashes[FSYNC_SKETCH_SIZE];      // sorted feature hashes, UINT64_MAX for unused
+} fcdc_sketch_t;
+
+void fcdc_sketch_init(fcdc_sketch_t *sketch);
+void fcdc_sketch_update(fcdc_sketch_t *sketch, void const *data, size_t size);
+bool fcdc_sketch_calculate(fistream_t *pistream, fcdc_sketch_t *sketch);
+
+#endif
@@ -0,0 +1,892 @@
+#include "cdc_sync_agent.h"
+#include "sync_agents.h"
+#include "cdc.h"
+#include <futils/log.h>
+#include <futils/mutex.h>
+#include <futils/vector.h>
+#include <fdb/sync/chunks.h>
+#include <fdb/sync/ids.h>
+#include <fcommon/limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+static char const TMP_FILE_EXT[] = ".tmp";
+
+static char STR_ID[] = "id";
+static char STR_PATH[] = "path";
+static char STR_STAGE[] = "stage";
+
+typedef enum
+{
+    FCDC_STAGE_CHUNKS = 0,          // The list of chunks is synchronized
+    FCDC_STAGE_DATA                 // The file data is synchronized
+} fcdc_stage_t;
+
+typedef struct
+{
+    char                path[FMAX_PATH];
+} fcdc_path_t;
+
+// Outgoing file. The data is sent when the list of chunks is delivered.
+typedef struct
+{
+    uint32_t            id;
+    char                path[FMAX_PATH];
+    fuuid_t             dst;
+    fsync_engine_t     *pengine;
+    fvector_t          *chunks;         // sent list of chunks, the engine reads it asynchronously (Type: fcdc_chunk_t)
+    bool                is_data_sent;
+} fcdc_send_t;
+
+// Incoming file
+typedef struct
+{
+    char                path[FMAX_PATH];
+    fmem_iostream_t    *chunks;         // received list of chunks
+    fvector_t          *files;          // local files with chunks of base (Type: fcdc_path_t)
+    fvector_t          *base;           // local chunks of file (Type: fcdc_base_chunk_t)
+} fcdc_recv_t;
+
+typedef struct
+{
+    uint32_t            file;           // file index
+    uint32_t            size;           // chunk size
+    uint64_t            offset;         // chunk offset in file
+    uint64_t            base_offset;    // chunk offset in base
+} fcdc_base_chunk_t;
+
+typedef struct
+{
+    fsync_agent_t       agent;
+    volatile uint32_t   ref_counter;
+    volatile uint32_t   id;             // outgoing files id generator
+    fdb_t              *db;             // chunks index
+    char                dir[FMAX_PATH];
+    pthread_mutex_t     mutex;
+    fvector_t          *sends;          // Type: fcdc_send_t
+    fvector_t          *recvs;          // Type: fcdc_recv_t
+} fcdc_sync_agent_t;
+
+static bool fcdc_full_path(char const *dir, char const *path, char *full_path, size_t size)
+{
+    int const len = snprintf(full_path, size, "%s/%s", dir, path);
+    if (len < 0 || (size_t)len >= size)
+    {
+        FS_ERR("File path is too long");
+        return false;
+    }
+    return true;
+}
+
+static binn *fcdc_metainf(uint32_t id, char const *path, fcdc_stage_t stage)
+{
+    binn *obj = binn_object();
+    if (obj
+        && (!binn_object_set_uint32(obj, STR_ID, id)
+            || !binn_object_set_str(obj, STR_PATH, (char *)path)
+            || !binn_object_set_uint8(obj, STR_STAGE, (uint8_t)stage)))
+    {
+        binn_free(obj);
+        obj = 0;
+    }
+    return obj;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// base_istream
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*
+ * Base data is the sequence of local chunks in the order of the incoming file.
+ * Unavailable chunks are read as zeros. It keeps the base consistent, the delta verifies the data by itself.
+ */
+typedef struct
+{
+    fistream_t          istream;
+    volatile uint32_t   ref_counter;
+    char                dir[FMAX_PATH];
+    fvector_t          *files;          // Type: fcdc_path_t
+    fvector_t          *chunks;         // Type: fcdc_base_chunk_t
+    uint64_t            size;           // base size
+    uint64_t            offset;         // read offset
+    size_t              chunk;          // current chunk
+    uint32_t            file;           // opened file index
+    fistream_t         *file_istream;   // opened file
+} fcdc_base_istream_t;
+
+static fistream_t* fcdc_base_istream_retain(fistream_t *pistream)
+{
+    if (pistream)
+    {
+        fcdc_base_istream_t *pbase_istream = (fcdc_base_istream_t *)pistream;
+        pbase_istream->ref_counter++;
+    }
+    else
+        FS_ERR("Invalid istream");
+    return pistream;
+}
+
+static void fcdc_base_istream_release(fistream_t *pistream)
+{
+    if (pistream)
+    {
+        fcdc_base_istream_t *pbase_istream = (fcdc_base_istream_t *)pistream;
+        if (!pbase_istream->ref_counter)
+            FS_ERR("Invalid istream");
+        else if (!--pbase_istream->ref_counter)
+        {
+            if (pbase_istream->file_istream)
+                pbase_istream->file_istream->release(pbase_istream->file_istream);
+            fvector_release(pbase_istream->files);
+            fvector_release(pbase_istream->chunks);
+            memset(pbase_istream, 0, sizeof *pbase_istream);
+            free(pbase_istream);
+        }
+    }
+    else
+        FS_ERR("Invalid istream");
+}
+
+static fcdc_base_chunk_t const *fcdc_base_istream_chunk(fcdc_base_istream_t *pbase_istream)
+{
+    fcdc_base_chunk_t const *chunks = (fcdc_base_chunk_t const *)fvector_ptr(pbase_istream->chunks);
+    size_t const chunks_num = fvector_size(pbase_istream->chunks);
+    uint64_t const offset = pbase_istream->offset;
+
+    fcdc_base_chunk_t const *chunk = chunks + pbase_istream->chunk;
+    if (chunk->base_offset <= offset && offset < chunk->base_offset + chunk->size)
+        return chunk;
+
+    // Binary search of the chunk which contains the offset
+    size_t lo = 0, hi = chunks_num;
+    while (hi - lo > 1)
+    {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (chunks[mid].base_offset <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    pbase_istream->chunk = lo;
+
+    return chunks + lo;
+}
+
+static size_t fcdc_base_istream_read_chunk(fcdc_base_istream_t *pbase_istream, fcdc_base_chunk_t const *chunk, char *data, size_t size)
+{
+    if (!pbase_istream->file_istream || pbase_istream->file != chunk->file)
+    {
+        if (pbase_istream->file_istream)
+            pbase_istream->file_istream->release(pbase_istream->file_istream);
+        pbase_istream->file_istream = 0;
+        pbase_istream->file = chunk->file;
+
+        fcdc_path_t const *file = (fcdc_path_t const *)fvector_at(pbase_istream->files, chunk->file);
+        char path[2 * FMAX_PATH];
+        if (file && fcdc_full_path(pbase_istream->dir, file->path, path, sizeof path))
+            pbase_istream->file_istream = ffile_mapped_istream(path);
+    }
+
+    uint64_t const offset = chunk->offset + (pbase_istream->offset - chunk->base_offset);
+
+    fistream_t *file_istream = pbase_istream->file_istream;
+
+    size_t read_size = 0;
+    if (file_istream && file_istream->seek(file_istream, (size_t)offset))
+        read_size = file_istream->read(file_istream, data, size);
+
+    memset(data + read_size, 0, size - read_size);
+
+    return size;
+}
+
+static size_t fcdc_base_istream_read(fistream_t *pistream, char *data, size_t size)
+{
+    if (!pistream)
+    {
+        FS_ERR("Invalid istream");
+        return 0;
+    }
+    fcdc_base_istream_t *pbase_istream = (fcdc_base_istream_t *)pistream;
+
+    size_t read_size = 0;
+
+    while (read_size < size && pbase_istream->offset < pbase_istream->size)
+    {
+        fcdc_base_chunk_t const *chunk = fcdc_base_istream_chunk(pbase_istream);
+
+        uint64_t const available_size = chunk->base_offset + chunk->size - pbase_istream->offset;
+        size_t const len = size - read_size < available_size ? size - read_size : (size_t)available_size;
+
+        read_size += fcdc_base_istream_read_chunk(pbase_istream, chunk, data + read_size, len);
+        pbase_istream->offset += len;
+    }
+
+    return read_size;
+}
+
+static bool fcdc_base_istream_seek(fistream_t *pistream, size_t pos)
+{
+    if (!pistream)
+    {
+        FS_ERR("Invalid istream");
+        return false;
+    }
+    fcdc_base_istream_t *pbase_istream = (fcdc_base_istream_t *)pistream;
+    pbase_istream->offset = pos > pbase_istream->size ? pbase_istream->size : pos;
+    return true;
+}
+
+static fstream_status_t fcdc_base_istream_status(fistream_t *pistream)
+{
+    fcdc_base_istream_t *pbase_istream = (fcdc_base_istream_t *)pistream;
+    return pbase_istream->offset < pbase_istream->size ? FSTREAM_STATUS_OK : FSTREAM_STATUS_EOF;
+}
+
+// Vectors are taken by the istream
+static fistream_t *fcdc_base_istream(char const *dir, fvector_t *files, fvector_t *chunks)
+{
+    fcdc_base_istream_t *pistream = malloc(sizeof(fcdc_base_istream_t));
+    if (!pistream)
+    {
+        FS_ERR("Unable to allocate memory for istream");
+        return 0;
+    }
+    memset(pistream, 0, sizeof *pistream);
+
+    pistream->istream.retain = fcdc_base_istream_retain;
+    pistream->istream.release = fcdc_base_istream_release;
+    pistream->istream.read = fcdc_base_istream_read;
+    pistream->istream.seek = fcdc_base_istream_seek;
+    pistream->istream.status = fcdc_base_istream_status;
+
+    pistream->ref_counter = 1;
+    strncpy(pistream->dir, dir, sizeof pistream->dir - 1);
+    pistream->files = files;
+    pistream->chunks = chunks;
+
+    size_t const chunks_num = fvector_size(chunks);
+    if (chunks_num)
+    {
+        fcdc_base_chunk_t const *last = (fcdc_base_chunk_t const *)fvector_at(chunks, chunks_num - 1);
+        pistream->size = last->base_offset + last->size;
+    }
+
+    return (fistream_t *)pistream;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// chunks index
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+typedef struct
+{
+    fdb_transaction_t       transaction;
+    fdb_map_t               map;
+    bool                    is_opened;
+    fdb_chunk_location_t    location;
+    fvector_t              *chunks;         // optional list of chunks (Type: fcdc_chunk_t)
+} fcdc_indexer_t;
+
+static bool fcdc_indexer_open(fcdc_indexer_t *indexer, fdb_t *db, char const *path)
+{
+    memset(indexer, 0, sizeof *indexer);
+    strncpy(indexer->location.path, path, sizeof indexer->location.path - 1);
+
+    if (!db)
+        return true;
+
+    if (!fdb_transaction_start(db, &indexer->transaction))
+        return false;
+
+    if (!fdb_chunks_map_open(&indexer->transaction, &indexer->map))
+    {
+        fdb_transaction_abort(&indexer->transaction);
+        return false;
+    }
+
+    indexer->is_opened = true;
+
+    return true;
+}
+
+static void fcdc_indexer_close(fcdc_indexer_t *indexer, bool commit)
+{
+    if (indexer->is_opened)
+    {
+        if (commit)
+            fdb_transaction_commit(&indexer->transaction);
+        fdb_map_close(&indexer->map);
+        fdb_transaction_abort(&indexer->transaction);
+        indexer->is_opened = false;
+    }
+}
+
+static bool fcdc_indexer_add(fcdc_indexer_t *indexer, uint64_t offset, fcdc_chunk_t const *chunk)
+{
+    if (indexer->chunks && !fvector_push_back(&indexer->chunks, chunk))
+    {
+        FS_ERR("Chunk wasn't remembered");
+        return false;
+    }
+
+    if (indexer->is_opened)
+    {
+        indexer->location.offset = offset;
+        indexer->location.size = chunk->size;
+        if (!fdb_chunk_put(&indexer->map, &indexer->transaction, &chunk->digest, &indexer->location))
+        {
+            FS_ERR("Chunk wasn't indexed");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Chunks of local file are indexed for the following synchronizations. The list of chunks is optional.
+static bool fcdc_index_file(fcdc_sync_agent_t *pagent, char const *path, fvector_t **chunks)
+{
+    char full_path[2 * FMAX_PATH];
+    if (!fcdc_full_path(pagent->dir, path, full_path, sizeof full_path))
+        return false;
+
+    fcdc_indexer_t indexer;
+    bool ret = false;
+
+    do
+    {
+        fistream_t *pistream = ffile_mapped_istream(full_path);
+        if (!pistream)
+            return false;
+
+        ret = fcdc_indexer_open(&indexer, pagent->db, path);
+        if (ret)
+        {
+            indexer.chunks = chunks ? *chunks : 0;
+            ret = fcdc_chunks(pistream, (fcdc_chunk_handler_t)fcdc_indexer_add, &indexer);
+            if (chunks)
+                *chunks = indexer.chunks;
+            fcdc_indexer_close(&indexer, ret);
+        }
+        else
+            FS_ERR("Chunks index wasn't opened");
+
+        pistream->release(pistream);
+
+        // The index was lost on the full map. The file is chunked again.
+        if (indexer.transaction.error == FERR_AGAIN
+            && chunks)
+            fvector_clear(chunks);
+    }
+    while (indexer.transaction.error == FERR_AGAIN);
+
+    return ret;
+}
+
+static uint32_t fcdc_file_idx(fvector_t **files, char const *path)
+{
+    size_t const files_num = fvector_size(*files);
+    fcdc_path_t const *paths = (fcdc_path_t const *)fvector_ptr(*files);
+
+    // Chunks of the same file usually go in a row
+    for (size_t i = files_num; i > 0; --i)
+    {
+        if (strcmp(paths[i - 1].path, path) == 0)
+            return (uint32_t)(i - 1);
+    }
+
+    fcdc_path_t file = { { 0 } };
+    strncpy(file.path, path, sizeof file.path - 1);
+
+    if (!fvector_push_back(files, &file))
+        return FINVALID_ID;
+
+    return (uint32_t)files_num;
+}
+
+// Local chunks of the incoming file are found by the index
+static bool fcdc_recv_base(fcdc_sync_agent_t *pagent, fcdc_recv_t *recv)
+{
+    recv->files = fvector(sizeof(fcdc_path_t), 0, 0);
+    recv->base = fvector(sizeof(fcdc_base_chunk_t), 0, 0);
+    if (!recv->files || !recv->base)
+    {
+        FS_ERR("Base vectors weren't created");
+        return false;
+    }
+
+    if (!pagent->db)
+        return true;
+
+    fistream_t *chunks_istream = fmem_istream(recv->chunks);
+    if (!chunks_istream)
+        return false;
+
+    bool ret = false;
+
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(pagent->db, &transaction))
+    {
+        fdb_map_t map = { 0 };
+        if (fdb_chunks_map_open(&transaction, &map))
+        {
+            ret = true;
+
+            uint64_t base_offset = 0;
+            fcdc_chunk_t chunk;
+
+            while (ret && chunks_istream->read(chunks_istream, (char *)&chunk, sizeof chunk) == sizeof chunk)
+            {
+                fdb_chunk_location_t location;
+                if (!fdb_chunk_get(&map, &transaction, &chunk.digest, &location)
+                    || location.size != chunk.size)
+                    continue;
+
+                fcdc_base_chunk_t const base_chunk =
+                {
+                    fcdc_file_idx(&recv->files, location.path),
+                    location.size,
+                    location.offset,
+                    base_offset
+                };
+
+                ret = base_chunk.file != FINVALID_ID
+                        && fvector_push_back(&recv->base, &base_chunk);
+                if (!ret)
+                    FS_ERR("Base chunk wasn't remembered");
+
+                base_offset += base_chunk.size;
+            }
+
+            fdb_map_close(&map);
+        }
+        fdb_transaction_abort(&transaction);
+    }
+
+    chunks_istream->release(chunks_istream);
+
+    return ret;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// sends and recvs
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static void fcdc_send_free(fcdc_send_t *send)
+{
+    fsync_engine_release(send->pengine);
+    fvector_release(send->chunks);
+}
+
+static void fcdc_recv_free(fcdc_recv_t *recv)
+{
+    if (recv->chunks)
+        fmem_iostream_release(recv->chunks);
+    fvector_release(recv->files);
+    fvector_release(recv->base);
+}
+
+// Should be called under lock
+static fcdc_send_t *fcdc_send_find(fcdc_sync_agent_t *pagent, uint32_t id)
+{
+    fcdc_send_t *sends = (fcdc_send_t *)fvector_ptr(pagent->sends);
+    for (size_t i = 0; i < fvector_size(pagent->sends); ++i)
+    {
+        if (sends[i].id == id)
+            return sends + i;
+    }
+    return 0;
+}
+
+// Should be called under lock
+static fcdc_recv_t *fcdc_recv_find(fcdc_sync_agent_t *pagent, char const *path)
+{
+    fcdc_recv_t *recvs = (fcdc_recv_t *)fvector_ptr(pagent->recvs);
+    for (size_t i = 0; i < fvector_size(pagent->recvs); ++i)
+    {
+        if (strcmp(recvs[i].path, path) == 0)
+            return recvs + i;
+    }
+    return 0;
+}
+
+static bool fcdc_send_remove(fcdc_sync_agent_t *pagent, uint32_t id)
+{
+    bool ret = false;
+
+    fpush_lock(pagent->mutex);
+    fcdc_send_t *send = fcdc_send_find(pagent, id);
+    if (send)
+    {
+        fcdc_send_free(send);
+        fvector_erase(&pagent->sends, fvector_idx(pagent->sends, send));
+        ret = true;
+    }
+    fpop_lock();
+
+    return ret;
+}
+
+static bool fcdc_recv_remove(fcdc_sync_agent_t *pagent, char const *path)
+{
+    bool ret = false;
+
+    fpush_lock(pagent->mutex);
+    fcdc_recv_t *recv = fcdc_recv_find(pagent, path);
+    if (recv)
+    {
+        fcdc_recv_free(recv);
+        fvector_erase(&pagent->recvs, fvector_idx(pagent->recvs, recv));
+        ret = true;
+    }
+    fpop_lock();
+
+    return ret;
+}
+
+static ferr_t fcdc_send_data(fcdc_sync_agent_t *pagent, fcdc_send_t const *send)
+{
+    char full_path[2 * FMAX_PATH];
+    if (!fcdc_full_path(pagent->dir, send->path, full_path, sizeof full_path))
+        return FFAIL;
+
+    fistream_t *pistream = ffile_mapped_istream(full_path);
+    if (!pistream)
+        return FFAIL;
+
+    size_t size = 0;
+    fistream_data(pistream, &size, 0);
+
+    ferr_t ret = FERR_NO_MEM;
+
+    binn *metainf = fcdc_metainf(send->id, send->path, FCDC_STAGE_DATA);
+    if (metainf)
+    {
+        ret = fsync_engine_sync(send->pengine, &send->dst, FCDC_SYNC_AGENT, metainf, pistream, size);
+        binn_free(metainf);
+    }
+
+    pistream->release(pistream);
+
+    return ret;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// cdc_sync_agent
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static fsync_agent_t* fcdc_sync_agent_retain(fcdc_sync_agent_t *pagent)
+{
+    if (pagent)
+        pagent->ref_counter++;
+    else
+        FS_ERR("Invalid sync agent");
+    return (fsync_agent_t*)pagent;
+}
+
+static void fcdc_sync_agent_release(fcdc_sync_agent_t *pagent)
+{
+    if (pagent)
+    {
+        if (!pagent->ref_counter)
+            FS_ERR("Invalid sync agent");
+        else if (!--pagent->ref_counter)
+        {
+            fcdc_send_t *sends = (fcdc_send_t *)fvector_ptr(pagent->sends);
+            for (size_t i = 0; i < fvector_size(pagent->sends); ++i)
+                fcdc_send_free(sends + i);
+            fvector_release(pagent->sends);
+
+            fcdc_recv_t *recvs = (fcdc_recv_t *)fvector_ptr(pagent->recvs);
+            for (size_t i = 0; i < fvector_size(pagent->recvs); ++i)
+                fcdc_recv_free(recvs + i);
+            fvector_release(pagent->recvs);
+
+            if (pagent->db)
+                fdb_release(pagent->db);
+
+            memset(pagent, 0, sizeof *pagent);
+            free(pagent);
+        }
+    }
+    else
+        FS_ERR("Invalid sync agent");
+}
+
+static bool fcdc_sync_agent_accept(fcdc_sync_agent_t *pagent, binn *metainf, fistream_t **pistream, fostream_t **postream)
+{
+    char const *path = binn_object_str(metainf, STR_PATH);
+    if (!path || strlen(path) >= FMAX_PATH)
+    {
+        FS_ERR("Invalid path of incoming file");
+        return false;
+    }
+
+    bool ret = false;
+
+    fpush_lock(pagent->mutex);
+
+    fcdc_recv_t *recv = fcdc_recv_find(pagent, path);
+    if (!recv)
+    {
+        fcdc_recv_t new_recv = { { 0 } };
+        strncpy(new_recv.path, path, sizeof new_recv.path - 1);
+        if (fvector_push_back(&pagent->recvs, &new_recv))
+            recv = (fcdc_recv_t *)fvector_at(pagent->recvs, fvector_size(pagent->recvs) - 1);
+        else
+            FS_ERR("Incoming file wasn't remembered");
+    }
+
+    if (recv)
+    {
+        switch (binn_object_uint8(metainf, STR_STAGE))
+        {
+            case FCDC_STAGE_CHUNKS:
+            {
+                // The list of chunks is received into memory
+                if (recv->chunks)
+                    fmem_iostream_release(recv->chunks);
+                recv->chunks = fmem_iostream(FMEM_BLOCK_SIZE);
+                *postream = recv->chunks ? fmem_ostream(recv->chunks) : 0;
+                ret = *postream != 0;
+                break;
+            }
+
+            case FCDC_STAGE_DATA:
+            {
+                // The base is assembled from the local chunks. The file is replaced on completion.
+                if (fvector_size(recv->base))
+                {
+                    *pistream = fcdc_base_istream(pagent->dir, recv->files, recv->base);
+                    if (*pistream)
+                        recv->files = recv->base = 0;
+                }
+
+                char tmp_path[2 * FMAX_PATH + sizeof TMP_FILE_EXT];
+                if (fcdc_full_path(pagent->dir, path, tmp_path, sizeof tmp_path - sizeof TMP_FILE_EXT + 1))
+                {
+                    strcat(tmp_path, TMP_FILE_EXT);
+                    *postream = ffile_ostream(tmp_path, false);
+                }
+                ret = *postream != 0;
+                break;
+            }
+
+            default:
+                FS_ERR("Unknown synchronization stage");
+                break;
+        }
+    }
+
+    fpop_lock();
+
+    return ret;
+}
+
+static void fcdc_sync_agent_error_handler(fcdc_sync_agent_t *pagent, binn *metainf, ferr_t err, char const *err_msg)
+{
+    (void)err;
+
+    char const *path = binn_object_str(metainf, STR_PATH);
+    if (!path)
+        return;
+
+    FS_ERR("File synchronization was failed: \'%s\'. Reason: \'%s\'", path, err_msg);
+
+    fcdc_send_remove(pagent, binn_object_uint32(metainf, STR_ID));
+
+    if (fcdc_recv_remove(pagent, path))
+    {
+        char tmp_path[2 * FMAX_PATH + sizeof TMP_FILE_EXT];
+        if (fcdc_full_path(pagent->dir, path, tmp_path, sizeof tmp_path - sizeof TMP_FILE_EXT + 1))
+        {
+            strcat(tmp_path, TMP_FILE_EXT);
+            remove(tmp_path);
+        }
+    }
+}
+
+static void fcdc_sync_agent_completion_handler(fcdc_sync_agent_t *pagent, binn *metainf)
+{
+    uint32_t const id = binn_object_uint32(metainf, STR_ID);
+    char const *path = binn_object_str(metainf, STR_PATH);
+    if (!path)
+        return;
+
+    switch (binn_object_uint8(metainf, STR_STAGE))
+    {
+        case FCDC_STAGE_CHUNKS:
+        {
+            // src. The list of chunks is delivered, the data is sent.
+            fcdc_send_t send = { 0 };
+            bool is_sent = false;
+
+            fpush_lock(pagent->mutex);
+            fcdc_send_t *psend = fcdc_send_find(pagent, id);
+            if (psend && !psend->is_data_sent && strcmp(psend->path, path) == 0)
+            {
+                psend->is_data_sent = true;
+                send = *psend;
+                is_sent = true;
+            }
+            fpop_lock();
+
+            if (is_sent && fcdc_send_data(pagent, &send) != FSUCCESS)
+            {
+                FS_ERR("File data wasn't sent: \'%s\'", path);
+                fcdc_send_remove(pagent, id);
+            }
+
+            // dst. The base is found for the incoming file.
+            fpush_lock(pagent->mutex);
+            fcdc_recv_t *recv = fcdc_recv_find(pagent, path);
+            if (recv && recv->chunks)
+            {
+                if (!fcdc_recv_base(pagent, recv))
+                    FS_ERR("Base data wasn't found: \'%s\'", path);
+                fmem_iostream_release(recv->chunks);
+                recv->chunks = 0;
+            }
+            fpop_lock();
+
+            break;
+        }
+
+        case FCDC_STAGE_DATA:
+        {
+            // src. The file is synchronized.
+            fcdc_send_remove(pagent, id);
+
+            // dst. The file is replaced and its chunks are indexed.
+            if (fcdc_recv_remove(pagent, path))
+            {
+                char full_path[2 * FMAX_PATH];
+                char tmp_path[2 * FMAX_PATH + sizeof TMP_FILE_EXT];
+                if (fcdc_full_path(pagent->dir, path, full_path, sizeof full_path))
+                {
+                    snprintf(tmp_path, sizeof tmp_path, "%s%s", full_path, TMP_FILE_EXT);
+                    if (rename(tmp_path, full_path) != 0)
+                        FS_ERR("File wasn't replaced: \'%s\'", full_path);
+                    else if (!fcdc_index_file(pagent, path, 0))
+                        FS_ERR("File chunks weren't indexed: \'%s\'", full_path);
+                }
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+fsync_agent_t *cdc_sync_agent(fdb_t *db, char const *dir)
+{
+    if (!dir || strlen(dir) >= FMAX_PATH)
+    {
+        FS_ERR("Invalid arguments");
+        return 0;
+    }
+
+    fcdc_sync_agent_t *pagent = malloc(sizeof(fcdc_sync_agent_t));
+    if (!pagent)
+    {
+        FS_ERR("No free space of memory");
+        return 0;
+    }
+    memset(pagent, 0, sizeof *pagent);
+
+    pagent->ref_counter = 1;
+    pagent->agent.id = FCDC_SYNC_AGENT;
+    pagent->agent.retain = (fsync_agent_retain_fn_t)fcdc_sync_agent_retain;
+    pagent->agent.release = (fsync_agent_release_fn_t)fcdc_sync_agent_release;
+    pagent->agent.accept = (fsync_agent_accept_fn_t)fcdc_sync_agent_accept;
+    pagent->agent.failed = (fsync_error_handler_fn_t)fcdc_sync_agent_error_handler;
+    pagent->agent.complete = (fsync_completion_handler_fn_t)fcdc_sync_agent_completion_handler;
+
+    static const pthread_mutex_t mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
+    pagent->mutex = mutex_initializer;
+
+    strncpy(pagent->dir, dir, sizeof pagent->dir - 1);
+    pagent->db = db ? fdb_retain(db) : 0;
+
+    pagent->sends = fvector(sizeof(fcdc_send_t), 0, 0);
+    pagent->recvs = fvector(sizeof(fcdc_recv_t), 0, 0);
+    if (!pagent->sends || !pagent->recvs)
+    {
+        FS_ERR("Agent vectors weren't created");
+        fcdc_sync_agent_release(pagent);
+        return 0;
+    }
+
+    return (fsync_agent_t *)pagent;
+}
+
+ferr_t cdc_sync_agent_sync(fsync_agent_t *agent, fsync_engine_t *pengine, fuuid_t const *dst, char const *path)
+{
+    if (!agent || agent->id != FCDC_SYNC_AGENT || !pengine || !dst || !path || strlen(path) >= FMAX_PATH)
+    {
+        FS_ERR("Invalid arguments");
+        return FERR_INVALID_ARG;
+    }
+
+    fcdc_sync_agent_t *pagent = (fcdc_sync_agent_t *)agent;
+
+    // The chunks of sent file are indexed too. The local files are the base for incoming ones.
+    fvector_t *chunks = fvector(sizeof(fcdc_chunk_t), 0, 0);
+    if (!chunks)
+    {
+        FS_ERR("Chunks vector wasn't created");
+        return FERR_NO_MEM;
+    }
+
+    if (!fcdc_index_file(pagent, path, &chunks))
+    {
+        FS_ERR("File chunks weren't calculated: \'%s\'", path);
+        fvector_release(chunks);
+        return FFAIL;
+    }
+
+    fcdc_send_t send = { ++pagent->id };
+    strncpy(send.path, path, sizeof send.path - 1);
+    send.dst = *dst;
+    send.pengine = fsync_engine_retain(pengine);
+    send.chunks = chunks;
+
+    // The list of chunks is kept by the outgoing file until it is synchronized
+    size_t const chunks_size = fvector_size(chunks) * sizeof(fcdc_chunk_t);
+    fistream_t *chunks_istream = fmem_const_istream((char const *)fvector_ptr(chunks), chunks_size);
+
+    ferr_t ret = FERR_NO_MEM;
+
+    fpush_lock(pagent->mutex);
+    if (fvector_push_back(&pagent->sends, &send))
+        ret = FSUCCESS;
+    else
+        FS_ERR("Outgoing file wasn't remembered");
+    fpop_lock();
+
+    if (ret == FSUCCESS)
+    {
+        binn *metainf = fcdc_metainf(send.id, path, FCDC_STAGE_CHUNKS);
+
+        ret = chunks_istream && metainf
+                ? fsync_engine_sync(pengine, dst, FCDC_SYNC_AGENT, metainf, chunks_istream, chunks_size)
+                : FERR_NO_MEM;
+
+        binn_free(metainf);
+
+        if (ret != FSUCCESS)
+            fcdc_send_remove(pagent, send.id);
+    }
+    else
+        fcdc_send_free(&send);
+
+    if (chunks_istream)
+        chunks_istream->release(chunks_istream);
+
+    return ret;
+}
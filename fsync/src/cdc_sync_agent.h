@@ -0,0 +1,14 @@
+#ifndef CDC_SYNC_AGENT_H_FSYNC
+#define CDC_SYNC_AGENT_H_FSYNC
+#include "sync_engine.h"
+
+/*
+ * Files synchronization with deduplication of content defined chunks.
+ * The list of file chunks is sent first. dst assembles the base data from the chunks of any local files
+ * and the file is synchronized by delta against this base, so only the missing chunks are transferred.
+ */
+
+fsync_agent_t *cdc_sync_agent(fdb_t *db, char const *dir);                                                                 // db is the chunks index, dir is the root of files
+ferr_t         cdc_sync_agent_sync(fsync_agent_t *agent, fsync_engine_t *pengine, fuuid_t const *dst, char const *path);  // path is relative to dir
+
+#endif
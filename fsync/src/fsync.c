@@ -3,8 +3,9 @@
 #include <fcommon/limits.h>
 #include <fcommon/messages.h>
 #include <fdb/sync/sync_files.h>
-#include <fdb/sync/statuses.h>
+#include <fdb/sync/bitmaps.h>
 #include <fdb/sync/nodes.h>
+#include <fdb/sync/shards.h>
 #include <futils/fs.h>
 #include <futils/log.h>
 #include <futils/queue.h>
@@ -53,6 +54,8 @@ struct fsync
 
     fmsgbus_t           *msgbus;
     fdb_t               *db;
+    fdb_shards_t        *shards;
+    fdb_t               *local_db;                                                                          // Shard of the local node sync tables
 };
 
 static void fsdir_evt_handler(fsdir_event_t const *event, void *arg)
@@ -77,7 +80,7 @@ static void fsync_status_handler(fsync_t *psync, FMSG_TYPE(node_status) const *m
 
     fdb_transaction_t transaction = { 0 };
 
-    if (fdb_transaction_start(psync->db, &transaction))
+    if (fdb_transaction_start(psync->local_db, &transaction))
     {
         fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &psync->uuid);
         if (files_map)
@@ -142,17 +145,27 @@ static void fsync_file_info_get(fmsg_sync_file_info_t const *sync_info, fsync_fi
 
 static void fsync_notify_files_diff(fsync_t *psync, fuuid_t const *uuid)
 {
+    fdb_t *peer_db = fdb_shard(psync->shards, uuid);
+    if (!peer_db)
+        return;
+
     fdb_transaction_t transaction = { 0 };
+    fdb_transaction_t peer_transaction = { 0 };
 
-    if (fdb_transaction_start(psync->db, &transaction))
+    // The local shard is locked first
+    if (fdb_transaction_start(psync->local_db, &transaction))
     {
-        fdb_sync_files_map_t *files_map_1 = fdb_sync_files(&transaction, &psync->uuid);
+        fdb_transaction_t *ptransaction = &transaction;
+        if (peer_db != psync->local_db)
+            ptransaction = fdb_transaction_start(peer_db, &peer_transaction) ? &peer_transaction : 0;
+
+        fdb_sync_files_map_t *files_map_1 = ptransaction ? fdb_sync_files(&transaction, &psync->uuid) : 0;
         if (files_map_1)
         {
-            fdb_sync_files_map_t *files_map_2 = fdb_sync_files(&transaction, uuid);
+            fdb_sync_files_map_t *files_map_2 = fdb_sync_files(ptransaction, uuid);
             if (files_map_2)
             {
-                fdb_sync_files_diff_iterator_t *diff = fdb_sync_files_diff_iterator(files_map_1, files_map_2, &transaction);
+                fdb_sync_files_diff_iterator_t *diff = fdb_sync_files_diff_iterator_ex(files_map_1, &transaction, files_map_2, ptransaction);
                 if (diff)
                 {
                     FMSG(sync_files_list, files_list, psync->uuid, *uuid,
@@ -192,14 +205,19 @@ static void fsync_notify_files_diff(fsync_t *psync, fuuid_t const *uuid)
                     }
                 }
 
+                if (ptransaction != &transaction)
+                    fdb_transaction_commit(ptransaction);
                 fdb_transaction_commit(&transaction);
                 fdb_sync_files_release(files_map_2);
             }
             fdb_sync_files_release(files_map_1);
         }
 
+        fdb_transaction_abort(&peer_transaction);
         fdb_transaction_abort(&transaction);
     }
+
+    fdb_release(peer_db);
 }
 
 static void fsync_sync_files_list_handler(fsync_t *psync, FMSG_TYPE(sync_files_list) const *msg)
@@ -216,100 +234,122 @@ static void fsync_sync_files_list_handler(fsync_t *psync, FMSG_TYPE(sync_files_l
     fdb_transaction_t transaction = { 0 };
 
     // Remote node files list (+)
-    if (fdb_transaction_start(psync->db, &transaction))
+    fdb_t *peer_db = fdb_shard(psync->shards, &msg->hdr.src);
+    bool is_added = true;
+
+    do
     {
-        files_map = fdb_sync_files(&transaction, &msg->hdr.src);
-        if (files_map)
+        if (peer_db && fdb_transaction_start(peer_db, &transaction))
         {
-            FS_INFO("Received %u files info", msg->files_num);
-
-            for(uint32_t i = 0; i < msg->files_num; ++i)
+            files_map = fdb_sync_files(&transaction, &msg->hdr.src);
+            if (files_map)
             {
-                fsync_file_info_t info;
-                fsync_file_info_get(msg->files + i, &info);
+                FS_INFO("Received %u files info", msg->files_num);
 
-                if (!fdb_sync_file_add(files_map, &transaction, &info))
+                bool const is_bulk = fdb_sync_files_bulk_start(files_map, &transaction);
+
+                is_added = true;
+
+                for(uint32_t i = 0; is_added && i < msg->files_num; ++i)
                 {
-                    FS_ERR("Transaction was aborted");
-                    fdb_transaction_abort(&transaction);
-                    return;
+                    fsync_file_info_t info;
+                    fsync_file_info_get(msg->files + i, &info);
+                    is_added = fdb_sync_file_add(files_map, &transaction, &info);
                 }
+
+                if (is_added && is_bulk)
+                    is_added = fdb_sync_files_bulk_finish(files_map);
+
+                if (is_added)
+                    fdb_transaction_commit(&transaction);
+                else
+                    FS_ERR("Transaction was aborted");
+
+                fdb_sync_files_release(files_map);
             }
+            else FS_ERR("Files map wasn't opened");
 
-            fdb_transaction_commit(&transaction);
-            fdb_sync_files_release(files_map);
+            fdb_transaction_abort(&transaction);
         }
-        else FS_ERR("Files map wasn't opened");
-
-        fdb_transaction_abort(&transaction);
+        else FS_ERR("Transaction wasn't started");
     }
-    else FS_ERR("Transaction wasn't started");
+    while (transaction.error == FERR_AGAIN);
 
-    // Local files list (-)
-    if (fdb_transaction_start(psync->db, &transaction))
+    if (peer_db)
+        fdb_release(peer_db);
+
+    if (!is_added)
+        return;
+
+    // Local files list (-). The message has no more files than the list, so the list is published once after the commit.
+    FMSG(sync_files_list, files_list, psync->uuid, msg->hdr.src,
+        false,
+        0
+    );
+
+    do
     {
-        fdb_map_t status_map = { 0 };
-        files_map = fdb_sync_files(&transaction, &psync->uuid);
-        if (files_map)
+        is_need_sync = false;
+        files_list.files_num = 0;
+
+        if (fdb_transaction_start(psync->local_db, &transaction))
         {
-            if (fdb_sync_files_statuses(&transaction, &psync->uuid, &status_map))
+            fdb_map_t status_map = { 0 };
+            files_map = fdb_sync_files(&transaction, &psync->uuid);
+            if (files_map)
             {
-                FMSG(sync_files_list, files_list, psync->uuid, msg->hdr.src,
-                    false,
-                    0
-                );
-
-                fsync_file_info_t info;
-
-                for(uint32_t i = 0; i < msg->files_num; ++i)
+                if (fdb_sync_files_statuses(&transaction, &psync->uuid, &status_map))
                 {
-                    fsync_file_info_get(msg->files + i, &info);
-                    info.id = FINVALID_ID;
-                    info.status = 0;
+                    bool const is_bulk = fdb_sync_files_bulk_start(files_map, &transaction);
 
-                    bool is_absent = fdb_sync_file_add_unique(files_map, &transaction, &info);
+                    fsync_file_info_t info;
 
-                    if (is_absent)
+                    for(uint32_t i = 0; i < msg->files_num && files_list.files_num < FARRAY_SIZE(files_list.files); ++i)
                     {
-                        fdb_data_t const file_id = { sizeof info.id, &info.id };
-                        fdb_statuses_map_put(&status_map, &transaction, FFILE_IS_EXIST, &file_id);
+                        fsync_file_info_get(msg->files + i, &info);
+                        info.id = FINVALID_ID;
+                        info.status = 0;
 
-                        fmsg_sync_file_info_t *file_info = &files_list.files[files_list.files_num++];
-                        file_info->id       = info.id;
-                        file_info->digest   = info.digest;
-                        file_info->size     = info.size;
-                        file_info->is_exist = (info.status & FFILE_IS_EXIST) != 0;
-                        memcpy(file_info->path, info.path, sizeof info.path);
+                        if (fdb_sync_file_add_unique(files_map, &transaction, &info))
+                        {
+                            fdb_bitmaps_map_set(&status_map, &transaction, FFILE_IS_EXIST, info.id);
 
-                        if (files_list.files_num >= FARRAY_SIZE(files_list.files))
+                            fmsg_sync_file_info_t *file_info = &files_list.files[files_list.files_num++];
+                            file_info->id       = info.id;
+                            file_info->digest   = info.digest;
+                            file_info->size     = info.size;
+                            file_info->is_exist = (info.status & FFILE_IS_EXIST) != 0;
+                            memcpy(file_info->path, info.path, sizeof info.path);
+
+                            is_need_sync = true;
+                        }
+                    }
+
+                    if ((!is_bulk || fdb_sync_files_bulk_finish(files_map))
+                        && fdb_transaction_commit(&transaction))
+                    {
+                        if (is_need_sync)
                         {
+                            files_list.is_last = true;
                             if (fmsgbus_publish(psync->msgbus, FSYNC_FILES_LIST, (fmsg_t const *)&files_list) != FSUCCESS)
                                 FS_ERR("Files list not published");
-                            files_list.files_num = 0;
                         }
                     }
+                    else
+                        is_need_sync = false;
 
-                    is_need_sync |= is_absent;
+                    fdb_map_close(&status_map);
                 }
-
-                fdb_transaction_commit(&transaction);
+                else FS_ERR("Statuses map wasn't opened");
                 fdb_sync_files_release(files_map);
-                fdb_map_close(&status_map);
-
-                if (is_need_sync)
-                {
-                    files_list.is_last = true;
-                    if (fmsgbus_publish(psync->msgbus, FSYNC_FILES_LIST, (fmsg_t const *)&files_list) != FSUCCESS)
-                        FS_ERR("Files list not published");
-                }
             }
-            else FS_ERR("Statuses map wasn't opened");
-        }
-        else FS_ERR("Files map wasn't opened");
+            else FS_ERR("Files map wasn't opened");
 
-        fdb_transaction_abort(&transaction);
+            fdb_transaction_abort(&transaction);
+        }
+        else FS_ERR("Transaction wasn't started");
     }
-    else FS_ERR("Transaction wasn't started");
+    while (transaction.error == FERR_AGAIN);
 
     if (is_need_sync)
     {
@@ -337,7 +377,7 @@ static void fsync_file_part_request_handler(fsync_t *psync, FMSG_TYPE(file_part_
         path[len++] = '/';
 
         fdb_transaction_t transaction = { 0 };
-        if (fdb_transaction_start(psync->db, &transaction))
+        if (fdb_transaction_start(psync->local_db, &transaction))
         {
             fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &psync->uuid);
             if (files_map)
@@ -386,9 +426,9 @@ static void fsync_msgbus_retain(fsync_t *psync, fmsgbus_t *pmsgbus)
 
 static void fsync_msgbus_release(fsync_t *psync)
 {
-    fmsgbus_unsubscribe(psync->msgbus, FNODE_STATUS,        (fmsg_handler_t)fsync_status_handler);
-    fmsgbus_unsubscribe(psync->msgbus, FSYNC_FILES_LIST,    (fmsg_handler_t)fsync_sync_files_list_handler);
-    fmsgbus_unsubscribe(psync->msgbus, FFILE_PART_REQUEST,  (fmsg_handler_t)fsync_file_part_request_handler);
+    fmsgbus_unsubscribe(psync->msgbus, FNODE_STATUS,        (fmsg_handler_t)fsync_status_handler, psync);
+    fmsgbus_unsubscribe(psync->msgbus, FSYNC_FILES_LIST,    (fmsg_handler_t)fsync_sync_files_list_handler, psync);
+    fmsgbus_unsubscribe(psync->msgbus, FFILE_PART_REQUEST,  (fmsg_handler_t)fsync_file_part_request_handler, psync);
     fmsgbus_release(psync->msgbus);
 }
 
@@ -410,7 +450,7 @@ static void *fsync_thread(void *param)
 
         FS_INFO("Synchronization...\n");
 
-        fsynchronizer_t *synchronizer = fsynchronizer_create(psync->msgbus, psync->db, &psync->uuid, psync->dir);
+        fsynchronizer_t *synchronizer = fsynchronizer_create(psync->msgbus, psync->db, psync->shards, &psync->uuid, psync->dir);
         if (synchronizer)
         {
             while(psync->is_sync_active && fsynchronizer_update(synchronizer));
@@ -507,65 +547,83 @@ static void fsync_scan_dir(fsync_t *psync)
 
     fdb_transaction_t transaction = { 0 };
 
-    if (fdb_transaction_start(psync->db, &transaction))
+    do
     {
-        fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &psync->uuid);
-        if (files_map)
+        if (fdb_transaction_start(psync->local_db, &transaction))
         {
-            fsiterator_t *it = fsdir_iterator(psync->dir);
-
-            if (it)
+            fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &psync->uuid);
+            if (files_map)
             {
-                time_t const cur_time = time(0);
+                fsiterator_t *it = fsdir_iterator(psync->dir);
+
+                // Files of the first scan are loaded in sorted order
+                bool const is_bulk = fdb_sync_files_is_empty(files_map, &transaction)
+                                     && fdb_sync_files_bulk_start(files_map, &transaction);
 
-                for(dirent_t entry; fsdir_iterator_next(it, &entry);)
+                if (it)
                 {
-                    if (entry.type == FS_REG)
-                    {
-                        fsync_file_info_t info = { 0 };
-                        info.id = FINVALID_ID;
-                        info.mod_time = cur_time;
-                        info.status = FFILE_IS_EXIST;
+                    time_t const cur_time = time(0);
 
-                        char full_path[FMAX_PATH];
-                        size_t full_path_len = fsdir_iterator_full_path(it, &entry, full_path, sizeof full_path);
-                        if (full_path_len <= sizeof full_path)
+                    for(dirent_t entry; fsdir_iterator_next(it, &entry);)
+                    {
+                        if (entry.type == FS_REG)
                         {
-                            if (fsfile_md5sum(full_path, &info.digest))
+                            fsync_file_info_t info = { 0 };
+                            info.id = FINVALID_ID;
+                            info.mod_time = cur_time;
+                            info.status = FFILE_IS_EXIST;
+
+                            char full_path[FMAX_PATH];
+                            size_t full_path_len = fsdir_iterator_full_path(it, &entry, full_path, sizeof full_path);
+                            if (full_path_len <= sizeof full_path)
                             {
-                                info.status |= FFILE_DIGEST_IS_CALCULATED;
-                                fsdir_iterator_path(it, &entry, info.path, sizeof info.path);
-                                fsfile_size(full_path, &info.size);
-
-                                if (!fdb_sync_file_add(files_map, &transaction, &info))
+                                if (fsfile_md5sum(full_path, &info.digest))
                                 {
-                                    fdb_transaction_abort(&transaction);
-                                    fdb_sync_files_release(files_map);
-                                    files_map = 0;
-                                    break;
+                                    info.status |= FFILE_DIGEST_IS_CALCULATED;
+                                    fsdir_iterator_path(it, &entry, info.path, sizeof info.path);
+                                    fsfile_size(full_path, &info.size);
+
+                                    if (!fdb_sync_file_add(files_map, &transaction, &info))
+                                    {
+                                        fdb_transaction_abort(&transaction);
+                                        fdb_sync_files_release(files_map);
+                                        files_map = 0;
+                                        break;
+                                    }
                                 }
                             }
+                            else
+                                FS_ERR("Full path length of \'%s\' file is too long.", entry.name);
                         }
-                        else
-                            FS_ERR("Full path length of \'%s\' file is too long.", entry.name);
                     }
+                    fsdir_iterator_free(it);
                 }
-                fsdir_iterator_free(it);
-            }
 
-            if (files_map)
-            {
-                psync->sync_time = time(0);
-                fdb_transaction_commit(&transaction);
-                fdb_sync_files_release(files_map);
+                if (files_map
+                    && is_bulk
+                    && !fdb_sync_files_bulk_finish(files_map))
+                {
+                    fdb_transaction_abort(&transaction);
+                    fdb_sync_files_release(files_map);
+                    files_map = 0;
+                }
+
+                if (files_map)
+                {
+                    psync->sync_time = time(0);
+                    fdb_transaction_commit(&transaction);
+                    fdb_sync_files_release(files_map);
+                }
             }
+            fdb_transaction_abort(&transaction);
         }
     }
+    while (transaction.error == FERR_AGAIN);
 }
 
-fsync_t *fsync_create(fmsgbus_t *pmsgbus, fdb_t *db, char const *dir, fuuid_t const *uuid)
+fsync_t *fsync_create(fmsgbus_t *pmsgbus, fdb_t *db, fdb_shards_t *shards, char const *dir, fuuid_t const *uuid)
 {
-    if (!pmsgbus || !db || !dir || !*dir || !uuid)
+    if (!pmsgbus || !db || !shards || !dir || !*dir || !uuid)
     {
         FS_ERR("Invalid arguments");
         return 0;
@@ -590,6 +648,14 @@ fsync_t *fsync_create(fmsgbus_t *pmsgbus, fdb_t *db, char const *dir, fuuid_t co
     fsync_msgbus_retain(psync, pmsgbus);
 
     psync->db = fdb_retain(db);
+    psync->shards = fdb_shards_retain(shards);
+
+    psync->local_db = fdb_shard(shards, uuid);
+    if (!psync->local_db)
+    {
+        fsync_release(psync);
+        return 0;
+    }
 
     if (fring_queue_create(psync->events_queue_buf, sizeof psync->events_queue_buf, &psync->events_queue) != FSUCCESS)
     {
@@ -701,6 +767,9 @@ void fsync_release(fsync_t *psync)
             sem_destroy(&psync->events_queue_sem);
             sem_destroy(&psync->sync_sem);
             fsync_msgbus_release(psync);
+            if (psync->local_db)
+                fdb_release(psync->local_db);
+            fdb_shards_release(psync->shards);
             fdb_release(psync->db);
             memset(psync, 0, sizeof *psync);
             free(psync);
@@ -3,10 +3,11 @@
 #include <futils/uuid.h>
 #include <futils/msgbus.h>
 #include <fdb/db.h>
+#include <fdb/sync/shards.h>
 
 typedef struct fsync fsync_t;
 
-fsync_t *fsync_create(fmsgbus_t *pmsgbus, fdb_t *db, char const *dir, fuuid_t const *uuid);
+fsync_t *fsync_create(fmsgbus_t *pmsgbus, fdb_t *db, fdb_shards_t *shards, char const *dir, fuuid_t const *uuid);
 fsync_t *fsync_retain(fsync_t *psync);
 void     fsync_release(fsync_t *psync);
 
@@ -42,6 +42,8 @@ typedef struct
     sem_t                       pin_sem;        // Semaphore for input stream data wait
     fistream_t                 *pin;            // input stream
     fostream_t                 *pout;           // output stream
+    fristream_data_listener_t   listener;       // Listener of new data and stream end. Reads don't wait data if it is set.
+    void                       *listener_param;
 } fristream_t;
 
 static fristream_t     *fristream_retain (fristream_t *pstream);
@@ -51,6 +53,20 @@ static void             fristream_close  (fristream_t *pstream);
 static fstream_status_t fristream_status (fristream_t *pstream);
 static void             fristream_fail   (fristream_t *pstream, ferr_t err, char const *err_msg);
 
+static void fristream_notify(fristream_t *pstream)
+{
+    fristream_data_listener_t listener = 0;
+    void *param = 0;
+
+    fpush_lock(pstream->mutex);
+    listener = pstream->listener;
+    param = pstream->listener_param;
+    fpop_lock();
+
+    if (listener)
+        listener(param, &pstream->istream);
+}
+
 static void fristream_data_handler(fristream_t *pstream, FMSG_TYPE(stream_data) const *msg)
 {
     if (msg->stream_id != pstream->id
@@ -86,25 +102,31 @@ static void fristream_data_handler(fristream_t *pstream, FMSG_TYPE(stream_data)
 
         sem_post(&pstream->pin_sem);
     }
+
+    fristream_notify(pstream);
 }
 
 void fristream_failed_handler(fristream_t *pstream, FMSG_TYPE(stream_failed) const *msg)
 {
     if (msg->stream_id != pstream->id
-        || memcmp(&msg->hdr.src, &pstream->src, sizeof pstream->src) != 0)
+        || memcmp(&msg->hdr.src, &pstream->src, sizeof pstream->src) != 0
+        || memcmp(&msg->source, &pstream->src, sizeof pstream->src) != 0)
         return;
     pstream->status = FSTREAM_STATUS_INVALID;
     sem_post(&pstream->pin_sem);
+    fristream_notify(pstream);
 }
 
 void fristream_closed_handler(fristream_t *pstream, FMSG_TYPE(stream_closed) const *msg)
 {
     if (msg->stream_id != pstream->id
-        || memcmp(&msg->hdr.src, &pstream->src, sizeof pstream->src) != 0)
+        || memcmp(&msg->hdr.src, &pstream->src, sizeof pstream->src) != 0
+        || memcmp(&msg->source, &pstream->src, sizeof pstream->src) != 0)
         return;
     pstream->total_size = msg->data_size;
     pstream->status = FSTREAM_STATUS_CLOSED;
     sem_post(&pstream->pin_sem);
+    fristream_notify(pstream);
 }
 
 void fristream_node_disconnected_handler(fristream_t *pstream, FMSG_TYPE(node_disconnected) const *msg)
@@ -113,6 +135,7 @@ void fristream_node_disconnected_handler(fristream_t *pstream, FMSG_TYPE(node_di
         return;
     pstream->status = FSTREAM_STATUS_CLOSED;
     sem_post(&pstream->pin_sem);
+    fristream_notify(pstream);
 }
 
 static void fristream_msgbus_retain(fristream_t *pstream, fmsgbus_t *pmsgbus)
@@ -126,10 +149,10 @@ static void fristream_msgbus_retain(fristream_t *pstream, fmsgbus_t *pmsgbus)
 
 static void fristream_msgbus_release(fristream_t *pstream)
 {
-    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_DATA,       (fmsg_handler_t)fristream_data_handler);
-    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_FAILED,     (fmsg_handler_t)fristream_failed_handler);
-    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_CLOSED,     (fmsg_handler_t)fristream_closed_handler);
-    fmsgbus_unsubscribe(pstream->msgbus, FNODE_DISCONNECTED, (fmsg_handler_t)fristream_node_disconnected_handler);
+    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_DATA,       (fmsg_handler_t)fristream_data_handler, pstream);
+    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_FAILED,     (fmsg_handler_t)fristream_failed_handler, pstream);
+    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_CLOSED,     (fmsg_handler_t)fristream_closed_handler, pstream);
+    fmsgbus_unsubscribe(pstream->msgbus, FNODE_DISCONNECTED, (fmsg_handler_t)fristream_node_disconnected_handler, pstream);
     fmsgbus_release(pstream->msgbus);
     pstream->msgbus = 0;
 }
@@ -216,6 +239,8 @@ static bool fristream_release(fristream_t *pstream)
         else if (!--pstream->ref_counter)
         {
             fristream_close(pstream);
+            if (pstream->msgbus)
+                fristream_msgbus_release(pstream);
             sem_destroy(&pstream->pin_sem);
             if (pstream->pin)
                 pstream->pin->release(pstream->pin);
@@ -243,6 +268,7 @@ static void fristream_close(fristream_t *pstream)
         {
             FMSG(stream_closed, closed, pstream->dst, pstream->src,
                 pstream->id,
+                pstream->src,
                 pstream->read_size
             );
             if (fmsgbus_publish(pstream->msgbus, FSTREAM_CLOSED, (fmsg_t const *)&closed) != FSUCCESS)
@@ -266,7 +292,8 @@ static void fristream_fail(fristream_t *pstream, ferr_t err, char const *err_msg
         {
             FMSG(stream_failed, fail, pstream->dst, pstream->src,
                 pstream->id,
-                pstream->read_size
+                pstream->src,
+                err
             );
             strncpy(fail.msg, err_msg, sizeof fail.msg);
             if (fmsgbus_publish(pstream->msgbus, FSTREAM_FAILED, (fmsg_t const *)&fail) != FSUCCESS)
@@ -289,10 +316,13 @@ static size_t fristream_read(fristream_t *pstream, char *data, size_t size)
     if (fristream_status(pstream) != FSTREAM_STATUS_OK)
         return 0;
 
+    bool const is_nonblocking = pstream->listener != 0;
+
     size_t read_size = 0;
     while (read_size < size)
     {
-        while (pstream->status == FSTREAM_STATUS_OK
+        while (!is_nonblocking
+               && pstream->status == FSTREAM_STATUS_OK
                && sem_wait(&pstream->pin_sem) == -1
                && errno == EINTR)
             continue;       // Restart if interrupted by handler
@@ -304,7 +334,7 @@ static size_t fristream_read(fristream_t *pstream, char *data, size_t size)
 
         read_size += rsize;
 
-        if (pstream->status != FSTREAM_STATUS_OK
+        if ((is_nonblocking || pstream->status != FSTREAM_STATUS_OK)
             && read_size < size)
             break;
     }
@@ -328,6 +358,26 @@ static fstream_status_t fristream_status(fristream_t *pstream)
     return pstream->status;
 }
 
+ferr_t frstream_istream_listen(fistream_t *pistream, fristream_data_listener_t listener, void *param)
+{
+    if (!pistream
+        || pistream->read != (fistream_read_fn_t)fristream_read
+        || !listener)
+    {
+        FS_ERR("Invalid arguments");
+        return FERR_INVALID_ARG;
+    }
+
+    fristream_t *pstream = (fristream_t *)pistream;
+
+    fpush_lock(pstream->mutex);
+    pstream->listener = listener;
+    pstream->listener_param = param;
+    fpop_lock();
+
+    return FSUCCESS;
+}
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // frostream
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -363,7 +413,8 @@ void frostream_accept_handler(frostream_t *pstream, FMSG_TYPE(stream_accept) con
 void frostream_failed_handler(frostream_t *pstream, FMSG_TYPE(stream_failed) const *msg)
 {
     if (msg->stream_id != pstream->id
-        || memcmp(&msg->hdr.src, &pstream->dst, sizeof pstream->dst) != 0)
+        || memcmp(&msg->hdr.src, &pstream->dst, sizeof pstream->dst) != 0
+        || memcmp(&msg->source, &pstream->src, sizeof pstream->src) != 0)      // the stream of peer may have the same id
         return;
     pstream->status = FSTREAM_STATUS_INVALID;
     sem_post(&pstream->sem);
@@ -372,7 +423,8 @@ void frostream_failed_handler(frostream_t *pstream, FMSG_TYPE(stream_failed) con
 void frostream_closed_handler(frostream_t *pstream, FMSG_TYPE(stream_closed) const *msg)
 {
     if (msg->stream_id != pstream->id
-        || memcmp(&msg->hdr.src, &pstream->dst, sizeof pstream->dst) != 0)
+        || memcmp(&msg->hdr.src, &pstream->dst, sizeof pstream->dst) != 0
+        || memcmp(&msg->source, &pstream->src, sizeof pstream->src) != 0)      // the stream of peer may have the same id
         return;
     pstream->status = FSTREAM_STATUS_CLOSED;
     sem_post(&pstream->sem);
@@ -397,10 +449,10 @@ static void frostream_msgbus_retain(frostream_t *pstream, fmsgbus_t *pmsgbus)
 
 static void frostream_msgbus_release(frostream_t *pstream)
 {
-    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_ACCEPT,     (fmsg_handler_t)frostream_accept_handler);
-    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_FAILED,     (fmsg_handler_t)frostream_failed_handler);
-    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_CLOSED,     (fmsg_handler_t)frostream_closed_handler);
-    fmsgbus_unsubscribe(pstream->msgbus, FNODE_DISCONNECTED, (fmsg_handler_t)frostream_node_disconnected_handler);
+    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_ACCEPT,     (fmsg_handler_t)frostream_accept_handler, pstream);
+    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_FAILED,     (fmsg_handler_t)frostream_failed_handler, pstream);
+    fmsgbus_unsubscribe(pstream->msgbus, FSTREAM_CLOSED,     (fmsg_handler_t)frostream_closed_handler, pstream);
+    fmsgbus_unsubscribe(pstream->msgbus, FNODE_DISCONNECTED, (fmsg_handler_t)frostream_node_disconnected_handler, pstream);
     fmsgbus_release(pstream->msgbus);
     pstream->msgbus = 0;
 }
@@ -481,6 +533,7 @@ static void frostream_close(frostream_t *pstream)
         {
             FMSG(stream_closed, closed, pstream->src, pstream->dst,
                 pstream->id,
+                pstream->src,
                 pstream->written_size
             );
             if (fmsgbus_publish(pstream->msgbus, FSTREAM_CLOSED, (fmsg_t const *)&closed) != FSUCCESS)
@@ -504,6 +557,7 @@ static void frostream_fail(frostream_t *pstream, ferr_t err, char const *err_msg
         {
             FMSG(stream_failed, fail, pstream->src, pstream->dst,
                 pstream->id,
+                pstream->src,
                 err
             );
             strncpy(fail.msg, err_msg, sizeof fail.msg);
@@ -741,6 +795,7 @@ static ferr_t frstream_factory_stream_msg_handler(frstream_factory_t *pfactory,
 
     FMSG(stream_failed, fail, pfactory->uuid, msg->source,
         msg->stream_id,
+        msg->source,
         FFAIL,
         "Input stream wasn't accepted"
     );
@@ -836,6 +891,7 @@ static void frstream_factory_stream_received(frstream_factory_t *pfactory, FMSG_
 
             FMSG(stream_failed, err, pfactory->uuid, msg->hdr.src,
                 msg->stream_id,
+                msg->hdr.src,
                 ret,
                 "There is no free space to handle the response"
             );
@@ -853,7 +909,7 @@ static void frstream_factory_msgbus_retain(frstream_factory_t *pfactory, fmsgbus
 
 static void frstream_factory_msgbus_release(frstream_factory_t *pfactory)
 {
-    fmsgbus_unsubscribe(pfactory->msgbus, FSTREAM, (fmsg_handler_t)frstream_factory_stream_received);
+    fmsgbus_unsubscribe(pfactory->msgbus, FSTREAM, (fmsg_handler_t)frstream_factory_stream_received, pfactory);
     fmsgbus_release(pfactory->msgbus);
 }
 
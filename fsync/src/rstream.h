@@ -14,6 +14,7 @@ typedef struct frstream_info
 
 typedef struct frstream_factory frstream_factory_t;
 typedef void (*fristream_listener_t)(void *, fistream_t *, frstream_info_t const *info);
+typedef void (*fristream_data_listener_t)(void *, fistream_t *);
 
 frstream_factory_t  *frstream_factory(fmsgbus_t *pmsgbus, fuuid_t const *uuid);
 frstream_factory_t  *frstream_factory_retain(frstream_factory_t *pfactory);
@@ -21,5 +22,6 @@ void                 frstream_factory_release(frstream_factory_t *pfactory);
 fostream_t          *frstream_factory_stream(frstream_factory_t *pfactory, fuuid_t const *dst, binn *metainf);  // src(ostream) ----> dst(istream)
 ferr_t               frstream_factory_istream_subscribe(frstream_factory_t *pfactory, fristream_listener_t istream_listener, void *param);
 ferr_t               frstream_factory_istream_unsubscribe(frstream_factory_t *pfactory, fristream_listener_t istream_listener);
+ferr_t               frstream_istream_listen(fistream_t *pistream, fristream_data_listener_t listener, void *param);   // Reads of istream don't wait data. Listener is notified about new data and stream end.
 
 #endif
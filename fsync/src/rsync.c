@@ -1,5 +1,7 @@
 #include "rsync.h"
+#include "rsync_match.h"
 #include <futils/log.h>
+#include <futils/utils.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -7,104 +9,580 @@
 #include <semaphore.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <librsync.h>
 
 enum
 {
-    FRBUF_SIZE = 8 * 1024
+    FRSYNC_IO_BUF_SIZE          = 256 * 1024,                       // Default size of input and output buffers of librsync jobs
+    FRSYNC_SEGMENT_SIZE         = 16 * 1024 * 1024,                 // Input is split into segments. Segments are processed in parallel.
+    FRSYNC_READ_SIZE            = 256 * 1024,                       // Size of one read from the input stream
+    FRSYNC_WORKERS_MAX          = 16,
+    FRSYNC_WINDOW_MAX           = 2 * FRSYNC_WORKERS_MAX,           // Max number of segments in progress
+    FRSYNC_WINDOW_SIZE_MAX      = 64 * 1024 * 1024,                 // Max size of output of segments which are processed ahead
+    FRSYNC_SIG_HEADER_SIZE      = 12,                               // Signature header: magic, block length, strong sum length
+    FRSYNC_DELTA_HEADER_SIZE    = 4,                                // Delta header: magic
+    FRSYNC_DELTA_OVERLAP        = 256 * 1024,                       // Delta of segment is calculated over the head of the next segment too
+    FRSYNC_BLOCK_LEN_MAX        = 128 * 1024                        // Limit of the block length for huge files
 };
 
+/*
+ * librsync job or in-tree delta job. Both jobs take the input and give the output by rs_buffers_t.
+ */
 typedef struct
 {
-    rs_job_t           *job;
-    uint32_t            in_size;
-    char                in_buf[FRBUF_SIZE];
-    uint32_t            out_size;
-    char                out_buf[FRBUF_SIZE];
+    rs_job_t           *rs_job;
+    frsync_match_job_t *match_job;
+} frsync_job_t;
+
+static bool frsync_job_is_valid(frsync_job_t const *job)
+{
+    return job->rs_job || job->match_job;
+}
+
+static rs_result frsync_job_iter(frsync_job_t *job, rs_buffers_t *buf)
+{
+    return job->match_job
+            ? frsync_match_job_iter(job->match_job, buf)
+            : rs_job_iter(job->rs_job, buf);
+}
+
+static void frsync_job_free(frsync_job_t *job)
+{
+    if (job->rs_job)
+        rs_job_free(job->rs_job);
+    frsync_match_job_free(job->match_job);
+    memset(job, 0, sizeof *job);
+}
+
+/*
+ * Job with input and output buffers. Buffers are allocated by the first use.
+ * The unconsumed input stays in place. It is moved to the buffer start only when the free tail is less than half of buffer.
+ * Memory and mapped input streams are passed to librsync without buffering.
+ */
+typedef struct
+{
+    frsync_job_t        job;
+    size_t              buf_size;
+    char               *in_buf;
+    size_t              in_begin;                                   // Unconsumed input is [in_begin, in_end)
+    size_t              in_end;
+    char               *out_buf;
 } frsync_iojob_t;
 
+static void frsync_iojob_init(frsync_iojob_t *io_job, frsync_job_t job, size_t buf_size)
+{
+    memset(io_job, 0, sizeof *io_job);
+    io_job->job = job;
+    io_job->buf_size = buf_size ? buf_size : FRSYNC_IO_BUF_SIZE;
+}
+
+static void frsync_iojob_free(frsync_iojob_t *io_job)
+{
+    frsync_job_free(&io_job->job);
+    free(io_job->in_buf);
+    free(io_job->out_buf);
+    memset(io_job, 0, sizeof *io_job);
+}
+
+static ferr_t frsync_write(fostream_t *postream, char const *data, size_t size)
+{
+    while(size)
+    {
+        size_t const write_size = postream->write(postream, data, size);
+        if (!write_size)
+            return FFAIL;
+        data += write_size;
+        size -= write_size;
+    }
+    return FSUCCESS;
+}
+
+// Runs the job while the output buffer is filled up. The output is written into the output stream.
+static rs_result frsync_iojob_iter(frsync_iojob_t *io_job, rs_buffers_t *buf, fostream_t *postream)
+{
+    rs_result result;
+
+    do
+    {
+        buf->next_out = io_job->out_buf;
+        buf->avail_out = postream ? io_job->buf_size : 0;
+
+        result = frsync_job_iter(&io_job->job, buf);
+
+        if (result != RS_BLOCKED
+            && result != RS_DONE)
+            return result;
+
+        if (postream
+            && frsync_write(postream, io_job->out_buf, buf->next_out - io_job->out_buf) != FSUCCESS)
+            return RS_IO_ERROR;
+    }
+    while (result == RS_BLOCKED && postream && !buf->avail_out);
+
+    return result;
+}
+
+// The output stream is optional. Jobs without output (signature loading) take the input only.
+// FERR_AGAIN is returned if the input stream has no data yet and it isn't closed. The job state is kept between calls.
 static ferr_t frsync_iojob_do(frsync_iojob_t *io_job, fistream_t *pistream, fostream_t *postream)
 {
-    uint32_t rsize = 0;
+    if (postream && !io_job->out_buf)
+    {
+        io_job->out_buf = malloc(io_job->buf_size);
+        if (!io_job->out_buf)
+        {
+            FS_ERR("Unable to allocate memory for output buffer");
+            return FFAIL;
+        }
+    }
+
     rs_result result;
+    rs_buffers_t buf = { 0 };
+    size_t size = 0, offset = 0;
+    char const *data = fistream_data(pistream, &size, &offset);
+
+    if (data && io_job->in_begin == io_job->in_end)
+    {
+        buf.next_in = (char *)data + offset;
+        buf.avail_in = size - offset;
+        buf.eof_in = true;
+
+        do
+            result = frsync_iojob_iter(io_job, &buf, postream);
+        while (result == RS_BLOCKED);
+
+        pistream->seek(pistream, size - buf.avail_in);
+
+        return result == RS_DONE ? FSUCCESS : FFAIL;
+    }
+
+    if (!io_job->in_buf)
+    {
+        io_job->in_buf = malloc(io_job->buf_size);
+        if (!io_job->in_buf)
+        {
+            FS_ERR("Unable to allocate memory for input buffer");
+            return FFAIL;
+        }
+    }
 
     do
     {
-        size_t const read_size = sizeof io_job->in_buf - io_job->in_size;
-        rsize = pistream->read(pistream, io_job->in_buf + io_job->in_size, read_size);
-        io_job->in_size += rsize;
+        if (io_job->in_begin
+            && io_job->buf_size - io_job->in_end < io_job->buf_size / 2)
+        {
+            memmove(io_job->in_buf, io_job->in_buf + io_job->in_begin, io_job->in_end - io_job->in_begin);
+            io_job->in_end -= io_job->in_begin;
+            io_job->in_begin = 0;
+        }
 
-        fstream_status_t istream_status = pistream->status(pistream);
+        size_t const read_size = pistream->read(pistream, io_job->in_buf + io_job->in_end, io_job->buf_size - io_job->in_end);
+        fstream_status_t const status = pistream->status(pistream);
 
-        rs_buffers_t buf = { 0 };
-        buf.next_in = io_job->in_buf;
-        buf.avail_in = io_job->in_size;
-        buf.eof_in = istream_status == FSTREAM_STATUS_EOF;
-        buf.next_out = io_job->out_buf;
-        buf.avail_out = sizeof io_job->out_buf;
+        io_job->in_end += read_size;
 
-        result = rs_job_iter(io_job->job, &buf);
+        buf.next_in = io_job->in_buf + io_job->in_begin;
+        buf.avail_in = io_job->in_end - io_job->in_begin;
+        buf.eof_in = status == FSTREAM_STATUS_EOF;
+
+        result = frsync_iojob_iter(io_job, &buf, postream);
 
         if (result != RS_BLOCKED
             && result != RS_DONE)
             return FFAIL;
 
-        size_t sig_size = buf.next_out - io_job->out_buf;
-        while(sig_size)
+        io_job->in_begin = io_job->in_end - buf.avail_in;
+        if (io_job->in_begin == io_job->in_end)
+            io_job->in_begin = io_job->in_end = 0;
+
+        // The job waits the input which isn't received yet. It is continued by the next call.
+        if (result == RS_BLOCKED && !read_size && status != FSTREAM_STATUS_EOF)
         {
-            uint32_t write_size = postream->write(postream, io_job->out_buf, sig_size);
-            if (!write_size)
+            if (status != FSTREAM_STATUS_OK)
+            {
+                FS_ERR("Input stream reading failed");
                 return FFAIL;
-            sig_size -= write_size;
+            }
+            if (io_job->in_end - io_job->in_begin == io_job->buf_size)
+            {
+                FS_ERR("Input buffer is too small for the job");
+                return FFAIL;
+            }
+            return FERR_AGAIN;
         }
-
-        if (buf.avail_in)
-            memmove(io_job->in_buf, io_job->in_buf + io_job->in_size - buf.avail_in, buf.avail_in);
-        io_job->in_size = buf.avail_in;
     }
     while (result == RS_BLOCKED);
 
     return FSUCCESS;
 }
 
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+// Segments processing
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+typedef frsync_job_t (*frsync_job_begin_fn_t)(void *param);
+
+typedef struct
+{
+    size_t              idx;                                        // Segment number
+    bool                is_done;
+    bool                is_eof;                                     // The input stream ends in this segment
+    ferr_t              result;
+    char               *data;                                       // Output of librsync job for segment
+    size_t              size;
+    size_t              capacity;
+} frsync_segment_t;
+
+/*
+ * Workers take segments in order and process them by separate librsync jobs.
+ * Output of jobs is taken by the caller in order of segments.
+ * The output which isn't released by the caller is limited by the window size. Two segments which are next for the caller
+ * aren't limited because the caller waits them.
+ */
 typedef struct
 {
-    rs_job_t           *job;
-    uint32_t            in_size;
-    char                in_buf[FRBUF_SIZE];
-} frsync_ijob_t;
+    fistream_t         *pistream;
+    char const         *data;                                       // Contiguous data of memory and mapped input streams
+    size_t              data_size;
+    pthread_mutex_t     stream_mutex;                               // Reads of input stream are serialized
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond;
+    frsync_job_begin_fn_t job_begin;
+    void               *param;
+    size_t              segment_size;
+    size_t              overlap;                                    // Number of bytes which are read after the end of segment
+    size_t              window;
+    size_t              window_size;                                // Limit of the buffered output
+    size_t              buffered_size;                              // Output of segments which aren't released
+    size_t              next_segment;                               // Next segment for processing
+    size_t              released_segments;                          // Number of segments which were taken by the caller
+    size_t              last_segment;                               // The last segment of the input stream
+    bool                is_stopped;
+    uint32_t            workers_num;
+    pthread_t           workers[FRSYNC_WORKERS_MAX];
+    frsync_segment_t    segments[FRSYNC_WINDOW_MAX];
+} frsync_segments_t;
+
+static uint32_t frsync_workers_num(uint32_t workers_num)
+{
+    if (!workers_num)
+    {
+        long const cpus_num = sysconf(_SC_NPROCESSORS_ONLN);
+        workers_num = cpus_num > 0 ? (uint32_t)cpus_num : 1;
+    }
 
-static ferr_t frsync_ijob_do(frsync_ijob_t *i_job, fistream_t *pistream)
+    return workers_num < FRSYNC_WORKERS_MAX ? workers_num : FRSYNC_WORKERS_MAX;
+}
+
+// Reserves the space for output of librsync job. The job writes directly into the segment buffer.
+static bool frsync_segment_reserve(frsync_segment_t *segment, size_t size)
+{
+    if (segment->size + size > segment->capacity)
+    {
+        size_t capacity = segment->capacity ? segment->capacity * 2 : FRSYNC_IO_BUF_SIZE;
+        while (capacity < segment->size + size)
+            capacity *= 2;
+
+        char *buf = realloc(segment->data, capacity);
+        if (!buf)
+        {
+            FS_ERR("Unable to allocate memory for output of segment");
+            return false;
+        }
+
+        segment->data = buf;
+        segment->capacity = capacity;
+    }
+
+    return true;
+}
+
+// Accounts the output of segment. Workers which are ahead of the caller wait while the window is full.
+static bool frsync_segments_buffer(frsync_segments_t *segments, frsync_segment_t *segment, size_t size)
 {
-    uint32_t rsize = 0;
+    pthread_mutex_lock(&segments->mutex);
+
+    segments->buffered_size += size;
+
+    while (!segments->is_stopped
+           && segment->idx > segments->released_segments + 1
+           && segments->buffered_size >= segments->window_size)
+        pthread_cond_wait(&segments->cond, &segments->mutex);
+
+    bool const is_stopped = segments->is_stopped;
+
+    pthread_mutex_unlock(&segments->mutex);
+
+    return !is_stopped;
+}
+
+// Reads the next part of segment. Seek and read are performed atomically because the input stream is shared by workers.
+static size_t frsync_segment_read(frsync_segments_t *segments, frsync_segment_t *segment, size_t pos, char *buf, size_t size, bool *is_eof)
+{
+    size_t rsize = 0;
+    bool is_seeked;
+    fstream_status_t status = FSTREAM_STATUS_OK;
+
+    pthread_mutex_lock(&segments->stream_mutex);
+    is_seeked = segments->pistream->seek(segments->pistream, (size_t)segment->idx * segments->segment_size + pos);
+    if (is_seeked)
+    {
+        rsize = segments->pistream->read(segments->pistream, buf, size);
+        status = segments->pistream->status(segments->pistream);
+    }
+    pthread_mutex_unlock(&segments->stream_mutex);
+
+    if (!is_seeked)
+    {
+        FS_ERR("Input stream seeking failed");
+        segment->result = FFAIL;
+    }
+
+    // The segment which starts after the stream end is empty
+    *is_eof = !rsize || status == FSTREAM_STATUS_EOF;
+
+    return rsize;
+}
+
+static void frsync_segment_process(frsync_segments_t *segments, frsync_segment_t *segment, char *in_buf)
+{
+    frsync_job_t job = segments->job_begin(segments->param);
+    if (!frsync_job_is_valid(&job))
+    {
+        FS_ERR("Unable to create job for segment");
+        segment->result = FFAIL;
+        return;
+    }
+
+    size_t const end = segments->segment_size + segments->overlap;
+    size_t pos = 0;
+    size_t in_begin = 0;
+    size_t in_end = 0;
+    bool eof_in = false;
+    rs_buffers_t buf = { 0 };
     rs_result result;
 
+    // Memory input is passed to the job as is
+    if (segments->data)
+    {
+        size_t const begin = segment->idx <= segments->data_size / segments->segment_size
+                                ? segment->idx * segments->segment_size
+                                : segments->data_size;
+        size_t const size = segments->data_size - begin;
+
+        buf.next_in = (char *)segments->data + begin;
+        buf.avail_in = size < end ? size : end;
+        buf.eof_in = eof_in = true;
+        segment->is_eof = size < end && size <= segments->segment_size;
+    }
+
     do
     {
-        size_t const read_size = sizeof i_job->in_buf - i_job->in_size;
-        rsize = pistream->read(pistream, i_job->in_buf + i_job->in_size, read_size);
-        i_job->in_size += rsize;
+        if (!eof_in)
+        {
+            if (in_begin
+                && FRSYNC_READ_SIZE - in_end < FRSYNC_READ_SIZE / 2)
+            {
+                memmove(in_buf, in_buf + in_begin, in_end - in_begin);
+                in_end -= in_begin;
+                in_begin = 0;
+            }
+
+            size_t read_size = FRSYNC_READ_SIZE - in_end;
+            if (read_size > end - pos)
+                read_size = end - pos;
+
+            bool is_eof = false;
+            size_t const rsize = read_size ? frsync_segment_read(segments, segment, pos, in_buf + in_end, read_size, &is_eof) : 0;
 
-        fstream_status_t istream_status = pistream->status(pistream);
+            if (segment->result != FSUCCESS)
+                break;
 
-        rs_buffers_t buf = { 0 };
-        buf.next_in = i_job->in_buf;
-        buf.avail_in = i_job->in_size;
-        buf.eof_in = istream_status == FSTREAM_STATUS_EOF;
+            pos += rsize;
+            in_end += rsize;
 
-        result = rs_job_iter(i_job->job, &buf);
+            eof_in = is_eof || pos == end;
+            segment->is_eof = is_eof && pos < end && pos <= segments->segment_size;
+
+            buf.next_in = in_buf + in_begin;
+            buf.avail_in = in_end - in_begin;
+            buf.eof_in = eof_in;
+        }
+
+        if (!frsync_segment_reserve(segment, FRSYNC_IO_BUF_SIZE))
+        {
+            segment->result = FFAIL;
+            break;
+        }
+
+        buf.next_out = segment->data + segment->size;
+        buf.avail_out = FRSYNC_IO_BUF_SIZE;
+
+        result = frsync_job_iter(&job, &buf);
 
         if (result != RS_BLOCKED
             && result != RS_DONE)
-            return FFAIL;
+        {
+            segment->result = FFAIL;
+            break;
+        }
+
+        size_t const out_size = buf.next_out - segment->data - segment->size;
+        segment->size += out_size;
 
-        if (buf.avail_in)
-            memmove(i_job->in_buf, i_job->in_buf + i_job->in_size - buf.avail_in, buf.avail_in);
-        i_job->in_size = buf.avail_in;
+        if (!frsync_segments_buffer(segments, segment, out_size))
+        {
+            segment->result = FFAIL;
+            break;
+        }
+
+        if (!segments->data)
+        {
+            in_begin = in_end - buf.avail_in;
+            if (in_begin == in_end)
+                in_begin = in_end = 0;
+        }
     }
     while (result == RS_BLOCKED);
 
-    return FSUCCESS;
+    frsync_job_free(&job);
+}
+
+static void *frsync_segments_worker(void *param)
+{
+    frsync_segments_t *segments = (frsync_segments_t *)param;
+
+    // Memory input isn't buffered
+    char *in_buf = segments->data ? 0 : malloc(FRSYNC_READ_SIZE);
+    if (!in_buf && !segments->data)
+        FS_ERR("Unable to allocate memory for segments processing");
+
+    for(;;)
+    {
+        frsync_segment_t *segment = 0;
+
+        pthread_mutex_lock(&segments->mutex);
+
+        while (!segments->is_stopped
+               && segments->next_segment <= segments->last_segment
+               && segments->next_segment - segments->released_segments >= segments->window)
+            pthread_cond_wait(&segments->cond, &segments->mutex);
+
+        if (!segments->is_stopped
+            && segments->next_segment <= segments->last_segment)
+        {
+            segment = &segments->segments[segments->next_segment % segments->window];
+            segment->idx = segments->next_segment++;
+            segment->is_done = false;
+            segment->is_eof = false;
+            segment->result = in_buf || segments->data ? FSUCCESS : FFAIL;
+            segment->size = 0;
+        }
+
+        pthread_mutex_unlock(&segments->mutex);
+
+        if (!segment)
+            break;
+
+        if (segment->result == FSUCCESS)
+            frsync_segment_process(segments, segment, in_buf);
+
+        pthread_mutex_lock(&segments->mutex);
+        segment->is_done = true;
+        if (segment->is_eof && segment->idx < segments->last_segment)
+            segments->last_segment = segment->idx;
+        pthread_cond_broadcast(&segments->cond);
+        pthread_mutex_unlock(&segments->mutex);
+    }
+
+    free(in_buf);
+
+    return 0;
+}
+
+static frsync_segments_t *frsync_segments_start(fistream_t *pistream, uint32_t workers_num, size_t segment_size, size_t overlap, frsync_job_begin_fn_t job_begin, void *param)
+{
+    frsync_segments_t *segments = malloc(sizeof(frsync_segments_t));
+    if (!segments)
+    {
+        FS_ERR("Unable to allocate memory for segments processing");
+        return 0;
+    }
+    memset(segments, 0, sizeof *segments);
+
+    static pthread_mutex_t const mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_cond_t const cond_initializer = PTHREAD_COND_INITIALIZER;
+
+    segments->pistream = pistream;
+    segments->data = fistream_data(pistream, &segments->data_size, 0);
+    segments->stream_mutex = mutex_initializer;
+    segments->mutex = mutex_initializer;
+    segments->cond = cond_initializer;
+    segments->job_begin = job_begin;
+    segments->param = param;
+    segments->segment_size = segment_size;
+    segments->overlap = overlap;
+    segments->window = 2 * workers_num;
+    segments->window_size = FRSYNC_WINDOW_SIZE_MAX;
+    segments->last_segment = SIZE_MAX;
+
+    for (; segments->workers_num < workers_num; ++segments->workers_num)
+    {
+        int rc = pthread_create(&segments->workers[segments->workers_num], 0, frsync_segments_worker, (void*)segments);
+        if (rc)
+        {
+            FS_ERR("Unable to create the thread for segments processing. Error: %d", rc);
+            break;
+        }
+    }
+
+    return segments;
+}
+
+static void frsync_segments_stop(frsync_segments_t *segments)
+{
+    pthread_mutex_lock(&segments->mutex);
+    segments->is_stopped = true;
+    pthread_cond_broadcast(&segments->cond);
+    pthread_mutex_unlock(&segments->mutex);
+
+    for (uint32_t i = 0; i < segments->workers_num; ++i)
+        pthread_join(segments->workers[i], 0);
+
+    for (size_t i = 0; i < FARRAY_SIZE(segments->segments); ++i)
+        free(segments->segments[i].data);
+
+    pthread_mutex_destroy(&segments->stream_mutex);
+    pthread_mutex_destroy(&segments->mutex);
+    pthread_cond_destroy(&segments->cond);
+    free(segments);
+}
+
+// Waits until the segment is processed. Segments are taken in order.
+static frsync_segment_t *frsync_segments_wait(frsync_segments_t *segments, size_t idx)
+{
+    frsync_segment_t *segment = &segments->segments[idx % segments->window];
+
+    pthread_mutex_lock(&segments->mutex);
+    while (segment->idx != idx || !segment->is_done)
+        pthread_cond_wait(&segments->cond, &segments->mutex);
+    pthread_mutex_unlock(&segments->mutex);
+
+    return segment;
+}
+
+// The slot of segment may be reused for the next segments. The output of segment is freed.
+static void frsync_segments_release(frsync_segments_t *segments, frsync_segment_t *segment)
+{
+    pthread_mutex_lock(&segments->mutex);
+    segments->buffered_size -= segment->size;
+    free(segment->data);
+    segment->data = 0;
+    segment->size = 0;
+    segment->capacity = 0;
+    segments->released_segments++;
+    pthread_cond_broadcast(&segments->cond);
+    pthread_mutex_unlock(&segments->mutex);
 }
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
@@ -113,10 +591,46 @@ static ferr_t frsync_ijob_do(frsync_ijob_t *i_job, fistream_t *pistream)
 struct frsync_signature_calculator
 {
     volatile uint32_t   ref_counter;
-    frsync_iojob_t      io_job;
+    uint32_t            workers_num;
+    uint32_t            block_len;
+    uint32_t            strong_len;                                 // 0 - full length of strong sum
 };
 
+/*
+ * The block length is about sqrt of file size (see rs_sig_args). Strong sums are truncated to the minimum length
+ * which is safe for the file size.
+ */
+void frsync_signature_args(uint64_t size, uint32_t *block_len, uint32_t *strong_len)
+{
+    rs_magic_number magic = RS_BLAKE2_SIG_MAGIC;
+    size_t len = 0;                                                 // Recommended block length
+    size_t strong = (size_t)-1;                                     // Minimum strong sum length
+
+    if (rs_sig_args((rs_long_t)size, &magic, &len, &strong) != RS_DONE)
+    {
+        *block_len = RS_DEFAULT_BLOCK_LEN;
+        *strong_len = 0;
+        return;
+    }
+
+    if (len > FRSYNC_BLOCK_LEN_MAX)
+    {
+        len = FRSYNC_BLOCK_LEN_MAX;
+        strong = (size_t)-1;
+        if (rs_sig_args((rs_long_t)size, &magic, &len, &strong) != RS_DONE)
+            strong = 0;
+    }
+
+    *block_len = (uint32_t)len;
+    *strong_len = (uint32_t)strong;
+}
+
 frsync_signature_calculator_t *frsync_signature_calculator_create()
+{
+    return frsync_signature_calculator_create_ex(0, 0, 0);
+}
+
+frsync_signature_calculator_t *frsync_signature_calculator_create_ex(uint32_t workers_num, uint32_t block_len, uint32_t strong_len)
 {
     frsync_signature_calculator_t *psig = malloc(sizeof(frsync_signature_calculator_t));
     if (!psig)
@@ -127,15 +641,9 @@ frsync_signature_calculator_t *frsync_signature_calculator_create()
     memset(psig, 0, sizeof *psig);
 
     psig->ref_counter = 1;
-
-    psig->io_job.job = rs_sig_begin(RS_DEFAULT_BLOCK_LEN, 0, RS_BLAKE2_SIG_MAGIC);
-
-    if (!psig->io_job.job)
-    {
-        FS_ERR("Unable to create job for signature calculation");
-        frsync_signature_calculator_release(psig);
-        return 0;
-    }
+    psig->workers_num = frsync_workers_num(workers_num);
+    psig->block_len = block_len ? block_len : RS_DEFAULT_BLOCK_LEN;
+    psig->strong_len = strong_len;
 
     return psig;
 }
@@ -157,8 +665,6 @@ void frsync_signature_calculator_release(frsync_signature_calculator_t *psig)
             FS_ERR("Invalid signature calculator");
         else if (!--psig->ref_counter)
         {
-            if (psig->io_job.job)
-                rs_job_free(psig->io_job.job);
             memset(psig, 0, sizeof *psig);
             free(psig);
         }
@@ -167,6 +673,53 @@ void frsync_signature_calculator_release(frsync_signature_calculator_t *psig)
         FS_ERR("Invalid signature calculator");
 }
 
+uint32_t frsync_signature_calculator_block_len(frsync_signature_calculator_t *psig)
+{
+    return psig ? psig->block_len : 0;
+}
+
+uint32_t frsync_signature_calculator_strong_len(frsync_signature_calculator_t *psig)
+{
+    return psig ? psig->strong_len : 0;
+}
+
+static frsync_job_t frsync_sig_job_begin(void *param)
+{
+    frsync_signature_calculator_t *psig = (frsync_signature_calculator_t *)param;
+    frsync_job_t const job = { rs_sig_begin(psig->block_len, psig->strong_len, RS_BLAKE2_SIG_MAGIC) };
+    return job;
+}
+
+// The whole input is processed by one job in the caller thread
+static ferr_t frsync_signature_calculate_serial(frsync_signature_calculator_t *psig, fistream_t *pbase_stream, fostream_t *psignature_ostream)
+{
+    frsync_iojob_t io_job;
+    frsync_iojob_init(&io_job, frsync_sig_job_begin(psig), 0);
+
+    if (!frsync_job_is_valid(&io_job.job))
+    {
+        FS_ERR("Unable to create job for signature calculation");
+        return FFAIL;
+    }
+
+    ferr_t ret = frsync_iojob_do(&io_job, pbase_stream, psignature_ostream);
+
+    frsync_iojob_free(&io_job);
+
+    if (ret == FERR_AGAIN)
+    {
+        FS_ERR("Base stream isn't complete");
+        ret = FFAIL;
+    }
+
+    return ret;
+}
+
+/*
+ * Segments are aligned to the block length, so signatures of segments are independent.
+ * The signature header is written only for the first segment.
+ * Workers aren't started for the input of one segment and for the input without seek.
+ */
 ferr_t frsync_signature_calculate(frsync_signature_calculator_t *psig, fistream_t *pbase_stream, fostream_t *psignature_ostream)
 {
     if (!psig || !pbase_stream || !psignature_ostream)
@@ -175,13 +728,53 @@ ferr_t frsync_signature_calculate(frsync_signature_calculator_t *psig, fistream_
         return FERR_INVALID_ARG;
     }
 
-    if (!pbase_stream->seek(pbase_stream, 0))
+    // Segments are aligned to the block length
+    size_t const segment_size = FRSYNC_SEGMENT_SIZE / psig->block_len * psig->block_len;
+
+    if (!segment_size)
     {
-        FS_ERR("Base stream seek failed");
+        FS_ERR("Invalid block length");
+        return FERR_INVALID_ARG;
+    }
+
+    size_t data_size = 0;
+
+    if (psig->workers_num <= 1
+        || !pbase_stream->seek
+        || (fistream_data(pbase_stream, &data_size, 0) && data_size <= segment_size))
+        return frsync_signature_calculate_serial(psig, pbase_stream, psignature_ostream);
+
+    frsync_segments_t *segments = frsync_segments_start(pbase_stream, psig->workers_num, segment_size, 0, frsync_sig_job_begin, psig);
+    if (!segments)
         return FFAIL;
+
+    ferr_t ret = segments->workers_num ? FSUCCESS : FFAIL;
+
+    for (size_t idx = 0; ret == FSUCCESS; ++idx)
+    {
+        frsync_segment_t *segment = frsync_segments_wait(segments, idx);
+
+        ret = segment->result;
+
+        if (ret == FSUCCESS)
+        {
+            size_t const header_size = idx ? FRSYNC_SIG_HEADER_SIZE : 0;
+            ret = segment->size >= header_size
+                    ? frsync_write(psignature_ostream, segment->data + header_size, segment->size - header_size)
+                    : FFAIL;
+        }
+
+        bool const is_eof = segment->is_eof;
+
+        frsync_segments_release(segments, segment);
+
+        if (is_eof)
+            break;
     }
 
-    return frsync_iojob_do(&psig->io_job, pbase_stream, psignature_ostream);
+    frsync_segments_stop(segments);
+
+    return ret;
 }
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
@@ -190,12 +783,34 @@ ferr_t frsync_signature_calculate(frsync_signature_calculator_t *psig, fistream_
 struct frsync_signature
 {
     volatile uint32_t   ref_counter;
+    frsync_backend_t    backend;
     rs_signature_t     *sumset;
+    frsync_match_table_t *ptable;                                   // Blocks table of in-tree backend
+    char               *data;                                       // Signature of in-tree backend which is received yet
+    size_t              size;
+    size_t              capacity;
     bool                is_ready;
-    frsync_ijob_t       ijob;
+    frsync_iojob_t      io_job;
 };
 
+static volatile frsync_backend_t frsync_default_backend = FRSYNC_BACKEND_NATIVE;
+
+void frsync_backend_set(frsync_backend_t backend)
+{
+    frsync_default_backend = backend;
+}
+
+frsync_backend_t frsync_backend()
+{
+    return frsync_default_backend;
+}
+
 frsync_signature_t *frsync_signature_create()
+{
+    return frsync_signature_create_ex(frsync_default_backend);
+}
+
+frsync_signature_t *frsync_signature_create_ex(frsync_backend_t backend)
 {
     frsync_signature_t *psig = malloc(sizeof(frsync_signature_t));
     if (!psig)
@@ -206,10 +821,16 @@ frsync_signature_t *frsync_signature_create()
     memset(psig, 0, sizeof *psig);
 
     psig->ref_counter = 1;
+    psig->backend = backend;
 
-    psig->ijob.job = rs_loadsig_begin(&psig->sumset);
+    // The in-tree backend loads the signature by itself
+    if (backend == FRSYNC_BACKEND_NATIVE)
+        return psig;
 
-    if (!psig->ijob.job)
+    frsync_job_t const job = { rs_loadsig_begin(&psig->sumset) };
+    frsync_iojob_init(&psig->io_job, job, 0);
+
+    if (!frsync_job_is_valid(&psig->io_job.job))
     {
         FS_ERR("Unable to create job for signature calculation");
         frsync_signature_release(psig);
@@ -236,10 +857,11 @@ void frsync_signature_release(frsync_signature_t *psig)
             FS_ERR("Invalid signature");
         else if (!--psig->ref_counter)
         {
-            if (psig->ijob.job)
-                rs_job_free(psig->ijob.job);
+            frsync_iojob_free(&psig->io_job);
             if (psig->sumset)
                 rs_free_sumset(psig->sumset);
+            frsync_match_table_free(psig->ptable);
+            free(psig->data);
             memset(psig, 0, sizeof *psig);
             free(psig);
         }
@@ -248,6 +870,91 @@ void frsync_signature_release(frsync_signature_t *psig)
         FS_ERR("Invalid signature");
 }
 
+// Signatures of other formats and with long blocks are loaded by librsync
+static ferr_t frsync_signature_native_build(frsync_signature_t *psig, char const *data, size_t size)
+{
+    if (frsync_match_is_supported(data, size))
+    {
+        psig->ptable = frsync_match_table_create(data, size);
+        return psig->ptable ? FSUCCESS : FFAIL;
+    }
+
+    psig->backend = FRSYNC_BACKEND_LIBRSYNC;
+
+    frsync_job_t const job = { rs_loadsig_begin(&psig->sumset) };
+    frsync_iojob_init(&psig->io_job, job, 0);
+
+    if (!frsync_job_is_valid(&psig->io_job.job))
+    {
+        FS_ERR("Unable to create job for signature calculation");
+        return FFAIL;
+    }
+
+    fistream_t *pistream = fmem_const_istream(data, size);
+    if (!pistream)
+    {
+        FS_ERR("Unable to create signature stream");
+        return FERR_NO_MEM;
+    }
+
+    ferr_t const ret = frsync_iojob_do(&psig->io_job, pistream, 0);
+    pistream->release(pistream);
+
+    return ret;
+}
+
+// The blocks table is built by the whole signature. The signature is collected until the end of stream.
+static ferr_t frsync_signature_native_load(frsync_signature_t *psig, fistream_t *psignature_istream)
+{
+    size_t size = 0, offset = 0;
+    char const *data = fistream_data(psignature_istream, &size, &offset);
+
+    if (data && !psig->size)
+    {
+        ferr_t const ret = frsync_signature_native_build(psig, data + offset, size - offset);
+        psignature_istream->seek(psignature_istream, size);
+        return ret;
+    }
+
+    for(;;)
+    {
+        if (psig->capacity - psig->size < FRSYNC_READ_SIZE)
+        {
+            size_t const capacity = psig->capacity ? psig->capacity * 2 : FRSYNC_READ_SIZE;
+            char *buf = realloc(psig->data, capacity);
+            if (!buf)
+            {
+                FS_ERR("Unable to allocate memory for signature");
+                return FFAIL;
+            }
+            psig->data = buf;
+            psig->capacity = capacity;
+        }
+
+        size_t const read_size = psignature_istream->read(psignature_istream, psig->data + psig->size, psig->capacity - psig->size);
+        psig->size += read_size;
+
+        fstream_status_t const status = psignature_istream->status(psignature_istream);
+        if (status == FSTREAM_STATUS_EOF)
+            break;
+        if (status != FSTREAM_STATUS_OK)
+        {
+            FS_ERR("Signature reading failed");
+            return FFAIL;
+        }
+        if (!read_size)
+            return FERR_AGAIN;
+    }
+
+    ferr_t const ret = frsync_signature_native_build(psig, psig->data, psig->size);
+
+    free(psig->data);
+    psig->data = 0;
+    psig->size = psig->capacity = 0;
+
+    return ret;
+}
+
 ferr_t frsync_signature_load(frsync_signature_t *psig, fistream_t *psignature_istream)
 {
     if (!psig || !psignature_istream)
@@ -259,10 +966,18 @@ ferr_t frsync_signature_load(frsync_signature_t *psig, fistream_t *psignature_is
     if (psig->is_ready)
         return FSUCCESS;
 
-    if (frsync_ijob_do(&psig->ijob, psignature_istream) == FSUCCESS)
-        psig->is_ready = rs_build_hash_table(psig->sumset) == RS_DONE;
+    ferr_t ret = psig->backend == FRSYNC_BACKEND_NATIVE
+                    ? frsync_signature_native_load(psig, psignature_istream)
+                    : frsync_iojob_do(&psig->io_job, psignature_istream, 0);
+
+    // The native backend could fall back to librsync
+    if (ret == FSUCCESS && psig->backend != FRSYNC_BACKEND_NATIVE
+        && rs_build_hash_table(psig->sumset) != RS_DONE)
+        ret = FFAIL;
+
+    psig->is_ready = ret == FSUCCESS;
 
-    return psig->is_ready ? FSUCCESS : FFAIL;
+    return ret;
 }
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
@@ -272,10 +987,30 @@ struct frsync_delta_calculator
 {
     volatile uint32_t   ref_counter;
     frsync_signature_t *psig;
+    uint32_t            workers_num;
     frsync_iojob_t      io_job;
 };
 
+static frsync_job_t frsync_delta_job_begin(void *param)
+{
+    frsync_delta_calculator_t *pdelta = (frsync_delta_calculator_t *)param;
+    frsync_signature_t *psig = pdelta->psig;
+    frsync_job_t job = { 0 };
+
+    if (psig->backend == FRSYNC_BACKEND_NATIVE)
+        job.match_job = frsync_match_job_begin(psig->ptable);
+    else
+        job.rs_job = rs_delta_begin(psig->sumset);
+
+    return job;
+}
+
 frsync_delta_calculator_t *frsync_delta_calculator_create(frsync_signature_t *psig)
+{
+    return frsync_delta_calculator_create_ex(psig, 0);
+}
+
+frsync_delta_calculator_t *frsync_delta_calculator_create_ex(frsync_signature_t *psig, uint32_t workers_num)
 {
     frsync_delta_calculator_t *pdelta = malloc(sizeof(frsync_delta_calculator_t));
     if (!pdelta)
@@ -287,10 +1022,11 @@ frsync_delta_calculator_t *frsync_delta_calculator_create(frsync_signature_t *ps
 
     pdelta->ref_counter = 1;
     pdelta->psig = frsync_signature_retain(psig);
+    pdelta->workers_num = frsync_workers_num(workers_num);
 
-    pdelta->io_job.job = rs_delta_begin(psig->sumset);
+    frsync_iojob_init(&pdelta->io_job, frsync_delta_job_begin(pdelta), 0);
 
-    if (!pdelta->io_job.job)
+    if (!frsync_job_is_valid(&pdelta->io_job.job))
     {
         FS_ERR("Unable to create job for delta calculation");
         frsync_delta_calculator_release(pdelta);
@@ -317,8 +1053,7 @@ void frsync_delta_calculator_release(frsync_delta_calculator_t *pdelta)
             FS_ERR("Invalid delta calculator");
         else if (!--pdelta->ref_counter)
         {
-            if (pdelta->io_job.job)
-                rs_job_free(pdelta->io_job.job);
+            frsync_iojob_free(&pdelta->io_job);
             frsync_signature_release(pdelta->psig);
             memset(pdelta, 0, sizeof *pdelta);
             free(pdelta);
@@ -328,6 +1063,310 @@ void frsync_delta_calculator_release(frsync_delta_calculator_t *pdelta)
         FS_ERR("Invalid delta calculator");
 }
 
+/*
+ * Delta commands of librsync:
+ *   0x00        - end
+ *   0x01..0x40  - literal, length is the command itself
+ *   0x41..0x44  - literal, length is 1, 2, 4 or 8 bytes
+ *   0x45..0x54  - copy, position and length are 1, 2, 4 or 8 bytes
+ * Numbers are big-endian.
+ */
+enum
+{
+    FRSYNC_OP_END           = 0x00,
+    FRSYNC_OP_LITERAL_64    = 0x40,
+    FRSYNC_OP_LITERAL_N1    = 0x41,
+    FRSYNC_OP_COPY_N1_N1    = 0x45,
+    FRSYNC_OP_COPY_N8_N8    = 0x54
+};
+
+typedef enum
+{
+    FRSYNC_DELTA_OP_END = 0,
+    FRSYNC_DELTA_OP_LITERAL,
+    FRSYNC_DELTA_OP_COPY
+} frsync_delta_op_type_t;
+
+typedef struct
+{
+    frsync_delta_op_type_t  type;
+    uint64_t                len;
+    uint64_t                pos;                                    // Position in base for copy command
+    char const             *data;                                   // Data of literal command
+} frsync_delta_op_t;
+
+typedef struct
+{
+    char const             *data;
+    char const             *end;
+    uint64_t                offset;                                 // Offset of the next command in new data
+} frsync_delta_reader_t;
+
+static bool frsync_delta_int_read(frsync_delta_reader_t *reader, unsigned width, uint64_t *value)
+{
+    if ((size_t)(reader->end - reader->data) < width)
+        return false;
+    *value = 0;
+    for (unsigned i = 0; i < width; ++i)
+        *value = (*value << 8) | (uint8_t)*reader->data++;
+    return true;
+}
+
+static bool frsync_delta_op_read(frsync_delta_reader_t *reader, frsync_delta_op_t *op)
+{
+    if (reader->data >= reader->end)
+        return false;
+
+    uint8_t const cmd = (uint8_t)*reader->data++;
+
+    memset(op, 0, sizeof *op);
+
+    if (cmd == FRSYNC_OP_END)
+        op->type = FRSYNC_DELTA_OP_END;
+    else if (cmd <= FRSYNC_OP_LITERAL_64)
+    {
+        op->type = FRSYNC_DELTA_OP_LITERAL;
+        op->len = cmd;
+    }
+    else if (cmd < FRSYNC_OP_COPY_N1_N1)
+    {
+        op->type = FRSYNC_DELTA_OP_LITERAL;
+        if (!frsync_delta_int_read(reader, 1u << (cmd - FRSYNC_OP_LITERAL_N1), &op->len))
+            return false;
+    }
+    else if (cmd <= FRSYNC_OP_COPY_N8_N8)
+    {
+        op->type = FRSYNC_DELTA_OP_COPY;
+        if (!frsync_delta_int_read(reader, 1u << ((cmd - FRSYNC_OP_COPY_N1_N1) / 4), &op->pos)
+            || !frsync_delta_int_read(reader, 1u << ((cmd - FRSYNC_OP_COPY_N1_N1) % 4), &op->len))
+            return false;
+    }
+    else
+        return false;
+
+    if (op->type == FRSYNC_DELTA_OP_LITERAL)
+    {
+        if ((uint64_t)(reader->end - reader->data) < op->len)
+            return false;
+        op->data = reader->data;
+        reader->data += op->len;
+    }
+
+    reader->offset += op->len;
+
+    return true;
+}
+
+static unsigned frsync_delta_int_width(uint64_t value)
+{
+    return value <= 0xFF ? 0 : value <= 0xFFFF ? 1 : value <= 0xFFFFFFFF ? 2 : 3;
+}
+
+static size_t frsync_delta_int_write(char *buf, unsigned width, uint64_t value)
+{
+    size_t const size = 1u << width;
+    for (size_t i = 0; i < size; ++i)
+        buf[i] = (char)(value >> (8 * (size - i - 1)));
+    return size;
+}
+
+static ferr_t frsync_delta_op_write(fostream_t *postream, frsync_delta_op_t const *op)
+{
+    char cmd[1 + 2 * sizeof(uint64_t)];
+    size_t size = 1;
+
+    switch(op->type)
+    {
+        case FRSYNC_DELTA_OP_LITERAL:
+        {
+            if (op->len <= FRSYNC_OP_LITERAL_64)
+                cmd[0] = (char)op->len;
+            else
+            {
+                unsigned const width = frsync_delta_int_width(op->len);
+                cmd[0] = (char)(FRSYNC_OP_LITERAL_N1 + width);
+                size += frsync_delta_int_write(cmd + size, width, op->len);
+            }
+            break;
+        }
+
+        case FRSYNC_DELTA_OP_COPY:
+        {
+            unsigned const pos_width = frsync_delta_int_width(op->pos);
+            unsigned const len_width = frsync_delta_int_width(op->len);
+            cmd[0] = (char)(FRSYNC_OP_COPY_N1_N1 + pos_width * 4 + len_width);
+            size += frsync_delta_int_write(cmd + size, pos_width, op->pos);
+            size += frsync_delta_int_write(cmd + size, len_width, op->len);
+            break;
+        }
+
+        default:
+            cmd[0] = FRSYNC_OP_END;
+            break;
+    }
+
+    ferr_t ret = frsync_write(postream, cmd, size);
+
+    if (ret == FSUCCESS && op->type == FRSYNC_DELTA_OP_LITERAL)
+        ret = frsync_write(postream, op->data, op->len);
+
+    return ret;
+}
+
+static bool frsync_delta_reader_init(frsync_delta_reader_t *reader, frsync_segment_t const *segment)
+{
+    if (segment->size < FRSYNC_DELTA_HEADER_SIZE)
+        return false;
+    reader->data = segment->data + FRSYNC_DELTA_HEADER_SIZE;
+    reader->end = segment->data + segment->size;
+    reader->offset = (uint64_t)segment->idx * FRSYNC_SEGMENT_SIZE;
+    return true;
+}
+
+/*
+ * Delta of segment covers the head of the next segment too. The next segment starts with literals
+ * until the first match is found. The delta of segment is used until this match.
+ */
+static uint64_t frsync_delta_segment_cut(frsync_segment_t const *segment, frsync_segment_t const *next_segment)
+{
+    frsync_delta_reader_t reader;
+    frsync_delta_op_t op;
+
+    uint64_t end = (uint64_t)next_segment->idx * FRSYNC_SEGMENT_SIZE;
+
+    if (frsync_delta_reader_init(&reader, segment))
+    {
+        while (frsync_delta_op_read(&reader, &op) && op.type != FRSYNC_DELTA_OP_END);
+        if (reader.offset > end)
+            end = reader.offset;
+    }
+
+    if (frsync_delta_reader_init(&reader, next_segment))
+    {
+        for (uint64_t offset = reader.offset; frsync_delta_op_read(&reader, &op) && op.type != FRSYNC_DELTA_OP_END; offset = reader.offset)
+        {
+            if (op.type == FRSYNC_DELTA_OP_COPY)
+                return offset < end ? offset : end;
+        }
+    }
+
+    return end;
+}
+
+// Writes commands of segment which cover [begin, end) range of new data. Adjacent copy commands are joined.
+static ferr_t frsync_delta_segment_write(frsync_segment_t const *segment, uint64_t begin, uint64_t end, frsync_delta_op_t *copy, fostream_t *postream)
+{
+    frsync_delta_reader_t reader;
+    if (!frsync_delta_reader_init(&reader, segment))
+        return FFAIL;
+
+    frsync_delta_op_t op;
+
+    for (uint64_t offset = reader.offset; offset < end; offset = reader.offset)
+    {
+        if (!frsync_delta_op_read(&reader, &op))
+            return FFAIL;
+
+        if (op.type == FRSYNC_DELTA_OP_END)
+            break;
+
+        if (reader.offset <= begin)
+            continue;
+
+        // The command is cut by range bounds
+        uint64_t const head = offset < begin ? begin - offset : 0;
+        uint64_t const tail = reader.offset > end ? reader.offset - end : 0;
+
+        op.len -= head + tail;
+        op.pos += head;
+        if (op.data)
+            op.data += head;
+
+        if (op.type == FRSYNC_DELTA_OP_COPY
+            && copy->len
+            && copy->pos + copy->len == op.pos)
+        {
+            copy->len += op.len;
+            continue;
+        }
+
+        if (copy->len
+            && frsync_delta_op_write(postream, copy) != FSUCCESS)
+            return FFAIL;
+
+        copy->len = 0;
+
+        if (op.type == FRSYNC_DELTA_OP_COPY)
+            *copy = op;
+        else if (frsync_delta_op_write(postream, &op) != FSUCCESS)
+            return FFAIL;
+    }
+
+    return FSUCCESS;
+}
+
+/*
+ * The hash table of signature is read-only after loading, so segments of new data are matched in parallel.
+ * Deltas of segments are merged into one delta stream.
+ */
+static ferr_t frsync_delta_calculate_parallel(frsync_delta_calculator_t *pdelta, fistream_t *pistream, fostream_t *pdelta_ostream)
+{
+    frsync_segments_t *segments = frsync_segments_start(pistream, pdelta->workers_num, FRSYNC_SEGMENT_SIZE, FRSYNC_DELTA_OVERLAP, frsync_delta_job_begin, pdelta);
+    if (!segments)
+        return FFAIL;
+
+    ferr_t ret = segments->workers_num ? FSUCCESS : FFAIL;
+
+    uint64_t begin = 0;
+    frsync_delta_op_t copy = { FRSYNC_DELTA_OP_COPY };
+    frsync_segment_t *segment = ret == FSUCCESS ? frsync_segments_wait(segments, 0) : 0;
+
+    if (segment)
+    {
+        ret = segment->result;
+        if (ret == FSUCCESS)
+            ret = segment->size >= FRSYNC_DELTA_HEADER_SIZE
+                    ? frsync_write(pdelta_ostream, segment->data, FRSYNC_DELTA_HEADER_SIZE)
+                    : FFAIL;
+    }
+
+    while (ret == FSUCCESS)
+    {
+        frsync_segment_t *next_segment = segment->is_eof ? 0 : frsync_segments_wait(segments, segment->idx + 1);
+
+        if (next_segment && next_segment->result != FSUCCESS)
+        {
+            ret = next_segment->result;
+            break;
+        }
+
+        uint64_t const end = next_segment ? frsync_delta_segment_cut(segment, next_segment) : UINT64_MAX;
+
+        ret = frsync_delta_segment_write(segment, begin, end, &copy, pdelta_ostream);
+
+        frsync_segments_release(segments, segment);
+
+        if (!next_segment)
+            break;
+
+        begin = end;
+        segment = next_segment;
+    }
+
+    frsync_segments_stop(segments);
+
+    if (ret == FSUCCESS && copy.len)
+        ret = frsync_delta_op_write(pdelta_ostream, &copy);
+
+    if (ret == FSUCCESS)
+    {
+        frsync_delta_op_t const end_op = { FRSYNC_DELTA_OP_END };
+        ret = frsync_delta_op_write(pdelta_ostream, &end_op);
+    }
+
+    return ret;
+}
+
 ferr_t frsync_delta_calculate(frsync_delta_calculator_t *pdelta, fistream_t *pistream, fostream_t *pdelta_ostream)
 {
     if (!pdelta || !pistream || !pdelta_ostream)
@@ -336,9 +1375,78 @@ ferr_t frsync_delta_calculate(frsync_delta_calculator_t *pdelta, fistream_t *pis
         return FERR_INVALID_ARG;
     }
 
+    // Streams without seek are processed by one job
+    if (pdelta->workers_num > 1 && pistream->seek)
+        return frsync_delta_calculate_parallel(pdelta, pistream, pdelta_ostream);
+
     return frsync_iojob_do(&pdelta->io_job, pistream, pdelta_ostream);
 }
 
+// Data is sent by literal commands. This delta is applied to any base.
+ferr_t frsync_delta_literal(fistream_t *pistream, fostream_t *pdelta_ostream)
+{
+    if (!pistream || !pdelta_ostream)
+    {
+        FS_ERR("Invalid arguments");
+        return FERR_INVALID_ARG;
+    }
+
+    char header[FRSYNC_DELTA_HEADER_SIZE];
+    frsync_delta_int_write(header, 2, RS_DELTA_MAGIC);
+
+    ferr_t ret = frsync_write(pdelta_ostream, header, sizeof header);
+
+    frsync_delta_op_t op = { FRSYNC_DELTA_OP_LITERAL };
+
+    size_t size = 0, offset = 0;
+    char const *data = fistream_data(pistream, &size, &offset);
+
+    if (data)
+    {
+        op.data = data + offset;
+        op.len = size - offset;
+
+        if (ret == FSUCCESS && op.len)
+            ret = frsync_delta_op_write(pdelta_ostream, &op);
+
+        pistream->seek(pistream, size);
+    }
+    else if (ret == FSUCCESS)
+    {
+        char *buf = malloc(FRSYNC_IO_BUF_SIZE);
+        if (!buf)
+        {
+            FS_ERR("Unable to allocate memory for data buffer");
+            return FERR_NO_MEM;
+        }
+
+        op.data = buf;
+
+        while (ret == FSUCCESS)
+        {
+            op.len = pistream->read(pistream, buf, FRSYNC_IO_BUF_SIZE);
+            if (op.len)
+                ret = frsync_delta_op_write(pdelta_ostream, &op);
+
+            fstream_status_t const status = pistream->status(pistream);
+            if (status == FSTREAM_STATUS_EOF)
+                break;
+            if (status != FSTREAM_STATUS_OK)
+                ret = FFAIL;
+        }
+
+        free(buf);
+    }
+
+    if (ret == FSUCCESS)
+    {
+        frsync_delta_op_t const end_op = { FRSYNC_DELTA_OP_END };
+        ret = frsync_delta_op_write(pdelta_ostream, &end_op);
+    }
+
+    return ret;
+}
+
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 // Delta apply
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
@@ -346,12 +1454,33 @@ struct frsync_delta
 {
     volatile uint32_t   ref_counter;
     fistream_t         *pbase_stream;
+    char const         *base_data;                  // Contiguous data of memory and mapped base streams
+    size_t              base_size;
     frsync_iojob_t      io_job;
 };
 
 static rs_result frsync_copy_cb(void *arg, rs_long_t pos, size_t *len, void **buf)
 {
-    fistream_t *pbase_stream = (fistream_t *)arg;
+    frsync_delta_t *pdelta = (frsync_delta_t *)arg;
+
+    // The base data is passed to librsync as is, without seek and copying
+    if (pdelta->base_data)
+    {
+        if (pos < 0 || (uint64_t)pos >= pdelta->base_size)
+        {
+            *len = 0;
+            return RS_INPUT_ENDED;
+        }
+
+        size_t const available_size = pdelta->base_size - (size_t)pos;
+        if (*len > available_size)
+            *len = available_size;
+        *buf = (void *)(pdelta->base_data + pos);
+
+        return RS_DONE;
+    }
+
+    fistream_t *pbase_stream = pdelta->pbase_stream;
 
     if (!pbase_stream->seek(pbase_stream, pos))
         return RS_IO_ERROR;
@@ -369,6 +1498,11 @@ static rs_result frsync_copy_cb(void *arg, rs_long_t pos, size_t *len, void **bu
 }
 
 frsync_delta_t *frsync_delta_create(fistream_t *pbase_stream)
+{
+    return frsync_delta_create_ex(pbase_stream, 0);
+}
+
+frsync_delta_t *frsync_delta_create_ex(fistream_t *pbase_stream, size_t buf_size)
 {
     frsync_delta_t *pdelta = malloc(sizeof(frsync_delta_t));
     if (!pdelta)
@@ -380,6 +1514,7 @@ frsync_delta_t *frsync_delta_create(fistream_t *pbase_stream)
 
     pdelta->ref_counter = 1;
     pdelta->pbase_stream = pbase_stream->retain(pbase_stream);
+    pdelta->base_data = fistream_data(pbase_stream, &pdelta->base_size, 0);
 
     if (!pbase_stream->seek(pbase_stream, 0))
     {
@@ -388,9 +1523,10 @@ frsync_delta_t *frsync_delta_create(fistream_t *pbase_stream)
         return 0;
     }
 
-    pdelta->io_job.job = rs_patch_begin(frsync_copy_cb, pbase_stream);
+    frsync_job_t const job = { rs_patch_begin(frsync_copy_cb, pdelta) };
+    frsync_iojob_init(&pdelta->io_job, job, buf_size);
 
-    if (!pdelta->io_job.job)
+    if (!frsync_job_is_valid(&pdelta->io_job.job))
     {
         FS_ERR("Unable to create job for delta");
         frsync_delta_release(pdelta);
@@ -417,8 +1553,7 @@ void frsync_delta_release(frsync_delta_t *pdelta)
             FS_ERR("Invalid delta");
         else if (!--pdelta->ref_counter)
         {
-            if (pdelta->io_job.job)
-                rs_job_free(pdelta->io_job.job);
+            frsync_iojob_free(&pdelta->io_job);
             pdelta->pbase_stream->release(pdelta->pbase_stream);
             memset(pdelta, 0, sizeof *pdelta);
             free(pdelta);
@@ -13,32 +13,49 @@
  * data  <======================> data
  */
 
+typedef enum
+{
+    FRSYNC_BACKEND_LIBRSYNC = 0,                                                                                    // Delta is calculated by librsync
+    FRSYNC_BACKEND_NATIVE                                                                                           // In-tree delta calculation with SIMD weak sums and open addressing table
+} frsync_backend_t;
+
+void                           frsync_backend_set(frsync_backend_t backend);                                        // Backend of signatures created by frsync_signature_create, native by default
+frsync_backend_t               frsync_backend();
+
 typedef struct frsync_signature_calculator frsync_signature_calculator_t;
 
+void                           frsync_signature_args(uint64_t size, uint32_t *block_len, uint32_t *strong_len);    // Signature parameters for the file size
 frsync_signature_calculator_t *frsync_signature_calculator_create();
+frsync_signature_calculator_t *frsync_signature_calculator_create_ex(uint32_t workers_num, uint32_t block_len, uint32_t strong_len);  // 0 - number of CPUs, default block length, full strong sum
 frsync_signature_calculator_t *frsync_signature_calculator_retain(frsync_signature_calculator_t *psig);
 void                           frsync_signature_calculator_release(frsync_signature_calculator_t *psig);
+uint32_t                       frsync_signature_calculator_block_len(frsync_signature_calculator_t *psig);
+uint32_t                       frsync_signature_calculator_strong_len(frsync_signature_calculator_t *psig);
 ferr_t                         frsync_signature_calculate(frsync_signature_calculator_t *psig, fistream_t *pbase_stream, fostream_t *psignature_ostream);
 
 typedef struct frsync_signature frsync_signature_t;
 
 frsync_signature_t            *frsync_signature_create();
+frsync_signature_t            *frsync_signature_create_ex(frsync_backend_t backend);                                // Delta calculators of signature use the backend. Native backend falls back to librsync for signatures it doesn't support.
 frsync_signature_t            *frsync_signature_retain(frsync_signature_t *psig);
 void                           frsync_signature_release(frsync_signature_t *psig);
-ferr_t                         frsync_signature_load(frsync_signature_t *psig, fistream_t *psignature_istream);
+ferr_t                         frsync_signature_load(frsync_signature_t *psig, fistream_t *psignature_istream);     // FERR_AGAIN - the rest of signature isn't received yet, next call continues loading
 
 typedef struct frsync_delta_calculator frsync_delta_calculator_t;
 
 frsync_delta_calculator_t     *frsync_delta_calculator_create(frsync_signature_t *psig);
+frsync_delta_calculator_t     *frsync_delta_calculator_create_ex(frsync_signature_t *psig, uint32_t workers_num);   // 0 - number of CPUs
 frsync_delta_calculator_t     *frsync_delta_calculator_retain(frsync_delta_calculator_t *pdelta);
 void                           frsync_delta_calculator_release(frsync_delta_calculator_t *pdelta);
 ferr_t                         frsync_delta_calculate(frsync_delta_calculator_t *pdelta, fistream_t *pistream, fostream_t *pdelta_ostream);
+ferr_t                         frsync_delta_literal(fistream_t *pistream, fostream_t *pdelta_ostream);                    // Delta without signature. It contains the whole data.
 
 typedef struct frsync_delta frsync_delta_t;
 
-frsync_delta_t                *frsync_delta_create(fistream_t *pbase_stream);
+frsync_delta_t                *frsync_delta_create(fistream_t *pbase_stream);                                       // Base data of ffile_mapped_istream is copied without seek and read
+frsync_delta_t                *frsync_delta_create_ex(fistream_t *pbase_stream, size_t buf_size);                   // 0 - default size of I/O buffers
 frsync_delta_t                *frsync_delta_retain(frsync_delta_t *pdelta);
 void                           frsync_delta_release(frsync_delta_t *pdelta);
-ferr_t                         frsync_delta_apply(frsync_delta_t *pdelta, fistream_t *pdelta_istream, fostream_t *pnew_ostream);
+ferr_t                         frsync_delta_apply(frsync_delta_t *pdelta, fistream_t *pdelta_istream, fostream_t *pnew_ostream);   // FERR_AGAIN - the rest of delta isn't received yet, next call continues applying
 
 #endif
@@ -0,0 +1,780 @@
+#include "rsync_match.h"
+#include <futils/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define FRSYNC_MATCH_AVX2
+#   include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define FRSYNC_MATCH_NEON
+#   include <arm_neon.h>
+#endif
+
+enum
+{
+    FRSYNC_MATCH_SIG_HEADER_SIZE    = 12,                           // Signature header: magic, block length, strong sum length
+    FRSYNC_MATCH_STRONG_LEN_MAX     = 32,                           // BLAKE2b-256
+    FRSYNC_MATCH_CMD_MAX            = 1 + 2 * sizeof(uint64_t),     // Max length of delta command header
+    FRSYNC_MATCH_LITERAL_MAX        = 64 * 1024,                    // Longer literals are split, so the unconsumed input is limited
+    FRSYNC_MATCH_BLOCK_LEN_MAX      = 128 * 1024,                   // The job input holds the literal and the block, it must fit the I/O buffer
+    FRSYNC_MATCH_FILTER_BITS        = 8,                            // Number of filter bits per block
+    FRSYNC_MATCH_CHAR_OFFSET        = 31                            // ROLLSUM_CHAR_OFFSET of librsync
+};
+
+enum
+{
+    FRSYNC_MATCH_OP_END             = 0x00,
+    FRSYNC_MATCH_OP_LITERAL_64      = 0x40,
+    FRSYNC_MATCH_OP_LITERAL_N1      = 0x41,
+    FRSYNC_MATCH_OP_COPY_N1_N1      = 0x45
+};
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+// Weak sum
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * Rollsum of librsync without the char offset:
+ *   s1 = sum(b[i])
+ *   s2 = sum((size - i) * b[i])
+ * Sums are calculated modulo 2^32. Only the low 16 bits are used by the digest.
+ */
+static void frsync_rollsum_scalar(uint8_t const *data, size_t size, uint32_t *ps1, uint32_t *ps2)
+{
+    uint32_t s1 = *ps1, s2 = *ps2;
+    for (size_t i = 0; i < size; ++i)
+    {
+        s1 += data[i];
+        s2 += s1;
+    }
+    *ps1 = s1;
+    *ps2 = s2;
+}
+
+#if defined(FRSYNC_MATCH_AVX2)
+
+static uint32_t frsync_mm256_hsum(__m256i v) __attribute__((target("avx2")));
+static uint32_t frsync_mm256_hsum(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(s);
+}
+
+// 32 bytes are summed at once. Weighted sum of the bytes is calculated by multiplication to 32..1 weights.
+static void frsync_rollsum_avx2(uint8_t const *data, size_t size, uint32_t *ps1, uint32_t *ps2) __attribute__((target("avx2")));
+static void frsync_rollsum_avx2(uint8_t const *data, size_t size, uint32_t *ps1, uint32_t *ps2)
+{
+    __m256i const weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                             16, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1);
+    __m256i const ones8 = _mm256_set1_epi8(1);
+    __m256i const ones16 = _mm256_set1_epi16(1);
+
+    __m256i vs1 = _mm256_setzero_si256();
+    __m256i vs2 = _mm256_setzero_si256();
+    __m256i vprev = _mm256_setzero_si256();                         // Sum of s1 before each 32 bytes
+
+    size_t const n = size / 32;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        __m256i const bytes = _mm256_loadu_si256((__m256i const *)(data + i * 32));
+        vprev = _mm256_add_epi32(vprev, vs1);
+        vs1 = _mm256_add_epi32(vs1, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, ones8), ones16));
+        vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones16));
+    }
+
+    uint32_t const s1 = frsync_mm256_hsum(vs1);
+    uint32_t const s2 = (frsync_mm256_hsum(vprev) << 5) + frsync_mm256_hsum(vs2);
+
+    *ps2 += *ps1 * (uint32_t)(n * 32) + s2;
+    *ps1 += s1;
+
+    frsync_rollsum_scalar(data + n * 32, size - n * 32, ps1, ps2);
+}
+
+#elif defined(FRSYNC_MATCH_NEON)
+
+static uint32_t frsync_neon_hsum(uint32x4_t v)
+{
+    return vgetq_lane_u32(v, 0) + vgetq_lane_u32(v, 1) + vgetq_lane_u32(v, 2) + vgetq_lane_u32(v, 3);
+}
+
+// 16 bytes are summed at once. Weighted sum of the bytes is calculated by multiplication to 16..1 weights.
+static void frsync_rollsum_neon(uint8_t const *data, size_t size, uint32_t *ps1, uint32_t *ps2)
+{
+    static uint8_t const weights[16] = { 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    uint8x8_t const weights_lo = vld1_u8(weights);
+    uint8x8_t const weights_hi = vld1_u8(weights + 8);
+
+    uint32x4_t vs1 = vdupq_n_u32(0);
+    uint32x4_t vs2 = vdupq_n_u32(0);
+    uint32x4_t vprev = vdupq_n_u32(0);                              // Sum of s1 before each 16 bytes
+
+    size_t const n = size / 16;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint8x16_t const bytes = vld1q_u8(data + i * 16);
+        vprev = vaddq_u32(vprev, vs1);
+        vs1 = vpadalq_u16(vs1, vpaddlq_u8(bytes));
+        uint16x8_t const weighted = vmlal_u8(vmull_u8(vget_low_u8(bytes), weights_lo), vget_high_u8(bytes), weights_hi);
+        vs2 = vpadalq_u16(vs2, weighted);
+    }
+
+    uint32_t const s1 = frsync_neon_hsum(vs1);
+    uint32_t const s2 = (frsync_neon_hsum(vprev) << 4) + frsync_neon_hsum(vs2);
+
+    *ps2 += *ps1 * (uint32_t)(n * 16) + s2;
+    *ps1 += s1;
+
+    frsync_rollsum_scalar(data + n * 16, size - n * 16, ps1, ps2);
+}
+
+#endif
+
+typedef void (*frsync_rollsum_fn_t)(uint8_t const *, size_t, uint32_t *, uint32_t *);
+
+#if defined(FRSYNC_MATCH_AVX2)
+static frsync_rollsum_fn_t  frsync_rollsum_impl = frsync_rollsum_scalar;
+static pthread_once_t       frsync_rollsum_once = PTHREAD_ONCE_INIT;
+
+// The CPU is checked once for all threads
+static void frsync_rollsum_select()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        frsync_rollsum_impl = frsync_rollsum_avx2;
+}
+#elif defined(FRSYNC_MATCH_NEON)
+static frsync_rollsum_fn_t const frsync_rollsum_impl = frsync_rollsum_neon;
+#else
+static frsync_rollsum_fn_t const frsync_rollsum_impl = frsync_rollsum_scalar;
+#endif
+
+// The char offset of librsync is added to the sums
+static void frsync_rollsum_sums(uint8_t const *data, size_t size, uint32_t *ps1, uint32_t *ps2)
+{
+    uint32_t s1 = 0, s2 = 0;
+
+#if defined(FRSYNC_MATCH_AVX2)
+    pthread_once(&frsync_rollsum_once, frsync_rollsum_select);
+#endif
+    frsync_rollsum_impl(data, size, &s1, &s2);
+
+    *ps1 = s1 + (uint32_t)size * FRSYNC_MATCH_CHAR_OFFSET;
+    *ps2 = s2 + (uint32_t)((uint64_t)size * (size + 1) / 2) * FRSYNC_MATCH_CHAR_OFFSET;
+}
+
+static inline uint32_t frsync_rollsum_digest(uint32_t s1, uint32_t s2)
+{
+    return (s2 << 16) | (s1 & 0xFFFF);
+}
+
+uint32_t frsync_rollsum(void const *data, size_t size)
+{
+    uint32_t s1, s2;
+    frsync_rollsum_sums((uint8_t const *)data, size, &s1, &s2);
+    return frsync_rollsum_digest(s1, s2);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+// Strong sum
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+static uint64_t const frsync_blake2b_iv[8] =
+{
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+};
+
+static uint8_t const frsync_blake2b_sigma[12][16] =
+{
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+static inline uint64_t frsync_rotr64(uint64_t v, unsigned n)
+{
+    return (v >> n) | (v << (64 - n));
+}
+
+#define FRSYNC_BLAKE2B_G(r, i, a, b, c, d)                          \
+    do {                                                            \
+        a = a + b + m[frsync_blake2b_sigma[r][2 * i]];              \
+        d = frsync_rotr64(d ^ a, 32);                               \
+        c = c + d;                                                  \
+        b = frsync_rotr64(b ^ c, 24);                               \
+        a = a + b + m[frsync_blake2b_sigma[r][2 * i + 1]];          \
+        d = frsync_rotr64(d ^ a, 16);                               \
+        c = c + d;                                                  \
+        b = frsync_rotr64(b ^ c, 63);                               \
+    } while(0)
+
+static void frsync_blake2b_compress(uint64_t h[8], uint8_t const block[128], uint64_t t, bool is_last)
+{
+    uint64_t m[16], v[16];
+
+    for (int i = 0; i < 16; ++i)
+    {
+        m[i] = 0;
+        for (int j = 7; j >= 0; --j)
+            m[i] = (m[i] << 8) | block[i * 8 + j];
+    }
+
+    for (int i = 0; i < 8; ++i)
+    {
+        v[i] = h[i];
+        v[i + 8] = frsync_blake2b_iv[i];
+    }
+
+    v[12] ^= t;
+    if (is_last)
+        v[14] = ~v[14];
+
+    for (int r = 0; r < 12; ++r)
+    {
+        FRSYNC_BLAKE2B_G(r, 0, v[0], v[4], v[ 8], v[12]);
+        FRSYNC_BLAKE2B_G(r, 1, v[1], v[5], v[ 9], v[13]);
+        FRSYNC_BLAKE2B_G(r, 2, v[2], v[6], v[10], v[14]);
+        FRSYNC_BLAKE2B_G(r, 3, v[3], v[7], v[11], v[15]);
+        FRSYNC_BLAKE2B_G(r, 4, v[0], v[5], v[10], v[15]);
+        FRSYNC_BLAKE2B_G(r, 5, v[1], v[6], v[11], v[12]);
+        FRSYNC_BLAKE2B_G(r, 6, v[2], v[7], v[ 8], v[13]);
+        FRSYNC_BLAKE2B_G(r, 7, v[3], v[4], v[ 9], v[14]);
+    }
+
+    for (int i = 0; i < 8; ++i)
+        h[i] ^= v[i] ^ v[i + 8];
+}
+
+#undef FRSYNC_BLAKE2B_G
+
+// Unkeyed BLAKE2b with 32 bytes digest, like rs_calc_strong_sum of librsync
+void frsync_blake2b(void const *data, size_t size, uint8_t sum[32])
+{
+    uint8_t const *ptr = (uint8_t const *)data;
+    uint64_t h[8];
+
+    memcpy(h, frsync_blake2b_iv, sizeof h);
+    h[0] ^= 0x01010000ull ^ FRSYNC_MATCH_STRONG_LEN_MAX;
+
+    uint64_t t = 0;
+
+    for (; size > 128; ptr += 128, size -= 128)
+    {
+        t += 128;
+        frsync_blake2b_compress(h, ptr, t, false);
+    }
+
+    uint8_t block[128] = { 0 };
+    memcpy(block, ptr, size);
+    t += size;
+    frsync_blake2b_compress(h, block, t, true);
+
+    for (int i = 0; i < FRSYNC_MATCH_STRONG_LEN_MAX; ++i)
+        sum[i] = (uint8_t)(h[i / 8] >> (8 * (i % 8)));
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+// Signature blocks table
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+typedef struct
+{
+    uint32_t            weak;
+    uint32_t            idx;                                        // Block index + 1. 0 - empty slot.
+} frsync_match_slot_t;
+
+/*
+ * Blocks are indexed by weak sums in the open addressing table with linear probing.
+ * The bit filter is checked first. It is small enough for L1/L2 caches, so most of positions without matches
+ * don't touch the table.
+ */
+struct frsync_match_table
+{
+    uint32_t            block_len;
+    uint32_t            strong_len;
+    uint32_t            blocks_num;
+    uint32_t           *weak;                                       // Weak sums of blocks
+    uint8_t            *strong;                                     // Strong sums of blocks
+    unsigned            slots_bits;
+    frsync_match_slot_t *slots;
+    unsigned            filter_bits;
+    uint64_t           *filter;
+};
+
+static inline uint32_t frsync_match_slot(frsync_match_table_t const *ptable, uint32_t weak)
+{
+    return (weak * 0x9E3779B1u) >> (32 - ptable->slots_bits);
+}
+
+static inline uint32_t frsync_match_filter_bit(frsync_match_table_t const *ptable, uint32_t weak)
+{
+    return (weak * 0x85EBCA6Bu) >> (32 - ptable->filter_bits);
+}
+
+static inline bool frsync_match_filter_test(frsync_match_table_t const *ptable, uint32_t weak)
+{
+    uint32_t const bit = frsync_match_filter_bit(ptable, weak);
+    return (ptable->filter[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static uint32_t frsync_match_be32(uint8_t const *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static unsigned frsync_match_bits(uint64_t num)
+{
+    unsigned bits = 6;
+    while ((1ull << bits) < num && bits < 31)
+        ++bits;
+    return bits;
+}
+
+bool frsync_match_is_supported(void const *signature, size_t size)
+{
+    uint8_t const *data = (uint8_t const *)signature;
+    if (!data || size < FRSYNC_MATCH_SIG_HEADER_SIZE)
+        return false;
+
+    uint32_t const block_len = frsync_match_be32(data + 4);
+    uint32_t const strong_len = frsync_match_be32(data + 8);
+
+    return frsync_match_be32(data) == RS_BLAKE2_SIG_MAGIC
+        && block_len && block_len <= FRSYNC_MATCH_BLOCK_LEN_MAX
+        && strong_len && strong_len <= FRSYNC_MATCH_STRONG_LEN_MAX;
+}
+
+static bool frsync_match_table_build(frsync_match_table_t *ptable, uint8_t const *data, size_t size)
+{
+    if (size < FRSYNC_MATCH_SIG_HEADER_SIZE
+        || frsync_match_be32(data) != RS_BLAKE2_SIG_MAGIC)
+    {
+        FS_ERR("Unsupported signature format");
+        return false;
+    }
+
+    ptable->block_len = frsync_match_be32(data + 4);
+    ptable->strong_len = frsync_match_be32(data + 8);
+
+    if (!ptable->block_len
+        || ptable->block_len > FRSYNC_MATCH_BLOCK_LEN_MAX
+        || !ptable->strong_len
+        || ptable->strong_len > FRSYNC_MATCH_STRONG_LEN_MAX)
+    {
+        FS_ERR("Invalid signature header");
+        return false;
+    }
+
+    data += FRSYNC_MATCH_SIG_HEADER_SIZE;
+    size -= FRSYNC_MATCH_SIG_HEADER_SIZE;
+
+    size_t const block_sig_size = sizeof(uint32_t) + ptable->strong_len;
+
+    if (size % block_sig_size
+        || size / block_sig_size >= UINT32_MAX / 2)
+    {
+        FS_ERR("Invalid signature size");
+        return false;
+    }
+
+    ptable->blocks_num = (uint32_t)(size / block_sig_size);
+    ptable->slots_bits = frsync_match_bits(2ull * ptable->blocks_num);
+    ptable->filter_bits = frsync_match_bits((uint64_t)FRSYNC_MATCH_FILTER_BITS * ptable->blocks_num);
+
+    ptable->weak = malloc(ptable->blocks_num * sizeof *ptable->weak + 1);
+    ptable->strong = malloc(ptable->blocks_num * ptable->strong_len + 1);
+    ptable->slots = calloc((size_t)1 << ptable->slots_bits, sizeof *ptable->slots);
+    ptable->filter = calloc(((size_t)1 << ptable->filter_bits) / 64, sizeof *ptable->filter);
+
+    if (!ptable->weak || !ptable->strong || !ptable->slots || !ptable->filter)
+    {
+        FS_ERR("Unable to allocate memory for signature table");
+        return false;
+    }
+
+    uint32_t const slots_mask = (1u << ptable->slots_bits) - 1;
+
+    for (uint32_t i = 0; i < ptable->blocks_num; ++i, data += block_sig_size)
+    {
+        uint32_t const weak = frsync_match_be32(data);
+
+        ptable->weak[i] = weak;
+        memcpy(ptable->strong + (size_t)i * ptable->strong_len, data + sizeof(uint32_t), ptable->strong_len);
+
+        uint32_t const bit = frsync_match_filter_bit(ptable, weak);
+        ptable->filter[bit >> 6] |= 1ull << (bit & 63);
+
+        uint32_t slot = frsync_match_slot(ptable, weak);
+        while (ptable->slots[slot].idx)
+            slot = (slot + 1) & slots_mask;
+        ptable->slots[slot].weak = weak;
+        ptable->slots[slot].idx = i + 1;
+    }
+
+    return true;
+}
+
+frsync_match_table_t *frsync_match_table_create(void const *signature, size_t size)
+{
+    if (!signature && size)
+    {
+        FS_ERR("Invalid arguments");
+        return 0;
+    }
+
+    frsync_match_table_t *ptable = malloc(sizeof(frsync_match_table_t));
+    if (!ptable)
+    {
+        FS_ERR("Unable to allocate memory for signature table");
+        return 0;
+    }
+    memset(ptable, 0, sizeof *ptable);
+
+    if (!frsync_match_table_build(ptable, (uint8_t const *)signature, size))
+    {
+        frsync_match_table_free(ptable);
+        return 0;
+    }
+
+    return ptable;
+}
+
+void frsync_match_table_free(frsync_match_table_t *ptable)
+{
+    if (ptable)
+    {
+        free(ptable->weak);
+        free(ptable->strong);
+        free(ptable->slots);
+        free(ptable->filter);
+        memset(ptable, 0, sizeof *ptable);
+        free(ptable);
+    }
+}
+
+static bool frsync_match_strong_eq(frsync_match_table_t const *ptable, uint32_t idx, uint8_t const *sum)
+{
+    return memcmp(ptable->strong + (size_t)idx * ptable->strong_len, sum, ptable->strong_len) == 0;
+}
+
+/*
+ * Looks up the full block. The block which follows the previous match is checked first,
+ * so the copy commands are joined. The strong sum is calculated only for the weak sum matches.
+ */
+static int64_t frsync_match_find(frsync_match_table_t const *ptable, uint32_t weak, uint8_t const *data, int64_t expected)
+{
+    uint8_t sum[FRSYNC_MATCH_STRONG_LEN_MAX];
+    bool is_sum = false;
+
+    if (expected >= 0
+        && expected < ptable->blocks_num
+        && ptable->weak[expected] == weak)
+    {
+        frsync_blake2b(data, ptable->block_len, sum);
+        is_sum = true;
+        if (frsync_match_strong_eq(ptable, (uint32_t)expected, sum))
+            return expected;
+    }
+
+    uint32_t const slots_mask = (1u << ptable->slots_bits) - 1;
+
+    for (uint32_t slot = frsync_match_slot(ptable, weak); ptable->slots[slot].idx; slot = (slot + 1) & slots_mask)
+    {
+        if (ptable->slots[slot].weak != weak)
+            continue;
+
+        if (!is_sum)
+        {
+            frsync_blake2b(data, ptable->block_len, sum);
+            is_sum = true;
+        }
+
+        uint32_t const idx = ptable->slots[slot].idx - 1;
+        if (frsync_match_strong_eq(ptable, idx, sum))
+            return idx;
+    }
+
+    return -1;
+}
+
+// Only the last block of signature may be shorter than the block length
+static int64_t frsync_match_find_last(frsync_match_table_t const *ptable, uint32_t weak, uint8_t const *data, size_t size)
+{
+    if (!ptable->blocks_num
+        || ptable->weak[ptable->blocks_num - 1] != weak)
+        return -1;
+
+    uint8_t sum[FRSYNC_MATCH_STRONG_LEN_MAX];
+    frsync_blake2b(data, size, sum);
+
+    return frsync_match_strong_eq(ptable, ptable->blocks_num - 1, sum) ? ptable->blocks_num - 1 : -1;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+// Delta job
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * The unconsumed input starts with the pending literal. The window [scan, scan + window) is the rolled block.
+ * Commands are written only when the output buffer has room for them, otherwise the job is blocked
+ * and continues from the same state with the next output buffer.
+ */
+struct frsync_match_job
+{
+    frsync_match_table_t const *ptable;
+    bool                is_header_written;
+    bool                is_done;
+    bool                is_sum_valid;
+    size_t              scan;                                       // Window position in the unconsumed input
+    size_t              window;                                     // Window length. It is less than the block length at the end of data.
+    uint32_t            s1;                                         // Rolling sums of window
+    uint32_t            s2;
+    uint64_t            copy_pos;                                   // Pending copy command
+    uint64_t            copy_len;
+};
+
+frsync_match_job_t *frsync_match_job_begin(frsync_match_table_t const *ptable)
+{
+    if (!ptable)
+    {
+        FS_ERR("Invalid arguments");
+        return 0;
+    }
+
+    frsync_match_job_t *pjob = malloc(sizeof(frsync_match_job_t));
+    if (!pjob)
+    {
+        FS_ERR("Unable to allocate memory for delta job");
+        return 0;
+    }
+    memset(pjob, 0, sizeof *pjob);
+
+    pjob->ptable = ptable;
+
+    return pjob;
+}
+
+void frsync_match_job_free(frsync_match_job_t *pjob)
+{
+    free(pjob);
+}
+
+static unsigned frsync_match_int_width(uint64_t value)
+{
+    return value <= 0xFF ? 0 : value <= 0xFFFF ? 1 : value <= 0xFFFFFFFF ? 2 : 3;
+}
+
+static void frsync_match_int_put(rs_buffers_t *buf, unsigned width, uint64_t value)
+{
+    size_t const size = (size_t)1 << width;
+    for (size_t i = 0; i < size; ++i)
+        buf->next_out[i] = (char)(value >> (8 * (size - i - 1)));
+    buf->next_out += size;
+    buf->avail_out -= size;
+}
+
+static void frsync_match_byte_put(rs_buffers_t *buf, uint8_t value)
+{
+    *buf->next_out++ = (char)value;
+    buf->avail_out--;
+}
+
+// The output buffer must have room for the command
+static void frsync_match_copy_put(frsync_match_job_t *pjob, rs_buffers_t *buf)
+{
+    if (!pjob->copy_len)
+        return;
+
+    unsigned const pos_width = frsync_match_int_width(pjob->copy_pos);
+    unsigned const len_width = frsync_match_int_width(pjob->copy_len);
+
+    frsync_match_byte_put(buf, (uint8_t)(FRSYNC_MATCH_OP_COPY_N1_N1 + pos_width * 4 + len_width));
+    frsync_match_int_put(buf, pos_width, pjob->copy_pos);
+    frsync_match_int_put(buf, len_width, pjob->copy_len);
+
+    pjob->copy_len = 0;
+}
+
+// The pending copy and the literal from the unconsumed input are written. The literal input is consumed.
+static bool frsync_match_literal_put(frsync_match_job_t *pjob, rs_buffers_t *buf, size_t size)
+{
+    if (buf->avail_out < 2 * FRSYNC_MATCH_CMD_MAX + size)
+        return false;
+
+    if (!size)
+        return true;
+
+    frsync_match_copy_put(pjob, buf);
+
+    if (size <= FRSYNC_MATCH_OP_LITERAL_64)
+        frsync_match_byte_put(buf, (uint8_t)size);
+    else
+    {
+        unsigned const width = frsync_match_int_width(size);
+        frsync_match_byte_put(buf, (uint8_t)(FRSYNC_MATCH_OP_LITERAL_N1 + width));
+        frsync_match_int_put(buf, width, size);
+    }
+
+    memcpy(buf->next_out, buf->next_in, size);
+    buf->next_out += size;
+    buf->avail_out -= size;
+    buf->next_in += size;
+    buf->avail_in -= size;
+
+    return true;
+}
+
+rs_result frsync_match_job_iter(frsync_match_job_t *pjob, rs_buffers_t *buf)
+{
+    if (!pjob || !buf)
+        return RS_PARAM_ERROR;
+
+    if (pjob->is_done)
+        return RS_DONE;
+
+    frsync_match_table_t const *ptable = pjob->ptable;
+    size_t const block_len = ptable->block_len;
+
+    if (!pjob->is_header_written)
+    {
+        if (buf->avail_out < sizeof(uint32_t))
+            return RS_BLOCKED;
+        frsync_match_int_put(buf, 2, RS_DELTA_MAGIC);
+        pjob->is_header_written = true;
+    }
+
+    for(;;)
+    {
+        // Long literals are split
+        if (pjob->scan >= FRSYNC_MATCH_LITERAL_MAX)
+        {
+            if (!frsync_match_literal_put(pjob, buf, pjob->scan))
+                return RS_BLOCKED;
+            pjob->scan = 0;
+        }
+
+        uint8_t const *data = (uint8_t const *)buf->next_in;
+        size_t const size = buf->avail_in;
+
+        if (!pjob->is_sum_valid)
+        {
+            size_t const tail = size - pjob->scan;
+
+            if (tail < block_len && !buf->eof_in)
+                return RS_BLOCKED;
+
+            pjob->window = tail < block_len ? tail : block_len;
+
+            if (!pjob->window)
+                break;
+
+            frsync_rollsum_sums(data + pjob->scan, pjob->window, &pjob->s1, &pjob->s2);
+            pjob->is_sum_valid = true;
+        }
+
+        int64_t idx = -1;
+
+        if (pjob->window == block_len)
+        {
+            int64_t const expected = pjob->copy_len ? (int64_t)((pjob->copy_pos + pjob->copy_len) / block_len) : -1;
+            size_t const scan_end = size - block_len < FRSYNC_MATCH_LITERAL_MAX ? size - block_len : FRSYNC_MATCH_LITERAL_MAX;
+            size_t scan = pjob->scan;
+            uint32_t s1 = pjob->s1, s2 = pjob->s2;
+
+            // The window is rolled while there are no matches and the next byte is available
+            for(;;)
+            {
+                uint32_t const weak = frsync_rollsum_digest(s1, s2);
+
+                if (frsync_match_filter_test(ptable, weak)
+                    && (idx = frsync_match_find(ptable, weak, data + scan, expected)) >= 0)
+                    break;
+
+                if (scan >= scan_end)
+                    break;
+
+                uint32_t const out = data[scan] + FRSYNC_MATCH_CHAR_OFFSET;
+                s1 += data[scan + block_len] + FRSYNC_MATCH_CHAR_OFFSET - out;
+                s2 += s1 - (uint32_t)block_len * out;
+                ++scan;
+            }
+
+            pjob->scan = scan;
+            pjob->s1 = s1;
+            pjob->s2 = s2;
+        }
+        else
+            idx = frsync_match_find_last(ptable, frsync_rollsum_digest(pjob->s1, pjob->s2), data + pjob->scan, pjob->window);
+
+        if (idx >= 0)
+        {
+            uint64_t const pos = (uint64_t)idx * block_len;
+
+            if (!frsync_match_literal_put(pjob, buf, pjob->scan))
+                return RS_BLOCKED;
+            pjob->scan = 0;
+
+            if (pjob->copy_len
+                && pjob->copy_pos + pjob->copy_len == pos)
+                pjob->copy_len += pjob->window;
+            else
+            {
+                if (buf->avail_out < FRSYNC_MATCH_CMD_MAX)
+                    return RS_BLOCKED;
+                frsync_match_copy_put(pjob, buf);
+                pjob->copy_pos = pos;
+                pjob->copy_len = pjob->window;
+            }
+
+            buf->next_in += pjob->window;
+            buf->avail_in -= pjob->window;
+            pjob->is_sum_valid = false;
+            continue;
+        }
+
+        if (pjob->scan >= FRSYNC_MATCH_LITERAL_MAX)
+            continue;
+
+        if (pjob->window == block_len
+            && size - pjob->scan > block_len)
+            continue;
+
+        if (!buf->eof_in)
+            return RS_BLOCKED;
+
+        // The window is shrunk at the end of data
+        uint32_t const out = data[pjob->scan] + FRSYNC_MATCH_CHAR_OFFSET;
+        pjob->s1 -= out;
+        pjob->s2 -= (uint32_t)pjob->window * out;
+        pjob->scan++;
+        if (!--pjob->window)
+            pjob->is_sum_valid = false;
+    }
+
+    // The rest of data is the literal
+    if (buf->avail_out < 3 * FRSYNC_MATCH_CMD_MAX + pjob->scan)
+        return RS_BLOCKED;
+
+    frsync_match_literal_put(pjob, buf, pjob->scan);
+    pjob->scan = 0;
+    frsync_match_copy_put(pjob, buf);
+    frsync_match_byte_put(buf, FRSYNC_MATCH_OP_END);
+
+    pjob->is_done = true;
+
+    return RS_DONE;
+}
@@ -0,0 +1,30 @@
+#ifndef RSYNC_MATCH_H_FSYNC
+#define RSYNC_MATCH_H_FSYNC
+#include <librsync.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * In-tree delta calculation. Signatures of librsync (RS_BLAKE2_SIG_MAGIC) are loaded into the open addressing
+ * hash table and the new data is matched against it. The delta has the librsync format, so it is applied by librsync.
+ * The weak sum is the rollsum of librsync, the strong sum is BLAKE2b-256 truncated to the signature strong sum length.
+ * Signatures with blocks longer than 128K are rejected, frsync loads them by librsync.
+ */
+
+uint32_t                frsync_rollsum(void const *data, size_t size);                             // Weak sum of block
+void                    frsync_blake2b(void const *data, size_t size, uint8_t sum[32]);            // Strong sum of block
+
+typedef struct frsync_match_table frsync_match_table_t;
+
+bool                    frsync_match_is_supported(void const *signature, size_t size);             // Header of signature is checked only
+frsync_match_table_t   *frsync_match_table_create(void const *signature, size_t size);               // Table of the whole signature
+void                    frsync_match_table_free(frsync_match_table_t *ptable);
+
+typedef struct frsync_match_job frsync_match_job_t;
+
+frsync_match_job_t     *frsync_match_job_begin(frsync_match_table_t const *ptable);
+rs_result               frsync_match_job_iter(frsync_match_job_t *pjob, rs_buffers_t *buf);        // The job works like librsync delta job
+void                    frsync_match_job_free(frsync_match_job_t *pjob);
+
+#endif
@@ -1,21 +1,43 @@
 #include "search_engine.h"
 #include <futils/fs.h>
 #include <futils/log.h>
+#include <futils/mutex.h>
+#include <futils/vector.h>
 #include <fdb/sync/dirs.h>
 #include <fdb/sync/files.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <errno.h>
-#include <time.h>
 
 #ifdef _WIN32
 #include <ctype.h>
 #endif
 
-static struct timespec const F1_SEC = { 1, 0 };
+enum
+{
+    FSEARCH_ENGINE_BATCH_SIZE       = 256,  // Number of files stored by one transaction
+    FSEARCH_ENGINE_WORKERS_MAX      = 16,
+    FSEARCH_ENGINE_WORKERS_DEFAULT  = 4
+};
+
+/*
+ * Scan unit is the indexed directory or the first level subtree of it. Each unit has own resumable scan status in DB.
+ * Fresh indexed directory is split into subtrees when several workers are used.
+ * Workers scan units in parallel. Found files and new scan positions are stored by the shared batched writer.
+ */
+typedef struct
+{
+    fsearch_engine_t   *engine;
+    pthread_t           thread;
+    bool                is_busy;        // Unit is scanned by the worker
+    fdir_scan_status_t  status;         // Status stored in DB
+    fdir_scan_status_t  new_status;     // Status which will be stored by the next flush
+    bool                is_changed;
+} fsearch_worker_t;
 
 struct search_engine
 {
@@ -24,109 +46,319 @@ struct search_engine
     fdb_t              *db;
 
     volatile bool       is_active;
-    pthread_t           scan_thread;
     sem_t               sem;
 
     fuuid_t             uuid;
+
+    pthread_mutex_t     workers_mutex;  // Scan units distribution. It's never locked inside a transaction.
+    uint32_t            workers_num;
+    fsearch_worker_t    workers[FSEARCH_ENGINE_WORKERS_MAX];
+
+    pthread_mutex_t     writer_mutex;   // Shared batched writer. It's never locked inside a transaction.
+    ffile_info_t       *batch;
+    size_t              batch_size;
 };
 
-static bool fsearch_engine_get_first_scan_dir(fsearch_engine_t *pengine, fdir_info_t *dir_info, fdir_scan_status_t *scan_status)
+static bool fsearch_engine_is_claimed(fsearch_engine_t *pengine, fdir_scan_status_t const *scan_status)
 {
+    for (uint32_t i = 0; i < pengine->workers_num; ++i)
+    {
+        fsearch_worker_t const *worker = &pengine->workers[i];
+        if (worker->is_busy
+            && worker->status.id == scan_status->id
+            && strcmp(worker->status.subtree, scan_status->subtree) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool fsearch_engine_claim_scan_dir(fsearch_worker_t *worker, fdir_info_t *dir_info)
+{
+    fsearch_engine_t *pengine = worker->engine;
+
     bool ret = false;
 
+    fpush_lock(pengine->workers_mutex);
+
     fdb_transaction_t transaction = { 0 };
     if (fdb_transaction_start(pengine->db, &transaction))
     {
         fdb_dirs_scan_status_t *dir_scan_status = fdb_dirs_scan_status(&transaction);
         if(dir_scan_status)
         {
-            if (fdb_dirs_scan_status_get(dir_scan_status, &transaction, scan_status))
+            fdb_dirs_t *dirs = fdb_dirs(&transaction);
+            if (dirs)
             {
-                fdb_dirs_t *dirs = fdb_dirs(&transaction);
-                if (dirs)
+                fdb_dirs_scan_status_iterator_t *it = fdb_dirs_scan_status_iterator(dir_scan_status, &transaction);
+                if (it)
                 {
-                    ret = fdb_dirs_get(dirs, &transaction, scan_status->id, dir_info);
-                    fdb_dirs_release(dirs);
-                } else FS_ERR("Dirs map wasn't opened");
+                    fdir_scan_status_t scan_status = { 0 };
+
+                    for(bool st = fdb_dirs_scan_status_iterator_first(it, &scan_status); st && !ret; st = fdb_dirs_scan_status_iterator_next(it, &scan_status))
+                    {
+                        if (!fsearch_engine_is_claimed(pengine, &scan_status)
+                            && fdb_dirs_get(dirs, &transaction, scan_status.id, dir_info))
+                        {
+                            worker->status = scan_status;
+                            worker->new_status = scan_status;
+                            worker->is_busy = true;
+                            ret = true;
+                        }
+                    }
+
+                    fdb_dirs_scan_status_iterator_free(it);
+                }
+                fdb_dirs_release(dirs);
+            } else FS_ERR("Dirs map wasn't opened");
 
-            }
             fdb_dirs_scan_status_release(dir_scan_status);
         } else FS_ERR("Statuses map wasn't opened");
 
         fdb_transaction_abort(&transaction);
     }
 
+    fpop_lock();
+
     return ret;
 }
 
+static void fsearch_engine_release_scan_dir(fsearch_worker_t *worker)
+{
+    fsearch_engine_t *pengine = worker->engine;
+
+    fpush_lock(pengine->writer_mutex);
+    worker->is_changed = false;
+    fpop_lock();
+
+    fpush_lock(pengine->workers_mutex);
+    worker->is_busy = false;
+    fpop_lock();
+}
+
 static void fsearch_engine_del_scan_dir_info(fsearch_engine_t *pengine, fdir_scan_status_t const *scan_status)
 {
     fdb_transaction_t transaction = { 0 };
-    if (fdb_transaction_start(pengine->db, &transaction))
+    do
     {
-        fdb_dirs_scan_status_t *dir_scan_status = fdb_dirs_scan_status(&transaction);
-        if(dir_scan_status)
+        if (fdb_transaction_start(pengine->db, &transaction))
         {
-            if (fdb_dirs_scan_status_del(dir_scan_status, &transaction, scan_status))
-                fdb_transaction_commit(&transaction);
-            fdb_dirs_scan_status_release(dir_scan_status);
-        }
-        else FS_ERR("Statuses map wasn't opened");
+            fdb_dirs_scan_status_t *dir_scan_status = fdb_dirs_scan_status(&transaction);
+            if(dir_scan_status)
+            {
+                if (fdb_dirs_scan_status_del(dir_scan_status, &transaction, scan_status))
+                    fdb_transaction_commit(&transaction);
+                fdb_dirs_scan_status_release(dir_scan_status);
+            }
+            else FS_ERR("Statuses map wasn't opened");
 
-        fdb_transaction_abort(&transaction);
+            fdb_transaction_abort(&transaction);
+        }
     }
+    while (transaction.error == FERR_AGAIN);
 }
 
-static void fsearch_engine_update_scan_dir_info(fsearch_engine_t *pengine, fdir_scan_status_t *scan_status, char const *dir)
+// Files and scan positions are stored by one transaction. Positions never outrun stored files.
+static void fsearch_engine_writer_flush_unsafe(fsearch_engine_t *pengine)
 {
+    bool is_changed = false;
+    for (uint32_t i = 0; i < pengine->workers_num && !is_changed; ++i)
+        is_changed = pengine->workers[i].is_changed;
+
+    if (!pengine->batch_size && !is_changed)
+        return;
+
     fdb_transaction_t transaction = { 0 };
-    if (fdb_transaction_start(pengine->db, &transaction))
+    do
     {
-        fdb_dirs_scan_status_t *dir_scan_status = fdb_dirs_scan_status(&transaction);
-        if(dir_scan_status)
+        if (fdb_transaction_start(pengine->db, &transaction))
         {
-            fdir_scan_status_t new_scan_status = { scan_status->id };
-            strncpy(new_scan_status.path, dir, sizeof new_scan_status.path);
+            fdb_files_t *files = fdb_files(&transaction, &pengine->uuid);
+            fdb_dirs_scan_status_t *dir_scan_status = fdb_dirs_scan_status(&transaction);
 
-            if (fdb_dirs_scan_status_update(dir_scan_status, &transaction, scan_status, &new_scan_status))
+            if (files && dir_scan_status)
             {
-                fdb_transaction_commit(&transaction);
-                memcpy(scan_status->path, new_scan_status.path, sizeof new_scan_status.path);
+                bool ret = fdb_files_add_all(files, &transaction, pengine->batch, pengine->batch_size);
+                if (!ret) FS_ERR("Unable to store the files info");
+
+                for (uint32_t i = 0; ret && i < pengine->workers_num; ++i)
+                {
+                    fsearch_worker_t *worker = &pengine->workers[i];
+                    if (worker->is_changed)
+                    {
+                        ret = fdb_dirs_scan_status_update(dir_scan_status, &transaction, &worker->status, &worker->new_status);
+                        if (!ret) FS_ERR("Unable to update the scan status");
+                    }
+                }
+
+                if (ret && fdb_transaction_commit(&transaction))
+                {
+                    for (uint32_t i = 0; i < pengine->workers_num; ++i)
+                    {
+                        fsearch_worker_t *worker = &pengine->workers[i];
+                        if (worker->is_changed)
+                        {
+                            worker->status = worker->new_status;
+                            worker->is_changed = false;
+                        }
+                    }
+                }
             }
-            else FS_ERR("Unable to delete the item from statuses map");
-            fdb_dirs_scan_status_release(dir_scan_status);
-        }
-        else FS_ERR("Statuses map wasn't opened");
+            else FS_ERR("Files or statuses map wasn't opened");
 
-        fdb_transaction_abort(&transaction);
+            if (files)
+                fdb_files_release(files);
+            if (dir_scan_status)
+                fdb_dirs_scan_status_release(dir_scan_status);
+
+            fdb_transaction_abort(&transaction);
+        }
     }
+    while (transaction.error == FERR_AGAIN);
+
+    pengine->batch_size = 0;
+}
+
+static void fsearch_engine_writer_flush(fsearch_engine_t *pengine)
+{
+    fpush_lock(pengine->writer_mutex);
+    fsearch_engine_writer_flush_unsafe(pengine);
+    fpop_lock();
+}
+
+static void fsearch_engine_writer_add_file(fsearch_engine_t *pengine, char const *subtree, char const *path, char const *full_path)
+{
+    uint64_t file_size = 0;
+    fsfile_size(full_path, &file_size);
+
+    fpush_lock(pengine->writer_mutex);
+
+    ffile_info_t *info = pengine->batch + pengine->batch_size++;
+    if (*subtree)
+        snprintf(info->path, sizeof info->path, "%s/%s", subtree, path);
+    else
+        strncpy(info->path, path, sizeof info->path);
+    info->size = file_size;
+
+    if (pengine->batch_size >= FSEARCH_ENGINE_BATCH_SIZE)
+        fsearch_engine_writer_flush_unsafe(pengine);
+
+    fpop_lock();
+}
+
+static void fsearch_engine_writer_update_scan_dir_info(fsearch_worker_t *worker, char const *dir)
+{
+    fsearch_engine_t *pengine = worker->engine;
+
+    fpush_lock(pengine->writer_mutex);
+    strncpy(worker->new_status.path, dir, sizeof worker->new_status.path);
+    worker->is_changed = true;
+    fpop_lock();
 }
 
-static void fsearch_engine_add_file(fsearch_engine_t *pengine, char const *path, uint64_t file_size)
+// Files of the top level are stored and each subdirectory becomes the separate scan unit
+static void fsearch_engine_split_scan_dir(fsearch_worker_t *worker, fdir_info_t const *dir_info)
 {
+    fsearch_engine_t *pengine = worker->engine;
+
+    fvector_t *subtrees = fvector(FMAX_FILENAME, 0, 64);
+    if (!subtrees)
+    {
+        FS_ERR("No free space of memory");
+        return;
+    }
+
+    fsdir_t *dir = fsdir_open(dir_info->path);
+    if (dir)
+    {
+        for(dirent_t entry; pengine->is_active && fsdir_read(dir, &entry);)
+        {
+            char full_path[FMAX_PATH];
+            if (snprintf(full_path, sizeof full_path, "%s/%s", dir_info->path, entry.name) >= (int)sizeof full_path)
+                continue;
+
+            if (entry.type == FS_REG)
+                fsearch_engine_writer_add_file(pengine, "", entry.name, full_path);
+            else if (entry.type == FS_DIR)
+            {
+                char name[FMAX_FILENAME] = { 0 };
+                strncpy(name, entry.name, sizeof name - 1);
+                if (!fvector_push_back(&subtrees, name))
+                    FS_ERR("Subdirectory \'%s\' is skipped", entry.name);
+            }
+        }
+        fsdir_close(dir);
+    }
+
+    fsearch_engine_writer_flush(pengine);
+
+    if (!pengine->is_active)
+    {
+        fvector_release(subtrees);
+        return;
+    }
+
+    size_t const subtrees_num = fvector_size(subtrees);
+    bool ret = false;
+
     fdb_transaction_t transaction = { 0 };
-    if (fdb_transaction_start(pengine->db, &transaction))
+    do
     {
-        fdb_files_t *files = fdb_files(&transaction, &pengine->uuid);
-        if (files)
+        if (fdb_transaction_start(pengine->db, &transaction))
         {
-            ffile_info_t info;
-            strncpy(info.path, path, sizeof info.path);
-            info.size = file_size;
+            fdb_dirs_scan_status_t *dir_scan_status = fdb_dirs_scan_status(&transaction);
+            if(dir_scan_status)
+            {
+                ret = true;
+
+                for (size_t i = 0; ret && i < subtrees_num; ++i)
+                {
+                    fdir_scan_status_t scan_status = { worker->status.id };
+                    strncpy(scan_status.subtree, (char const *)fvector_at(subtrees, i), sizeof scan_status.subtree - 1);
+                    ret = fdb_dirs_scan_status_add(dir_scan_status, &transaction, &scan_status);
+                }
 
-            if (fdb_files_add(files, &transaction, &info))
-                fdb_transaction_commit(&transaction);
-            else FS_ERR("Unable to store the file info");
+                ret = ret
+                      && fdb_dirs_scan_status_del(dir_scan_status, &transaction, &worker->status)
+                      && fdb_transaction_commit(&transaction);
 
-            fdb_files_release(files);
+                fdb_dirs_scan_status_release(dir_scan_status);
+            }
+            else FS_ERR("Statuses map wasn't opened");
+
+            fdb_transaction_abort(&transaction);
         }
-        fdb_transaction_abort(&transaction);
     }
+    while (transaction.error == FERR_AGAIN);
+
+    fvector_release(subtrees);
+
+    if (ret)
+    {
+        for (size_t i = 0; i < subtrees_num; ++i)
+            sem_post(&pengine->sem);
+    }
+    else
+        FS_ERR("Unable to split the directory \'%s\' into subtrees", dir_info->path);
 }
 
-static void fsearch_engine_scan_dir(fsearch_engine_t *pengine, fdir_info_t const *dir_info, fdir_scan_status_t *scan_status)
+static void fsearch_engine_scan_dir(fsearch_worker_t *worker, fdir_info_t const *dir_info)
 {
-    fsiterator_t *it = fsdir_iterator(dir_info->path);
+    fsearch_engine_t *pengine = worker->engine;
+    fdir_scan_status_t const *scan_status = &worker->status;
+
+    char root[FMAX_PATH];
+    if (*scan_status->subtree)
+    {
+        if (snprintf(root, sizeof root, "%s/%s", dir_info->path, scan_status->subtree) >= (int)sizeof root)
+        {
+            FS_ERR("Path of \'%s\' subtree is too long", scan_status->subtree);
+            return;
+        }
+    }
+    else
+        strncpy(root, dir_info->path, sizeof root);
+
+    fsiterator_t *it = fsdir_iterator(root);
     if (it)
     {
         fsdir_iterator_seek(it, scan_status->path);
@@ -143,9 +375,7 @@ static void fsearch_engine_scan_dir(fsearch_engine_t *pengine, fdir_info_t const
                     {
                         char full_path[FMAX_PATH];
                         fsdir_iterator_full_path(it, &entry, full_path, sizeof full_path);
-                        uint64_t file_size = 0;
-                        fsfile_size(full_path, &file_size);
-                        fsearch_engine_add_file(pengine, path, file_size);
+                        fsearch_engine_writer_add_file(pengine, scan_status->subtree, path, full_path);
                     }
                     break;
                 }
@@ -155,7 +385,7 @@ static void fsearch_engine_scan_dir(fsearch_engine_t *pengine, fdir_info_t const
                     char dir_path[FMAX_PATH];
                     size_t path_len = fsdir_iterator_directory(it, dir_path, sizeof dir_path);
                     if (path_len <= sizeof dir_path)
-                        fsearch_engine_update_scan_dir_info(pengine, scan_status, dir_path);
+                        fsearch_engine_writer_update_scan_dir_info(worker, dir_path);
                     break;
                 }
 
@@ -165,12 +395,14 @@ static void fsearch_engine_scan_dir(fsearch_engine_t *pengine, fdir_info_t const
         }
         fsdir_iterator_free(it);
     }
+
+    fsearch_engine_writer_flush(pengine);
 }
 
 static void *fsearch_engine_dirs_scan_thread(void *param)
 {
-    fsearch_engine_t *pengine = (fsearch_engine_t*)param;
-    pengine->is_active = true;
+    fsearch_worker_t *worker = (fsearch_worker_t*)param;
+    fsearch_engine_t *pengine = worker->engine;
 
     while(pengine->is_active)
     {
@@ -180,30 +412,31 @@ static void *fsearch_engine_dirs_scan_thread(void *param)
         if (!pengine->is_active)
             break;
 
-        bool dir_is_valid;
+        fdir_info_t dir_info = { 0 };
 
-        do
+        while (pengine->is_active
+               && fsearch_engine_claim_scan_dir(worker, &dir_info))
         {
-            fdir_scan_status_t scan_status = { 0 };
-            fdir_info_t dir_info = { 0 };
-
-            dir_is_valid = fsearch_engine_get_first_scan_dir(pengine, &dir_info, &scan_status);
-
-            if (!pengine->is_active || !dir_is_valid)
-                break;
+            if (pengine->workers_num > 1
+                && !*worker->status.subtree
+                && !*worker->status.path)
+                fsearch_engine_split_scan_dir(worker, &dir_info);
+            else
+            {
+                fsearch_engine_scan_dir(worker, &dir_info);
 
-            fsearch_engine_scan_dir(pengine, &dir_info, &scan_status);
+                if (pengine->is_active)
+                    fsearch_engine_del_scan_dir_info(pengine, &worker->status);
+            }
 
-            if (pengine->is_active)
-                fsearch_engine_del_scan_dir_info(pengine, &scan_status);
+            fsearch_engine_release_scan_dir(worker);
         }
-        while (pengine->is_active && dir_is_valid);
     }   // while(is_active)
 
     return 0;
 }
 
-fsearch_engine_t *fsearch_engine(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *uuid)
+fsearch_engine_t *fsearch_engine(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *uuid, uint32_t workers_num)
 {
     if (!pmsgbus || !db || !uuid)
     {
@@ -211,6 +444,11 @@ fsearch_engine_t *fsearch_engine(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *u
         return 0;
     }
 
+    if (!workers_num)
+        workers_num = FSEARCH_ENGINE_WORKERS_DEFAULT;
+    else if (workers_num > FSEARCH_ENGINE_WORKERS_MAX)
+        workers_num = FSEARCH_ENGINE_WORKERS_MAX;
+
     fsearch_engine_t *pengine = malloc(sizeof(fsearch_engine_t));
     if (!pengine)
     {
@@ -219,28 +457,46 @@ fsearch_engine_t *fsearch_engine(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *u
     }
     memset(pengine, 0, sizeof *pengine);
 
+    static pthread_mutex_t const mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
+
     pengine->ref_counter = 1;
     pengine->pmsgbus = fmsgbus_retain(pmsgbus);
     pengine->db = fdb_retain(db);
     pengine->uuid = *uuid;
+    pengine->workers_mutex = mutex_initializer;
+    pengine->writer_mutex = mutex_initializer;
 
-    if (sem_init(&pengine->sem, 0, 1) == -1)
+    pengine->batch = malloc(FSEARCH_ENGINE_BATCH_SIZE * sizeof(ffile_info_t));
+    if (!pengine->batch)
     {
-        FS_ERR("The semaphore initialization is failed");
+        FS_ERR("No free space of memory");
         fsearch_engine_release(pengine);
         return 0;
     }
 
-    int rc = pthread_create(&pengine->scan_thread, 0, fsearch_engine_dirs_scan_thread, (void*)pengine);
-    if (rc)
+    // Each worker looks for unfinished scan units at start
+    if (sem_init(&pengine->sem, 0, workers_num) == -1)
     {
-        FS_ERR("Unable to create the thread for directories scan. Error: %d", rc);
+        FS_ERR("The semaphore initialization is failed");
         fsearch_engine_release(pengine);
         return 0;
     }
 
-    while(!pengine->is_active)
-        nanosleep(&F1_SEC, NULL);
+    pengine->is_active = true;
+
+    for (; pengine->workers_num < workers_num; ++pengine->workers_num)
+    {
+        fsearch_worker_t *worker = &pengine->workers[pengine->workers_num];
+        worker->engine = pengine;
+
+        int rc = pthread_create(&worker->thread, 0, fsearch_engine_dirs_scan_thread, (void*)worker);
+        if (rc)
+        {
+            FS_ERR("Unable to create the thread for directories scan. Error: %d", rc);
+            fsearch_engine_release(pengine);
+            return 0;
+        }
+    }
 
     return pengine;
 }
@@ -262,14 +518,17 @@ void fsearch_engine_release(fsearch_engine_t *pengine)
             FS_ERR("Invalid search engine");
         else if (!--pengine->ref_counter)
         {
-            if (pengine->is_active)
-            {
-                pengine->is_active = false;
+            pengine->is_active = false;
+
+            for (uint32_t i = 0; i < pengine->workers_num; ++i)
                 sem_post(&pengine->sem);
-                pthread_join(pengine->scan_thread, 0);
-            }
+            for (uint32_t i = 0; i < pengine->workers_num; ++i)
+                pthread_join(pengine->workers[i].thread, 0);
 
             sem_destroy(&pengine->sem);
+            pthread_mutex_destroy(&pengine->workers_mutex);
+            pthread_mutex_destroy(&pengine->writer_mutex);
+            free(pengine->batch);
             fmsgbus_release(pengine->pmsgbus);
             fdb_release(pengine->db);
             free(pengine);
@@ -312,31 +571,35 @@ bool fsearch_engine_add_dir(fsearch_engine_t *pengine, char const *dir)
     bool ret = false;
 
     fdb_transaction_t transaction = { 0 };
-    if (fdb_transaction_start(pengine->db, &transaction))
+    do
     {
-        fdb_dirs_t *dirs = fdb_dirs(&transaction);
-        if (dirs)
+        if (fdb_transaction_start(pengine->db, &transaction))
         {
-            uint32_t id;
-            if (fdb_dirs_add_unique(dirs, &transaction, dir, &id))
+            fdb_dirs_t *dirs = fdb_dirs(&transaction);
+            if (dirs)
             {
-                fdb_dirs_scan_status_t *dir_scan_status = fdb_dirs_scan_status(&transaction);
-                if(dir_scan_status)
+                uint32_t id;
+                if (fdb_dirs_add_unique(dirs, &transaction, dir, &id))
                 {
-                    fdir_scan_status_t scan_status = { id };
-
-                    if (fdb_dirs_scan_status_add(dir_scan_status, &transaction, &scan_status))
+                    fdb_dirs_scan_status_t *dir_scan_status = fdb_dirs_scan_status(&transaction);
+                    if(dir_scan_status)
                     {
-                        ret = true;
-                        fdb_transaction_commit(&transaction);
+                        fdir_scan_status_t scan_status = { id };
+
+                        if (fdb_dirs_scan_status_add(dir_scan_status, &transaction, &scan_status))
+                        {
+                            ret = true;
+                            fdb_transaction_commit(&transaction);
+                        }
+                        fdb_dirs_scan_status_release(dir_scan_status);
                     }
-                    fdb_dirs_scan_status_release(dir_scan_status);
-                }
-            } else FS_WARN("Directory isn't unique");
-            fdb_dirs_release(dirs);
+                } else FS_WARN("Directory isn't unique");
+                fdb_dirs_release(dirs);
+            }
+            fdb_transaction_abort(&transaction);
         }
-        fdb_transaction_abort(&transaction);
     }
+    while (transaction.error == FERR_AGAIN);
 
     if (ret)
         sem_post(&pengine->sem);
@@ -4,7 +4,8 @@
 typedef enum
 {
     FINVALID_SYNC_AGENT = 0,
-    FSEARCH_ENGINE_SYNC_AGENT
+    FSEARCH_ENGINE_SYNC_AGENT,
+    FCDC_SYNC_AGENT
 } fsync_agents_t;
 
 #endif
@@ -1,12 +1,14 @@
 #include "sync_engine.h"
 #include "rstream.h"
 #include "rsync.h"
+#include "cdc.h"
 #include <futils/log.h>
 #include <futils/utils.h>
 #include <futils/vector.h>
 #include <futils/mutex.h>
 #include <fcommon/limits.h>
 #include <fcommon/messages.h>
+#include <fdb/sync/sketches.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -14,35 +16,142 @@
 #include <semaphore.h>
 #include <errno.h>
 
-static struct timespec const F10_MSEC = { 0, 10000000 };
+enum
+{
+    FSYNC_SIGNATURE_CACHE_MAX = 64 * 1024 * 1024,   // Signatures of larger size aren't cached
+    FSYNC_LITERAL_SIZE_MAX    = 64 * 1024,          // Small data is sent without signature
+    FSYNC_LITERAL_BASE_RATIO  = 16,                 // Data is sent without signature if the base is 16 times smaller
+    FSYNC_APPEND_CHECK_SIZE   = 1024 * 1024,        // Size of the buffer for the digest of the data prefix
+    FSYNC_SKETCH_SIMILARITY   = 20,                 // Minimal similarity (in percents) of the local file which is used as the base for new data
+    FSYNC_SIZE_CLASS_DELAY    = 2                   // Pending synchronization of twice larger data is started up to 2 sec later
+};
 
 /*
  *               synchronization
  *  src  ------------ DATA ------------------> dst
  *       -- FSYNC_REQUEST ------------------->          mandatory
+ *      <-- FSYNC_OK ------------------------           data is equal, the synchronization is completed
+ *      <-- FSYNC_LITERAL -------------------           no signature, delta contains the whole data
+ *      <-- FSYNC_APPEND --------------------           local data is a prefix, delta contains the tail only
+ *       -- FSYNC_APPEND_REJECT ------------->          prefix isn't equal, dst continues with the signature
+ *      <-- FSYNC_SKETCH_REQUEST ------------           no local data, the sketch is requested to find a similar local file
+ *       -- FSYNC_SKETCH -------------------->          the most similar local file is the base for signature
+ *      <-- FSYNC_SIGNATURE_VALID -----------           local data wasn't changed, src uses the signature received earlier
  *      <-- signature istream/FSYNC_FAILED --           mandatory
  *       -- FSYNC_CANCEL -------------------->          optional
- *      <-- [signature] ---------------------           mandatory
  *       -- delta istream ------------------->          mandatory
+ *      <-- [signature] ---------------------           mandatory
  *       -- [delta] -------------------------> apply    mandatory
  *      <-- FSYNC_OK/FSYNC_FAILED -----------           mandatory
+ *
+ * The delta istream is requested while the signature is transferred. The signature data is buffered by istream.
+ * src caches the received signatures by dst and offers the digest of dst data of the cached signature in FSYNC_REQUEST.
+ *
+ * Synchronizations don't own threads. Each synchronization is the state machine which is driven by messages.
+ * The messages handlers save events and queue the synchronization, workers perform its steps up to the next wait.
+ * Steps don't wait the data of remote streams. The istreams notify about the new data and the step continues
+ * the signature loading or the delta applying from the received part.
  */
 
+typedef struct fsync_task fsync_task_t;
+typedef struct fsync_signature_istream fsync_signature_istream_t;
+typedef struct fsync_sketch_ostream fsync_sketch_ostream_t;
+
+typedef bool (*fsync_step_fn_t)(fsync_engine_t *, fsync_task_t *);    // true - synchronization is finished
+typedef void (*fsync_task_free_fn_t)(fsync_task_t *);
+
+// Synchronization which is performed by workers
+struct fsync_task
+{
+    bool                    is_queued;                          // task is queued or its step is performed
+    bool                    is_signaled;                        // events are received while the step is performed
+    fuuid_t                 peer;                               // remote node
+    time_t                  deadline;                           // pending task start order: request time + delay of the data size class
+    uint32_t                order;                              // pending task arrival order
+};
+
+typedef enum
+{
+    FSYNC_STEP_WAIT = 0,                                        // synchronization waits events
+    FSYNC_STEP_NEXT,                                            // next step is ready
+    FSYNC_STEP_DONE                                             // synchronization is finished
+} fsync_step_t;
+
+// src events. They are set by messages handlers.
+typedef struct
+{
+    bool                    is_literal;                         // data is requested without signature
+    bool                    is_completed;                       // synchronization is completed by dst
+    bool                    is_append;                          // tail of data is requested
+    uint64_t                append_offset;                      // size of the data prefix on dst
+    fmd5_t                  append_digest;                      // digest of the data prefix on dst
+    bool                    is_sketch_requested;                // sketch of data is requested
+    bool                    is_signature_valid;                 // signature which was received earlier is valid
+    fistream_t             *signature_istream;                  // signature istream
+    fmd5_t                  signature_digest;                   // digest of the signature base on dst (zero - unknown)
+    bool                    is_canceled;                        // synchronization is canceled by dst
+    ferr_t                  err;                                // error
+} fsync_src_events_t;
+
+typedef enum
+{
+    FSYNC_SRC_REQUEST = 0,                                      // request isn't sent
+    FSYNC_SRC_NEGOTIATION,                                      // dst chooses the way of synchronization
+    FSYNC_SRC_SIGNATURE,                                        // src receives the signature
+    FSYNC_SRC_COMPLETION                                        // delta is sent, dst applies it
+} fsync_src_state_t;
+
 // src
 typedef struct
 {
+    fsync_task_t            task;                               // synchronization task
     uint32_t                sync_id;                            // synchronization id (key)
     fuuid_t                 dst;                                // destination uuid
     uint32_t                agent_id;                           // synchronization agent id
     time_t                  time;                               // synchronization start time
     binn                   *metainf;                            // meta information
     fistream_t             *pistream;                           // istream with data
+    uint64_t                size;                               // data size
     fostream_t             *delta_ostream;                      // ostream for delta
+    fsync_src_state_t       state;                              // synchronization state
+    fsync_src_events_t      events;                             // events which aren't handled yet
+    fsync_agent_t          *agent;                              // synchronization agent
+    bool                    has_key;                            // signature key of local data is known
+    fdb_signature_key_t     key;                                // signature key of local data
+    fdb_remote_signature_key_t remote_key;                      // key of the signature which was received earlier from dst
+    fistream_t             *signature_istream;                  // signature istream
+    fmd5_t                  signature_digest;                   // digest of the signature base on dst (zero - unknown)
+    frsync_signature_t     *psig;                               // signature which is loaded
+    fsync_signature_istream_t *sig_istream;                     // signature istream with copy for the cache (0 - signature isn't cached)
+    ferr_t                  err;                                // error
+    char const             *err_msg;                            // error message
 } fsync_src_t;
 
+// dst events. They are set by messages handlers.
+typedef struct
+{
+    fistream_t             *delta_istream;                      // delta istream
+    bool                    is_append_rejected;                 // prefix isn't equal, dst continues with the signature
+    bool                    is_sketch;                          // sketch of the source data is received
+    uint64_t                sketch[FSYNC_SKETCH_SIZE];          // sketch of the source data
+    bool                    is_canceled;                        // synchronization is canceled by src
+    ferr_t                  err;                                // error
+} fsync_dst_events_t;
+
+typedef enum
+{
+    FSYNC_DST_REQUEST = 0,                                      // request is received
+    FSYNC_DST_APPEND,                                           // dst waits the tail delta or the append rejection
+    FSYNC_DST_ACCEPT,                                           // dst accepts the new data
+    FSYNC_DST_SKETCH,                                           // dst waits the sketch of the source data
+    FSYNC_DST_BASE,                                             // way of synchronization is chosen by the base data
+    FSYNC_DST_DELTA                                             // dst waits the delta
+} fsync_dst_state_t;
+
 // dst
 typedef struct
 {
+    fsync_task_t            task;                               // synchronization task
     uint32_t                sync_id;                            // synchronization id (key)
     fuuid_t                 src;                                // source uuid (key)
     uint32_t                agent_id;                           // synchronization agent id
@@ -51,54 +160,50 @@ typedef struct
     fostream_t             *signature_ostream;                  // ostream for signature
     fistream_t             *pistream;                           // istream with data
     fostream_t             *postream;                           // ostream for data
-} fsync_dst_t;
-
-typedef struct
-{
-    volatile bool           is_active;                          // thread activity flag
-    volatile bool           is_busy;                            // synchronization flag (true - if thread busy with synchronization)
-    sem_t                   sem;                                // Semaphore for events wait
-    pthread_t               thread;                             // synchronization thread
-} fsync_thread_t;
-
-typedef struct
-{
-    fsync_thread_t          sync;                               // synchronization thread status
-    volatile uint32_t       sync_id;                            // synchronization id
-    fistream_t             *signature_istream;                  // signature istream
-    ferr_t                  err;                                // error
-} fsync_src_thread_t;
-
-typedef struct
-{
-    fsync_thread_t          sync;
-    uint32_t                sync_id;                            // synchronization id
-    fuuid_t                 src;                                // source uuid
+    uint32_t                block_len;                          // signature block length
+    uint32_t                strong_len;                         // signature strong sum length
+    uint64_t                size;                               // data size (0 - unknown)
+    fmd5_t                  digest;                             // data digest (zero - unknown)
+    fmd5_t                  base_digest;                        // digest of local data whose signature is known by src (zero - unknown)
+    fsync_dst_state_t       state;                              // synchronization state
+    fsync_dst_events_t      events;                             // events which aren't handled yet
+    fsync_agent_t          *agent;                              // synchronization agent
+    bool                    has_key;                            // signature key of local data is known
+    fdb_signature_key_t     key;                                // signature key of local data
+    bool                    is_append;                          // only the tail of data is received
+    bool                    is_similar;                         // base is the most similar local file
     fistream_t             *delta_istream;                      // delta istream
+    frsync_delta_t         *pdelta;                             // delta which is applied
+    fsync_sketch_ostream_t *sketch_ostream;                     // data ostream with the sketch calculation (0 - sketch isn't indexed)
     ferr_t                  err;                                // error
-} fsync_dst_thread_t;
-
-typedef struct
-{
-    pthread_mutex_t         mutex;                              // mutex for streams vector guard
-    fvector_t              *scrs;                               // vector of fsync_src_t
-    sem_t                   sem;                                // Semaphore for stream data wait
-    fsync_src_thread_t      threads[FDATA_SYNC_THREADS_NUM];    // synchronization threads
-} fsync_src_threads_t;
+    char const             *err_msg;                            // error message
+} fsync_dst_t;
 
+// Tasks of one peer which aren't started. Binary heap by the start order.
 typedef struct
 {
-    pthread_mutex_t         mutex;                              // mutex for streams vector guard
-    fvector_t              *dsts;                               // vector of fsync_dst_t
-    sem_t                   sem;                                // Semaphore for stream data wait
-    fsync_dst_thread_t      threads[FDATA_SYNC_THREADS_NUM];    // synchronization threads
-} fsync_dst_threads_t;
+    fuuid_t                 peer;                               // remote node
+    fvector_t              *tasks;                              // vector of fsync_task_t*
+} fsync_peer_tasks_t;
 
+// Workers perform the steps of queued synchronizations
 typedef struct
 {
     fsync_engine_t         *pengine;
-    uint32_t                thread_id;
-} fsync_thread_param_t;
+    fsync_step_fn_t         step;                               // synchronization step
+    fsync_task_free_fn_t    free;                               // synchronization release
+    pthread_mutex_t         mutex;                              // mutex for tasks and events guard
+    fvector_t              *peers;                              // vector of fsync_peer_tasks_t with the tasks which aren't started (sorted by peer)
+    fuuid_t                 last_peer;                          // peer of the last started task
+    size_t                  pending_num;                        // number of the tasks which aren't started
+    uint32_t                order;                              // tasks arrival order generator
+    fvector_t              *active;                             // vector of fsync_task_t* which are started
+    fvector_t              *queue;                              // vector of fsync_task_t* with events
+    sem_t                   sem;                                // Semaphore for tasks wait
+    volatile bool           is_active;                          // workers activity flag
+    uint32_t                threads_num;                        // number of started threads
+    pthread_t               threads[FDATA_SYNC_THREADS_NUM];    // worker threads
+} fsync_workers_t;
 
 struct sync_engine
 {
@@ -107,12 +212,13 @@ struct sync_engine
     fuuid_t                 uuid;                               // current node uuid
     fmsgbus_t              *msgbus;                             // messages bus
     frstream_factory_t     *stream_factory;                     // remote streams factory
+    fdb_t                  *db;                                 // signatures cache and sketches index
 
     pthread_mutex_t         agents_mutex;                       // agents vector guard mutex
     fvector_t              *agents;                             // vector of fsync_agent_t*
 
-    fsync_src_threads_t     src_threads;                        // src threads
-    fsync_dst_threads_t     dst_threads;                        // dst threads
+    fsync_workers_t         src_workers;                        // src synchronizations
+    fsync_workers_t         dst_workers;                        // dst synchronizations
 };
 
 typedef enum
@@ -125,26 +231,19 @@ typedef struct
 {
     uint32_t        sync_id;
     fsync_stream_t  stream_type;
+    fmd5_t          digest;         // digest of the signature base (zero - unknown)
 } fsync_stream_metainf_t;
 
-#define FSYNC_CHECK_CANCEL_SATATE()                 \
-    if (!thread->sync.is_active)                    \
-        break;                                      \
-                                                    \
-    if (!thread->sync.is_busy)                      \
-    {                                               \
-        ret = thread->err;                          \
-        err_msg = "Synchronization was canceled";   \
-        break;                                      \
-    }
-
-static binn *fsync_signature_stream_metainf(uint32_t sync_id)
+// The digest of local data lets src reuse the signature while the data isn't changed
+static binn *fsync_signature_stream_metainf(uint32_t sync_id, fmd5_t const *digest)
 {
     binn *obj = binn_object();
     if (obj)
     {
         binn_object_set_uint32(obj, "sync_id",     sync_id);
         binn_object_set_uint8 (obj, "stream_type", FSYNC_SIGNATURE_STREAM);
+        if (digest)
+            binn_object_set_blob(obj, "digest", (void *)digest->data, sizeof digest->data);
     }
     return obj;
 }
@@ -167,830 +266,1922 @@ static fsync_stream_metainf_t fsync_stream_metainf(binn *metainf)
         binn_object_uint32(metainf, "sync_id"),
         binn_object_uint8 (metainf, "stream_type")
     };
+
+    int digest_size = 0;
+    void const *digest = binn_object_blob(metainf, "digest", &digest_size);
+    if (digest && digest_size == sizeof ret.digest.data)
+        memcpy(ret.digest.data, digest, sizeof ret.digest.data);
+
     return ret;
 }
 
-//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// fsync_agent
-//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-
-static int fsync_agent_cmp(fsync_agent_t const **lhs, fsync_agent_t const **rhs)
+static ferr_t fsync_ostream_write(fostream_t *postream, char const *data, size_t size)
 {
-    return (int)(*lhs)->id - (*rhs)->id;
+    while(size)
+    {
+        size_t const write_size = postream->write(postream, data, size);
+        if (!write_size)
+            return FFAIL;
+        data += write_size;
+        size -= write_size;
+    }
+    return FSUCCESS;
 }
 
-static ferr_t fsync_agent_add(fsync_engine_t *pengine, fsync_agent_t *agent)
+static size_t fsync_istream_read(fistream_t *pistream, char *data, size_t size)
 {
-    ferr_t ret = FSUCCESS;
+    size_t read_size = 0;
+    while(read_size < size)
+    {
+        size_t const n = pistream->read(pistream, data + read_size, size - read_size);
+        if (!n)
+            break;
+        read_size += n;
+    }
+    return read_size;
+}
 
-    agent->retain(agent);
+/*
+ * Digest of the whole data prefix. Equal digests confirm the local data is a prefix of the source one,
+ * any change inside the prefix rejects the append. The istream is positioned at the prefix end.
+ */
+static bool fsync_prefix_digest(fistream_t *pistream, uint64_t size, fmd5_t *digest)
+{
+    size_t const buf_size = size < FSYNC_APPEND_CHECK_SIZE ? (size_t)size : FSYNC_APPEND_CHECK_SIZE;
 
-    fpush_lock(pengine->agents_mutex);
-    if (fvector_push_back(&pengine->agents, &agent))
-        fvector_qsort(pengine->agents, (fvector_comparer_t)fsync_agent_cmp);
-    else
+    char *buf = malloc(buf_size ? buf_size : 1);
+    if (!buf)
     {
-        agent->release(agent);
-        FS_ERR("No memory for new agent");
-        ret = FERR_NO_MEM;
+        FS_ERR("Unable to allocate memory for data prefix");
+        return false;
     }
-    fpop_lock();
 
-    return ret;
-}
+    fmd5_context_t ctx;
+    fmd5_init(&ctx);
 
-static fsync_agent_t *fsync_agent_get(fsync_engine_t *pengine, uint32_t agent_id)
-{
-    fsync_agent_t *agent = 0;
-    fsync_agent_t const key = { agent_id };
-    fsync_agent_t const *pkey = &key;
+    bool ret = pistream->seek(pistream, 0);
 
-    fpush_lock(pengine->agents_mutex);
-    fsync_agent_t **pagent = (fsync_agent_t **)fvector_bsearch(pengine->agents, &pkey, (fvector_comparer_t)fsync_agent_cmp);
-    if (pagent)
-        agent = (*pagent)->retain(*pagent);
-    fpop_lock();
+    for (uint64_t offset = 0; ret && offset < size;)
+    {
+        size_t const len = size - offset < buf_size ? (size_t)(size - offset) : buf_size;
+        ret = fsync_istream_read(pistream, buf, len) == len;
+        if (ret)
+        {
+            fmd5_update(&ctx, buf, (uint32_t)len);
+            offset += len;
+        }
+    }
 
-    return agent;
+    free(buf);
+
+    if (ret)
+        fmd5_final(&ctx, digest);
+
+    return ret;
 }
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// fsync_src
+// signatures cache
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-static bool fsync_src_push_back(fsync_src_threads_t *src_threads, fsync_src_t const *src)
+// Copy of the signature for the cache
+typedef struct
 {
-    src->pistream->retain(src->pistream);
+    char                   *data;                               // signature copy
+    size_t                  size;
+    size_t                  capacity;
+    bool                    is_overflow;                        // signature is too large for the cache
+} fsync_signature_copy_t;
 
-    bool is_added = true;
+static void fsync_signature_copy_append(fsync_signature_copy_t *pcopy, char const *data, size_t size)
+{
+    if (pcopy->is_overflow || !size)
+        return;
 
-    fpush_lock(src_threads->mutex);
-    if (!fvector_push_back(&src_threads->scrs, src))
+    if (pcopy->size + size > FSYNC_SIGNATURE_CACHE_MAX)
+        pcopy->is_overflow = true;
+    else if (pcopy->size + size > pcopy->capacity)
     {
-        src->pistream->release(src->pistream);
-        FS_ERR("No memory for new synchronization stream");
-        is_added = false;
-    }
-    fpop_lock();
+        size_t capacity = pcopy->capacity ? pcopy->capacity * 2 : 64 * 1024;
+        while (capacity < pcopy->size + size)
+            capacity *= 2;
 
-    if (is_added)
-        sem_post(&src_threads->sem);
+        char *buf = realloc(pcopy->data, capacity);
+        if (buf)
+        {
+            pcopy->data = buf;
+            pcopy->capacity = capacity;
+        }
+        else
+            pcopy->is_overflow = true;
+    }
 
-    return is_added;
+    if (!pcopy->is_overflow)
+    {
+        memcpy(pcopy->data + pcopy->size, data, size);
+        pcopy->size += size;
+    }
 }
 
-static bool fsync_src_pop_back(fsync_src_threads_t *src_threads, fsync_src_t *src)
+// Signature is sent to the remote side and copied for the cache
+typedef struct
 {
-    bool ret = false;
+    fostream_t              ostream;
+    fostream_t             *postream;                           // signature ostream
+    fsync_signature_copy_t  copy;                               // signature copy
+} fsync_signature_ostream_t;
 
-    fpush_lock(src_threads->mutex);
-    size_t vector_size = fvector_size(src_threads->scrs);
-    if (vector_size)
-    {
-        fsync_src_t *last = (fsync_src_t *)fvector_at(src_threads->scrs, vector_size - 1);
-        *src = *last;
-        fvector_erase(&src_threads->scrs, vector_size - 1);
-        ret = true;
-    }
-    fpop_lock();
+static fostream_t *fsync_signature_ostream_retain(fostream_t *postream) { return postream; }
+static void        fsync_signature_ostream_release(fostream_t *postream) { (void)postream; }
+static bool        fsync_signature_ostream_seek(fostream_t *postream, size_t pos) { (void)postream; (void)pos; return false; }
 
-    return ret;
+static size_t fsync_signature_ostream_write(fostream_t *postream, char const *data, size_t size)
+{
+    fsync_signature_ostream_t *psig_ostream = (fsync_signature_ostream_t *)postream;
+    size = psig_ostream->postream->write(psig_ostream->postream, data, size);
+    fsync_signature_copy_append(&psig_ostream->copy, data, size);
+    return size;
 }
 
-static void fsync_src_free(fsync_src_t *src)
+static fstream_status_t fsync_signature_ostream_status(fostream_t *postream)
 {
-    if (src->pistream)
-        src->pistream->release(src->pistream);
-    if (src->delta_ostream)
-        src->delta_ostream->release(src->delta_ostream);
-    binn_free(src->metainf);
+    fsync_signature_ostream_t *psig_ostream = (fsync_signature_ostream_t *)postream;
+    return psig_ostream->postream->status
+                ? psig_ostream->postream->status(psig_ostream->postream)
+                : FSTREAM_STATUS_OK;
 }
 
-static bool fsync_src_remove_last(fsync_src_threads_t *src_threads)
+static void fsync_signature_ostream_init(fsync_signature_ostream_t *psig_ostream, fostream_t *postream)
 {
-    bool ret = false;
+    memset(psig_ostream, 0, sizeof *psig_ostream);
+    psig_ostream->ostream.retain = fsync_signature_ostream_retain;
+    psig_ostream->ostream.release = fsync_signature_ostream_release;
+    psig_ostream->ostream.write = fsync_signature_ostream_write;
+    psig_ostream->ostream.seek = fsync_signature_ostream_seek;
+    psig_ostream->ostream.status = fsync_signature_ostream_status;
+    psig_ostream->postream = postream;
+}
 
-    fpush_lock(src_threads->mutex);
-    size_t vector_size = fvector_size(src_threads->scrs);
-    if (vector_size)
-    {
-        fsync_src_t *poutgoing_stream = (fsync_src_t *)fvector_at(src_threads->scrs, vector_size - 1);
-        fsync_src_free(poutgoing_stream);
-        fvector_erase(&src_threads->scrs, vector_size - 1);
-        ret = true;
-    }
-    fpop_lock();
+// Signature is received from the remote side and copied for the cache
+struct fsync_signature_istream
+{
+    fistream_t              istream;
+    fistream_t             *pistream;                           // signature istream
+    fsync_signature_copy_t  copy;                               // signature copy
+};
 
-    return ret;
+static fistream_t *fsync_signature_istream_retain(fistream_t *pistream) { return pistream; }
+static void        fsync_signature_istream_release(fistream_t *pistream) { (void)pistream; }
+static bool        fsync_signature_istream_seek(fistream_t *pistream, size_t pos) { (void)pistream; (void)pos; return false; }
+
+static size_t fsync_signature_istream_read(fistream_t *pistream, char *data, size_t size)
+{
+    fsync_signature_istream_t *psig_istream = (fsync_signature_istream_t *)pistream;
+    size = psig_istream->pistream->read(psig_istream->pistream, data, size);
+    fsync_signature_copy_append(&psig_istream->copy, data, size);
+    return size;
 }
 
-static void *fsync_src_thread(void *);
+static fstream_status_t fsync_signature_istream_status(fistream_t *pistream)
+{
+    fsync_signature_istream_t *psig_istream = (fsync_signature_istream_t *)pistream;
+    return psig_istream->pistream->status(psig_istream->pistream);
+}
 
-static bool fsync_src_create(fsync_engine_t *pengine, fsync_src_threads_t *src_threads)
+static void fsync_signature_istream_init(fsync_signature_istream_t *psig_istream, fistream_t *pistream)
 {
-    static const pthread_mutex_t mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
+    memset(psig_istream, 0, sizeof *psig_istream);
+    psig_istream->istream.retain = fsync_signature_istream_retain;
+    psig_istream->istream.release = fsync_signature_istream_release;
+    psig_istream->istream.read = fsync_signature_istream_read;
+    psig_istream->istream.seek = fsync_signature_istream_seek;
+    psig_istream->istream.status = fsync_signature_istream_status;
+    psig_istream->pistream = pistream;
+}
 
-    src_threads->mutex = mutex_initializer;
+// The cached signature is copied because the transaction shouldn't be kept while the signature is sent
+static bool fsync_signature_cache_get(fsync_engine_t *pengine, fdb_signature_key_t const *key, char **data, size_t *size)
+{
+    bool ret = false;
 
-    src_threads->scrs = fvector(sizeof(fsync_src_t), 0, 0);
-    if (!src_threads->scrs)
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(pengine->db, &transaction))
     {
-        FS_ERR("Streams vector wasn't created");
-        return false;
+        fdb_map_t map = { 0 };
+        if (fdb_signatures_map_open(&transaction, &map))
+        {
+            fdb_data_t signature = { 0 };
+            if (fdb_signature_get(&map, &transaction, key, &signature))
+            {
+                *data = malloc(signature.size);
+                if (*data)
+                {
+                    memcpy(*data, signature.data, signature.size);
+                    *size = signature.size;
+                    ret = true;
+                }
+                else
+                    FS_ERR("Unable to allocate memory for signature");
+            }
+            fdb_map_close(&map);
+        }
+        fdb_transaction_abort(&transaction);
     }
 
-    if (sem_init(&src_threads->sem, 0, 0) == -1)
-    {
-        FS_ERR("The semaphore initialization is failed");
-        return false;
-    }
+    return ret;
+}
 
-    for(uint32_t i = 0; i < FARRAY_SIZE(src_threads->threads); ++i)
+static void fsync_signature_cache_put(fsync_engine_t *pengine, fdb_signature_key_t const *key, char const *data, size_t size)
+{
+    fdb_transaction_t transaction = { 0 };
+    do
     {
-        fsync_src_thread_t *sync_thread = src_threads->threads + i;
-        sync_thread->sync.is_active = false;
-        sync_thread->sync.is_busy = false;
-        sync_thread->err = FSUCCESS;
-
-        if (sem_init(&sync_thread->sync.sem, 0, 0) == -1)
+        if (fdb_transaction_start(pengine->db, &transaction))
         {
-            FS_ERR("The semaphore initialization is failed");
-            return false;
+            fdb_map_t map = { 0 };
+            if (fdb_signatures_map_open(&transaction, &map))
+            {
+                if (fdb_signature_put(&map, &transaction, key, data, size))
+                    fdb_transaction_commit(&transaction);
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
         }
+    }
+    while (transaction.error == FERR_AGAIN);
+}
 
-        fsync_thread_param_t thread_param = { pengine, i };
+// Digest of the remote data whose signature was received earlier
+static bool fsync_remote_signature_digest(fsync_engine_t *pengine, fuuid_t const *peer, fdb_remote_signature_key_t *key)
+{
+    bool ret = false;
 
-        int rc = pthread_create(&sync_thread->sync.thread, 0, fsync_src_thread, &thread_param);
-        if (rc)
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(pengine->db, &transaction))
+    {
+        fdb_map_t map = { 0 };
+        if (fdb_remote_signatures_map_open(&transaction, peer, &map))
         {
-            FS_ERR("Unable to create the thread. Error: %d", rc);
-            return false;
+            ret = fdb_remote_signature_get(&map, &transaction, key, 0);
+            fdb_map_close(&map);
         }
-
-        while(!sync_thread->sync.is_active)
-            nanosleep(&F10_MSEC, NULL);
+        fdb_transaction_abort(&transaction);
     }
 
-    return true;
+    return ret;
 }
 
-static void fsync_src_threads_free(fsync_src_threads_t *src_threads)
+// The signature is copied into the istream because the transaction shouldn't be kept while the delta is calculated
+static fistream_t *fsync_remote_signature_istream(fsync_engine_t *pengine, fuuid_t const *peer, fdb_remote_signature_key_t const *key)
 {
-    for(uint32_t i = 0; i < FARRAY_SIZE(src_threads->threads); ++i)
-        src_threads->threads[i].sync.is_active = false;
-
-    for(uint32_t i = 0; i < FARRAY_SIZE(src_threads->threads); ++i)
-    {
-        sem_post(&src_threads->sem);
-        sem_post(&src_threads->threads[i].sync.sem);
-    }
+    fistream_t *pistream = 0;
 
-    for(uint32_t i = 0; i < FARRAY_SIZE(src_threads->threads); ++i)
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(pengine->db, &transaction))
     {
-        fsync_src_thread_t *thread = src_threads->threads + i;
-        pthread_join(thread->sync.thread, 0);
-        sem_destroy(&thread->sync.sem);
-        if (thread->signature_istream)
-            thread->signature_istream->release(thread->signature_istream);
-        thread->signature_istream = 0;
+        fdb_map_t map = { 0 };
+        if (fdb_remote_signatures_map_open(&transaction, peer, &map))
+        {
+            fdb_remote_signature_key_t found = *key;
+            fdb_data_t signature = { 0 };
+            if (fdb_remote_signature_get(&map, &transaction, &found, &signature)
+                && memcmp(&found.digest, &key->digest, sizeof key->digest) == 0)
+                pistream = fmem_const_istream(signature.data, signature.size);
+            fdb_map_close(&map);
+        }
+        fdb_transaction_abort(&transaction);
     }
 
-    sem_destroy(&src_threads->sem);
+    return pistream;
+}
 
-    if (src_threads->scrs)
+static void fsync_remote_signature_put(fsync_engine_t *pengine, fuuid_t const *peer, fdb_remote_signature_key_t const *key, char const *data, size_t size)
+{
+    fdb_transaction_t transaction = { 0 };
+    do
     {
-        while(fsync_src_remove_last(src_threads));
-        fvector_release(src_threads->scrs);
+        if (fdb_transaction_start(pengine->db, &transaction))
+        {
+            fdb_map_t map = { 0 };
+            if (fdb_remote_signatures_map_open(&transaction, peer, &map))
+            {
+                if (fdb_remote_signature_put(&map, &transaction, key, data, size))
+                    fdb_transaction_commit(&transaction);
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
+        }
     }
+    while (transaction.error == FERR_AGAIN);
 }
 
-static void *fsync_src_thread(void *param)
-{
-    fsync_thread_param_t *thread_param = (fsync_thread_param_t *)param;
-    fsync_engine_t       *pengine      = thread_param->pengine;
-    uint32_t const        thread_id    = thread_param->thread_id;
-    fsync_src_threads_t  *src_threads  = &pengine->src_threads;
-    fsync_src_thread_t   *thread       = src_threads->threads + thread_id;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// sketches index
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-    thread->sync.is_active = true;
+// Received data is written and its sketch is calculated on the fly
+struct fsync_sketch_ostream
+{
+    fostream_t              ostream;
+    fostream_t             *postream;                           // data ostream
+    fcdc_sketch_t           sketch;                             // sketch of the written data
+    uint64_t                size;                               // size of the written data
+};
 
-    while(thread->sync.is_active)
-    {
-        while (sem_wait(&src_threads->sem) == -1 && errno == EINTR)
-            continue;       // Restart if interrupted by handler
-        if (!thread->sync.is_active)
-            break;
+static fostream_t *fsync_sketch_ostream_retain(fostream_t *postream) { return postream; }
+static void        fsync_sketch_ostream_release(fostream_t *postream) { (void)postream; }
+static bool        fsync_sketch_ostream_seek(fostream_t *postream, size_t pos) { (void)postream; (void)pos; return false; }
 
-        ferr_t ret = FSUCCESS;
-        char const *err_msg = "";
+static size_t fsync_sketch_ostream_write(fostream_t *postream, char const *data, size_t size)
+{
+    fsync_sketch_ostream_t *psketch_ostream = (fsync_sketch_ostream_t *)postream;
+    size = psketch_ostream->postream->write(psketch_ostream->postream, data, size);
+    fcdc_sketch_update(&psketch_ostream->sketch, data, size);
+    psketch_ostream->size += size;
+    return size;
+}
 
-        fsync_src_t                src = { 0 };
-        fsync_agent_t             *agent = 0;
-        frsync_signature_t        *psig = 0;
-        frsync_delta_calculator_t *pdelta_calc = 0;
+static fstream_status_t fsync_sketch_ostream_status(fostream_t *postream)
+{
+    fsync_sketch_ostream_t *psketch_ostream = (fsync_sketch_ostream_t *)postream;
+    return psketch_ostream->postream->status
+                ? psketch_ostream->postream->status(psketch_ostream->postream)
+                : FSTREAM_STATUS_OK;
+}
 
-        if (!fsync_src_pop_back(src_threads, &src))
-            continue;
+static void fsync_sketch_ostream_init(fsync_sketch_ostream_t *psketch_ostream, fostream_t *postream)
+{
+    memset(psketch_ostream, 0, sizeof *psketch_ostream);
+    psketch_ostream->ostream.retain = fsync_sketch_ostream_retain;
+    psketch_ostream->ostream.release = fsync_sketch_ostream_release;
+    psketch_ostream->ostream.write = fsync_sketch_ostream_write;
+    psketch_ostream->ostream.seek = fsync_sketch_ostream_seek;
+    psketch_ostream->ostream.status = fsync_sketch_ostream_status;
+    psketch_ostream->postream = postream;
+    fcdc_sketch_init(&psketch_ostream->sketch);
+}
 
-        thread->sync_id = src.sync_id;
-        thread->sync.is_busy = true;
+static void fsync_sketch_put(fsync_engine_t *pengine, char const *path, uint64_t const *hashes)
+{
+    fdb_sketch_t sketch;
+    memcpy(sketch.hashes, hashes, sizeof sketch.hashes);
 
-        do
+    fdb_transaction_t transaction = { 0 };
+    do
+    {
+        if (fdb_transaction_start(pengine->db, &transaction))
         {
-            agent = fsync_agent_get(pengine, src.agent_id);
-            if (!agent)
+            fdb_sketches_t sketches;
+            if (fdb_sketches_open(&transaction, &sketches))
             {
-                ret = FFAIL;
-                err_msg = "Synchronization request was performed to unknown agent";
-                FS_ERR(err_msg);
-                break;
+                if (fdb_sketch_put(&sketches, &transaction, path, &sketch))
+                    fdb_transaction_commit(&transaction);
+                fdb_sketches_close(&sketches);
             }
+            fdb_transaction_abort(&transaction);
+        }
+    }
+    while (transaction.error == FERR_AGAIN);
+}
 
-            // I. synchronization request
-            FMSG(sync_request, req, pengine->uuid, src.dst,
-                 src.agent_id,
-                 src.sync_id,
-                 src.metainf ? binn_size(src.metainf) : 0
-            );
-            if (src.metainf)
-                memcpy(req.metainf, binn_ptr(src.metainf), req.metainf_size);
+// The most similar local file
+static bool fsync_sketch_find(fsync_engine_t *pengine, uint64_t const *hashes, char *path, size_t size)
+{
+    bool ret = false;
 
-            ret = fmsgbus_publish(pengine->msgbus, FSYNC_REQUEST, (fmsg_t const *)&req);
-            if (ret != FSUCCESS)
-            {
-                err_msg = "Synchronization request publishing was failed";
-                FS_ERR(err_msg);
-                if (agent->failed)
-                    agent->failed(agent, src.metainf, ret, err_msg);
-                break;
-            }
+    fdb_sketch_t sketch;
+    memcpy(sketch.hashes, hashes, sizeof sketch.hashes);
 
-            // II. Wait signature istream
-            while (sem_wait(&thread->sync.sem) == -1 && errno == EINTR)
-                continue;       // Restart if interrupted by handler
+    if (sketch.hashes[0] == UINT64_MAX)
+        return false;
 
-            FSYNC_CHECK_CANCEL_SATATE();
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(pengine->db, &transaction))
+    {
+        fdb_sketches_t sketches;
+        if (fdb_sketches_open(&transaction, &sketches))
+        {
+            uint32_t similarity = 0;
+            ret = fdb_sketch_find(&sketches, &transaction, &sketch, path, size, &similarity)
+                    && similarity >= FSYNC_SKETCH_SIMILARITY;
+            fdb_sketches_close(&sketches);
+        }
+        fdb_transaction_abort(&transaction);
+    }
 
-            // III. Load signature
-            psig = frsync_signature_create();
-            if (!psig)
-            {
-                ret = FFAIL;
-                err_msg = "Signature creation was failed";
-                FS_ERR(err_msg);
-                break;
-            }
+    return ret;
+}
 
-            FSYNC_CHECK_CANCEL_SATATE();
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// fsync_agent
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-            ret = frsync_signature_load(psig, thread->signature_istream);
-            if (ret != FSUCCESS)
-            {
-                err_msg = "Signature receiving was failed";
-                FS_ERR(err_msg);
-                break;
-            }
+static int fsync_agent_cmp(fsync_agent_t const **lhs, fsync_agent_t const **rhs)
+{
+    return (int)(*lhs)->id - (*rhs)->id;
+}
 
-            FSYNC_CHECK_CANCEL_SATATE();
+static ferr_t fsync_agent_add(fsync_engine_t *pengine, fsync_agent_t *agent)
+{
+    ferr_t ret = FSUCCESS;
 
-            char str[2 * sizeof(fuuid_t) + 1] = { 0 };
-            FS_INFO("Signature received: %s", fuuid2str(&pengine->uuid, str, sizeof str));
+    agent->retain(agent);
 
-            // IV. Request ostream for data signature
-            binn *obj = fsync_delta_stream_metainf(src.sync_id);
-            if (!obj)
-            {
-                ret = FFAIL;
-                err_msg = "Remote stream request was failed. Binn isn't created.";
-                FS_ERR(err_msg);
-                break;
-            }
-            src.delta_ostream = frstream_factory_stream(pengine->stream_factory, &src.dst, obj);
-            binn_free(obj);
+    fpush_lock(pengine->agents_mutex);
+    if (fvector_push_back(&pengine->agents, &agent))
+        fvector_qsort(pengine->agents, (fvector_comparer_t)fsync_agent_cmp);
+    else
+    {
+        agent->release(agent);
+        FS_ERR("No memory for new agent");
+        ret = FERR_NO_MEM;
+    }
+    fpop_lock();
 
-            if (!src.delta_ostream)
-            {
-                ret = FFAIL;
-                err_msg = "Remote stream request was failed";
-                FS_ERR(err_msg);
-                break;
-            }
+    return ret;
+}
+
+static fsync_agent_t *fsync_agent_get(fsync_engine_t *pengine, uint32_t agent_id)
+{
+    fsync_agent_t *agent = 0;
+    fsync_agent_t const key = { agent_id };
+    fsync_agent_t const *pkey = &key;
+
+    fpush_lock(pengine->agents_mutex);
+    fsync_agent_t **pagent = (fsync_agent_t **)fvector_bsearch(pengine->agents, &pkey, (fvector_comparer_t)fsync_agent_cmp);
+    if (pagent)
+        agent = (*pagent)->retain(*pagent);
+    fpop_lock();
+
+    return agent;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// fsync_workers
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*
+ * src and dst have separate workers. The src step waits the signature only after dst started to send it
+ * and the dst step waits the delta only after src started to send it, so steps never wait the steps queued behind them.
+ */
+
+// The task is queued. Workers mutex should be locked.
+static bool fsync_workers_queue(fsync_workers_t *workers, fsync_task_t *task)
+{
+    if (!fvector_push_back(&workers->queue, &task))
+    {
+        FS_ERR("No memory for synchronization event");
+        return false;
+    }
+    task->is_queued = true;
+    sem_post(&workers->sem);
+    return true;
+}
+
+// New events of the task. Workers mutex should be locked.
+static void fsync_workers_signal(fsync_workers_t *workers, fsync_task_t *task)
+{
+    if (task->is_queued)
+        task->is_signaled = true;
+    else
+        fsync_workers_queue(workers, task);
+}
+
+/*
+ * Pending tasks are started in order of deadline. The deadline is the request time plus the delay which grows
+ * with the data size, so small data is synchronized first, but requests which come later than the delay don't overtake large data.
+ * Peers are served in turn, one peer with many requests doesn't delay the others.
+ */
+
+static time_t fsync_size_delay(uint64_t size)
+{
+    time_t delay = 0;
+    for(uint64_t blocks = size / FSYNC_BLOCK_SIZE; blocks; blocks >>= 1)
+        delay += FSYNC_SIZE_CLASS_DELAY;
+    return delay;
+}
+
+static bool fsync_task_is_before(fsync_task_t const *lhs, fsync_task_t const *rhs)
+{
+    if (lhs->deadline != rhs->deadline)
+        return lhs->deadline < rhs->deadline;
+    return (int32_t)(lhs->order - rhs->order) < 0;
+}
+
+static void fsync_tasks_sift_up(fsync_task_t **heap, size_t i)
+{
+    while (i > 0)
+    {
+        size_t const parent = (i - 1) / 2;
+        if (!fsync_task_is_before(heap[i], heap[parent]))
+            break;
+        fsync_task_t *tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+static void fsync_tasks_sift_down(fsync_task_t **heap, size_t size, size_t i)
+{
+    for(;;)
+    {
+        size_t first = i;
+        size_t const left = 2 * i + 1;
+        size_t const right = left + 1;
+        if (left < size && fsync_task_is_before(heap[left], heap[first]))
+            first = left;
+        if (right < size && fsync_task_is_before(heap[right], heap[first]))
+            first = right;
+        if (first == i)
+            break;
+        fsync_task_t *tmp = heap[i];
+        heap[i] = heap[first];
+        heap[first] = tmp;
+        i = first;
+    }
+}
+
+static bool fsync_tasks_push(fvector_t **tasks, fsync_task_t *task)
+{
+    if (!fvector_push_back(tasks, &task))
+        return false;
+    fsync_tasks_sift_up((fsync_task_t **)fvector_ptr(*tasks), fvector_size(*tasks) - 1);
+    return true;
+}
 
-            FSYNC_CHECK_CANCEL_SATATE();
+// The task is removed from any place of the heap
+static void fsync_tasks_erase(fvector_t **tasks, size_t idx)
+{
+    fsync_task_t **heap = (fsync_task_t **)fvector_ptr(*tasks);
+    size_t const size = fvector_size(*tasks) - 1;
 
-            // V. Calculate delta
-            pdelta_calc = frsync_delta_calculator_create(psig);
-            if (!pdelta_calc)
+    heap[idx] = heap[size];
+    fvector_pop_back(tasks);
+    heap = (fsync_task_t **)fvector_ptr(*tasks);    // memory may be reallocated
+
+    if (idx < size)
+    {
+        fsync_tasks_sift_up(heap, idx);
+        fsync_tasks_sift_down(heap, size, idx);
+    }
+}
+
+static int fsync_peer_tasks_cmp(fsync_peer_tasks_t const *lhs, fsync_peer_tasks_t const *rhs)
+{
+    return memcmp(&lhs->peer, &rhs->peer, sizeof lhs->peer);
+}
+
+static bool fsync_workers_push(fsync_workers_t *workers, fsync_task_t *task, fuuid_t const *peer, uint64_t size)
+{
+    bool is_added = false;
+
+    task->peer = *peer;
+    task->deadline = time(0) + fsync_size_delay(size);
+
+    fpush_lock(workers->mutex);
+
+    do
+    {
+        fsync_peer_tasks_t const key = { *peer };
+        fsync_peer_tasks_t *peer_tasks = (fsync_peer_tasks_t *)fvector_bsearch(workers->peers, &key, (fvector_comparer_t)fsync_peer_tasks_cmp);
+
+        if (!peer_tasks)
+        {
+            fsync_peer_tasks_t const new_peer_tasks = { *peer, fvector(sizeof(fsync_task_t *), 0, 0) };
+            if (!new_peer_tasks.tasks
+                || !fvector_push_back(&workers->peers, &new_peer_tasks))
             {
-                ret = FFAIL;
-                err_msg = "Delta calculation was failed";
-                FS_ERR(err_msg);
+                if (new_peer_tasks.tasks)
+                    fvector_release(new_peer_tasks.tasks);
+                FS_ERR("No memory for new synchronization");
                 break;
             }
+            fvector_qsort(workers->peers, (fvector_comparer_t)fsync_peer_tasks_cmp);
+            peer_tasks = (fsync_peer_tasks_t *)fvector_bsearch(workers->peers, &key, (fvector_comparer_t)fsync_peer_tasks_cmp);
+        }
+
+        task->order = workers->order++;
 
-            ret = frsync_delta_calculate(pdelta_calc,
-                                         src.pistream,
-                                         src.delta_ostream);
-            if (ret != FSUCCESS)
+        if (!fsync_tasks_push(&peer_tasks->tasks, task))
+        {
+            // Peers without tasks aren't kept
+            if (!fvector_size(peer_tasks->tasks))
             {
-                err_msg = "Delta calculation was failed";
-                FS_ERR(err_msg);
-                break;
+                fvector_release(peer_tasks->tasks);
+                fvector_erase(&workers->peers, fvector_idx(workers->peers, peer_tasks));
             }
+            FS_ERR("No memory for new synchronization");
+            break;
+        }
 
-            src.delta_ostream->release(src.delta_ostream);
-            src.delta_ostream = 0;
+        workers->pending_num++;
+        is_added = true;
+    }
+    while(0);
 
-            FSYNC_CHECK_CANCEL_SATATE();
+    fpop_lock();
 
-            // VI. Wait completion
-            while (sem_wait(&thread->sync.sem) == -1 && errno == EINTR)
-                continue;       // Restart if interrupted by handler
+    if (is_added)
+        sem_post(&workers->sem);
 
-            char src_str[2 * sizeof(fuuid_t) + 1] = { 0 };
-            char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
-            if (thread->err == FSUCCESS)
-            {
-                if (agent->complete)
-                    agent->complete(agent, src.metainf);
-                FS_INFO("Synchronization was successfully completed: src=%s, dst=%s",
-                        fuuid2str(&pengine->uuid, src_str, sizeof src_str),
-                        fuuid2str(&src.dst, dst_str, sizeof dst_str));
-            }
-            else
+    return is_added;
+}
+
+// The pending task is removed. Peers without tasks aren't kept. Workers mutex should be locked.
+static void fsync_workers_erase_pending(fsync_workers_t *workers, size_t peer_idx, size_t task_idx)
+{
+    fsync_peer_tasks_t *peer_tasks = (fsync_peer_tasks_t *)fvector_at(workers->peers, peer_idx);
+
+    fsync_tasks_erase(&peer_tasks->tasks, task_idx);
+    workers->pending_num--;
+
+    if (!fvector_size(peer_tasks->tasks))
+    {
+        fvector_release(peer_tasks->tasks);
+        fvector_erase(&workers->peers, peer_idx);
+    }
+}
+
+// Peer whose pending task is started next. Workers mutex should be locked.
+static size_t fsync_workers_next_peer(fsync_workers_t *workers)
+{
+    size_t const peers_num = fvector_size(workers->peers);
+
+    for(size_t i = 0; i < peers_num; ++i)
+    {
+        fsync_peer_tasks_t const *peer_tasks = (fsync_peer_tasks_t const *)fvector_at(workers->peers, i);
+        if (memcmp(&peer_tasks->peer, &workers->last_peer, sizeof workers->last_peer) > 0)
+            return i;
+    }
+
+    return 0;
+}
+
+// Next task with events or the pending task which is started. Workers mutex should be locked.
+static fsync_task_t *fsync_workers_next(fsync_workers_t *workers)
+{
+    fsync_task_t *task = 0;
+
+    if (fvector_size(workers->queue))
+    {
+        task = *(fsync_task_t **)fvector_at(workers->queue, 0);
+        fvector_erase(&workers->queue, 0);
+    }
+    else if (workers->pending_num
+             && fvector_size(workers->active) < FSYNC_ACTIVE_MAX)
+    {
+        size_t const idx = fsync_workers_next_peer(workers);
+        fsync_peer_tasks_t *peer_tasks = (fsync_peer_tasks_t *)fvector_at(workers->peers, idx);
+        fsync_task_t *pending = *(fsync_task_t **)fvector_at(peer_tasks->tasks, 0);
+
+        if (fvector_push_back(&workers->active, &pending))
+        {
+            workers->last_peer = peer_tasks->peer;
+            fsync_workers_erase_pending(workers, idx, 0);
+            pending->is_queued = true;
+            task = pending;
+        }
+        else
+            FS_ERR("No memory for new synchronization");
+    }
+
+    return task;
+}
+
+// The step is performed. Finished task is removed, the task with new events is queued again. Workers mutex should be locked.
+static void fsync_workers_done(fsync_workers_t *workers, fsync_task_t *task, bool is_finished)
+{
+    if (is_finished)
+    {
+        for(size_t i = 0; i < fvector_size(workers->active); ++i)
+        {
+            if (*(fsync_task_t **)fvector_at(workers->active, i) == task)
             {
-                if (agent->failed)
-                    agent->failed(agent, src.metainf, thread->err, "Synchronization failed");
-                FS_INFO("Synchronization failed: src=%s, dst=%s",
-                        fuuid2str(&pengine->uuid, src_str, sizeof src_str),
-                        fuuid2str(&src.dst, dst_str, sizeof dst_str));
+                fvector_erase(&workers->active, i);
+                break;
             }
         }
-        while(0);
 
-        if(psig)
-            frsync_signature_release(psig);
-        if (pdelta_calc)
-            frsync_delta_calculator_release(pdelta_calc);
-        if (thread->signature_istream)
+        // Place for the pending task
+        if (workers->pending_num)
+            sem_post(&workers->sem);
+    }
+    else if (task->is_signaled)
+    {
+        task->is_signaled = false;
+        if (!fsync_workers_queue(workers, task))
+            task->is_queued = false;
+    }
+    else
+        task->is_queued = false;
+}
+
+static void *fsync_workers_thread(void *param)
+{
+    fsync_workers_t *workers = (fsync_workers_t *)param;
+
+    while(workers->is_active)
+    {
+        while (sem_wait(&workers->sem) == -1 && errno == EINTR)
+            continue;       // Restart if interrupted by handler
+        if (!workers->is_active)
+            break;
+
+        fsync_task_t *task = 0;
+
+        fpush_lock(workers->mutex);
+        task = fsync_workers_next(workers);
+        fpop_lock();
+
+        if (!task)
+            continue;
+
+        bool const is_finished = workers->step(workers->pengine, task);
+
+        fpush_lock(workers->mutex);
+        fsync_workers_done(workers, task, is_finished);
+        fpop_lock();
+
+        if (is_finished)
+            workers->free(task);
+    }
+
+    return 0;
+}
+
+static bool fsync_workers_create(fsync_engine_t *pengine, fsync_workers_t *workers, fsync_step_fn_t step, fsync_task_free_fn_t free_fn)
+{
+    static const pthread_mutex_t mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
+
+    if (sem_init(&workers->sem, 0, 0) == -1)
+    {
+        FS_ERR("The semaphore initialization is failed");
+        return false;
+    }
+
+    workers->pengine = pengine;
+    workers->step = step;
+    workers->free = free_fn;
+    workers->mutex = mutex_initializer;
+
+    workers->peers = fvector(sizeof(fsync_peer_tasks_t), 0, 0);
+    workers->active = fvector(sizeof(fsync_task_t *), 0, 0);
+    workers->queue = fvector(sizeof(fsync_task_t *), 0, 0);
+    if (!workers->peers || !workers->active || !workers->queue)
+    {
+        FS_ERR("Synchronizations vector wasn't created");
+        return false;
+    }
+
+    workers->is_active = true;
+
+    for(; workers->threads_num < FARRAY_SIZE(workers->threads); ++workers->threads_num)
+    {
+        int rc = pthread_create(workers->threads + workers->threads_num, 0, fsync_workers_thread, workers);
+        if (rc)
         {
-            thread->signature_istream->release(thread->signature_istream);
-            thread->signature_istream = 0;
+            FS_ERR("Unable to create the thread. Error: %d", rc);
+            return false;
         }
-        thread->sync_id = 0;
-        thread->sync.is_busy = false;
-        thread->err = FSUCCESS;
+    }
 
-        if (ret != FSUCCESS && agent->failed)
-            agent->failed(agent, src.metainf, ret, err_msg);
+    return true;
+}
 
-        if (agent) agent->release(agent);
-        fsync_src_free(&src);
+// Workers are stopped before the messages handlers are unsubscribed. Steps in progress are finished.
+static void fsync_workers_stop(fsync_workers_t *workers)
+{
+    workers->is_active = false;
 
-        if (ret != FSUCCESS)
+    for(uint32_t i = 0; i < workers->threads_num; ++i)
+        sem_post(&workers->sem);
+
+    for(uint32_t i = 0; i < workers->threads_num; ++i)
+        pthread_join(workers->threads[i], 0);
+
+    workers->threads_num = 0;
+}
+
+static void fsync_workers_free(fsync_workers_t *workers)
+{
+    if (workers->peers)
+    {
+        for(size_t i = 0; i < fvector_size(workers->peers); ++i)
         {
-            FMSG(sync_cancel, err, pengine->uuid, src.dst,
-                src.sync_id,
-                ret
-            );
-            strncpy(err.msg, err_msg, sizeof err.msg);
-            if (fmsgbus_publish(pengine->msgbus, FSYNC_CANCEL, (fmsg_t const *)&err) != FSUCCESS)
-                FS_ERR("Synchronization error wasn't published");
+            fsync_peer_tasks_t *peer_tasks = (fsync_peer_tasks_t *)fvector_at(workers->peers, i);
+            for(size_t j = 0; j < fvector_size(peer_tasks->tasks); ++j)
+                workers->free(*(fsync_task_t **)fvector_at(peer_tasks->tasks, j));
+            fvector_release(peer_tasks->tasks);
         }
+        fvector_release(workers->peers);
+    }
+
+    if (workers->active)
+    {
+        for(size_t i = 0; i < fvector_size(workers->active); ++i)
+            workers->free(*(fsync_task_t **)fvector_at(workers->active, i));
+        fvector_release(workers->active);
+    }
+
+    if (workers->queue)
+        fvector_release(workers->queue);
+
+    // The semaphore is initialized with the workers
+    if (workers->step)
+        sem_destroy(&workers->sem);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// fsync_src
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static void fsync_src_free(fsync_task_t *task)
+{
+    fsync_src_t *src = (fsync_src_t *)task;
+    if (src->pistream)
+        src->pistream->release(src->pistream);
+    if (src->delta_ostream)
+        src->delta_ostream->release(src->delta_ostream);
+    if (src->signature_istream)
+        src->signature_istream->release(src->signature_istream);
+    if (src->events.signature_istream)
+        src->events.signature_istream->release(src->events.signature_istream);
+    if (src->psig)
+        frsync_signature_release(src->psig);
+    if (src->sig_istream)
+    {
+        free(src->sig_istream->copy.data);
+        free(src->sig_istream);
+    }
+    if (src->agent)
+        src->agent->release(src->agent);
+    binn_free(src->metainf);
+    free(src);
+}
+
+// Synchronization in progress. Workers mutex should be locked.
+static fsync_src_t *fsync_src_find(fsync_workers_t *workers, uint32_t sync_id)
+{
+    for(size_t i = 0; i < fvector_size(workers->active); ++i)
+    {
+        fsync_src_t *src = *(fsync_src_t **)fvector_at(workers->active, i);
+        if (src->sync_id == sync_id)
+            return src;
     }
     return 0;
 }
 
-static bool fsync_src_set_signature_istream(fsync_src_threads_t *src_threads, uint32_t sync_id, fistream_t *signature_istream)
+// Synchronization which isn't started. Workers mutex should be locked.
+static fsync_src_t *fsync_src_find_pending(fsync_workers_t *workers, uint32_t sync_id, size_t *peer_idx, size_t *task_idx)
 {
-    for(uint32_t i = 0; i < FARRAY_SIZE(src_threads->threads); ++i)
+    for(size_t i = 0; i < fvector_size(workers->peers); ++i)
     {
-        fsync_src_thread_t *src_thread = src_threads->threads + i;
-        if (src_thread->sync_id == sync_id)
+        fsync_peer_tasks_t const *peer_tasks = (fsync_peer_tasks_t const *)fvector_at(workers->peers, i);
+        for(size_t j = 0; j < fvector_size(peer_tasks->tasks); ++j)
         {
-            if (src_thread->signature_istream)
+            fsync_src_t *src = *(fsync_src_t **)fvector_at(peer_tasks->tasks, j);
+            if (src->sync_id == sync_id)
             {
-                FS_ERR("Signature istream is already exist");
-                return false;
+                *peer_idx = i;
+                *task_idx = j;
+                return src;
             }
-            src_thread->signature_istream = signature_istream->retain(signature_istream);
-            sem_post(&src_thread->sync.sem);
-            return true;
         }
     }
-    return false;
+    return 0;
+}
+
+static fsync_step_t fsync_src_fail(fsync_src_t *src, ferr_t err, char const *err_msg)
+{
+    FS_ERR(err_msg);
+    src->err = err;
+    src->err_msg = err_msg;
+    return FSYNC_STEP_DONE;
 }
 
-static void fsync_src_cancel(fsync_src_threads_t *src_threads, uint32_t sync_id, ferr_t err)
+// I. synchronization request. Signature parameters are chosen by the data size.
+//    The data digest lets dst skip the synchronization of equal data.
+static fsync_step_t fsync_src_request(fsync_engine_t *pengine, fsync_src_t *src)
 {
-    for(uint32_t i = 0; i < FARRAY_SIZE(src_threads->threads); ++i)
+    src->agent = fsync_agent_get(pengine, src->agent_id);
+    if (!src->agent)
+        return fsync_src_fail(src, FFAIL, "Synchronization request was performed to unknown agent");
+
+    fsync_agent_t *agent = src->agent;
+
+    src->has_key = agent->signature_key
+                    && agent->signature_key(agent, src->metainf, &src->key);
+    if (!src->size && src->has_key)
+        src->size = src->key.size;
+
+    uint32_t block_len = 0, strong_len = 0;
+    if (src->size)
+        frsync_signature_args(src->size, &block_len, &strong_len);
+
+    FMSG(sync_request, req, pengine->uuid, src->dst,
+         src->agent_id,
+         src->sync_id,
+         block_len,
+         strong_len,
+         src->size
+    );
+    if (src->has_key)
+        req.digest = src->key.digest;
+
+    // The signature of dst data which was received earlier is offered. dst confirms it if its data isn't changed.
+    if (pengine->db && src->has_key)
     {
-        fsync_src_thread_t *src_thread = src_threads->threads + i;
-        if (src_thread->sync_id == sync_id)
+        strncpy(src->remote_key.path, src->key.path, sizeof src->remote_key.path);
+        if (fsync_remote_signature_digest(pengine, &src->dst, &src->remote_key))
+            req.base_digest = src->remote_key.digest;
+    }
+    req.metainf_size = src->metainf ? binn_size(src->metainf) : 0;
+    if (src->metainf)
+        memcpy(req.metainf, binn_ptr(src->metainf), req.metainf_size);
+
+    ferr_t ret = fmsgbus_publish(pengine->msgbus, FSYNC_REQUEST, (fmsg_t const *)&req);
+    if (ret != FSUCCESS)
+        return fsync_src_fail(src, ret, "Synchronization request publishing was failed");
+
+    src->state = FSYNC_SRC_NEGOTIATION;
+    return FSYNC_STEP_WAIT;
+}
+
+// dst has no local data and looks for a similar file. The empty sketch is sent if the data isn't readable.
+static fsync_step_t fsync_src_sketch(fsync_engine_t *pengine, fsync_src_t *src)
+{
+    FMSG(sync_sketch, sketch, pengine->uuid, src->dst,
+         src->sync_id
+    );
+
+    fcdc_sketch_t data_sketch;
+    if (fcdc_sketch_calculate(src->pistream, &data_sketch))
+    {
+        memcpy(sketch.hashes, data_sketch.hashes, sizeof sketch.hashes);
+        if (pengine->db && src->has_key)
+            fsync_sketch_put(pengine, src->key.path, data_sketch.hashes);
+    }
+    else
+        memset(sketch.hashes, 0xFF, sizeof sketch.hashes);
+
+    if (!src->pistream->seek(src->pistream, 0)
+        || fmsgbus_publish(pengine->msgbus, FSYNC_SKETCH, (fmsg_t const *)&sketch) != FSUCCESS)
+        return fsync_src_fail(src, FFAIL, "Negotiation with destination was failed");
+
+    return FSYNC_STEP_WAIT;
+}
+
+// III. Request ostream for delta. The round trip is overlapped with the signature transfer.
+static bool fsync_src_delta_ostream(fsync_engine_t *pengine, fsync_src_t *src)
+{
+    binn *obj = fsync_delta_stream_metainf(src->sync_id);
+    if (!obj)
+    {
+        FS_ERR("Remote stream request was failed. Binn isn't created.");
+        return false;
+    }
+    src->delta_ostream = frstream_factory_stream(pengine->stream_factory, &src->dst, obj);
+    binn_free(obj);
+
+    if (!src->delta_ostream)
+    {
+        FS_ERR("Remote stream request was failed");
+        return false;
+    }
+
+    return true;
+}
+
+// IV. Data (or its tail) is sent without signature
+static fsync_step_t fsync_src_literal_delta(fsync_engine_t *pengine, fsync_src_t *src)
+{
+    if (!fsync_src_delta_ostream(pengine, src))
+        return fsync_src_fail(src, FFAIL, "Remote stream request was failed");
+
+    if (frsync_delta_literal(src->pistream, src->delta_ostream) != FSUCCESS)
+        return fsync_src_fail(src, FFAIL, "Data sending was failed");
+
+    src->delta_ostream->release(src->delta_ostream);
+    src->delta_ostream = 0;
+
+    src->state = FSYNC_SRC_COMPLETION;
+    return FSYNC_STEP_WAIT;
+}
+
+// V. Calculate delta by the loaded signature
+static fsync_step_t fsync_src_delta(fsync_engine_t *pengine, fsync_src_t *src)
+{
+    char str[2 * sizeof(fuuid_t) + 1] = { 0 };
+    FS_INFO("Signature received: %s", fuuid2str(&pengine->uuid, str, sizeof str));
+
+    frsync_delta_calculator_t *pdelta_calc = frsync_delta_calculator_create(src->psig);
+    frsync_signature_release(src->psig);
+    src->psig = 0;
+    if (!pdelta_calc)
+        return fsync_src_fail(src, FFAIL, "Delta calculation was failed");
+
+    ferr_t const ret = frsync_delta_calculate(pdelta_calc,
+                                              src->pistream,
+                                              src->delta_ostream);
+    frsync_delta_calculator_release(pdelta_calc);
+    if (ret != FSUCCESS)
+        return fsync_src_fail(src, ret, "Delta calculation was failed");
+
+    src->delta_ostream->release(src->delta_ostream);
+    src->delta_ostream = 0;
+
+    src->state = FSYNC_SRC_COMPLETION;
+    return FSYNC_STEP_WAIT;
+}
+
+// IV. dst data wasn't changed. The signature which was received earlier is loaded from the cache.
+static fsync_step_t fsync_src_cached_signature(fsync_engine_t *pengine, fsync_src_t *src)
+{
+    if (!fsync_src_delta_ostream(pengine, src))
+        return fsync_src_fail(src, FFAIL, "Remote stream request was failed");
+
+    src->psig = frsync_signature_create();
+    if (!src->psig)
+        return fsync_src_fail(src, FFAIL, "Signature creation was failed");
+
+    fistream_t *pcached_istream = fsync_remote_signature_istream(pengine, &src->dst, &src->remote_key);
+    if (!pcached_istream)
+        return fsync_src_fail(src, FFAIL, "Cached signature wasn't found");
+
+    ferr_t const ret = frsync_signature_load(src->psig, pcached_istream);
+    pcached_istream->release(pcached_istream);
+    if (ret != FSUCCESS)
+        return fsync_src_fail(src, FFAIL, "Signature receiving was failed");
+
+    return fsync_src_delta(pengine, src);
+}
+
+// IV. Signature of dst data is received. It is cached if dst reports the digest of its data.
+static fsync_step_t fsync_src_signature_receive(fsync_engine_t *pengine, fsync_src_t *src)
+{
+    if (!fsync_src_delta_ostream(pengine, src))
+        return fsync_src_fail(src, FFAIL, "Remote stream request was failed");
+
+    src->psig = frsync_signature_create();
+    if (!src->psig)
+        return fsync_src_fail(src, FFAIL, "Signature creation was failed");
+
+    static fmd5_t const zero_digest = { { 0 } };
+    if (pengine->db && src->has_key
+        && memcmp(&src->signature_digest, &zero_digest, sizeof zero_digest) != 0)
+    {
+        src->sig_istream = malloc(sizeof *src->sig_istream);
+        if (!src->sig_istream)
+            return fsync_src_fail(src, FERR_NO_MEM, "Unable to allocate memory for signature istream");
+        fsync_signature_istream_init(src->sig_istream, src->signature_istream);
+    }
+
+    src->state = FSYNC_SRC_SIGNATURE;
+    return FSYNC_STEP_NEXT;
+}
+
+// IV. The received part of signature is loaded. The rest of signature is waited.
+static fsync_step_t fsync_src_signature(fsync_engine_t *pengine, fsync_src_t *src)
+{
+    fsync_signature_istream_t *sig_istream = src->sig_istream;
+
+    ferr_t const ret = frsync_signature_load(src->psig, sig_istream ? &sig_istream->istream : src->signature_istream);
+    if (ret == FERR_AGAIN)
+        return FSYNC_STEP_WAIT;
+    if (ret != FSUCCESS)
+        return fsync_src_fail(src, ret, "Signature receiving was failed");
+
+    if (sig_istream)
+    {
+        if (!sig_istream->copy.is_overflow)
         {
-            src_thread->err = err;
-            src_thread->sync.is_busy = false;
-            sem_post(&src_thread->sync.sem);
-            break;
+            strncpy(src->remote_key.path, src->key.path, sizeof src->remote_key.path);
+            src->remote_key.digest = src->signature_digest;
+            fsync_remote_signature_put(pengine, &src->dst, &src->remote_key, sig_istream->copy.data, sig_istream->copy.size);
         }
+        free(sig_istream->copy.data);
+        free(sig_istream);
+        src->sig_istream = 0;
+    }
+
+    return fsync_src_delta(pengine, src);
+}
+
+// II. Wait signature istream or the negotiation result
+static fsync_step_t fsync_src_negotiation(fsync_engine_t *pengine, fsync_src_t *src, fsync_src_events_t const *events)
+{
+    if (events->is_sketch_requested)
+        return fsync_src_sketch(pengine, src);
+
+    bool is_append = false;
+
+    if (events->is_append)
+    {
+        // Only the tail is sent if dst has the prefix of data
+        fmd5_t digest;
+        is_append = (!src->size || events->append_offset < src->size)
+                    && fsync_prefix_digest(src->pistream, events->append_offset, &digest)
+                    && memcmp(&digest, &events->append_digest, sizeof digest) == 0;
+
+        if (!is_append)
+        {
+            // The prefix check moves the istream
+            FMSG(sync_append_reject, reject, pengine->uuid, src->dst,
+                 src->sync_id
+            );
+
+            if (!src->pistream->seek(src->pistream, 0)
+                || fmsgbus_publish(pengine->msgbus, FSYNC_APPEND_REJECT, (fmsg_t const *)&reject) != FSUCCESS)
+                return fsync_src_fail(src, FFAIL, "Negotiation with destination was failed");
+
+            return FSYNC_STEP_WAIT;
+        }
+    }
+
+    if (events->is_completed)
+    {
+        if (src->agent->complete)
+            src->agent->complete(src->agent, src->metainf);
+        char str[2 * sizeof(fuuid_t) + 1] = { 0 };
+        FS_INFO("Data is up to date: %s", fuuid2str(&src->dst, str, sizeof str));
+        return FSYNC_STEP_DONE;
+    }
+
+    if (is_append || events->is_literal)
+        return fsync_src_literal_delta(pengine, src);
+
+    if (events->is_signature_valid)
+        return fsync_src_cached_signature(pengine, src);
+
+    if (src->signature_istream)
+        return fsync_src_signature_receive(pengine, src);
+
+    return FSYNC_STEP_WAIT;
+}
+
+// VI. Wait completion
+static fsync_step_t fsync_src_completion(fsync_engine_t *pengine, fsync_src_t *src, fsync_src_events_t const *events)
+{
+    if (!events->is_completed && !events->is_canceled)
+        return FSYNC_STEP_WAIT;
+
+    char src_str[2 * sizeof(fuuid_t) + 1] = { 0 };
+    char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
+    if (!events->is_canceled)
+    {
+        if (src->agent->complete)
+            src->agent->complete(src->agent, src->metainf);
+        FS_INFO("Synchronization was successfully completed: src=%s, dst=%s",
+                fuuid2str(&pengine->uuid, src_str, sizeof src_str),
+                fuuid2str(&src->dst, dst_str, sizeof dst_str));
+    }
+    else
+    {
+        if (src->agent->failed)
+            src->agent->failed(src->agent, src->metainf, events->err, "Synchronization failed");
+        FS_INFO("Synchronization failed: src=%s, dst=%s",
+                fuuid2str(&pengine->uuid, src_str, sizeof src_str),
+                fuuid2str(&src->dst, dst_str, sizeof dst_str));
     }
+
+    return FSYNC_STEP_DONE;
 }
 
-static void fsync_src_ok(fsync_src_threads_t *src_threads, uint32_t sync_id)
+static void fsync_src_finish(fsync_engine_t *pengine, fsync_src_t *src)
 {
-    for(uint32_t i = 0; i < FARRAY_SIZE(src_threads->threads); ++i)
+    if (src->err == FSUCCESS)
+        return;
+
+    if (src->agent && src->agent->failed)
+        src->agent->failed(src->agent, src->metainf, src->err, src->err_msg);
+
+    FMSG(sync_cancel, err, pengine->uuid, src->dst,
+        src->sync_id,
+        src->err
+    );
+    strncpy(err.msg, src->err_msg, sizeof err.msg);
+    if (fmsgbus_publish(pengine->msgbus, FSYNC_CANCEL, (fmsg_t const *)&err) != FSUCCESS)
+        FS_ERR("Synchronization error wasn't published");
+}
+
+static bool fsync_src_step(fsync_engine_t *pengine, fsync_task_t *task)
+{
+    fsync_src_t        *src     = (fsync_src_t *)task;
+    fsync_workers_t    *workers = &pengine->src_workers;
+    fsync_src_events_t  events;
+
+    // The istream is taken under the lock because the istream listener looks for the synchronization by it
+    fpush_lock(workers->mutex);
+    events = src->events;
+    memset(&src->events, 0, sizeof src->events);
+    if (events.signature_istream)
+    {
+        src->signature_istream = events.signature_istream;
+        src->signature_digest = events.signature_digest;
+    }
+    fpop_lock();
+
+    fsync_step_t step = FSYNC_STEP_NEXT;
+
+    while (step == FSYNC_STEP_NEXT)
     {
-        fsync_src_thread_t *src_thread = src_threads->threads + i;
-        if (src_thread->sync_id == sync_id)
+        if (events.is_canceled && src->state != FSYNC_SRC_COMPLETION)
         {
-            src_thread->err = FSUCCESS;
-            sem_post(&src_thread->sync.sem);
+            step = fsync_src_fail(src, events.err, "Synchronization was canceled");
             break;
         }
+
+        switch(src->state)
+        {
+            case FSYNC_SRC_REQUEST:     step = fsync_src_request(pengine, src);                 break;
+            case FSYNC_SRC_NEGOTIATION: step = fsync_src_negotiation(pengine, src, &events);    break;
+            case FSYNC_SRC_SIGNATURE:   step = fsync_src_signature(pengine, src);               break;
+            case FSYNC_SRC_COMPLETION:  step = fsync_src_completion(pengine, src, &events);     break;
+        }
+    }
+
+    if (step != FSYNC_STEP_DONE)
+        return false;
+
+    fsync_src_finish(pengine, src);
+    return true;
+}
+
+static bool fsync_src_set_signature_istream(fsync_workers_t *workers, uint32_t sync_id, fistream_t *signature_istream, fmd5_t const *digest)
+{
+    bool ret = false;
+
+    fpush_lock(workers->mutex);
+    fsync_src_t *src = fsync_src_find(workers, sync_id);
+    if (src)
+    {
+        if (src->signature_istream || src->events.signature_istream)
+            FS_ERR("Signature istream is already exist");
+        else
+        {
+            src->events.signature_istream = signature_istream->retain(signature_istream);
+            src->events.signature_digest = *digest;
+            fsync_workers_signal(workers, &src->task);
+            ret = true;
+        }
+    }
+    fpop_lock();
+
+    return ret;
+}
+
+// The synchronization which isn't started is removed, its steps aren't performed
+static void fsync_src_cancel(fsync_workers_t *workers, uint32_t sync_id, ferr_t err)
+{
+    fsync_src_t *pending = 0;
+    size_t peer_idx = 0, task_idx = 0;
+
+    fpush_lock(workers->mutex);
+    fsync_src_t *src = fsync_src_find(workers, sync_id);
+    if (src)
+    {
+        src->events.err = err;
+        src->events.is_canceled = true;
+        fsync_workers_signal(workers, &src->task);
+    }
+    else
+    {
+        pending = fsync_src_find_pending(workers, sync_id, &peer_idx, &task_idx);
+        if (pending)
+            fsync_workers_erase_pending(workers, peer_idx, task_idx);
+    }
+    fpop_lock();
+
+    if (pending)
+    {
+        pending->agent = fsync_agent_get(workers->pengine, pending->agent_id);
+        if (pending->agent && pending->agent->failed)
+            pending->agent->failed(pending->agent, pending->metainf, err, "Synchronization was canceled");
+        workers->free(&pending->task);
     }
 }
 
+static void fsync_src_ok(fsync_workers_t *workers, uint32_t sync_id)
+{
+    fpush_lock(workers->mutex);
+    fsync_src_t *src = fsync_src_find(workers, sync_id);
+    if (src)
+    {
+        src->events.is_completed = true;
+        fsync_workers_signal(workers, &src->task);
+    }
+    fpop_lock();
+}
+
+static void fsync_src_literal(fsync_workers_t *workers, uint32_t sync_id)
+{
+    fpush_lock(workers->mutex);
+    fsync_src_t *src = fsync_src_find(workers, sync_id);
+    if (src)
+    {
+        src->events.is_literal = true;
+        fsync_workers_signal(workers, &src->task);
+    }
+    fpop_lock();
+}
+
+static void fsync_src_sketch_request(fsync_workers_t *workers, uint32_t sync_id)
+{
+    fpush_lock(workers->mutex);
+    fsync_src_t *src = fsync_src_find(workers, sync_id);
+    if (src)
+    {
+        src->events.is_sketch_requested = true;
+        fsync_workers_signal(workers, &src->task);
+    }
+    fpop_lock();
+}
+
+static void fsync_src_signature_valid(fsync_workers_t *workers, uint32_t sync_id)
+{
+    fpush_lock(workers->mutex);
+    fsync_src_t *src = fsync_src_find(workers, sync_id);
+    if (src)
+    {
+        src->events.is_signature_valid = true;
+        fsync_workers_signal(workers, &src->task);
+    }
+    fpop_lock();
+}
+
+static void fsync_src_append(fsync_workers_t *workers, uint32_t sync_id, uint64_t offset, fmd5_t const *digest)
+{
+    fpush_lock(workers->mutex);
+    fsync_src_t *src = fsync_src_find(workers, sync_id);
+    if (src)
+    {
+        src->events.append_offset = offset;
+        src->events.append_digest = *digest;
+        src->events.is_append = true;
+        fsync_workers_signal(workers, &src->task);
+    }
+    fpop_lock();
+}
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // fsync_dst
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-static bool fsync_dst_push_back(fsync_dst_threads_t *dst_threads, fsync_dst_t const *dst)
+static void fsync_dst_free(fsync_task_t *task)
 {
-    bool is_added = true;
+    fsync_dst_t *dst = (fsync_dst_t *)task;
+    if (dst->signature_ostream)
+        dst->signature_ostream->release(dst->signature_ostream);
+    if (dst->pistream)
+        dst->pistream->release(dst->pistream);
+    if (dst->postream)
+        dst->postream->release(dst->postream);
+    if (dst->delta_istream)
+        dst->delta_istream->release(dst->delta_istream);
+    if (dst->events.delta_istream)
+        dst->events.delta_istream->release(dst->events.delta_istream);
+    if (dst->pdelta)
+        frsync_delta_release(dst->pdelta);
+    free(dst->sketch_ostream);
+    if (dst->agent)
+        dst->agent->release(dst->agent);
+    binn_free(dst->metainf);
+    free(dst);
+}
 
-    fpush_lock(dst_threads->mutex);
-    if (!fvector_push_back(&dst_threads->dsts, dst))
+// Synchronization in progress. Workers mutex should be locked.
+static fsync_dst_t *fsync_dst_find(fsync_workers_t *workers, fuuid_t const *src, uint32_t sync_id)
+{
+    for(size_t i = 0; i < fvector_size(workers->active); ++i)
     {
-        FS_ERR("No memory for new synchronization stream");
-        is_added = false;
+        fsync_dst_t *dst = *(fsync_dst_t **)fvector_at(workers->active, i);
+        if (dst->sync_id == sync_id
+            && memcmp(&dst->src, src, sizeof *src) == 0)
+            return dst;
     }
-    fpop_lock();
+    return 0;
+}
 
-    if (is_added)
-        sem_post(&dst_threads->sem);
+// Synchronization which isn't started. Workers mutex should be locked.
+static fsync_dst_t *fsync_dst_find_pending(fsync_workers_t *workers, fuuid_t const *src, uint32_t sync_id, size_t *peer_idx, size_t *task_idx)
+{
+    fsync_peer_tasks_t const key = { *src };
+    fsync_peer_tasks_t const *peer_tasks = (fsync_peer_tasks_t const *)fvector_bsearch(workers->peers, &key, (fvector_comparer_t)fsync_peer_tasks_cmp);
+    if (!peer_tasks)
+        return 0;
 
-    return is_added;
+    for(size_t j = 0; j < fvector_size(peer_tasks->tasks); ++j)
+    {
+        fsync_dst_t *dst = *(fsync_dst_t **)fvector_at(peer_tasks->tasks, j);
+        if (dst->sync_id == sync_id)
+        {
+            *peer_idx = fvector_idx(workers->peers, peer_tasks);
+            *task_idx = j;
+            return dst;
+        }
+    }
+    return 0;
+}
+
+// Local data is equal to the source one
+static bool fsync_dst_is_equal(fsync_dst_t const *dst, fdb_signature_key_t const *key)
+{
+    static fmd5_t const zero_digest = { { 0 } };
+    return memcmp(&dst->digest, &zero_digest, sizeof zero_digest) != 0
+            && memcmp(&dst->digest, &key->digest, sizeof key->digest) == 0
+            && (!dst->size || dst->size == key->size);
 }
 
-static bool fsync_dst_pop_back(fsync_dst_threads_t *dst_threads, fsync_dst_t *dst)
-{
-    bool ret = false;
+// src has the signature of local data
+static bool fsync_dst_is_signature_known(fsync_dst_t const *dst, fdb_signature_key_t const *key)
+{
+    static fmd5_t const zero_digest = { { 0 } };
+    return memcmp(&dst->base_digest, &zero_digest, sizeof zero_digest) != 0
+            && memcmp(&dst->base_digest, &key->digest, sizeof key->digest) == 0;
+}
+
+// Signature isn't useful for empty, small or too different base
+static bool fsync_dst_is_literal(fsync_dst_t const *dst, fdb_signature_key_t const *key)
+{
+    if (!dst->pistream)
+        return true;
+
+    if (!dst->size)
+        return false;
+
+    if (dst->size <= FSYNC_LITERAL_SIZE_MAX)
+        return true;
+
+    size_t base_size = 0;
+    if (key)
+        base_size = key->size;
+    else if (!fistream_data(dst->pistream, &base_size, 0))
+        return false;
+
+    return base_size < dst->size / FSYNC_LITERAL_BASE_RATIO;
+}
+
+static fsync_step_t fsync_dst_fail(fsync_dst_t *dst, ferr_t err, char const *err_msg)
+{
+    FS_ERR(err_msg);
+    dst->err = err;
+    dst->err_msg = err_msg;
+    return FSYNC_STEP_DONE;
+}
+
+// I.  Negotiation. Equal data isn't synchronized.
+// II. Append. The local data is a prefix of the grown data, so only the tail is requested.
+static fsync_step_t fsync_dst_request(fsync_engine_t *pengine, fsync_dst_t *dst)
+{
+    dst->agent = fsync_agent_get(pengine, dst->agent_id);
+    if (!dst->agent)
+        return fsync_dst_fail(dst, FFAIL, "Synchronization request was performed to unknown agent");
+
+    fsync_agent_t *agent = dst->agent;
+    char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
+
+    dst->has_key = agent->signature_key
+                    && agent->signature_key(agent, dst->metainf, &dst->key);
+
+    if (dst->has_key && fsync_dst_is_equal(dst, &dst->key))
+    {
+        FMSG(sync_ok, ok, pengine->uuid, dst->src,
+            dst->sync_id
+        );
+        ferr_t const ret = fmsgbus_publish(pengine->msgbus, FSYNC_OK, (fmsg_t const *)&ok);
+        if (ret != FSUCCESS)
+            return fsync_dst_fail(dst, ret, "Synchronization completion event not published");
+
+        FS_INFO("Data is up to date: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
+        return FSYNC_STEP_DONE;
+    }
+
+    dst->state = FSYNC_DST_ACCEPT;
+
+    if (!dst->has_key
+        || !agent->append
+        || !dst->key.size
+        || dst->key.size >= dst->size)
+        return FSYNC_STEP_NEXT;
 
-    fpush_lock(dst_threads->mutex);
-    size_t vector_size = fvector_size(dst_threads->dsts);
-    if (vector_size)
+    fmd5_t prefix_digest;
+
+    if (agent->append(agent, dst->metainf, &dst->pistream, &dst->postream)
+        && dst->pistream
+        && dst->postream
+        && fsync_prefix_digest(dst->pistream, dst->key.size, &prefix_digest))
     {
-        fsync_dst_t *last = (fsync_dst_t *)fvector_at(dst_threads->dsts, vector_size - 1);
-        *dst = *last;
-        fvector_erase(&dst_threads->dsts, vector_size - 1);
-        ret = true;
-    }
-    fpop_lock();
+        FMSG(sync_append, append, pengine->uuid, dst->src,
+            dst->sync_id,
+            dst->key.size,
+            prefix_digest
+        );
+        ferr_t const ret = fmsgbus_publish(pengine->msgbus, FSYNC_APPEND, (fmsg_t const *)&append);
+        if (ret != FSUCCESS)
+            return fsync_dst_fail(dst, ret, "Append request not published");
 
-    return ret;
-}
+        // Wait the tail delta or the rejection
+        dst->state = FSYNC_DST_APPEND;
+        return FSYNC_STEP_WAIT;
+    }
 
-static void fsync_dst_free(fsync_dst_t *dst)
-{
-    if (dst->signature_ostream)
-        dst->signature_ostream->release(dst->signature_ostream);
     if (dst->pistream)
         dst->pistream->release(dst->pistream);
     if (dst->postream)
         dst->postream->release(dst->postream);
-    binn_free(dst->metainf);
+    dst->pistream = 0;
+    dst->postream = 0;
+
+    return FSYNC_STEP_NEXT;
 }
 
-static bool fsync_dst_remove_last(fsync_dst_threads_t *dst_threads)
+static fsync_step_t fsync_dst_append(fsync_engine_t *pengine, fsync_dst_t *dst, fsync_dst_events_t const *events)
 {
-    bool ret = false;
-
-    fpush_lock(dst_threads->mutex);
-    size_t vector_size = fvector_size(dst_threads->dsts);
-    if (vector_size)
+    if (dst->delta_istream)
     {
-        fsync_dst_t *pincoming_stream = (fsync_dst_t *)fvector_at(dst_threads->dsts, vector_size - 1);
-        fsync_dst_free(pincoming_stream);
-        fvector_erase(&dst_threads->dsts, vector_size - 1);
-        ret = true;
+        char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
+        FS_INFO("Append data tail: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
+        dst->is_append = true;
+        dst->state = FSYNC_DST_DELTA;
+        return FSYNC_STEP_NEXT;
     }
-    fpop_lock();
 
-    return ret;
-}
+    if (!events->is_append_rejected)
+        return FSYNC_STEP_WAIT;
 
-static void *fsync_dst_thread(void *);
+    dst->pistream->release(dst->pistream);
+    dst->postream->release(dst->postream);
+    dst->pistream = 0;
+    dst->postream = 0;
 
-static bool fsync_dst_create(fsync_engine_t *pengine, fsync_dst_threads_t *dst_threads)
+    dst->state = FSYNC_DST_ACCEPT;
+    return FSYNC_STEP_NEXT;
+}
+
+// III. Accept the sync request. The istream is absent if there is no local data.
+static fsync_step_t fsync_dst_accept(fsync_engine_t *pengine, fsync_dst_t *dst)
 {
-    static const pthread_mutex_t mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
+    fsync_agent_t *agent = dst->agent;
 
-    dst_threads->mutex = mutex_initializer;
+    if (!agent->accept(agent, dst->metainf, &dst->pistream, &dst->postream))
+        return fsync_dst_fail(dst, FFAIL, "Sync request wasn't accepted");
 
-    dst_threads->dsts = fvector(sizeof(fsync_dst_t), 0, 0);
-    if (!dst_threads->dsts)
-    {
-        FS_ERR("Streams vector wasn't created");
-        return false;
-    }
+    if (!dst->postream)
+        return fsync_dst_fail(dst, FFAIL, "Destination ostream is inaccessible");
 
-    if (sem_init(&dst_threads->sem, 0, 0) == -1)
-    {
-        FS_ERR("The semaphore initialization is failed");
-        return false;
-    }
+    dst->state = FSYNC_DST_BASE;
 
-    for(uint32_t i = 0; i < FARRAY_SIZE(dst_threads->threads); ++i)
-    {
-        fsync_dst_thread_t *sync_thread = dst_threads->threads + i;
-        sync_thread->sync.is_active = false;
-        sync_thread->sync.is_busy = false;
-        sync_thread->err = FSUCCESS;
+    // New data. The most similar local file is searched by the sketch of source data and it becomes the base.
+    if (dst->pistream
+        || dst->size <= FSYNC_LITERAL_SIZE_MAX
+        || !pengine->db
+        || !agent->open)
+        return FSYNC_STEP_NEXT;
 
-        if (sem_init(&sync_thread->sync.sem, 0, 0) == -1)
-        {
-            FS_ERR("The semaphore initialization is failed");
-            return false;
-        }
+    FMSG(sync_sketch_request, sketch_request, pengine->uuid, dst->src,
+        dst->sync_id
+    );
+    ferr_t const ret = fmsgbus_publish(pengine->msgbus, FSYNC_SKETCH_REQUEST, (fmsg_t const *)&sketch_request);
+    if (ret != FSUCCESS)
+        return fsync_dst_fail(dst, ret, "Sketch request not published");
 
-        fsync_thread_param_t thread_param = { pengine, i };
+    // Wait the sketch
+    dst->state = FSYNC_DST_SKETCH;
+    return FSYNC_STEP_WAIT;
+}
 
-        int rc = pthread_create(&sync_thread->sync.thread, 0, fsync_dst_thread, &thread_param);
-        if (rc)
-        {
-            FS_ERR("Unable to create the thread. Error: %d", rc);
-            return false;
-        }
+static fsync_step_t fsync_dst_sketch(fsync_engine_t *pengine, fsync_dst_t *dst, fsync_dst_events_t const *events)
+{
+    if (!events->is_sketch)
+        return FSYNC_STEP_WAIT;
 
-        static struct timespec const ts = { 0, 10000000 };
-        while(!sync_thread->sync.is_active)
-            nanosleep(&ts, NULL);
+    char path[FMAX_PATH];
+    if (fsync_sketch_find(pengine, events->sketch, path, sizeof path))
+    {
+        dst->pistream = dst->agent->open(dst->agent, path);
+        dst->is_similar = dst->pistream != 0;
     }
 
-    return true;
+    if (dst->is_similar)
+    {
+        char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
+        FS_INFO("Similar local data is the base: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
+    }
+
+    dst->state = FSYNC_DST_BASE;
+    return FSYNC_STEP_NEXT;
 }
 
-static void fsync_dst_threads_free(fsync_dst_threads_t *dst_threads)
+// IV. Signature calculation. Signature of unchanged file is taken from the cache.
+static ferr_t fsync_dst_signature(fsync_engine_t *pengine, fsync_dst_t *dst)
 {
-    for(uint32_t i = 0; i < FARRAY_SIZE(dst_threads->threads); ++i)
-        dst_threads->threads[i].sync.is_active = false;
+    char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
 
-    for(uint32_t i = 0; i < FARRAY_SIZE(dst_threads->threads); ++i)
+    frsync_signature_calculator_t *psig_calc = frsync_signature_calculator_create_ex(0, dst->block_len, dst->strong_len);
+    if (!psig_calc)
     {
-        sem_post(&dst_threads->sem);
-        sem_post(&dst_threads->threads[i].sync.sem);
+        FS_ERR("Signature calculator wasn't created");
+        return FFAIL;
     }
 
-    for(uint32_t i = 0; i < FARRAY_SIZE(dst_threads->threads); ++i)
+    ferr_t ret;
+
+    bool const is_cacheable = pengine->db && dst->has_key && !dst->is_similar;
+    dst->key.block_len = frsync_signature_calculator_block_len(psig_calc);
+    dst->key.strong_len = frsync_signature_calculator_strong_len(psig_calc);
+
+    char *cached_sig = 0;
+    size_t cached_sig_size = 0;
+
+    if (is_cacheable
+        && fsync_signature_cache_get(pengine, &dst->key, &cached_sig, &cached_sig_size))
     {
-        fsync_dst_thread_t *thread = dst_threads->threads + i;
-        pthread_join(thread->sync.thread, 0);
-        sem_destroy(&thread->sync.sem);
-        if (thread->delta_istream)
-            thread->delta_istream->release(thread->delta_istream);
-        thread->delta_istream = 0;
+        FS_INFO("Send cached signature: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
+        ret = fsync_ostream_write(dst->signature_ostream, cached_sig, cached_sig_size);
+        free(cached_sig);
     }
+    else
+    {
+        FS_INFO("Calculate signature: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
 
-    sem_destroy(&dst_threads->sem);
+        fsync_signature_ostream_t sig_ostream;
+        fsync_signature_ostream_init(&sig_ostream, dst->signature_ostream);
 
-    if (dst_threads->dsts)
-    {
-        while(fsync_dst_remove_last(dst_threads));
-        fvector_release(dst_threads->dsts);
+        ret = frsync_signature_calculate(psig_calc,
+                                         dst->pistream,
+                                         is_cacheable ? &sig_ostream.ostream : dst->signature_ostream);
+
+        if (ret == FSUCCESS && is_cacheable && !sig_ostream.copy.is_overflow)
+            fsync_signature_cache_put(pengine, &dst->key, sig_ostream.copy.data, sig_ostream.copy.size);
+
+        free(sig_ostream.copy.data);
     }
+
+    frsync_signature_calculator_release(psig_calc);
+
+    return ret;
 }
 
-static void *fsync_dst_thread(void *param)
+// IV. Data is requested without signature, by the signature known by src or by the new signature
+static fsync_step_t fsync_dst_base(fsync_engine_t *pengine, fsync_dst_t *dst)
 {
-    fsync_thread_param_t *thread_param = (fsync_thread_param_t *)param;
-    fsync_engine_t       *pengine      = thread_param->pengine;
-    uint32_t const        thread_id    = thread_param->thread_id;
-    fsync_dst_threads_t  *dst_threads  = &pengine->dst_threads;
-    fsync_dst_thread_t   *thread       = dst_threads->threads + thread_id;
+    char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
+    bool const is_key_valid = dst->has_key && dst->pistream && !dst->is_similar;
 
-    thread->sync.is_active = true;
+    dst->state = FSYNC_DST_DELTA;
 
-    while(thread->sync.is_active)
+    if (fsync_dst_is_literal(dst, is_key_valid ? &dst->key : 0))
     {
-        while (sem_wait(&dst_threads->sem) == -1 && errno == EINTR)
-            continue;       // Restart if interrupted by handler
-        if (!thread->sync.is_active)
-            break;
-
-        fsync_dst_t                    dst = { 0 };
-        fsync_agent_t                 *agent = 0;
-        frsync_signature_calculator_t *psig_calc = 0;
-        frsync_delta_t                *pdelta = 0;
+        FMSG(sync_literal, literal, pengine->uuid, dst->src,
+            dst->sync_id
+        );
+        ferr_t const ret = fmsgbus_publish(pengine->msgbus, FSYNC_LITERAL, (fmsg_t const *)&literal);
+        if (ret != FSUCCESS)
+            return fsync_dst_fail(dst, ret, "Literal data request not published");
 
-        if (!fsync_dst_pop_back(dst_threads, &dst))
-            continue;
+        FS_INFO("Request data without signature: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
+        return FSYNC_STEP_WAIT;
+    }
 
-        thread->sync_id = dst.sync_id;
-        thread->src = dst.src;
-        thread->sync.is_busy = true;
+    if (is_key_valid
+        && fsync_dst_is_signature_known(dst, &dst->key))
+    {
+        // src has the signature of local data. The signature isn't calculated and sent.
+        FMSG(sync_signature_valid, valid, pengine->uuid, dst->src,
+            dst->sync_id
+        );
+        ferr_t const ret = fmsgbus_publish(pengine->msgbus, FSYNC_SIGNATURE_VALID, (fmsg_t const *)&valid);
+        if (ret != FSUCCESS)
+            return fsync_dst_fail(dst, ret, "Signature confirmation not published");
 
-        ferr_t          ret     = FSUCCESS;
-        char const     *err_msg = "";
+        FS_INFO("Signature is known by source: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
+        return FSYNC_STEP_WAIT;
+    }
 
-        do
-        {
-            agent = fsync_agent_get(pengine, dst.agent_id);
-            if (!agent)
-            {
-                FS_ERR("Synchronization request was performed to unknown agent");
-                break;
-            }
+    // Request ostream for data signature
+    binn *obj = fsync_signature_stream_metainf(dst->sync_id, is_key_valid ? &dst->key.digest : 0);
+    if (!obj)
+        return fsync_dst_fail(dst, FFAIL, "Remote stream request was failed. Binn isn't created.");
+    dst->signature_ostream = frstream_factory_stream(pengine->stream_factory, &dst->src, obj);
+    binn_free(obj);
 
-            // I. Accept the sync request
-            if (!agent->accept(agent, dst.metainf, &dst.pistream, &dst.postream))
-            {
-                ret = FFAIL;
-                err_msg = "Sync request wasn't accepted";
-                FS_ERR(err_msg);
-                break;
-            }
+    if (!dst->signature_ostream)
+        return fsync_dst_fail(dst, FFAIL, "Remote stream request was failed");
 
-            if (!dst.pistream)
-            {
-                ret = FFAIL;
-                err_msg = "Destination istream is inaccessible";
-                FS_ERR(err_msg);
-                break;
-            }
+    ferr_t const ret = fsync_dst_signature(pengine, dst);
+    if (ret != FSUCCESS)
+        return fsync_dst_fail(dst, ret, "Signature calculation was failed");
 
-            if (!dst.postream)
-            {
-                ret = FFAIL;
-                err_msg = "Destination ostream is inaccessible";
-                FS_ERR(err_msg);
-                break;
-            }
+    dst->signature_ostream->release(dst->signature_ostream);
+    dst->signature_ostream = 0;
 
-            FSYNC_CHECK_CANCEL_SATATE();
+    // The delta istream may be received while the signature is sent
+    return dst->delta_istream ? FSYNC_STEP_NEXT : FSYNC_STEP_WAIT;
+}
 
-            // II. Request ostream for data signature
-            binn *obj = fsync_signature_stream_metainf(dst.sync_id);
-            if (!obj)
-            {
-                ret = FFAIL;
-                err_msg = "Remote stream request was failed. Binn isn't created.";
-                FS_ERR(err_msg);
-                break;
-            }
-            dst.signature_ostream = frstream_factory_stream(pengine->stream_factory, &dst.src, obj);
-            binn_free(obj);
+// VI. Delta apply. Literal delta doesn't refer to the base data.
+//     The received part of delta is applied, the rest of delta is waited.
+static fsync_step_t fsync_dst_delta(fsync_engine_t *pengine, fsync_dst_t *dst)
+{
+    if (!dst->delta_istream)
+        return FSYNC_STEP_WAIT;
 
-            if (!dst.signature_ostream)
-            {
-                ret = FFAIL;
-                err_msg = "Remote stream request was failed";
-                FS_ERR(err_msg);
-                break;
-            }
+    fsync_agent_t *agent = dst->agent;
 
-            FSYNC_CHECK_CANCEL_SATATE();
+    if (!dst->pdelta)
+    {
+        if (!dst->pistream)
+            dst->pistream = fmem_const_istream("", 0);
 
-            // III. Signature calculation
-            psig_calc = frsync_signature_calculator_create();
-            if (!psig_calc)
-            {
-                ret = FFAIL;
-                err_msg = "Signature calculator wasn't created";
-                FS_ERR(err_msg);
-                break;
-            }
+        dst->pdelta = frsync_delta_create(dst->pistream);
+        if (!dst->pdelta)
+            return fsync_dst_fail(dst, FFAIL, "Delta wasn't created");
 
-            char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
-            FS_INFO("Calculate signature: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
+        // Sketch of the new data is indexed, so the data may become the base for similar data
+        if (pengine->db && !dst->is_append && agent->signature_key)
+        {
+            dst->sketch_ostream = malloc(sizeof *dst->sketch_ostream);
+            if (!dst->sketch_ostream)
+                return fsync_dst_fail(dst, FERR_NO_MEM, "Unable to allocate memory for sketch ostream");
+            fsync_sketch_ostream_init(dst->sketch_ostream, dst->postream);
+        }
+    }
 
-            ret = frsync_signature_calculate(psig_calc,
-                                             dst.pistream,
-                                             dst.signature_ostream);
-            if (ret != FSUCCESS)
-            {
-                err_msg = "Signature calculation was failed";
-                FS_ERR(err_msg);
-                break;
-            }
-            dst.signature_ostream->release(dst.signature_ostream);
-            dst.signature_ostream = 0;
+    fsync_sketch_ostream_t *sketch_ostream = dst->sketch_ostream;
 
-            FSYNC_CHECK_CANCEL_SATATE();
+    ferr_t ret = frsync_delta_apply(dst->pdelta,
+                                    dst->delta_istream,
+                                    sketch_ostream ? &sketch_ostream->ostream : dst->postream);
+    if (ret == FERR_AGAIN)
+        return FSYNC_STEP_WAIT;
 
-            // IV. Wait delta istream
-            while (sem_wait(&thread->sync.sem) == -1 && errno == EINTR)
-                continue;       // Restart if interrupted by handler
+    frsync_delta_release(dst->pdelta);
+    dst->pdelta = 0;
 
-            FSYNC_CHECK_CANCEL_SATATE();
+    if (ret != FSUCCESS)
+        return fsync_dst_fail(dst, ret, "Application of delta was failed");
+
+    // VII. Complete the synchronization. Streams are closed, so the agent is free to replace the data.
+    dst->pistream->release(dst->pistream);
+    dst->pistream = 0;
+    dst->postream->release(dst->postream);
+    dst->postream = 0;
+
+    if (agent->complete)
+        agent->complete(agent, dst->metainf);
+
+    fdb_signature_key_t data_key = { { 0 } };
+    if (sketch_ostream
+        && sketch_ostream->size > FSYNC_LITERAL_SIZE_MAX
+        && agent->signature_key(agent, dst->metainf, &data_key))
+        fsync_sketch_put(pengine, data_key.path, sketch_ostream->sketch.hashes);
+
+    // VIII. Send notification to client
+    FMSG(sync_ok, ok, pengine->uuid, dst->src,
+        dst->sync_id
+    );
+    ret = fmsgbus_publish(pengine->msgbus, FSYNC_OK, (fmsg_t const *)&ok);
+    if (ret != FSUCCESS)
+        return fsync_dst_fail(dst, ret, "Synchronization completion event not published");
 
-            // V. Delta apply
-            pdelta = frsync_delta_create(dst.pistream);
-            if (!pdelta)
-            {
-                ret = FFAIL;
-                err_msg = "Delta wasn't created";
-                FS_ERR(err_msg);
-                break;
-            }
+    char dst_str[2 * sizeof(fuuid_t) + 1] = { 0 };
+    FS_INFO("Delta was successfully applied: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
 
-            ret = frsync_delta_apply(pdelta,
-                                     thread->delta_istream,
-                                     dst.postream);
-            if (ret != FSUCCESS)
-            {
-                err_msg = "Application of delta was failed";
-                FS_ERR(err_msg);
-                break;
-            }
+    return FSYNC_STEP_DONE;
+}
 
-            // VI. Complete the synchronization
-            if (agent->complete)
-                agent->complete(agent, dst.metainf);
+static void fsync_dst_finish(fsync_engine_t *pengine, fsync_dst_t *dst)
+{
+    if (dst->err == FSUCCESS)
+        return;
 
-            // V. Send notification to client
-            FMSG(sync_ok, ok, pengine->uuid, dst.src,
-                dst.sync_id
-            );
-            ret = fmsgbus_publish(pengine->msgbus, FSYNC_OK, (fmsg_t const *)&ok);
-            if (ret != FSUCCESS)
-            {
-                err_msg = "Synchronization completion event not published";
-                FS_ERR(err_msg);
-                break;
-            }
+    if (dst->agent && dst->agent->failed)
+        dst->agent->failed(dst->agent, dst->metainf, dst->err, dst->err_msg);
 
-            FS_INFO("Delta was successfully applied: %s", fuuid2str(&pengine->uuid, dst_str, sizeof dst_str));
-        }
-        while(0);
+    FMSG(sync_failed, err, pengine->uuid, dst->src,
+        dst->sync_id,
+        dst->err
+    );
+    strncpy(err.msg, dst->err_msg, sizeof err.msg);
+    if (fmsgbus_publish(pengine->msgbus, FSYNC_FAILED, (fmsg_t const *)&err) != FSUCCESS)
+        FS_ERR("Synchronization error not published");
+}
 
-        thread->sync_id = 0;
+static bool fsync_dst_step(fsync_engine_t *pengine, fsync_task_t *task)
+{
+    fsync_dst_t        *dst     = (fsync_dst_t *)task;
+    fsync_workers_t    *workers = &pengine->dst_workers;
+    fsync_dst_events_t  events;
+
+    // The istream is taken under the lock because the istream listener looks for the synchronization by it
+    fpush_lock(workers->mutex);
+    events = dst->events;
+    memset(&dst->events, 0, sizeof dst->events);
+    if (events.delta_istream)
+        dst->delta_istream = events.delta_istream;
+    fpop_lock();
 
-        if (pdelta)
-            frsync_delta_release(pdelta);
+    fsync_step_t step = FSYNC_STEP_NEXT;
 
-        if (psig_calc)
-            frsync_signature_calculator_release(psig_calc);
+    while (step == FSYNC_STEP_NEXT)
+    {
+        if (events.is_canceled)
+        {
+            step = fsync_dst_fail(dst, events.err, "Synchronization was canceled");
+            break;
+        }
 
-        if (ret != FSUCCESS && agent->failed)
-            agent->failed(agent, dst.metainf, ret, err_msg);
+        switch(dst->state)
+        {
+            case FSYNC_DST_REQUEST: step = fsync_dst_request(pengine, dst);             break;
+            case FSYNC_DST_APPEND:  step = fsync_dst_append(pengine, dst, &events);     break;
+            case FSYNC_DST_ACCEPT:  step = fsync_dst_accept(pengine, dst);              break;
+            case FSYNC_DST_SKETCH:  step = fsync_dst_sketch(pengine, dst, &events);     break;
+            case FSYNC_DST_BASE:    step = fsync_dst_base(pengine, dst);                break;
+            case FSYNC_DST_DELTA:   step = fsync_dst_delta(pengine, dst);               break;
+        }
+    }
 
-        if (agent)
-            agent->release(agent);
+    if (step != FSYNC_STEP_DONE)
+        return false;
 
-        fsync_dst_free(&dst);
+    fsync_dst_finish(pengine, dst);
+    return true;
+}
 
-        thread->sync.is_busy = false;
-        thread->err = FSUCCESS;
+static bool fsync_dst_set_delta_istream(fsync_workers_t *workers, fuuid_t const *src, uint32_t sync_id, fistream_t *delta_istream)
+{
+    bool ret = false;
 
-        if (ret != FSUCCESS)
+    fpush_lock(workers->mutex);
+    fsync_dst_t *dst = fsync_dst_find(workers, src, sync_id);
+    if (dst)
+    {
+        if (dst->delta_istream || dst->events.delta_istream)
+            FS_ERR("Delta istream is already exist");
+        else
         {
-            FMSG(sync_failed, err, pengine->uuid, dst.src,
-                dst.sync_id,
-                ret
-            );
-            strncpy(err.msg, err_msg, sizeof err.msg);
-            if (fmsgbus_publish(pengine->msgbus, FSYNC_FAILED, (fmsg_t const *)&err) != FSUCCESS)
-                FS_ERR("Synchronization error not published");
+            dst->events.delta_istream = delta_istream->retain(delta_istream);
+            fsync_workers_signal(workers, &dst->task);
+            ret = true;
         }
     }
-    return 0;
+    fpop_lock();
+
+    return ret;
 }
 
-static bool fsync_dst_set_delta_istream(fsync_dst_threads_t *dst_threads, fuuid_t const *src, uint32_t sync_id, fistream_t *delta_istream)
+static void fsync_dst_sketch_received(fsync_workers_t *workers, fuuid_t const *src, uint32_t sync_id, uint64_t const *sketch)
 {
-    for(uint32_t i = 0; i < FARRAY_SIZE(dst_threads->threads); ++i)
+    fpush_lock(workers->mutex);
+    fsync_dst_t *dst = fsync_dst_find(workers, src, sync_id);
+    if (dst)
     {
-        fsync_dst_thread_t *dst_thread = dst_threads->threads + i;
-        if (dst_thread->sync_id == sync_id
-            && memcmp(&dst_thread->src, src, sizeof *src) == 0)
-        {
-            if (dst_thread->delta_istream)
-            {
-                FS_ERR("Delta istream is already exist");
-                return false;
-            }
-            dst_thread->delta_istream = delta_istream->retain(delta_istream);
-            sem_post(&dst_thread->sync.sem);
-            return true;
-        }
+        memcpy(dst->events.sketch, sketch, sizeof dst->events.sketch);
+        dst->events.is_sketch = true;
+        fsync_workers_signal(workers, &dst->task);
     }
-    return false;
+    fpop_lock();
 }
 
-static void fsync_dst_cancel(fsync_dst_threads_t *dst_threads, fuuid_t const *src, uint32_t sync_id, ferr_t err)
+// dst continues with the signature
+static void fsync_dst_reject_append(fsync_workers_t *workers, fuuid_t const *src, uint32_t sync_id)
 {
-    for(uint32_t i = 0; i < FARRAY_SIZE(dst_threads->threads); ++i)
+    fpush_lock(workers->mutex);
+    fsync_dst_t *dst = fsync_dst_find(workers, src, sync_id);
+    if (dst)
     {
-        fsync_dst_thread_t *dst_thread = dst_threads->threads + i;
-        if (dst_thread->sync_id == sync_id
-            && memcmp(&dst_thread->src, src, sizeof *src) == 0)
-        {
-            dst_thread->err = err;
-            dst_thread->sync.is_busy = false;
-            sem_post(&dst_thread->sync.sem);
-            break;
-        }
+        dst->events.is_append_rejected = true;
+        fsync_workers_signal(workers, &dst->task);
+    }
+    fpop_lock();
+}
+
+// The synchronization which isn't started is removed. The agent doesn't know it yet.
+static void fsync_dst_cancel(fsync_workers_t *workers, fuuid_t const *src, uint32_t sync_id, ferr_t err)
+{
+    fsync_dst_t *pending = 0;
+    size_t peer_idx = 0, task_idx = 0;
+
+    fpush_lock(workers->mutex);
+    fsync_dst_t *dst = fsync_dst_find(workers, src, sync_id);
+    if (dst)
+    {
+        dst->events.err = err;
+        dst->events.is_canceled = true;
+        fsync_workers_signal(workers, &dst->task);
     }
+    else
+    {
+        pending = fsync_dst_find_pending(workers, src, sync_id, &peer_idx, &task_idx);
+        if (pending)
+            fsync_workers_erase_pending(workers, peer_idx, task_idx);
+    }
+    fpop_lock();
+
+    if (pending)
+        workers->free(&pending->task);
 }
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -1003,17 +2194,27 @@ static void fsync_request_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_reques
     if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
         return;
 
-    fsync_dst_t dst =
+    fsync_dst_t *dst = malloc(sizeof(fsync_dst_t) + msg->metainf_size);    // meta information outlives the message
+    if (dst)
     {
-        msg->sync_id,
-        msg->hdr.src,
-        msg->agent_id,
-        time(0),
-        msg->metainf_size ? binn_open((void*)msg->metainf) : 0,
-    };
+        memset(dst, 0, sizeof *dst);
+        dst->sync_id = msg->sync_id;
+        dst->src = msg->hdr.src;
+        dst->agent_id = msg->agent_id;
+        dst->time = time(0);
+        dst->metainf = msg->metainf_size ? binn_open(memcpy(dst + 1, msg->metainf, msg->metainf_size)) : 0;
+        dst->block_len = msg->block_len;
+        dst->strong_len = msg->strong_len;
+        dst->size = msg->size;
+        dst->digest = msg->digest;
+        dst->base_digest = msg->base_digest;
+    }
 
-    if (!fsync_dst_push_back(&pengine->dst_threads, &dst))
+    if (!dst || !fsync_workers_push(&pengine->dst_workers, &dst->task, &dst->src, dst->size))
     {
+        if (dst)
+            fsync_dst_free(&dst->task);
+
         FMSG(sync_failed, err, pengine->uuid, msg->hdr.src,
             msg->sync_id,
             FFAIL,
@@ -1030,7 +2231,7 @@ static void fsync_failure_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_failed
 {
     if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
         return;
-    fsync_src_cancel(&pengine->src_threads, msg->sync_id, (ferr_t)msg->err);
+    fsync_src_cancel(&pengine->src_workers, msg->sync_id, (ferr_t)msg->err);
     FS_ERR("Synchronization was failed. Reason: \'%s\'", msg->msg);
 }
 
@@ -1039,7 +2240,7 @@ static void fsync_cancel_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_cancel)
 {
     if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
         return;
-    fsync_dst_cancel(&pengine->dst_threads, &msg->hdr.src, msg->sync_id, msg->err);
+    fsync_dst_cancel(&pengine->dst_workers, &msg->hdr.src, msg->sync_id, msg->err);
     FS_ERR("Synchronization was canceled. Reason: \'%s\'", msg->msg);
 }
 
@@ -1048,14 +2249,97 @@ static void fsync_ok_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_ok) const *
 {
     if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
         return;
-    fsync_src_ok(&pengine->src_threads, msg->sync_id);
+    fsync_src_ok(&pengine->src_workers, msg->sync_id);
+}
+
+// FSYNC_LITERAL handler
+static void fsync_literal_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_literal) const *msg)
+{
+    if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
+        return;
+    fsync_src_literal(&pengine->src_workers, msg->sync_id);
+}
+
+// FSYNC_APPEND handler
+static void fsync_append_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_append) const *msg)
+{
+    if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
+        return;
+    fsync_src_append(&pengine->src_workers, msg->sync_id, msg->offset, &msg->digest);
+}
+
+// FSYNC_APPEND_REJECT handler
+static void fsync_append_reject_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_append_reject) const *msg)
+{
+    if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
+        return;
+    fsync_dst_reject_append(&pengine->dst_workers, &msg->hdr.src, msg->sync_id);
+}
+
+// FSYNC_SIGNATURE_VALID handler
+static void fsync_signature_valid_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_signature_valid) const *msg)
+{
+    if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
+        return;
+    fsync_src_signature_valid(&pengine->src_workers, msg->sync_id);
+}
+
+// FSYNC_SKETCH_REQUEST handler
+static void fsync_sketch_request_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_sketch_request) const *msg)
+{
+    if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
+        return;
+    fsync_src_sketch_request(&pengine->src_workers, msg->sync_id);
+}
+
+// FSYNC_SKETCH handler
+static void fsync_sketch_handler(fsync_engine_t *pengine, FMSG_TYPE(sync_sketch) const *msg)
+{
+    if (memcmp(&msg->hdr.dst, &pengine->uuid, sizeof pengine->uuid) != 0)
+        return;
+    fsync_dst_sketch_received(&pengine->dst_workers, &msg->hdr.src, msg->sync_id, msg->hashes);
+}
+
+// New data of signature istream. src continues the signature loading.
+static void fsync_signature_data_listener(fsync_engine_t *pengine, fistream_t *pstream)
+{
+    fsync_workers_t *workers = &pengine->src_workers;
+
+    fpush_lock(workers->mutex);
+    for(size_t i = 0; i < fvector_size(workers->active); ++i)
+    {
+        fsync_src_t *src = *(fsync_src_t **)fvector_at(workers->active, i);
+        if (src->signature_istream == pstream)
+        {
+            fsync_workers_signal(workers, &src->task);
+            break;
+        }
+    }
+    fpop_lock();
+}
+
+// New data of delta istream. dst continues the delta applying.
+static void fsync_delta_data_listener(fsync_engine_t *pengine, fistream_t *pstream)
+{
+    fsync_workers_t *workers = &pengine->dst_workers;
+
+    fpush_lock(workers->mutex);
+    for(size_t i = 0; i < fvector_size(workers->active); ++i)
+    {
+        fsync_dst_t *dst = *(fsync_dst_t **)fvector_at(workers->active, i);
+        if (dst->delta_istream == pstream)
+        {
+            fsync_workers_signal(workers, &dst->task);
+            break;
+        }
+    }
+    fpop_lock();
 }
 
 static void fsync_engine_istream_listener(fsync_engine_t *pengine, fistream_t *pstream, frstream_info_t const *info)
 {
     ferr_t      ret = FSUCCESS;
     char const *err_msg = "";
-    uint32_t    sync_id = 0;
 
     if (!info->metainf)
     {
@@ -1069,7 +2353,15 @@ static void fsync_engine_istream_listener(fsync_engine_t *pengine, fistream_t *p
     {
         if(metainf.stream_type == FSYNC_SIGNATURE_STREAM)
         {
-            if (!fsync_src_set_signature_istream(&pengine->src_threads, metainf.sync_id, pstream))
+            if (frstream_istream_listen(pstream, (fristream_data_listener_t)fsync_signature_data_listener, pengine) != FSUCCESS)
+            {
+                ret = FFAIL;
+                err_msg = "Signature istream isn't listened";
+                FS_ERR(err_msg);
+                break;
+            }
+
+            if (!fsync_src_set_signature_istream(&pengine->src_workers, metainf.sync_id, pstream, &metainf.digest))
             {
                 ret = FFAIL;
                 err_msg = "Unknown synchronization id";
@@ -1079,7 +2371,15 @@ static void fsync_engine_istream_listener(fsync_engine_t *pengine, fistream_t *p
         }
         else if(metainf.stream_type == FSYNC_DELTA_STREAM)
         {
-            if (!fsync_dst_set_delta_istream(&pengine->dst_threads, &info->peer, metainf.sync_id, pstream))
+            if (frstream_istream_listen(pstream, (fristream_data_listener_t)fsync_delta_data_listener, pengine) != FSUCCESS)
+            {
+                ret = FFAIL;
+                err_msg = "Delta istream isn't listened";
+                FS_ERR(err_msg);
+                break;
+            }
+
+            if (!fsync_dst_set_delta_istream(&pengine->dst_workers, &info->peer, metainf.sync_id, pstream))
             {
                 ret = FFAIL;
                 err_msg = "Unknown synchronization id";
@@ -1100,7 +2400,7 @@ static void fsync_engine_istream_listener(fsync_engine_t *pengine, fistream_t *p
     {
         if(metainf.stream_type == FSYNC_SIGNATURE_STREAM)
         {
-            fsync_src_cancel(&pengine->src_threads, sync_id, ret);
+            fsync_src_cancel(&pengine->src_workers, metainf.sync_id, ret);
 
             FMSG(sync_cancel, err, pengine->uuid, info->peer,
                 metainf.sync_id,
@@ -1112,7 +2412,7 @@ static void fsync_engine_istream_listener(fsync_engine_t *pengine, fistream_t *p
         }
         else if(metainf.stream_type == FSYNC_DELTA_STREAM)
         {
-            fsync_dst_cancel(&pengine->dst_threads, &info->peer, metainf.sync_id, ret);
+            fsync_dst_cancel(&pengine->dst_workers, &info->peer, metainf.sync_id, ret);
 
             FMSG(sync_failed, err, pengine->uuid, info->peer,
                 metainf.sync_id,
@@ -1134,21 +2434,33 @@ static void fsync_engine_msgbus_retain(fsync_engine_t *pengine, fmsgbus_t *pmsgb
     fmsgbus_subscribe(pengine->msgbus, FSYNC_FAILED,    (fmsg_handler_t)fsync_failure_handler,  pengine);
     fmsgbus_subscribe(pengine->msgbus, FSYNC_CANCEL,    (fmsg_handler_t)fsync_cancel_handler,   pengine);
     fmsgbus_subscribe(pengine->msgbus, FSYNC_OK,        (fmsg_handler_t)fsync_ok_handler,       pengine);
+    fmsgbus_subscribe(pengine->msgbus, FSYNC_LITERAL,   (fmsg_handler_t)fsync_literal_handler,  pengine);
+    fmsgbus_subscribe(pengine->msgbus, FSYNC_APPEND,    (fmsg_handler_t)fsync_append_handler,   pengine);
+    fmsgbus_subscribe(pengine->msgbus, FSYNC_APPEND_REJECT, (fmsg_handler_t)fsync_append_reject_handler, pengine);
+    fmsgbus_subscribe(pengine->msgbus, FSYNC_SKETCH_REQUEST, (fmsg_handler_t)fsync_sketch_request_handler, pengine);
+    fmsgbus_subscribe(pengine->msgbus, FSYNC_SKETCH,    (fmsg_handler_t)fsync_sketch_handler,   pengine);
+    fmsgbus_subscribe(pengine->msgbus, FSYNC_SIGNATURE_VALID, (fmsg_handler_t)fsync_signature_valid_handler, pengine);
 }
 
 static void fsync_engine_msgbus_release(fsync_engine_t *pengine)
 {
     if (pengine->msgbus)
     {
-        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_REQUEST, (fmsg_handler_t)fsync_request_handler);
-        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_FAILED,  (fmsg_handler_t)fsync_failure_handler);
-        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_CANCEL,  (fmsg_handler_t)fsync_cancel_handler);
-        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_OK,      (fmsg_handler_t)fsync_ok_handler);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_REQUEST, (fmsg_handler_t)fsync_request_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_FAILED,  (fmsg_handler_t)fsync_failure_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_CANCEL,  (fmsg_handler_t)fsync_cancel_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_OK,      (fmsg_handler_t)fsync_ok_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_LITERAL, (fmsg_handler_t)fsync_literal_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_APPEND,  (fmsg_handler_t)fsync_append_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_APPEND_REJECT, (fmsg_handler_t)fsync_append_reject_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_SKETCH_REQUEST, (fmsg_handler_t)fsync_sketch_request_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_SKETCH,  (fmsg_handler_t)fsync_sketch_handler, pengine);
+        fmsgbus_unsubscribe(pengine->msgbus, FSYNC_SIGNATURE_VALID, (fmsg_handler_t)fsync_signature_valid_handler, pengine);
         fmsgbus_release(pengine->msgbus);
     }
 }
 
-fsync_engine_t *fsync_engine(fmsgbus_t *pmsgbus, fuuid_t const *uuid)
+fsync_engine_t *fsync_engine(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *uuid)
 {
     if (!pmsgbus || !uuid)
     {
@@ -1167,6 +2479,7 @@ fsync_engine_t *fsync_engine(fmsgbus_t *pmsgbus, fuuid_t const *uuid)
 
     pengine->ref_counter = 1;
     pengine->uuid = *uuid;
+    pengine->db = db ? fdb_retain(db) : 0;
     fsync_engine_msgbus_retain(pengine, pmsgbus);
 
     static const pthread_mutex_t mutex_initializer = PTHREAD_MUTEX_INITIALIZER;
@@ -1196,16 +2509,16 @@ fsync_engine_t *fsync_engine(fmsgbus_t *pmsgbus, fuuid_t const *uuid)
         return 0;
     }
 
-    if (!fsync_src_create(pengine, &pengine->src_threads))
+    if (!fsync_workers_create(pengine, &pengine->src_workers, fsync_src_step, fsync_src_free))
     {
-        FS_ERR("Sources vector wasn't created");
+        FS_ERR("Source workers weren't created");
         fsync_engine_release(pengine);
         return 0;
     }
 
-    if (!fsync_dst_create(pengine, &pengine->dst_threads))
+    if (!fsync_workers_create(pengine, &pengine->dst_workers, fsync_dst_step, fsync_dst_free))
     {
-        FS_ERR("Destinations vector wasn't created");
+        FS_ERR("Destination workers weren't created");
         fsync_engine_release(pengine);
         return 0;
     }
@@ -1230,8 +2543,8 @@ void fsync_engine_release(fsync_engine_t *pengine)
             FS_ERR("Invalid sync engine");
         else if (!--pengine->ref_counter)
         {
-            fsync_src_threads_free(&pengine->src_threads);
-            fsync_dst_threads_free(&pengine->dst_threads);
+            fsync_workers_stop(&pengine->src_workers);
+            fsync_workers_stop(&pengine->dst_workers);
             fsync_engine_msgbus_release(pengine);
 
             if (pengine->stream_factory)
@@ -1240,6 +2553,9 @@ void fsync_engine_release(fsync_engine_t *pengine)
                 frstream_factory_release(pengine->stream_factory);
             }
 
+            fsync_workers_free(&pengine->src_workers);
+            fsync_workers_free(&pengine->dst_workers);
+
             if(pengine->agents)
             {
                 for(size_t i = 0; i < fvector_size(pengine->agents); ++i)
@@ -1250,6 +2566,9 @@ void fsync_engine_release(fsync_engine_t *pengine)
                 fvector_release(pengine->agents);
             }
 
+            if (pengine->db)
+                fdb_release(pengine->db);
+
             free(pengine);
         }
     }
@@ -1268,7 +2587,7 @@ ferr_t fsync_engine_register_agent(fsync_engine_t *pengine, fsync_agent_t *agent
     return fsync_agent_add(pengine, agent);
 }
 
-ferr_t fsync_engine_sync(fsync_engine_t *pengine, fuuid_t const *dst, uint32_t agent_id, binn *metainf, fistream_t *pstream)
+ferr_t fsync_engine_sync(fsync_engine_t *pengine, fuuid_t const *dst, uint32_t agent_id, binn *metainf, fistream_t *pstream, uint64_t size)
 {
     if (!pengine || !dst || !pstream)
     {
@@ -1283,31 +2602,27 @@ ferr_t fsync_engine_sync(fsync_engine_t *pengine, fuuid_t const *dst, uint32_t a
         return FFAIL;
     }
 
-    sem_t sem;
-
-    if (sem_init(&sem, 0, 0) == -1)
+    fsync_src_t *src = malloc(sizeof(fsync_src_t) + metainf_size);     // meta information is copied, synchronization may start later
+    if (!src)
     {
-        FS_ERR("The semaphore initialization is failed");
-        return FFAIL;
+        FS_ERR("No free space of memory");
+        return FERR_NO_MEM;
     }
 
-    fsync_src_t src =
-    {
-        ++pengine->sync_id,
-        *dst,
-        agent_id,
-        time(0),
-        metainf ? binn_open(binn_ptr(metainf)) : 0,
-        pstream
-    };
+    memset(src, 0, sizeof *src);
+    src->sync_id = ++pengine->sync_id;
+    src->dst = *dst;
+    src->agent_id = agent_id;
+    src->time = time(0);
+    src->metainf = metainf_size ? binn_open(memcpy(src + 1, binn_ptr(metainf), metainf_size)) : 0;
+    src->pistream = pstream->retain(pstream);
+    src->size = size;
 
-    ferr_t ret = fsync_src_push_back(&pengine->src_threads, &src) ? FSUCCESS : FERR_NO_MEM;
-    if (ret != FSUCCESS)
+    if (!fsync_workers_push(&pengine->src_workers, &src->task, &src->dst, src->size))
     {
-        binn_free(src.metainf);
-        sem_destroy(&sem);
-        return ret;
+        fsync_src_free(&src->task);
+        return FERR_NO_MEM;
     }
 
-    return ret;
+    return FSUCCESS;
 }
@@ -4,6 +4,8 @@
 #include <futils/uuid.h>
 #include <futils/errno.h>
 #include <futils/stream.h>
+#include <fdb/db.h>
+#include <fdb/sync/signatures.h>
 #include <stdint.h>
 #include <binn.h>
 
@@ -15,6 +17,9 @@ typedef void           (*fsync_agent_release_fn_t)     (fsync_agent_t *);
 typedef bool           (*fsync_agent_accept_fn_t)      (fsync_agent_t *, binn *metainf, fistream_t **pistream, fostream_t **postream);
 typedef void           (*fsync_error_handler_fn_t)     (fsync_agent_t *, binn *metainf, ferr_t err, char const *err_msg);
 typedef void           (*fsync_completion_handler_fn_t)(fsync_agent_t *, binn *metainf);
+typedef bool           (*fsync_signature_key_fn_t)     (fsync_agent_t *, binn *metainf, fdb_signature_key_t *key);
+typedef bool           (*fsync_agent_append_fn_t)      (fsync_agent_t *, binn *metainf, fistream_t **pistream, fostream_t **postream);
+typedef fistream_t*    (*fsync_agent_open_fn_t)        (fsync_agent_t *, char const *path);
 
 struct fsync_agent
 {
@@ -24,12 +29,15 @@ struct fsync_agent
     fsync_agent_accept_fn_t         accept;
     fsync_error_handler_fn_t        failed;
     fsync_completion_handler_fn_t   complete;
+    fsync_signature_key_fn_t        signature_key;  // Optional. Identity of the local file of metainf. Used for signatures cache and skipping of equal data.
+    fsync_agent_append_fn_t         append;         // Optional. Opens the local file for reading and for writing to its end. Grown data is completed by its tail.
+    fsync_agent_open_fn_t           open;           // Optional. Opens the local file by path of signature key. The most similar file is the base for new data.
 };
 
-fsync_engine_t *fsync_engine(fmsgbus_t *pmsgbus, fuuid_t const *uuid);
+fsync_engine_t *fsync_engine(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *uuid);                         // db is optional. Signatures are cached in db, sketches of data are indexed in db.
 fsync_engine_t *fsync_engine_retain(fsync_engine_t *pengine);
 void            fsync_engine_release(fsync_engine_t *pengine);
 ferr_t          fsync_engine_register_agent(fsync_engine_t *pengine, fsync_agent_t *agent);
-ferr_t          fsync_engine_sync(fsync_engine_t *pengine, fuuid_t const *dst, uint32_t agent_id, binn *metainf, fistream_t *pstream);  // data -> dst
+ferr_t          fsync_engine_sync(fsync_engine_t *pengine, fuuid_t const *dst, uint32_t agent_id, binn *metainf, fistream_t *pstream, uint64_t size);  // data -> dst. Signature parameters depend on the data size (0 - unknown).
 
 #endif
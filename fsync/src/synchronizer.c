@@ -4,8 +4,9 @@
 #include <futils/vector.h>
 #include <futils/mutex.h>
 #include <fdb/sync/nodes.h>
-#include <fdb/sync/statuses.h>
+#include <fdb/sync/bitmaps.h>
 #include <fdb/sync/sync_files.h>
+#include <fdb/sync/shards.h>
 #include <fcommon/limits.h>
 #include <fcommon/messages.h>
 #include <string.h>
@@ -54,6 +55,8 @@ struct fsynchronizer
     fuuid_t                 uuid;                               // uuid
     fmsgbus_t              *msgbus;                             // messages bus
     fdb_t                  *db;                                 // db
+    fdb_shards_t           *shards;                             // db shards of nodes sync tables
+    fdb_t                  *local_db;                           // db shard of the local node
     pthread_mutex_t         mutex;
     fvector_t              *sync_files;                         // synchronized files (Type: fsynchronizer_file_t)
 };
@@ -69,7 +72,9 @@ static void fsynchronizer_file_part_handler(fsynchronizer_t *psynchronizer, FMSG
         uint32_t id = FINVALID_ID;
 
         fdb_transaction_t transaction = { 0 };
-        if (fdb_transaction_start(psynchronizer->db, &transaction))
+
+        fdb_t *peer_db = fdb_shard(psynchronizer->shards, &msg->hdr.src);
+        if (peer_db && fdb_transaction_start(peer_db, &transaction))
         {
             fdb_sync_files_map_t *uuid_files_map = fdb_sync_files(&transaction, &msg->hdr.src);
             if (uuid_files_map)
@@ -77,17 +82,20 @@ static void fsynchronizer_file_part_handler(fsynchronizer_t *psynchronizer, FMSG
                 fdb_sync_file_path(uuid_files_map, &transaction, msg->id, path, sizeof path);
                 fdb_sync_files_release(uuid_files_map);
             }
+            fdb_transaction_abort(&transaction);
+        }
+
+        if (peer_db)
+            fdb_release(peer_db);
 
-            if (path[0])
+        if (path[0] && fdb_transaction_start(psynchronizer->local_db, &transaction))
+        {
+            fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &psynchronizer->uuid);
+            if (files_map)
             {
-                fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &psynchronizer->uuid);
-                if (files_map)
-                {
-                    fdb_sync_file_id(files_map, &transaction, path, strlen(path), &id);
-                    fdb_sync_files_release(files_map);
-                }
+                fdb_sync_file_id(files_map, &transaction, path, strlen(path), &id);
+                fdb_sync_files_release(files_map);
             }
-
             fdb_transaction_abort(&transaction);
         }
 
@@ -120,16 +128,22 @@ static void fsynchronizer_msgbus_retain(fsynchronizer_t *psynchronizer, fmsgbus_
 
 static void fsynchronizer_msgbus_release(fsynchronizer_t *psynchronizer)
 {
-    fmsgbus_unsubscribe(psynchronizer->msgbus, FFILE_PART,          (fmsg_handler_t)fsynchronizer_file_part_handler);
+    fmsgbus_unsubscribe(psynchronizer->msgbus, FFILE_PART,          (fmsg_handler_t)fsynchronizer_file_part_handler, psynchronizer);
     fmsgbus_release(psynchronizer->msgbus);
 }
 
-static bool fsynchronizer_update_sync_files_list(fsynchronizer_t *psynchronizer)
+typedef struct
+{
+    char        path[FMAX_PATH];
+} fsynchronizer_path_t;
+
+// Local files which should be synchronized. Paths of files are collected for sources search.
+static bool fsynchronizer_collect_sync_files(fsynchronizer_t *psynchronizer, fvector_t **paths)
 {
     bool ret = false;
 
     fdb_transaction_t transaction = { 0 };
-    if (fdb_transaction_start(psynchronizer->db, &transaction))
+    if (fdb_transaction_start(psynchronizer->local_db, &transaction))
     {
         fdb_map_t status_map = { 0 };
         if (fdb_sync_files_statuses(&transaction, &psynchronizer->uuid, &status_map))
@@ -137,125 +151,79 @@ static bool fsynchronizer_update_sync_files_list(fsynchronizer_t *psynchronizer)
             fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &psynchronizer->uuid);
             if (files_map)
             {
-                fdb_nodes_t *nodes = fdb_nodes(&transaction);
-                if (nodes)
+                fdb_bitmaps_map_iterator_t *statuses_map_iterator = fdb_bitmaps_map_iterator(&status_map, &transaction, FFILE_IS_EXIST);
+                if (statuses_map_iterator)
                 {
-                    fdb_statuses_map_iterator_t *statuses_map_iterator = fdb_statuses_map_iterator(&status_map, &transaction, FFILE_IS_EXIST);
-                    if (statuses_map_iterator)
+                    ret = true;
+
+                    uint32_t id = FINVALID_ID;
+                    for(bool st = fdb_bitmaps_map_iterator_first(statuses_map_iterator, &id); ret && st; st = fdb_bitmaps_map_iterator_next(statuses_map_iterator, &id))
                     {
-                        ret = true;
+                        fsync_file_info_t file_info = { 0 };
 
-                        fdb_data_t file_id = { 0 };
-                        for(bool st = fdb_statuses_map_iterator_first(statuses_map_iterator, &file_id); ret && st; st = fdb_statuses_map_iterator_next(statuses_map_iterator, &file_id))
+                        if (fdb_sync_file_get(files_map, &transaction, id, &file_info))
                         {
-                            fsync_file_info_t file_info = { 0 };
-                            uint32_t const id = *(uint32_t*)file_id.data;
+                            char path[2 * FMAX_PATH];
+                            size_t dir_path_len = strlen(psynchronizer->dir);
+                            memcpy(path, psynchronizer->dir, dir_path_len);
+                            strncpy(path + dir_path_len, file_info.path, sizeof path - dir_path_len);
+
+                            file_assembler_t *fassembler = file_assembler_open(path, file_info.size);
+                            if (!fassembler)
+                            {
+                                ret = false;
+                                FS_ERR("File assembler wasn't opened");
+                                break;
+                            }
+
+                            fvector_t *file_srcs = fvector(sizeof(fsynchronizer_file_src_t), 0, 0);
+                            if (!file_srcs)
+                            {
+                                file_assembler_close(fassembler);
+                                ret = false;
+                                FS_ERR("File sources vector wasn't created");
+                                break;
+                            }
+
+                            fvector_t *requested_parts = fvector(sizeof(fsynchronizer_requested_part_t), 0, 0);
+                            if (!requested_parts)
+                            {
+                                file_assembler_close(fassembler);
+                                fvector_release(file_srcs);
+                                ret = false;
+                                FS_ERR("Requested parts vector wasn't created");
+                                break;
+                            }
+
+                            fsynchronizer_path_t sync_path;
+                            memcpy(sync_path.path, file_info.path, sizeof sync_path.path);
 
-                            if (fdb_sync_file_get(files_map, &transaction, id, &file_info))
+                            fpush_lock(psynchronizer->mutex);
+
+                            fsynchronizer_file_t const sync_file = { id, file_info.size, file_srcs, requested_parts, fassembler };
+                            if (!fvector_push_back(&psynchronizer->sync_files, &sync_file))
                             {
-                                char path[2 * FMAX_PATH];
-                                size_t dir_path_len = strlen(psynchronizer->dir);
-                                memcpy(path, psynchronizer->dir, dir_path_len);
-                                strncpy(path + dir_path_len, file_info.path, sizeof path - dir_path_len);
-
-                                file_assembler_t *fassembler = file_assembler_open(path, file_info.size);
-                                if (!fassembler)
-                                {
-                                    ret = false;
-                                    FS_ERR("File assembler wasn't opened");
-                                    break;
-                                }
-
-                                fvector_t *file_srcs = fvector(sizeof(fsynchronizer_file_src_t), 0, 0);
-                                if (!file_srcs)
-                                {
-                                    file_assembler_close(fassembler);
-                                    ret = false;
-                                    FS_ERR("File sources vector wasn't created");
-                                    break;
-                                }
-
-                                fvector_t *requested_parts = fvector(sizeof(fsynchronizer_requested_part_t), 0, 0);
-                                if (!requested_parts)
-                                {
-                                    file_assembler_close(fassembler);
-                                    fvector_release(file_srcs);
-                                    ret = false;
-                                    FS_ERR("Requested parts vector wasn't created");
-                                    break;
-                                }
-
-                                fpush_lock(psynchronizer->mutex);
-
-                                fsynchronizer_file_t const sync_file = { id, file_info.size, file_srcs, requested_parts, fassembler };
-                                if (!fvector_push_back(&psynchronizer->sync_files, &sync_file))
-                                {
-                                    file_assembler_close(fassembler);
-                                    fvector_release(file_srcs);
-                                    fvector_release(requested_parts);
-                                    FS_ERR("Sync file info wasn't remembered");
-                                    ret = false;
-                                }
-
-                                fpop_lock();
-
-                                if (!ret)
-                                    break;
-
-                                fdb_nodes_iterator_t *nodes_iterator = fdb_nodes_iterator(nodes, &transaction);
-                                if (nodes_iterator)
-                                {
-                                    fuuid_t uuid;
-                                    fdb_node_info_t node_info;
-
-                                    for (bool nst = fdb_nodes_first(nodes_iterator, &uuid, &node_info); ret && nst; nst = fdb_nodes_next(nodes_iterator, &uuid, &node_info))
-                                    {
-                                        fdb_sync_files_map_t *files_map4uuid = fdb_sync_files(&transaction, &uuid);
-                                        if (files_map4uuid)
-                                        {
-                                            fsync_file_info_t info = { 0 };
-                                            if (fdb_sync_file_get_by_path(files_map4uuid, &transaction, file_info.path, strlen(file_info.path), &info))
-                                            {
-                                                if (info.status & FFILE_IS_EXIST)
-                                                {
-                                                    fsynchronizer_file_src_t const file_src = { info.id, uuid };
-                                                    if (!fvector_push_back(&file_srcs, &file_src))
-                                                    {
-                                                        FS_ERR("File info wasn't remembered");
-                                                        ret = false;
-                                                    }
-                                                }
-                                            }
-                                            else
-                                            {
-                                                ret = false;
-                                                FS_ERR("Unable to find file information by path");
-                                            }
-                                            fdb_sync_files_release(files_map4uuid);
-                                        }
-                                        else
-                                        {
-                                            ret = false;
-                                            FS_ERR("Unable to retrieve files for uuid");
-                                        }
-                                    }
-                                    fdb_nodes_iterator_free(nodes_iterator);
-                                }
-                                else
-                                {
-                                    ret = false;
-                                    FS_ERR("Unable to create  the nodes iterator");
-                                }
+                                file_assembler_close(fassembler);
+                                fvector_release(file_srcs);
+                                fvector_release(requested_parts);
+                                FS_ERR("Sync file info wasn't remembered");
+                                ret = false;
                             }
-                            else
+                            else if (!fvector_push_back(paths, &sync_path))
                             {
+                                FS_ERR("Sync file path wasn't remembered");
                                 ret = false;
-                                FS_ERR("Unable to get file information by id");
                             }
+
+                            fpop_lock();
+                        }
+                        else
+                        {
+                            ret = false;
+                            FS_ERR("Unable to get file information by id");
                         }
-                        fdb_statuses_map_iterator_free(statuses_map_iterator);
                     }
-                    fdb_nodes_release(nodes);
+                    fdb_bitmaps_map_iterator_free(statuses_map_iterator);
                 }
                 fdb_sync_files_release(files_map);
             }
@@ -264,6 +232,132 @@ static bool fsynchronizer_update_sync_files_list(fsynchronizer_t *psynchronizer)
         fdb_transaction_abort(&transaction);
     }
 
+    return ret;
+}
+
+static bool fsynchronizer_collect_nodes(fsynchronizer_t *psynchronizer, fvector_t **uuids)
+{
+    bool ret = false;
+
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(psynchronizer->db, &transaction))
+    {
+        fdb_nodes_t *nodes = fdb_nodes(&transaction);
+        if (nodes)
+        {
+            fdb_nodes_iterator_t *nodes_iterator = fdb_nodes_iterator(nodes, &transaction);
+            if (nodes_iterator)
+            {
+                ret = true;
+
+                fuuid_t uuid;
+                fdb_node_info_t node_info;
+
+                for (bool nst = fdb_nodes_first(nodes_iterator, &uuid, &node_info); ret && nst; nst = fdb_nodes_next(nodes_iterator, &uuid, &node_info))
+                {
+                    if (!fvector_push_back(uuids, &uuid))
+                    {
+                        FS_ERR("Node uuid wasn't remembered");
+                        ret = false;
+                    }
+                }
+                fdb_nodes_iterator_free(nodes_iterator);
+            }
+            else FS_ERR("Unable to create  the nodes iterator");
+            fdb_nodes_release(nodes);
+        }
+        fdb_transaction_abort(&transaction);
+    }
+
+    return ret;
+}
+
+// Sources of sync files are looked for in the shard of the node
+static bool fsynchronizer_collect_file_srcs(fsynchronizer_t *psynchronizer, fuuid_t const *uuid, fvector_t *paths, size_t first_file)
+{
+    bool ret = false;
+
+    fdb_t *db = fdb_shard(psynchronizer->shards, uuid);
+    if (!db)
+        return false;
+
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(db, &transaction))
+    {
+        fdb_sync_files_map_t *files_map4uuid = fdb_sync_files(&transaction, uuid);
+        if (files_map4uuid)
+        {
+            ret = true;
+
+            fsynchronizer_path_t const *sync_paths = (fsynchronizer_path_t const *)fvector_ptr(paths);
+
+            for (size_t i = 0; ret && i < fvector_size(paths); ++i)
+            {
+                fsync_file_info_t info = { 0 };
+                if (fdb_sync_file_get_by_path(files_map4uuid, &transaction, sync_paths[i].path, strlen(sync_paths[i].path), &info))
+                {
+                    if (info.status & FFILE_IS_EXIST)
+                    {
+                        fsynchronizer_file_src_t const file_src = { info.id, *uuid };
+
+                        fpush_lock(psynchronizer->mutex);
+                        fsynchronizer_file_t *sync_file = (fsynchronizer_file_t *)fvector_at(psynchronizer->sync_files, first_file + i);
+                        if (!sync_file || !fvector_push_back(&sync_file->src, &file_src))
+                        {
+                            FS_ERR("File info wasn't remembered");
+                            ret = false;
+                        }
+                        fpop_lock();
+                    }
+                }
+                else
+                {
+                    ret = false;
+                    FS_ERR("Unable to find file information by path");
+                }
+            }
+            fdb_sync_files_release(files_map4uuid);
+        }
+        else FS_ERR("Unable to retrieve files for uuid");
+        fdb_transaction_abort(&transaction);
+    }
+
+    fdb_release(db);
+
+    return ret;
+}
+
+/*
+ * Sync tables of nodes may be in different DB shards.
+ * Local files, nodes and sources of files are collected by separate transactions, so only one shard is locked at once.
+ */
+static bool fsynchronizer_update_sync_files_list(fsynchronizer_t *psynchronizer)
+{
+    fvector_t *paths = fvector(sizeof(fsynchronizer_path_t), 0, 0);
+    fvector_t *uuids = fvector(sizeof(fuuid_t), 0, 0);
+
+    bool ret = paths && uuids;
+
+    if (!ret)
+        FS_ERR("Vectors for sync files weren't created");
+
+    size_t first_file = 0;
+
+    fpush_lock(psynchronizer->mutex);
+    first_file = fvector_size(psynchronizer->sync_files);
+    fpop_lock();
+
+    ret = ret
+          && fsynchronizer_collect_sync_files(psynchronizer, &paths)
+          && fsynchronizer_collect_nodes(psynchronizer, &uuids);
+
+    fuuid_t const *nodes = ret ? (fuuid_t const *)fvector_ptr(uuids) : 0;
+    for (size_t i = 0; ret && i < fvector_size(uuids); ++i)
+        ret = fsynchronizer_collect_file_srcs(psynchronizer, &nodes[i], paths, first_file);
+
+    fvector_release(paths);
+    fvector_release(uuids);
+
     if (ret)
     {
         fpush_lock(psynchronizer->mutex);
@@ -274,9 +368,9 @@ static bool fsynchronizer_update_sync_files_list(fsynchronizer_t *psynchronizer)
     return ret;
 }
 
-fsynchronizer_t *fsynchronizer_create(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *uuid, char const *dir)
+fsynchronizer_t *fsynchronizer_create(fmsgbus_t *pmsgbus, fdb_t *db, fdb_shards_t *shards, fuuid_t const *uuid, char const *dir)
 {
-    if (!pmsgbus || !db || !uuid || !dir)
+    if (!pmsgbus || !db || !shards || !uuid || !dir)
     {
         FS_ERR("Invalid arguments");
         return 0;
@@ -303,9 +397,12 @@ fsynchronizer_t *fsynchronizer_create(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t con
     psynchronizer->uuid = *uuid;
     fsynchronizer_msgbus_retain(psynchronizer, pmsgbus);
     psynchronizer->db = fdb_retain(db);
+    psynchronizer->shards = fdb_shards_retain(shards);
+    psynchronizer->local_db = fdb_shard(shards, uuid);
 
     psynchronizer->sync_files = fvector(sizeof(fsynchronizer_file_t), 0, 0);
-    if (!psynchronizer->sync_files)
+    if (!psynchronizer->sync_files
+        || !psynchronizer->local_db)
     {
         fsynchronizer_free(psynchronizer);
         return 0;
@@ -344,46 +441,61 @@ void fsynchronizer_free(fsynchronizer_t *psynchronizer)
         fpop_lock();
 
         fsynchronizer_msgbus_release(psynchronizer);
+        if (psynchronizer->local_db)
+            fdb_release(psynchronizer->local_db);
+        fdb_shards_release(psynchronizer->shards);
         fdb_release(psynchronizer->db);
         memset(psynchronizer, 0, sizeof *psynchronizer);
         free(psynchronizer);
     }
 }
 
+// Files are erased after the transaction, so the lost transaction can be repeated for the same files
 static void fsynchronizer_cleanup_ready_files_info(fsynchronizer_t *psynchronizer)
 {
+    bool is_cleared = false;
+
     fdb_transaction_t transaction = { 0 };
-    if (fdb_transaction_start(psynchronizer->db, &transaction))
+    do
     {
-        fdb_map_t status_map = { 0 };
-        if (fdb_sync_files_statuses(&transaction, &psynchronizer->uuid, &status_map))
+        if (fdb_transaction_start(psynchronizer->local_db, &transaction))
         {
-            fsynchronizer_file_t *sync_files = (fsynchronizer_file_t *)fvector_ptr(psynchronizer->sync_files);
-            size_t sync_files_size = fvector_size(psynchronizer->sync_files);
-
-            for(size_t i = 0; i < sync_files_size;)
+            fdb_map_t status_map = { 0 };
+            if (fdb_sync_files_statuses(&transaction, &psynchronizer->uuid, &status_map))
             {
-                bool const file_is_ready = file_assembler_is_ready(sync_files[i].fassembler);
+                fsynchronizer_file_t const *sync_files = (fsynchronizer_file_t const *)fvector_ptr(psynchronizer->sync_files);
+                size_t const sync_files_size = fvector_size(psynchronizer->sync_files);
 
-                if (file_is_ready)
+                for(size_t i = 0; i < sync_files_size; ++i)
                 {
-                    fdb_data_t const file_id = { sizeof sync_files[i].file_id, &sync_files[i].file_id };
-                    fdb_statuses_map_del(&status_map, &transaction, FFILE_IS_EXIST, &file_id);
-
-                    if (fvector_erase(&psynchronizer->sync_files, i))
-                    {
-                        sync_files = (fsynchronizer_file_t *)fvector_ptr(psynchronizer->sync_files);
-                        sync_files_size = fvector_size(psynchronizer->sync_files);
-                        continue;
-                    }
+                    if (file_assembler_is_ready(sync_files[i].fassembler))
+                        fdb_bitmaps_map_clear(&status_map, &transaction, FFILE_IS_EXIST, sync_files[i].file_id);
                 }
-                ++i;
+
+                is_cleared = fdb_transaction_commit(&transaction);
+                fdb_map_close(&status_map);
             }
+            fdb_transaction_abort(&transaction);
+        }
+    }
+    while (transaction.error == FERR_AGAIN);
 
-            fdb_transaction_commit(&transaction);
-            fdb_map_close(&status_map);
+    if (!is_cleared)
+        return;
+
+    fsynchronizer_file_t *sync_files = (fsynchronizer_file_t *)fvector_ptr(psynchronizer->sync_files);
+    size_t sync_files_size = fvector_size(psynchronizer->sync_files);
+
+    for(size_t i = 0; i < sync_files_size;)
+    {
+        if (file_assembler_is_ready(sync_files[i].fassembler)
+            && fvector_erase(&psynchronizer->sync_files, i))
+        {
+            sync_files = (fsynchronizer_file_t *)fvector_ptr(psynchronizer->sync_files);
+            sync_files_size = fvector_size(psynchronizer->sync_files);
+            continue;
         }
-        fdb_transaction_abort(&transaction);
+        ++i;
     }
 }
 
@@ -3,11 +3,12 @@
 #include <futils/uuid.h>
 #include <futils/msgbus.h>
 #include <fdb/db.h>
+#include <fdb/sync/shards.h>
 #include <stdbool.h>
 
 typedef struct fsynchronizer fsynchronizer_t;
 
-fsynchronizer_t *fsynchronizer_create(fmsgbus_t *pmsgbus, fdb_t *db, fuuid_t const *uuid, char const *dir);
+fsynchronizer_t *fsynchronizer_create(fmsgbus_t *pmsgbus, fdb_t *db, fdb_shards_t *shards, fuuid_t const *uuid, char const *dir);
 void             fsynchronizer_free(fsynchronizer_t *);
 bool             fsynchronizer_update(fsynchronizer_t *);
 
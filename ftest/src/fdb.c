@@ -1,14 +1,24 @@
 #include "test.h"
 #include <fdb/db.h>
 #include <fdb/sync/ids.h>
+#include <fdb/sync/sync_files.h>
+#include <fdb/sync/bitmaps.h>
+#include <fdb/sync/files.h>
+#include <fdb/sync/shards.h>
+#include <fdb/sync/signatures.h>
+#include <fdb/sync/chunks.h>
+#include <fdb/sync/sketches.h>
+#include <fdb/bulk.h>
 #include <futils/utils.h>
+#include <binn.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdio.h>
 
 FTEST_START(fbd_simple)
 {
-    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024);
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
     if (pdb)
     {
         fdb_transaction_t transaction = {0};
@@ -69,7 +79,7 @@ FTEST_END()
 
 FTEST_START(fbd_ids)
 {
-    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024);
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
     if (pdb)
     {
         fdb_transaction_t transaction = {0};
@@ -124,7 +134,794 @@ FTEST_START(fbd_ids)
 }
 FTEST_END()
 
+// Freed ids are reused. Ids which were reserved but weren't used are returned to DB when the DB handler is released.
+FTEST_START(fbd_ids_reuse)
+{
+    remove("test_ids/data.mdb");
+    remove("test_ids/lock.mdb");
+
+    enum { IDS_NUM = 8 };
+    uint32_t ids[IDS_NUM];
+
+    fdb_t *pdb = fdb_open("test_ids", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    FTEST_ASSERT(pdb);
+
+    fdb_transaction_t transaction = {0};
+    fdb_map_t map = {0};
+    FTEST_ASSERT(fdb_transaction_start(pdb, &transaction));
+    FTEST_ASSERT(fdb_ids_map_open(&transaction, "ids", &map));
+    for(uint32_t i = 0; i < IDS_NUM; ++i)
+    {
+        FTEST_ASSERT(fdb_id_generate(&map, &transaction, ids + i));
+        FTEST_ASSERT(ids[i] == i);
+    }
+    FTEST_ASSERT(fdb_transaction_commit(&transaction));
+
+    FTEST_ASSERT(fdb_transaction_start(pdb, &transaction));
+    FTEST_ASSERT(fdb_id_free(&map, &transaction, ids[2]));
+    FTEST_ASSERT(fdb_id_free(&map, &transaction, ids[5]));
+    FTEST_ASSERT(fdb_transaction_commit(&transaction));
+
+    // The reserved block is used first
+    uint32_t id = FINVALID_ID;
+    FTEST_ASSERT(fdb_transaction_start(pdb, &transaction));
+    FTEST_ASSERT(fdb_id_generate(&map, &transaction, &id));
+    FTEST_ASSERT(id == IDS_NUM);
+    FTEST_ASSERT(fdb_transaction_commit(&transaction));
+
+    fdb_map_close(&map);
+    fdb_release(pdb);
+
+    pdb = fdb_open("test_ids", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    FTEST_ASSERT(pdb);
+
+    // Ids of aborted transaction aren't lost
+    FTEST_ASSERT(fdb_transaction_start(pdb, &transaction));
+    FTEST_ASSERT(fdb_ids_map_open(&transaction, "ids", &map));
+    FTEST_ASSERT(fdb_id_generate(&map, &transaction, &id));
+    FTEST_ASSERT(id == ids[2] || id == ids[5]);
+    fdb_transaction_abort(&transaction);
+
+    uint32_t new_ids[3];
+    FTEST_ASSERT(fdb_transaction_start(pdb, &transaction));
+    FTEST_ASSERT(fdb_ids_map_open(&transaction, "ids", &map));
+    for(uint32_t i = 0; i < 3; ++i)
+        FTEST_ASSERT(fdb_id_generate(&map, &transaction, new_ids + i));
+    FTEST_ASSERT(fdb_transaction_commit(&transaction));
+
+    // Freed ids are recycled and the rest of the returned block goes next
+    FTEST_ASSERT(new_ids[0] != new_ids[1]);
+    FTEST_ASSERT(new_ids[0] == ids[2] || new_ids[0] == ids[5]);
+    FTEST_ASSERT(new_ids[1] == ids[2] || new_ids[1] == ids[5]);
+    FTEST_ASSERT(new_ids[2] == IDS_NUM + 1);
+
+    fdb_map_close(&map);
+    fdb_release(pdb);
+}
+FTEST_END()
+
+FTEST_START(fbd_sync_files_tree)
+{
+    fdb_t *pdb = fdb_open("test", 8u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fuuid_t const uuid = FUUID(1, 2, 3);
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &uuid);
+            if (files_map)
+            {
+                char const *paths[] = { "a/b/c.txt", "a/d.txt", "a/b/e/f.txt", "g.txt" };
+                for(int i = 0; i < FARRAY_SIZE(paths); ++i)
+                {
+                    fsync_file_info_t info = { 0 };
+                    info.id = FINVALID_ID;
+                    strncpy(info.path, paths[i], sizeof info.path);
+                    FTEST_ASSERT(fdb_sync_file_add(files_map, &transaction, &info));
+                }
+
+                fsync_file_info_t info = { 0 };
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "a/b/e/f.txt", 11, &info));
+                FTEST_ASSERT(strcmp(info.path, "a/b/e/f.txt") == 0);
+
+                // Paths are normalized
+                fsync_file_info_t win_info = { 0 };
+                win_info.id = FINVALID_ID;
+                strncpy(win_info.path, "\\x\\/y.txt", sizeof win_info.path);
+                FTEST_ASSERT(fdb_sync_file_add(files_map, &transaction, &win_info));
+                FTEST_ASSERT(strcmp(win_info.path, "x/y.txt") == 0);
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "x\\y.txt", 7, &info));
+                FTEST_ASSERT(strcmp(info.path, "x/y.txt") == 0 && info.id == win_info.id);
+                strncpy(win_info.path, "x/", sizeof win_info.path);
+                FTEST_ASSERT(!fdb_sync_file_add(files_map, &transaction, &win_info));
+
+                // All files under 'a/b'
+                int files_num = 0;
+                fdb_sync_files_iterator_t *it = fdb_sync_files_subtree_iterator(files_map, &transaction, "a/b");
+                FTEST_ASSERT(it);
+                for (bool st = fdb_sync_files_iterator_first(it, &info); st; st = fdb_sync_files_iterator_next(it, &info))
+                {
+                    FTEST_ASSERT(strncmp(info.path, "a/b/", 4) == 0);
+                    files_num++;
+                }
+                fdb_sync_files_iterator_free(it);
+                FTEST_ASSERT(files_num == 2);
+
+                // Directory renaming
+                FTEST_ASSERT(fdb_sync_dir_move(files_map, &transaction, "a/b", "h/b"));
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "h/b/c.txt", 9, &info));
+                FTEST_ASSERT(!fdb_sync_file_get_by_path(files_map, &transaction, "a/b/c.txt", 9, &info));
+
+                // The directory isn't moved into own subtree
+                FTEST_ASSERT(!fdb_sync_dir_move(files_map, &transaction, "h", "h/b/e/h"));
+                FTEST_ASSERT(!fdb_sync_dir_move(files_map, &transaction, "h/b", "h/b/n/b"));
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "h/b/e/f.txt", 11, &info));
+                FTEST_ASSERT(strcmp(info.path, "h/b/e/f.txt") == 0);
+
+                // Directory paths are normalized
+                FTEST_ASSERT(fdb_sync_dir_move(files_map, &transaction, "\\h\\b\\e\\", "h//m/"));
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "h/m/f.txt", 9, &info));
+                FTEST_ASSERT(strcmp(info.path, "h/m/f.txt") == 0);
+                FTEST_ASSERT(fdb_sync_dir_move(files_map, &transaction, "h/m", "h/b/e"));
+                FTEST_ASSERT(!fdb_sync_dir_move(files_map, &transaction, "/", "n"));
+
+                // File moving
+                fsync_file_info_t moved_info = { 0 };
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "h/b/c.txt", 9, &moved_info));
+                strncpy(moved_info.path, "k/c.txt", sizeof moved_info.path);
+                FTEST_ASSERT(fdb_sync_file_add(files_map, &transaction, &moved_info));
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "k/c.txt", 7, &info));
+                FTEST_ASSERT(info.id == moved_info.id);
+                FTEST_ASSERT(!fdb_sync_file_get_by_path(files_map, &transaction, "h/b/c.txt", 9, &info));
+
+                // Empty directories are deleted
+                uint32_t dir_id = FINVALID_ID;
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "a/d.txt", 7, &info));
+                FTEST_ASSERT(fdb_sync_file_del(files_map, &transaction, info.id));
+                FTEST_ASSERT(!fdb_sync_dir_id(files_map, &transaction, "a", 1, &dir_id));
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "h/b/e/f.txt", 11, &info));
+                FTEST_ASSERT(fdb_sync_file_del(files_map, &transaction, info.id));
+                FTEST_ASSERT(!fdb_sync_dir_id(files_map, &transaction, "h", 1, &dir_id));
+                FTEST_ASSERT(fdb_sync_dir_id(files_map, &transaction, "k", 1, &dir_id));
+
+                fdb_sync_files_release(files_map);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+// Files of previous versions are stored with full paths
+FTEST_START(fbd_sync_files_migration)
+{
+    fdb_t *pdb = fdb_open("test", 8u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fuuid_t const uuid = FUUID(4, 5, 6);
+        char uuid_str[sizeof(fuuid_t) * 2 + 1];
+        fuuid2str(&uuid, uuid_str, sizeof uuid_str);
+
+        char info_tbl_name[64], path_ids_tbl_name[64];
+        snprintf(info_tbl_name, sizeof info_tbl_name, "%s/sync/file/info", uuid_str);
+        snprintf(path_ids_tbl_name, sizeof path_ids_tbl_name, "%s/sync/file/path/id", uuid_str);
+
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_map_t info_map = { 0 }, path_ids_map = { 0 };
+            FTEST_ASSERT(fdb_map_open(&transaction, info_tbl_name, FDB_MAP_CREATE | FDB_MAP_INTEGERKEY, &info_map));
+            FTEST_ASSERT(fdb_map_open(&transaction, path_ids_tbl_name, FDB_MAP_CREATE, &path_ids_map));
+
+            char const *paths[] = { "a/b/c.txt", "a/d.txt", "g.txt" };
+            for(uint32_t i = 0; i < FARRAY_SIZE(paths); ++i)
+            {
+                binn *obj = binn_object();
+                FTEST_ASSERT(binn_object_set_str(obj, "path", (char *)paths[i]));
+                fmd5_t const digest = { 0 };
+                FTEST_ASSERT(binn_object_set_blob(obj, "digest", (void *)digest.data, sizeof digest.data));
+                FTEST_ASSERT(binn_object_set_uint64(obj, "size", i + 1));
+
+                fdb_data_t const id = { sizeof i, &i };
+                fdb_data_t const info = { binn_size(obj), binn_ptr(obj) };
+                fdb_data_t const path = { strlen(paths[i]), (void *)paths[i] };
+                FTEST_ASSERT(fdb_map_put(&info_map, &transaction, &id, &info));
+                FTEST_ASSERT(fdb_map_put(&path_ids_map, &transaction, &path, &id));
+                binn_free(obj);
+            }
+
+            fdb_map_close(&path_ids_map);
+            fdb_map_close(&info_map);
+
+            fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &uuid);
+            FTEST_ASSERT(files_map);
+
+            for(uint32_t i = 0; i < FARRAY_SIZE(paths); ++i)
+            {
+                fsync_file_info_t info = { 0 };
+                FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, paths[i], strlen(paths[i]), &info));
+                FTEST_ASSERT(info.id == i && info.size == i + 1);
+                FTEST_ASSERT(strcmp(info.path, paths[i]) == 0);
+            }
+
+            fdb_sync_files_release(files_map);
+
+            // The old map is deleted
+            FTEST_ASSERT(!fdb_map_open(&transaction, path_ids_tbl_name, 0, &path_ids_map));
+
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+// The transaction which was lost on the full map is repeated after the map growth
+FTEST_START(fbd_map_full)
+{
+    remove("test_map_full/data.mdb");
+    remove("test_map_full/lock.mdb");
+
+    fdb_t *pdb = fdb_open("test_map_full", 4u, 1u, 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        enum { VALUES_NUM = 1024 };
+        static char const value_data[4096];
+        fdb_data_t const value = { sizeof value_data, (void *)value_data };
+
+        int attempts = 0;
+        fdb_transaction_t transaction = {0};
+        do
+        {
+            ++attempts;
+            if (fdb_transaction_start(pdb, &transaction))
+            {
+                fdb_map_t map = {0};
+                if (fdb_map_open(&transaction, "values", FDB_MAP_CREATE | FDB_MAP_INTEGERKEY, &map))
+                {
+                    bool ret = true;
+                    for(uint32_t i = 0; ret && i < VALUES_NUM; ++i)
+                    {
+                        fdb_data_t const key = { sizeof i, &i };
+                        ret = fdb_map_put(&map, &transaction, &key, &value);
+                    }
+                    if (ret)
+                        fdb_transaction_commit(&transaction);
+                    fdb_map_close(&map);
+                }
+                fdb_transaction_abort(&transaction);
+            }
+        }
+        while (transaction.error == FERR_AGAIN && attempts < 16);
+
+        FTEST_ASSERT(attempts > 1 && transaction.error == FSUCCESS);
+
+        FTEST_ASSERT(fdb_transaction_start(pdb, &transaction));
+
+        fdb_stat_t stat;
+        FTEST_ASSERT(fdb_stat(&transaction, &stat));
+        FTEST_ASSERT(stat.map_size >= VALUES_NUM * sizeof value_data);
+
+        fdb_map_t map = {0};
+        fdb_map_stat_t map_stat;
+        FTEST_ASSERT(fdb_map_open(&transaction, "values", 0, &map));
+        FTEST_ASSERT(fdb_map_stat(&map, &transaction, &map_stat));
+        FTEST_ASSERT(map_stat.entries == VALUES_NUM);
+        fdb_map_close(&map);
+
+        fdb_transaction_abort(&transaction);
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_bitmaps)
+{
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_map_t map = {0};
+            if (fdb_bitmaps_map_open(&transaction, "bitmaps", &map))
+            {
+                enum { IDS_NUM = 10000 };
+
+                // Sparse chunks are stored as arrays and dense chunks as bitmaps
+                for(uint32_t i = 0; i < IDS_NUM; ++i)
+                    FTEST_ASSERT(fdb_bitmaps_map_set(&map, &transaction, 1 << 1, i * 2));
+                FTEST_ASSERT(fdb_bitmaps_map_set(&map, &transaction, 1 << 1 | 1 << 2, 0x10000000));
+
+                for(uint32_t i = 0; i < IDS_NUM; i += 2)
+                    FTEST_ASSERT(fdb_bitmaps_map_clear(&map, &transaction, 1 << 1, i * 2));
+
+                FTEST_ASSERT(fdb_bitmaps_map_test(&map, &transaction, 1 << 1 | 1 << 2, 0x10000000));
+                FTEST_ASSERT(fdb_bitmaps_map_test(&map, &transaction, 1 << 1, 2));
+                FTEST_ASSERT(!fdb_bitmaps_map_test(&map, &transaction, 1 << 1, 4));
+                FTEST_ASSERT(!fdb_bitmaps_map_test(&map, &transaction, 1 << 2, 2));
+
+                fdb_bitmaps_map_iterator_t *it = fdb_bitmaps_map_iterator(&map, &transaction, 1 << 1);
+                FTEST_ASSERT(it);
+
+                uint32_t ids_num = 0;
+                uint32_t id = FINVALID_ID;
+                for (bool st = fdb_bitmaps_map_iterator_first(it, &id); st; st = fdb_bitmaps_map_iterator_next(it, &id))
+                {
+                    FTEST_ASSERT(ids_num < IDS_NUM / 2 ? id == ids_num * 4 + 2 : id == 0x10000000);
+                    ids_num++;
+                }
+                fdb_bitmaps_map_iterator_free(it);
+                FTEST_ASSERT(ids_num == IDS_NUM / 2 + 1);
+
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_cursor_get_multiple)
+{
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_map_t map = {0};
+            if (fdb_map_open(&transaction, "multiple", FDB_MAP_CREATE | FDB_MAP_MULTI | FDB_MAP_FIXED_SIZE_VALUE | FDB_MAP_INTEGERVAL, &map))
+            {
+                enum { IDS_NUM = 10000 };
+
+                char key_data[] = "ids";
+                fdb_data_t key = { sizeof key_data, key_data };
+
+                for(uint32_t i = 0; i < IDS_NUM; ++i)
+                {
+                    fdb_data_t const value = { sizeof i, &i };
+                    FTEST_ASSERT(fdb_map_put(&map, &transaction, &key, &value));
+                }
+
+                fdb_cursor_t cursor;
+                FTEST_ASSERT(fdb_cursor_open(&map, &transaction, &cursor));
+
+                uint32_t ids_num = 0;
+                fdb_data_t values = { 0 };
+                for (bool st = fdb_cursor_get_multiple(&cursor, &key, &values, FDB_SET); st; st = fdb_cursor_get_multiple(&cursor, &key, &values, FDB_NEXT_DUP))
+                {
+                    FTEST_ASSERT(values.size && values.size % sizeof(uint32_t) == 0);
+                    uint32_t const *ids = (uint32_t const *)values.data;
+                    for (size_t i = 0; i < values.size / sizeof(uint32_t); ++i)
+                        FTEST_ASSERT(ids[i] == ids_num++);
+                }
+                FTEST_ASSERT(ids_num == IDS_NUM);
+
+                fdb_cursor_close(&cursor);
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_shards)
+{
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fuuid_t uuid_1, uuid_2;
+        fuuid_gen(&uuid_1);
+        fuuid_gen(&uuid_2);
+
+        fdb_shards_t *shards = fdb_shards(pdb, "test", FDB_SHARDS_PER_NODE, FDB_DURABLE);
+        FTEST_ASSERT(shards);
+
+        fdb_t *db_1 = fdb_shard(shards, &uuid_1);
+        fdb_t *db_2 = fdb_shard(shards, &uuid_2);
+        fdb_t *db_3 = fdb_shard(shards, &uuid_1);
+        FTEST_ASSERT(db_1 && db_2 && db_1 != db_2 && db_1 == db_3 && db_1 != pdb);
+
+        // Transactions of different shards are active at once
+        fdb_transaction_t transaction_1 = {0};
+        fdb_transaction_t transaction_2 = {0};
+        FTEST_ASSERT(fdb_transaction_start(db_1, &transaction_1));
+        FTEST_ASSERT(fdb_transaction_start(db_2, &transaction_2));
+
+        fdb_sync_files_map_t *files_map_1 = fdb_sync_files(&transaction_1, &uuid_1);
+        fdb_sync_files_map_t *files_map_2 = fdb_sync_files(&transaction_2, &uuid_2);
+        FTEST_ASSERT(files_map_1 && files_map_2);
+
+        fsync_file_info_t info = { FINVALID_ID, "dir/file" };
+        FTEST_ASSERT(fdb_sync_file_add(files_map_1, &transaction_1, &info));
+
+        fdb_sync_files_diff_iterator_t *diff = fdb_sync_files_diff_iterator_ex(files_map_1, &transaction_1, files_map_2, &transaction_2);
+        FTEST_ASSERT(diff);
+
+        fdb_diff_kind_t diff_kind;
+        FTEST_ASSERT(fdb_sync_files_diff_iterator_first(diff, &info, &diff_kind));
+        FTEST_ASSERT(diff_kind == FDB_FILE_ABSENT && strcmp(info.path, "dir/file") == 0);
+        FTEST_ASSERT(!fdb_sync_files_diff_iterator_next(diff, &info, &diff_kind));
+        fdb_sync_files_diff_iterator_free(diff);
+
+        fdb_sync_files_release(files_map_1);
+        fdb_sync_files_release(files_map_2);
+        fdb_transaction_abort(&transaction_2);
+        fdb_transaction_abort(&transaction_1);
+
+        fdb_release(db_1);
+        fdb_release(db_2);
+        fdb_release(db_3);
+        fdb_shards_release(shards);
+
+        // Without sharding all nodes use the main DB
+        shards = fdb_shards(pdb, "test", FDB_SHARDS_NONE, FDB_DURABLE);
+        FTEST_ASSERT(shards);
+        db_1 = fdb_shard(shards, &uuid_1);
+        FTEST_ASSERT(db_1 == pdb);
+        fdb_release(db_1);
+        fdb_shards_release(shards);
+
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_bulk_loader)
+{
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_map_t map = {0};
+            if (fdb_map_open(&transaction, "bulk", FDB_MAP_CREATE | FDB_MAP_INTEGERKEY, &map))
+            {
+                enum { KEYS_NUM = 20000 };
+
+                // Small memory limit. Sorted runs are spilled into temporary files.
+                fdb_bulk_loader_t *loader = fdb_bulk_loader(&map, &transaction, 0);
+                FTEST_ASSERT(loader);
+
+                for(uint32_t i = 0; i < KEYS_NUM; ++i)
+                {
+                    uint32_t key = (i * 7919) % KEYS_NUM;
+                    uint64_t value = key;
+                    fdb_data_t const k = { sizeof key, &key };
+                    fdb_data_t const v = { sizeof value, &value };
+                    FTEST_ASSERT(fdb_bulk_loader_add(loader, &k, &v));
+                }
+
+                // The last added value wins
+                uint32_t key = 42;
+                uint64_t value = 4242;
+                fdb_data_t const k = { sizeof key, &key };
+                fdb_data_t const v = { sizeof value, &value };
+                FTEST_ASSERT(fdb_bulk_loader_add(loader, &k, &v));
+
+                FTEST_ASSERT(fdb_bulk_loader_size(loader) == KEYS_NUM + 1);
+                FTEST_ASSERT(fdb_bulk_loader_flush(loader));
+                fdb_bulk_loader_free(loader);
+
+                uint32_t keys_num = 0;
+                fdb_cursor_t cursor = {0};
+                FTEST_ASSERT(fdb_cursor_open(&map, &transaction, &cursor));
+                fdb_data_t ck = {0}, cv = {0};
+                for(bool st = fdb_cursor_get(&cursor, &ck, &cv, FDB_FIRST); st; st = fdb_cursor_get(&cursor, &ck, &cv, FDB_NEXT))
+                {
+                    uint32_t id;
+                    uint64_t val;
+                    memcpy(&id, ck.data, sizeof id);
+                    memcpy(&val, cv.data, sizeof val);
+                    FTEST_ASSERT(id == keys_num);
+                    FTEST_ASSERT(val == (id == 42 ? 4242 : id));
+                    keys_num++;
+                }
+                fdb_cursor_close(&cursor);
+                FTEST_ASSERT(keys_num == KEYS_NUM);
+
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+// The path which is added twice in bulk mode keeps one id
+FTEST_START(fbd_sync_files_bulk)
+{
+    fdb_t *pdb = fdb_open("test", 8u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fuuid_t const uuid = FUUID(7, 8, 9);
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_sync_files_map_t *files_map = fdb_sync_files(&transaction, &uuid);
+            FTEST_ASSERT(files_map);
+            FTEST_ASSERT(fdb_sync_files_is_empty(files_map, &transaction));
+            FTEST_ASSERT(fdb_sync_files_bulk_start(files_map, &transaction));
+
+            char const *paths[] = { "a/b.txt", "c.txt", "a//b.txt", "c.txt" };
+            uint32_t ids[FARRAY_SIZE(paths)];
+            for(int i = 0; i < FARRAY_SIZE(paths); ++i)
+            {
+                fsync_file_info_t info = { 0 };
+                info.id = FINVALID_ID;
+                strncpy(info.path, paths[i], sizeof info.path);
+                FTEST_ASSERT(fdb_sync_file_add(files_map, &transaction, &info));
+                ids[i] = info.id;
+            }
+            FTEST_ASSERT(ids[0] == ids[2] && ids[1] == ids[3] && ids[0] != ids[1]);
+
+            fsync_file_info_t info = { 0 };
+            info.id = FINVALID_ID;
+            strncpy(info.path, "d.txt", sizeof info.path);
+            FTEST_ASSERT(fdb_sync_file_add_unique(files_map, &transaction, &info));
+            info.id = FINVALID_ID;
+            FTEST_ASSERT(!fdb_sync_file_add_unique(files_map, &transaction, &info));
+
+            FTEST_ASSERT(fdb_sync_files_bulk_finish(files_map));
+            FTEST_ASSERT(!fdb_sync_files_is_empty(files_map, &transaction));
+
+            int files_num = 0;
+            fdb_sync_files_iterator_t *it = fdb_sync_files_iterator(files_map, &transaction);
+            FTEST_ASSERT(it);
+            for (bool st = fdb_sync_files_iterator_first(it, &info); st; st = fdb_sync_files_iterator_next(it, &info))
+                files_num++;
+            fdb_sync_files_iterator_free(it);
+            FTEST_ASSERT(files_num == 3);
+
+            FTEST_ASSERT(fdb_sync_file_get_by_path(files_map, &transaction, "a/b.txt", 7, &info));
+            FTEST_ASSERT(info.id == ids[0]);
+
+            fdb_sync_files_release(files_map);
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_files_find)
+{
+    fdb_t *pdb = fdb_open("test", 8u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fuuid_t uuid;
+            fuuid_gen(&uuid);
+
+            fdb_files_t *files = fdb_files(&transaction, &uuid);
+            if (files)
+            {
+                ffile_info_t infos[] =
+                {
+                    { "docs/report.txt", 1 },
+                    { "docs/report.doc", 2 },
+                    { "src/main.c", 3 },
+                    { "src/report/main.c", 4 }
+                };
+
+                FTEST_ASSERT(fdb_files_add_all(files, &transaction, infos, 3));
+                FTEST_ASSERT(fdb_files_add(files, &transaction, &infos[3]));
+                FTEST_ASSERT(fdb_files_add(files, &transaction, &infos[0]));
+
+                FTEST_ASSERT(fdb_files_find(files, &transaction, "main.c"));
+                FTEST_ASSERT(fdb_files_find(files, &transaction, "docs/*.doc"));
+                FTEST_ASSERT(fdb_files_find(files, &transaction, "c/m"));
+                FTEST_ASSERT(!fdb_files_find(files, &transaction, "src/*.txt"));
+                FTEST_ASSERT(!fdb_files_find(files, &transaction, "repo.txt"));
+
+                uint32_t found_num = 0;
+                ffile_info_t info;
+                fdb_files_iterator_t *it = fdb_files_find_iterator(files, &transaction, "report");
+                FTEST_ASSERT(it);
+                for (bool st = fdb_files_iterator_first(it, &info); st; st = fdb_files_iterator_next(it, &info))
+                {
+                    FTEST_ASSERT(strstr(info.path, "report"));
+                    found_num++;
+                }
+                fdb_files_iterator_free(it);
+                FTEST_ASSERT(found_num == 3);
+
+                fdb_files_release(files);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_signatures)
+{
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fdb_signature_key_t key = { "dir/file", 42, 1000, { { 1, 2, 3 } }, 2048, 8 };
+        static char const SIGNATURE[] = "signature";
+
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_map_t map = {0};
+            if (fdb_signatures_map_open(&transaction, &map))
+            {
+                FTEST_ASSERT(fdb_signature_put(&map, &transaction, &key, SIGNATURE, sizeof SIGNATURE));
+
+                fdb_data_t signature = {0};
+                FTEST_ASSERT(fdb_signature_get(&map, &transaction, &key, &signature));
+                FTEST_ASSERT(signature.size == sizeof SIGNATURE && memcmp(signature.data, SIGNATURE, sizeof SIGNATURE) == 0);
+
+                // Modified file
+                fdb_signature_key_t modified_key = key;
+                modified_key.mod_time++;
+                FTEST_ASSERT(!fdb_signature_get(&map, &transaction, &modified_key, &signature));
+
+                // Other block length
+                modified_key = key;
+                modified_key.block_len = 4096;
+                FTEST_ASSERT(!fdb_signature_get(&map, &transaction, &modified_key, &signature));
+
+                FTEST_ASSERT(fdb_signature_del(&map, &transaction, key.path));
+                FTEST_ASSERT(!fdb_signature_get(&map, &transaction, &key, &signature));
+
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_remote_signatures)
+{
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fuuid_t const peer = FUUID(1, 2, 3);
+        fuuid_t const other_peer = FUUID(3, 2, 1);
+        fdb_remote_signature_key_t const key = { "dir/file", { { 1, 2, 3 } } };
+        static char const SIGNATURE[] = "signature";
+
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_map_t map = {0}, other_map = {0};
+            if (fdb_remote_signatures_map_open(&transaction, &peer, &map)
+                && fdb_remote_signatures_map_open(&transaction, &other_peer, &other_map))
+            {
+                FTEST_ASSERT(fdb_remote_signature_put(&map, &transaction, &key, SIGNATURE, sizeof SIGNATURE));
+
+                fdb_remote_signature_key_t found = { "dir/file" };
+                fdb_data_t signature = {0};
+                FTEST_ASSERT(fdb_remote_signature_get(&map, &transaction, &found, &signature));
+                FTEST_ASSERT(memcmp(&found.digest, &key.digest, sizeof key.digest) == 0);
+                FTEST_ASSERT(signature.size == sizeof SIGNATURE && memcmp(signature.data, SIGNATURE, sizeof SIGNATURE) == 0);
+
+                // Signatures of other peer
+                FTEST_ASSERT(!fdb_remote_signature_get(&other_map, &transaction, &found, 0));
+
+                fdb_map_close(&other_map);
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_chunks)
+{
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fmd5_t const digest = { { 1, 2, 3 } };
+        fmd5_t const unknown_digest = { { 3, 2, 1 } };
+        fdb_chunk_location_t const location = { "dir/file", 65536, 4096 };
+
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_map_t map = {0};
+            if (fdb_chunks_map_open(&transaction, &map))
+            {
+                FTEST_ASSERT(fdb_chunk_put(&map, &transaction, &digest, &location));
+
+                fdb_chunk_location_t found = {0};
+                FTEST_ASSERT(fdb_chunk_get(&map, &transaction, &digest, &found));
+                FTEST_ASSERT(strcmp(found.path, location.path) == 0
+                             && found.offset == location.offset
+                             && found.size == location.size);
+
+                FTEST_ASSERT(!fdb_chunk_get(&map, &transaction, &unknown_digest, &found));
+
+                fdb_map_close(&map);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
+FTEST_START(fbd_sketches)
+{
+    fdb_t *pdb = fdb_open("test", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);
+    if (pdb)
+    {
+        fdb_sketch_t original, edited, other;
+        for (uint64_t i = 0; i < FSYNC_SKETCH_SIZE; ++i)
+        {
+            original.hashes[i] = i + 1;
+            edited.hashes[i] = i < 24 ? i + 1 : i + 100;
+            other.hashes[i] = i + 200;
+        }
+
+        FTEST_ASSERT(fdb_sketch_similarity(&original, &original) == 100);
+        FTEST_ASSERT(fdb_sketch_similarity(&original, &edited) == 75);
+        FTEST_ASSERT(fdb_sketch_similarity(&original, &other) == 0);
+
+        fdb_transaction_t transaction = {0};
+        if (fdb_transaction_start(pdb, &transaction))
+        {
+            fdb_sketches_t sketches;
+            if (fdb_sketches_open(&transaction, &sketches))
+            {
+                FTEST_ASSERT(fdb_sketch_put(&sketches, &transaction, "dir/original", &original));
+                FTEST_ASSERT(fdb_sketch_put(&sketches, &transaction, "dir/other", &other));
+
+                char path[FMAX_PATH];
+                uint32_t similarity = 0;
+                FTEST_ASSERT(fdb_sketch_find(&sketches, &transaction, &edited, path, sizeof path, &similarity));
+                FTEST_ASSERT(strcmp(path, "dir/original") == 0 && similarity == 75);
+
+                // Features of the previous sketch are removed
+                FTEST_ASSERT(fdb_sketch_put(&sketches, &transaction, "dir/original", &other));
+                FTEST_ASSERT(!fdb_sketch_find(&sketches, &transaction, &edited, path, sizeof path, &similarity));
+
+                FTEST_ASSERT(fdb_sketch_del(&sketches, &transaction, "dir/original"));
+                FTEST_ASSERT(fdb_sketch_find(&sketches, &transaction, &other, path, sizeof path, &similarity));
+                FTEST_ASSERT(strcmp(path, "dir/other") == 0 && similarity == 100);
+
+                fdb_sketches_close(&sketches);
+            }
+            fdb_transaction_abort(&transaction);
+        }
+        fdb_release(pdb);
+    }
+}
+FTEST_END()
+
 FUNIT_TEST_START(fbd)
     FTEST(fbd_simple);
     FTEST(fbd_ids);
+    FTEST(fbd_ids_reuse);
+    FTEST(fbd_sync_files_tree);
+    FTEST(fbd_sync_files_migration);
+    FTEST(fbd_map_full);
+    FTEST(fbd_bitmaps);
+    FTEST(fbd_cursor_get_multiple);
+    FTEST(fbd_bulk_loader);
+    FTEST(fbd_sync_files_bulk);
+    FTEST(fbd_files_find);
+    FTEST(fbd_shards);
+    FTEST(fbd_signatures);
+    FTEST(fbd_remote_signatures);
+    FTEST(fbd_chunks);
+    FTEST(fbd_sketches);
 FUNIT_TEST_END()
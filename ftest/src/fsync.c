@@ -1,12 +1,23 @@
 #include "test.h"
 #include "../../fsync/src/rsync.h"
+#include "../../fsync/src/rsync_match.h"
 #include "../../fsync/src/rstream.h"
 #include "../../fsync/src/sync_engine.h"
+#include "../../fsync/src/cdc.h"
+#include "../../fsync/src/cdc_sync_agent.h"
+#include <fdb/sync/sketches.h>
 #include <futils/stream.h>
 #include <futils/msgbus.h>
+#include <futils/utils.h>
+#include <futils/fs.h>
 #include <fcommon/limits.h>
+#include <fcommon/messages.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include <time.h>
 
@@ -190,6 +201,420 @@ FTEST_START(frsync_algorithm)
 }
 FTEST_END()
 
+static void frsync_random_data(char *data, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (char)(seed >> 16);
+    }
+}
+
+// Rollsum of librsync (ROLLSUM_CHAR_OFFSET is 31)
+static uint32_t frsync_rollsum_ref(uint8_t const *data, size_t size)
+{
+    uint32_t s1 = 0, s2 = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        s1 += data[i] + 31;
+        s2 += s1;
+    }
+    return (s2 << 16) | (s1 & 0xFFFF);
+}
+
+// The vectorized sums are compared with the scalar ones for unaligned data and tails of all lengths
+FTEST_START(frsync_rollsum)
+{
+    size_t const size = 64 * 1024 + 100;
+    char *data = malloc(size);                                                          FTEST_ASSERT(data);
+    frsync_random_data(data, size, 0x12345678);
+
+    for (size_t offset = 0; offset < 32; ++offset)
+    {
+        for (size_t len = 0; len <= 300; ++len)
+            FTEST_ASSERT(frsync_rollsum(data + offset, len) == frsync_rollsum_ref((uint8_t const *)data + offset, len));
+    }
+
+    // Sums of long blocks wrap around
+    memset(data, 0xFF, size);
+    FTEST_ASSERT(frsync_rollsum(data + 1, size - 32) == frsync_rollsum_ref((uint8_t const *)data + 1, size - 32));
+
+    free(data);
+}
+FTEST_END()
+
+static fmem_iostream_t *frsync_signature_calculate_by(uint32_t workers_num, uint32_t block_len, uint32_t strong_len, char const *data, size_t size)
+{
+    fmem_iostream_t *piostream = fmem_iostream(FMEM_BLOCK_SIZE);
+    fistream_t *pdata_stream = fmem_const_istream(data, size);
+    fostream_t *postream = fmem_ostream(piostream);
+
+    frsync_signature_calculator_t *psig_calc = frsync_signature_calculator_create_ex(workers_num, block_len, strong_len);
+    ferr_t rc = frsync_signature_calculate(psig_calc, pdata_stream, postream);
+    frsync_signature_calculator_release(psig_calc);
+
+    postream->release(postream);
+    pdata_stream->release(pdata_stream);
+
+    if (rc != FSUCCESS)
+    {
+        fmem_iostream_release(piostream);
+        return 0;
+    }
+
+    return piostream;
+}
+
+// Memory iostream doesn't report the end of data, so the data is copied for the constant istream
+static size_t frsync_mem_read(fmem_iostream_t *piostream, char *buf, size_t size)
+{
+    fistream_t *pistream = fmem_istream(piostream);
+    size = pistream->read(pistream, buf, size);
+    pistream->release(pistream);
+    return size;
+}
+
+FTEST_START(frsync_parallel_signature)
+{
+    // The data doesn't fit to one segment and the tail isn't aligned to block length
+    size_t const size = 2 * 16 * 1024 * 1024 + 5000;
+    char *data = malloc(size);                                                          FTEST_ASSERT(data);
+
+    frsync_random_data(data, size, 0x12345678);
+
+    fmem_iostream_t *pserial = frsync_signature_calculate_by(1, 0, 0, data, size);     FTEST_ASSERT(pserial);
+    fmem_iostream_t *pparallel = frsync_signature_calculate_by(4, 0, 0, data, size);   FTEST_ASSERT(pparallel);
+
+    fistream_t *pserial_istream = fmem_istream(pserial);
+    fistream_t *pparallel_istream = fmem_istream(pparallel);
+
+    char serial_buf[4096], parallel_buf[4096];
+    size_t serial_size, parallel_size, total_size = 0;
+
+    do
+    {
+        serial_size = pserial_istream->read(pserial_istream, serial_buf, sizeof serial_buf);
+        parallel_size = pparallel_istream->read(pparallel_istream, parallel_buf, sizeof parallel_buf);
+        FTEST_ASSERT(serial_size == parallel_size);
+        FTEST_ASSERT(memcmp(serial_buf, parallel_buf, serial_size) == 0);
+        total_size += serial_size;
+    }
+    while (serial_size);
+
+    FTEST_ASSERT(total_size > 0);
+
+    pparallel_istream->release(pparallel_istream);
+    pserial_istream->release(pserial_istream);
+    fmem_iostream_release(pparallel);
+    fmem_iostream_release(pserial);
+    free(data);
+}
+FTEST_END()
+
+// Input which is received in parts. The status is OK while the rest of data isn't received.
+typedef struct
+{
+    fistream_t  stream;
+    char const *data;
+    size_t      size;                   // size of the received data
+    size_t      total_size;
+    size_t      offset;
+} fpartial_istream_t;
+
+static fistream_t* fpartial_istream_retain(fistream_t *p) { return p; }
+static void        fpartial_istream_release(fistream_t *p) { (void)p; }
+static bool        fpartial_istream_seek(fistream_t *p, size_t o) { (void)p; (void)o; return false; }
+
+static size_t fpartial_istream_read(fistream_t *stream, char *data, size_t size)
+{
+    fpartial_istream_t *pstream = (fpartial_istream_t *)stream;
+    if (size > pstream->size - pstream->offset)
+        size = pstream->size - pstream->offset;
+    memcpy(data, pstream->data + pstream->offset, size);
+    pstream->offset += size;
+    return size;
+}
+
+static fstream_status_t fpartial_istream_status(fistream_t *stream)
+{
+    fpartial_istream_t *pstream = (fpartial_istream_t *)stream;
+    return pstream->offset < pstream->total_size ? FSTREAM_STATUS_OK : FSTREAM_STATUS_EOF;
+}
+
+static void fpartial_istream_init(fpartial_istream_t *pstream, char const *data, size_t size)
+{
+    memset(pstream, 0, sizeof *pstream);
+    pstream->stream.retain = fpartial_istream_retain;
+    pstream->stream.release = fpartial_istream_release;
+    pstream->stream.read = fpartial_istream_read;
+    pstream->stream.seek = fpartial_istream_seek;
+    pstream->stream.status = fpartial_istream_status;
+    pstream->data = data;
+    pstream->total_size = size;
+}
+
+static void fpartial_istream_receive(fpartial_istream_t *pstream, size_t size)
+{
+    pstream->size = pstream->total_size - pstream->size > size ? pstream->size + size : pstream->total_size;
+}
+
+static ferr_t frsync_signature_load_by(frsync_signature_t *psig, char const *sig, size_t size, size_t part_size)
+{
+    if (!part_size)
+    {
+        fistream_t *psignature_istream = fmem_const_istream(sig, size);
+        ferr_t const rc = frsync_signature_load(psig, psignature_istream);
+        psignature_istream->release(psignature_istream);
+        return rc;
+    }
+
+    // Signature loading waits the rest of signature
+    fpartial_istream_t sig_istream;
+    fpartial_istream_init(&sig_istream, sig, size);
+
+    ferr_t rc;
+    do
+    {
+        fpartial_istream_receive(&sig_istream, part_size);
+        rc = frsync_signature_load(psig, &sig_istream.stream);
+    }
+    while (rc == FERR_AGAIN);
+
+    return sig_istream.size == size ? rc : FFAIL;
+}
+
+static ferr_t frsync_delta_apply_by(frsync_delta_t *pdelta, char const *delta, size_t size, size_t part_size, fostream_t *pnew_ostream)
+{
+    if (!part_size)
+    {
+        fistream_t *pdelta_istream = fmem_const_istream(delta, size);
+        ferr_t const rc = frsync_delta_apply(pdelta, pdelta_istream, pnew_ostream);
+        pdelta_istream->release(pdelta_istream);
+        return rc;
+    }
+
+    // Delta applying waits the rest of delta
+    fpartial_istream_t delta_istream;
+    fpartial_istream_init(&delta_istream, delta, size);
+
+    ferr_t rc;
+    do
+    {
+        fpartial_istream_receive(&delta_istream, part_size);
+        rc = frsync_delta_apply(pdelta, &delta_istream.stream, pnew_ostream);
+    }
+    while (rc == FERR_AGAIN);
+
+    return delta_istream.size == size ? rc : FFAIL;
+}
+
+typedef struct
+{
+    frsync_backend_t    backend;        // backend of delta calculation
+    uint32_t            workers_num;    // 0 - number of CPUs
+    uint32_t            block_len;      // 0 - default block length
+    uint32_t            strong_len;     // 0 - full strong sum
+    size_t              part_size;      // signature and delta are received by parts, 0 - at once
+} frsync_round_trip_t;
+
+/*
+ * The signature of base is calculated by librsync, the delta of data is calculated by the backend
+ * and applied to base by librsync. The new data should be equal to data.
+ */
+static bool frsync_round_trip(frsync_round_trip_t const *args, char const *base, size_t base_size, char const *data, size_t size, size_t *delta_size)
+{
+    size_t const buf_size = size + 1024 * 1024;
+    char *sig = malloc(buf_size);
+    char *delta = malloc(buf_size);
+    char *new_data = malloc(buf_size);
+
+    fmem_iostream_t *psignature = frsync_signature_calculate_by(args->workers_num, args->block_len, args->strong_len, base, base_size);
+    size_t const sig_size = psignature ? frsync_mem_read(psignature, sig, buf_size) : 0;
+
+    frsync_signature_t *psig = frsync_signature_create_ex(args->backend);
+    bool ret = sig_size && sig_size < buf_size
+               && frsync_signature_load_by(psig, sig, sig_size, args->part_size) == FSUCCESS;
+
+    // Delta calculation
+    fmem_iostream_t *pdelta_iostream = fmem_iostream(FMEM_BLOCK_SIZE);
+    if (ret)
+    {
+        fostream_t *pdelta_ostream = fmem_ostream(pdelta_iostream);
+        fistream_t *pdata_stream = fmem_const_istream(data, size);
+
+        frsync_delta_calculator_t *pdelta_calc = frsync_delta_calculator_create_ex(psig, args->workers_num);
+        ret = frsync_delta_calculate(pdelta_calc, pdata_stream, pdelta_ostream) == FSUCCESS;
+        frsync_delta_calculator_release(pdelta_calc);
+
+        pdata_stream->release(pdata_stream);
+        pdelta_ostream->release(pdelta_ostream);
+    }
+
+    // Delta apply
+    *delta_size = ret ? frsync_mem_read(pdelta_iostream, delta, buf_size) : 0;
+    fmem_iostream_t *pnew_iostream = fmem_iostream(FMEM_BLOCK_SIZE);
+    if (ret)
+    {
+        fistream_t *pbase_stream = fmem_const_istream(base, base_size);
+        fostream_t *pnew_ostream = fmem_ostream(pnew_iostream);
+
+        frsync_delta_t *pdelta = frsync_delta_create(pbase_stream);
+        ret = *delta_size && *delta_size < buf_size
+              && frsync_delta_apply_by(pdelta, delta, *delta_size, args->part_size, pnew_ostream) == FSUCCESS;
+        frsync_delta_release(pdelta);
+
+        pnew_ostream->release(pnew_ostream);
+        pbase_stream->release(pbase_stream);
+    }
+
+    ret = ret
+          && frsync_mem_read(pnew_iostream, new_data, buf_size) == size
+          && memcmp(new_data, data, size) == 0;
+
+    fmem_iostream_release(pnew_iostream);
+    fmem_iostream_release(pdelta_iostream);
+    frsync_signature_release(psig);
+    if (psignature)
+        fmem_iostream_release(psignature);
+    free(new_data);
+    free(delta);
+    free(sig);
+
+    return ret;
+}
+
+FTEST_START(frsync_parallel_delta)
+{
+    size_t const base_size = 2 * 16 * 1024 * 1024 + 5000;
+    size_t const insert_size = 777;
+    size_t const insert_pos = 16 * 1024 * 1024 - 1000;                                 // Near the segments boundary
+    size_t const size = base_size + insert_size;
+
+    char *base = malloc(base_size);                                                     FTEST_ASSERT(base);
+    char *data = malloc(size);                                                          FTEST_ASSERT(data);
+
+    frsync_random_data(base, base_size, 0x12345678);
+
+    memcpy(data, base, insert_pos);
+    frsync_random_data(data + insert_pos, insert_size, 0x87654321);
+    memcpy(data + insert_pos + insert_size, base + insert_pos, base_size - insert_pos);
+    memset(data + size / 2, 0, 100);
+
+    // Block length isn't a divisor of the segment size
+    frsync_round_trip_t args = { FRSYNC_BACKEND_LIBRSYNC, 4 };
+    frsync_signature_args(base_size, &args.block_len, &args.strong_len);                FTEST_ASSERT(args.block_len > 2048 && args.strong_len < 32);
+
+    size_t delta_size = 0;
+    FTEST_ASSERT(frsync_round_trip(&args, base, base_size, data, size, &delta_size));
+
+    free(data);
+    free(base);
+}
+FTEST_END()
+
+FTEST_START(frsync_native_delta)
+{
+    size_t const base_size = 16 * 1024 * 1024 + 5000;
+    size_t const size = base_size + 1000;
+
+    char *base = malloc(base_size);                                                     FTEST_ASSERT(base);
+    char *data = malloc(size);                                                          FTEST_ASSERT(data);
+
+    frsync_random_data(base, base_size, 0x12345678);
+
+    // Shifted data, changed block and the short tail block
+    frsync_random_data(data, 1000, 0x87654321);
+    memcpy(data + 1000, base, base_size);
+    memset(data + size / 2, 0, 100);
+
+    frsync_round_trip_t args = { FRSYNC_BACKEND_NATIVE, 4 };
+    frsync_signature_args(base_size, &args.block_len, &args.strong_len);
+
+    size_t delta_size = 0;
+    FTEST_ASSERT(frsync_round_trip(&args, base, base_size, data, size, &delta_size));
+    FTEST_ASSERT(delta_size < size / 2);
+
+    free(data);
+    free(base);
+}
+FTEST_END()
+
+FTEST_START(frsync_native_block_len)
+{
+    size_t const size = 2 * 1024 * 1024;
+
+    char *base = malloc(size);                                                          FTEST_ASSERT(base);
+    char *data = malloc(size);                                                          FTEST_ASSERT(data);
+
+    frsync_random_data(base, size, 0x12345678);
+    memcpy(data, base, size);
+    memset(data + size / 2, 0, 100);
+
+    // The longest supported block is matched by the native backend
+    frsync_round_trip_t args = { FRSYNC_BACKEND_NATIVE, 1, 128 * 1024 };
+    size_t delta_size = 0;
+    FTEST_ASSERT(frsync_round_trip(&args, base, size, data, size, &delta_size));
+    FTEST_ASSERT(delta_size < size / 2);
+
+    // The signature with longer blocks is loaded by librsync
+    args.block_len = 256 * 1024;
+    FTEST_ASSERT(frsync_round_trip(&args, base, size, data, size, &delta_size));
+
+    free(data);
+    free(base);
+}
+FTEST_END()
+
+FTEST_START(frsync_partial_input)
+{
+    size_t const size = 1024 * 1024;
+
+    char *base = malloc(size);                                                          FTEST_ASSERT(base);
+    char *data = malloc(size);                                                          FTEST_ASSERT(data);
+
+    frsync_random_data(base, size, 0x12345678);
+    memcpy(data, base, size);
+    memset(data + size / 2, 0, 100);
+
+    frsync_backend_t const backends[] = { FRSYNC_BACKEND_LIBRSYNC, FRSYNC_BACKEND_NATIVE };
+
+    for (size_t i = 0; i < sizeof backends / sizeof *backends; ++i)
+    {
+        frsync_round_trip_t const args = { backends[i], 1, 0, 0, 1000 };
+        size_t delta_size = 0;
+        FTEST_ASSERT(frsync_round_trip(&args, base, size, data, size, &delta_size));
+    }
+
+    free(data);
+    free(base);
+}
+FTEST_END()
+
+// Segments are read by seek, so the input which can't be seeked isn't taken as empty
+FTEST_START(frsync_seek_fail)
+{
+    size_t const size = 2 * 16 * 1024 * 1024 + 5000;
+    char *data = malloc(size);                                                          FTEST_ASSERT(data);
+    frsync_random_data(data, size, 0x12345678);
+
+    fpartial_istream_t data_istream;
+    fpartial_istream_init(&data_istream, data, size);
+    fpartial_istream_receive(&data_istream, size);
+
+    fmem_iostream_t *piostream = fmem_iostream(FMEM_BLOCK_SIZE);
+    fostream_t *postream = fmem_ostream(piostream);
+
+    frsync_signature_calculator_t *psig_calc = frsync_signature_calculator_create_ex(4, 0, 0);  FTEST_ASSERT(psig_calc);
+    ferr_t rc = frsync_signature_calculate(psig_calc, &data_istream.stream, postream);
+    FTEST_ASSERT(rc != FSUCCESS);
+    frsync_signature_calculator_release(psig_calc);
+
+    postream->release(postream);
+    fmem_iostream_release(piostream);
+    free(data);
+}
+FTEST_END()
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // rstream test
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -260,6 +685,207 @@ FTEST_START(frstream_fail)
 }
 FTEST_END()
 
+static void fristream_opposite_agent(void *ptr, fistream_t *pstream, frstream_info_t const *info)
+{
+    fistream_t **ppistream = (fistream_t **)ptr;
+    *ppistream = pstream->retain(pstream);
+}
+
+// Two peers stream to each other. Both streams have the same id.
+FTEST_START(frstream_opposite)
+{
+    ferr_t rc;
+    (void)rc;
+
+    static fuuid_t const uuid1 = FUUID(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    static fuuid_t const uuid2 = FUUID(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    frstream_factory_t *factory1 = frstream_factory(msgbus, &uuid1);                        FTEST_ASSERT(factory1 != 0);
+    frstream_factory_t *factory2 = frstream_factory(msgbus, &uuid2);                        FTEST_ASSERT(factory2 != 0);
+
+    if (factory1 && factory2)
+    {
+        fistream_t * volatile pistream1 = 0;
+        fistream_t * volatile pistream2 = 0;
+
+        rc = frstream_factory_istream_subscribe(factory1, fristream_opposite_agent, (void*)&pistream1);  FTEST_ASSERT(rc == FSUCCESS);
+        rc = frstream_factory_istream_subscribe(factory2, fristream_opposite_agent, (void*)&pistream2);  FTEST_ASSERT(rc == FSUCCESS);
+
+        fostream_t *postream1 = frstream_factory_stream(factory1, &uuid2, 0);              FTEST_ASSERT(postream1 != 0);
+        fostream_t *postream2 = frstream_factory_stream(factory2, &uuid1, 0);              FTEST_ASSERT(postream2 != 0);
+
+        for(int i = 0; i < 10 && (!pistream1 || !pistream2); ++i)
+        {
+            static struct timespec const F1_SEC = { 1, 0 };
+            nanosleep(&F1_SEC, NULL);
+        }
+        FTEST_ASSERT(pistream1 && pistream2);
+
+        if (postream1 && postream2 && pistream1 && pistream2)
+        {
+            // Closing of the stream from peer2 to peer1 mustn't close the stream from peer1 to peer2
+            postream2->release(postream2);
+            postream2 = 0;
+
+            static struct timespec const F100_MSEC = { 0, 100000000 };
+            nanosleep(&F100_MSEC, NULL);
+
+            size_t written = postream1->write(postream1, FDATA, sizeof FDATA);             FTEST_ASSERT(written == sizeof FDATA);
+            (void)written;
+
+            char tmp[sizeof FDATA] = { 0 };
+            size_t read_size = pistream2->read(pistream2, tmp, sizeof tmp);
+            FTEST_ASSERT(read_size == sizeof tmp);
+            FTEST_ASSERT(memcmp(FDATA, tmp, sizeof FDATA) == 0);
+            (void)read_size;
+        }
+
+        rc = frstream_factory_istream_unsubscribe(factory1, fristream_opposite_agent);      FTEST_ASSERT(rc == FSUCCESS);
+        rc = frstream_factory_istream_unsubscribe(factory2, fristream_opposite_agent);      FTEST_ASSERT(rc == FSUCCESS);
+        if (pistream1) pistream1->release(pistream1);
+        if (pistream2) pistream2->release(pistream2);
+        if (postream1) postream1->release(postream1);
+        if (postream2) postream2->release(postream2);
+    }
+
+    if (factory1) frstream_factory_release(factory1);
+    if (factory2) frstream_factory_release(factory2);
+}
+FTEST_END()
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// cdc test
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+typedef struct
+{
+    size_t          num;
+    uint64_t        size;
+    fcdc_chunk_t    chunks[256];
+} fcdc_chunks_list_t;
+
+static bool fcdc_chunks_list_add(fcdc_chunks_list_t *list, uint64_t offset, fcdc_chunk_t const *chunk)
+{
+    if (list->num >= FARRAY_SIZE(list->chunks) || offset != list->size)
+        return false;
+    list->chunks[list->num++] = *chunk;
+    list->size += chunk->size;
+    return true;
+}
+
+static size_t fcdc_chunks_list_common(fcdc_chunks_list_t const *lhs, fcdc_chunks_list_t const *rhs)
+{
+    size_t num = 0;
+    for (size_t i = 0; i < lhs->num; ++i)
+    {
+        for (size_t j = 0; j < rhs->num; ++j)
+        {
+            if (memcmp(&lhs->chunks[i].digest, &rhs->chunks[j].digest, sizeof(fmd5_t)) == 0)
+            {
+                num++;
+                break;
+            }
+        }
+    }
+    return num;
+}
+
+FTEST_START(fcdc_chunking)
+{
+    size_t const size = 4 * 1024 * 1024;
+    char *data = malloc(size + 1);
+    FTEST_ASSERT(data);
+
+    if (data)
+    {
+        uint32_t rnd = 42;
+        for (size_t i = 0; i < size; ++i)
+        {
+            rnd = rnd * 1103515245 + 12345;
+            data[i] = (char)(rnd >> 16);
+        }
+
+        static fcdc_chunks_list_t list, modified_list;
+
+        fistream_t *pistream = fmem_const_istream(data, size);
+        FTEST_ASSERT(pistream && fcdc_chunks(pistream, (fcdc_chunk_handler_t)fcdc_chunks_list_add, &list));
+        FTEST_ASSERT(list.size == size);
+
+        for (size_t i = 0; i + 1 < list.num; ++i)
+            FTEST_ASSERT(list.chunks[i].size >= FCDC_CHUNK_MIN && list.chunks[i].size <= FCDC_CHUNK_MAX);
+
+        // One byte is inserted. Only the chunk around it is changed.
+        memmove(data + size / 2 + 1, data + size / 2, size - size / 2);
+        data[size / 2] = 'x';
+
+        fistream_t *pmodified_istream = fmem_const_istream(data, size + 1);
+        FTEST_ASSERT(pmodified_istream && fcdc_chunks(pmodified_istream, (fcdc_chunk_handler_t)fcdc_chunks_list_add, &modified_list));
+        FTEST_ASSERT(modified_list.size == size + 1);
+        FTEST_ASSERT(fcdc_chunks_list_common(&modified_list, &list) + 2 >= list.num);
+
+        if (pistream)
+            pistream->release(pistream);
+        if (pmodified_istream)
+            pmodified_istream->release(pmodified_istream);
+        free(data);
+    }
+}
+FTEST_END()
+
+FTEST_START(fcdc_sketch)
+{
+    size_t const size = 1024 * 1024;
+    char *data = malloc(size);
+    char *other = malloc(size);
+    FTEST_ASSERT(data && other);
+
+    if (data && other)
+    {
+        uint32_t rnd = 42;
+        for (size_t i = 0; i < size; ++i)
+        {
+            rnd = rnd * 1103515245 + 12345;
+            data[i] = (char)(rnd >> 16);
+            other[i] = (char)(rnd >> 8);
+        }
+
+        fdb_sketch_t original, edited, unrelated;
+
+        fcdc_sketch_t sketch;
+        fistream_t *pistream = fmem_const_istream(data, size);
+        FTEST_ASSERT(pistream && fcdc_sketch_calculate(pistream, &sketch));
+        memcpy(original.hashes, sketch.hashes, sizeof original.hashes);
+
+        // Sketch doesn't depend on the data splitting
+        fcdc_sketch_init(&sketch);
+        fcdc_sketch_update(&sketch, data, 12345);
+        fcdc_sketch_update(&sketch, data + 12345, size - 12345);
+        FTEST_ASSERT(memcmp(original.hashes, sketch.hashes, sizeof original.hashes) == 0);
+
+        // Some bytes are changed
+        for (size_t i = 0; i < 8; ++i)
+            memset(data + i * size / 8, 'x', 100);
+
+        fcdc_sketch_init(&sketch);
+        fcdc_sketch_update(&sketch, data, size);
+        memcpy(edited.hashes, sketch.hashes, sizeof edited.hashes);
+
+        fcdc_sketch_init(&sketch);
+        fcdc_sketch_update(&sketch, other, size);
+        memcpy(unrelated.hashes, sketch.hashes, sizeof unrelated.hashes);
+
+        FTEST_ASSERT(fdb_sketch_similarity(&original, &edited) >= 80);
+        FTEST_ASSERT(fdb_sketch_similarity(&original, &unrelated) <= 10);
+
+        if (pistream)
+            pistream->release(pistream);
+    }
+
+    free(data);
+    free(other);
+}
+FTEST_END()
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // sync_engine test
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -311,7 +937,7 @@ FTEST_START(fsync_engine)
 
     static fuuid_t const uuid = FUUID(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
 
-    fsync_engine_t *psync_engine = fsync_engine(msgbus, &uuid);                             FTEST_ASSERT(psync_engine);
+    fsync_engine_t *psync_engine = fsync_engine(msgbus, 0, &uuid);                          FTEST_ASSERT(psync_engine);
     if (psync_engine)
     {
         fsync_agent_t agent =
@@ -324,7 +950,7 @@ FTEST_START(fsync_engine)
             fsync_agent_completion_handler
         };
         rc = fsync_engine_register_agent(psync_engine, &agent);                             FTEST_ASSERT(rc == FSUCCESS);
-        rc = fsync_engine_sync(psync_engine, &uuid, 42, 0, src_istream);                    FTEST_ASSERT(rc == FSUCCESS);
+        rc = fsync_engine_sync(psync_engine, &uuid, 42, 0, src_istream, sizeof FDATA);      FTEST_ASSERT(rc == FSUCCESS);
 
         while(!is_sync_completed)
         {
@@ -340,13 +966,966 @@ FTEST_START(fsync_engine)
 }
 FTEST_END()
 
+static volatile bool is_sync_requested = false;
+static volatile bool is_sync_canceled = false;
+
+static void fsync_request_listener(void *param, fmsg_t const *msg)
+{
+    (void)param;
+    (void)msg;
+    is_sync_requested = true;
+}
+
+static fistream_t *pdelta_istream = 0;
+
+static void fsync_delta_istream_agent(void *ptr, fistream_t *pstream, frstream_info_t const *info)
+{
+    pdelta_istream = pstream->retain(pstream);
+}
+
+static void fsync_agent_cancel_handler(fsync_agent_t *pagent, binn *metainf, ferr_t err, char const *err_msg)
+{
+    is_sync_canceled = true;
+}
+
+// Second signature stream of the synchronization is rejected and the synchronization is canceled
+FTEST_START(fsync_engine_stream_fail)
+{
+    ferr_t rc;
+
+    static fuuid_t const uuid = FUUID(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    static fuuid_t const dst_uuid = FUUID(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    static struct timespec const F10_MSEC = { 0, 10000000 };
+
+    fistream_t *src_istream = fmem_const_istream(FDATA, sizeof FDATA);                      FTEST_ASSERT(src_istream);
+
+    fsync_engine_t *psync_engine = fsync_engine(msgbus, 0, &uuid);                          FTEST_ASSERT(psync_engine);
+    frstream_factory_t *pfactory = frstream_factory(msgbus, &dst_uuid);                     FTEST_ASSERT(pfactory);
+    rc = frstream_factory_istream_subscribe(pfactory, fsync_delta_istream_agent, 0);       FTEST_ASSERT(rc == FSUCCESS);
+
+    fsync_agent_t agent =
+    {
+        42,
+        fsync_agent_retain,
+        fsync_agent_release,
+        fsync_agent_accept,
+        fsync_agent_cancel_handler,
+        fsync_agent_completion_handler
+    };
+    rc = fsync_engine_register_agent(psync_engine, &agent);                                 FTEST_ASSERT(rc == FSUCCESS);
+    rc = fmsgbus_subscribe(msgbus, FSYNC_REQUEST, fsync_request_listener, &agent);          FTEST_ASSERT(rc == FSUCCESS);
+
+    // dst doesn't exist. The synchronization waits the signature.
+    rc = fsync_engine_sync(psync_engine, &dst_uuid, 42, 0, src_istream, sizeof FDATA);      FTEST_ASSERT(rc == FSUCCESS);
+
+    for(int i = 0; i < 1000 && !is_sync_requested; ++i)
+        nanosleep(&F10_MSEC, NULL);
+    FTEST_ASSERT(is_sync_requested);
+
+    binn *metainf = binn_object();                                                          FTEST_ASSERT(metainf);
+    binn_object_set_uint32(metainf, "sync_id", 1);
+    binn_object_set_uint8 (metainf, "stream_type", 0);
+
+    fostream_t *psignature_ostream = frstream_factory_stream(pfactory, &uuid, metainf);    FTEST_ASSERT(psignature_ostream);
+    fostream_t *pduplicate_ostream = frstream_factory_stream(pfactory, &uuid, metainf);    FTEST_ASSERT(!pduplicate_ostream);
+    binn_free(metainf);
+
+    for(int i = 0; i < 1000 && !is_sync_canceled; ++i)
+        nanosleep(&F10_MSEC, NULL);
+    FTEST_ASSERT(is_sync_canceled);
+
+    if (pdelta_istream)
+        pdelta_istream->release(pdelta_istream);
+    psignature_ostream->release(psignature_ostream);
+    frstream_factory_istream_unsubscribe(pfactory, fsync_delta_istream_agent);
+    frstream_factory_release(pfactory);
+    fsync_engine_release(psync_engine);
+    fmsgbus_unsubscribe(msgbus, FSYNC_REQUEST, fsync_request_listener, &agent);
+    src_istream->release(src_istream);
+}
+FTEST_END()
+
+// Requests of the synchronizations in order of their start
+typedef struct
+{
+    fuuid_t     dst;
+    uint32_t    sync_id;
+} fsync_started_t;
+
+static pthread_mutex_t fsync_started_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fsync_started_t fsync_started[2 * FSYNC_ACTIVE_MAX];
+static volatile uint32_t fsync_started_num = 0;
+static volatile uint32_t fsync_failed_num = 0;
+
+static void fsync_started_listener(void *param, FMSG_TYPE(sync_request) const *msg)
+{
+    (void)param;
+    pthread_mutex_lock(&fsync_started_mutex);
+    if (fsync_started_num < FARRAY_SIZE(fsync_started))
+    {
+        fsync_started[fsync_started_num].dst = msg->hdr.dst;
+        fsync_started[fsync_started_num].sync_id = msg->sync_id;
+        fsync_started_num++;
+    }
+    pthread_mutex_unlock(&fsync_started_mutex);
+}
+
+static void fsync_started_failed_handler(fsync_agent_t *pagent, binn *metainf, ferr_t err, char const *err_msg)
+{
+    pthread_mutex_lock(&fsync_started_mutex);
+    fsync_failed_num++;
+    pthread_mutex_unlock(&fsync_started_mutex);
+}
+
+static bool fsync_started_wait(uint32_t num)
+{
+    static struct timespec const F10_MSEC = { 0, 10000000 };
+    for(int i = 0; i < 1000 && fsync_started_num < num; ++i)
+        nanosleep(&F10_MSEC, NULL);
+    return fsync_started_num == num;
+}
+
+// Synchronization with the peer which doesn't answer. It is active until it is failed by the peer.
+static bool fsync_engine_block(fsync_engine_t *pengine, fuuid_t const *peer, fistream_t *pistream, uint32_t num)
+{
+    uint32_t const started_num = fsync_started_num;
+    for(uint32_t i = 0; i < num; ++i)
+    {
+        if (fsync_engine_sync(pengine, peer, 42, 0, pistream, 1) != FSUCCESS)
+            return false;
+    }
+    return fsync_started_wait(started_num + num);
+}
+
+static void fsync_engine_unblock(fuuid_t const *peer, fuuid_t const *uuid, uint32_t sync_id)
+{
+    FMSG(sync_failed, err, *peer, *uuid,
+        sync_id,
+        FFAIL,
+        "Blocking synchronization is finished"
+    );
+    fmsgbus_publish(msgbus, FSYNC_FAILED, (fmsg_t const *)&err);
+}
+
+// The synchronization which is canceled before its start is never started
+FTEST_START(fsync_engine_pending_cancel)
+{
+    ferr_t rc;
+
+    static fuuid_t const uuid = FUUID(0, 2);
+    static fuuid_t const blocker = FUUID(1);
+    static fuuid_t const peer = FUUID(2);
+    static struct timespec const F10_MSEC = { 0, 10000000 };
+
+    fsync_started_num = 0;
+    fsync_failed_num = 0;
+
+    fistream_t *src_istream = fmem_const_istream(FDATA, sizeof FDATA);                      FTEST_ASSERT(src_istream);
+    fsync_engine_t *psync_engine = fsync_engine(msgbus, 0, &uuid);                          FTEST_ASSERT(psync_engine);
+
+    fsync_agent_t agent =
+    {
+        42,
+        fsync_agent_retain,
+        fsync_agent_release,
+        fsync_agent_accept,
+        fsync_started_failed_handler,
+        fsync_agent_completion_handler
+    };
+    rc = fsync_engine_register_agent(psync_engine, &agent);                                 FTEST_ASSERT(rc == FSUCCESS);
+    rc = fmsgbus_subscribe(msgbus, FSYNC_REQUEST, (fmsg_handler_t)fsync_started_listener, &agent);
+    FTEST_ASSERT(rc == FSUCCESS);
+
+    // All places for active synchronizations are taken
+    FTEST_ASSERT(fsync_engine_block(psync_engine, &blocker, src_istream, FSYNC_ACTIVE_MAX));
+
+    uint32_t const canceled_id = FSYNC_ACTIVE_MAX + 1;
+    uint32_t const next_id = FSYNC_ACTIVE_MAX + 2;
+    rc = fsync_engine_sync(psync_engine, &peer, 42, 0, src_istream, sizeof FDATA);          FTEST_ASSERT(rc == FSUCCESS);
+    rc = fsync_engine_sync(psync_engine, &peer, 42, 0, src_istream, sizeof FDATA);          FTEST_ASSERT(rc == FSUCCESS);
+
+    // Pending synchronization is canceled by the peer
+    fsync_engine_unblock(&peer, &uuid, canceled_id);
+    for(int i = 0; i < 1000 && !fsync_failed_num; ++i)
+        nanosleep(&F10_MSEC, NULL);
+    FTEST_ASSERT(fsync_failed_num == 1);
+
+    // Two places are free. Only the second synchronization is started.
+    fsync_engine_unblock(&blocker, &uuid, 1);
+    fsync_engine_unblock(&blocker, &uuid, 2);
+    FTEST_ASSERT(fsync_started_wait(FSYNC_ACTIVE_MAX + 1));
+    for(int i = 0; i < 20; ++i)
+        nanosleep(&F10_MSEC, NULL);
+    FTEST_ASSERT(fsync_started_num == FSYNC_ACTIVE_MAX + 1);
+    FTEST_ASSERT(fsync_started[FSYNC_ACTIVE_MAX].sync_id == next_id);
+
+    fsync_engine_release(psync_engine);
+    fmsgbus_unsubscribe(msgbus, FSYNC_REQUEST, (fmsg_handler_t)fsync_started_listener, &agent);
+    src_istream->release(src_istream);
+}
+FTEST_END()
+
+// Small data is synchronized first. Peers are served in turn.
+FTEST_START(fsync_engine_pending_order)
+{
+    ferr_t rc;
+
+    static fuuid_t const uuid = FUUID(0, 3);
+    static fuuid_t const blocker = FUUID(1);
+    static fuuid_t const peer = FUUID(2);
+    static fuuid_t const other_peer = FUUID(3);
+
+    fsync_started_num = 0;
+    fsync_failed_num = 0;
+
+    fistream_t *src_istream = fmem_const_istream(FDATA, sizeof FDATA);                      FTEST_ASSERT(src_istream);
+    fsync_engine_t *psync_engine = fsync_engine(msgbus, 0, &uuid);                          FTEST_ASSERT(psync_engine);
+
+    fsync_agent_t agent =
+    {
+        42,
+        fsync_agent_retain,
+        fsync_agent_release,
+        fsync_agent_accept,
+        fsync_started_failed_handler,
+        fsync_agent_completion_handler
+    };
+    rc = fsync_engine_register_agent(psync_engine, &agent);                                 FTEST_ASSERT(rc == FSUCCESS);
+    rc = fmsgbus_subscribe(msgbus, FSYNC_REQUEST, (fmsg_handler_t)fsync_started_listener, &agent);
+    FTEST_ASSERT(rc == FSUCCESS);
+
+    // All places for active synchronizations are taken
+    FTEST_ASSERT(fsync_engine_block(psync_engine, &blocker, src_istream, FSYNC_ACTIVE_MAX));
+
+    uint32_t const large_id = FSYNC_ACTIVE_MAX + 1;
+    uint32_t const small_id = FSYNC_ACTIVE_MAX + 2;
+    uint32_t const next_small_id = FSYNC_ACTIVE_MAX + 3;
+    uint32_t const other_small_id = FSYNC_ACTIVE_MAX + 4;
+
+    rc = fsync_engine_sync(psync_engine, &peer, 42, 0, src_istream, 64 * 1024 * 1024);      FTEST_ASSERT(rc == FSUCCESS);
+    rc = fsync_engine_sync(psync_engine, &peer, 42, 0, src_istream, sizeof FDATA);          FTEST_ASSERT(rc == FSUCCESS);
+    rc = fsync_engine_sync(psync_engine, &peer, 42, 0, src_istream, sizeof FDATA);          FTEST_ASSERT(rc == FSUCCESS);
+    rc = fsync_engine_sync(psync_engine, &other_peer, 42, 0, src_istream, sizeof FDATA);    FTEST_ASSERT(rc == FSUCCESS);
+
+    // Places are freed one by one
+    uint32_t const expected_ids[] = { small_id, other_small_id, next_small_id, large_id };
+    fuuid_t const *expected_peers[] = { &peer, &other_peer, &peer, &peer };
+
+    for(uint32_t i = 0; i < FARRAY_SIZE(expected_ids); ++i)
+    {
+        fsync_engine_unblock(&blocker, &uuid, i + 1);
+        FTEST_ASSERT(fsync_started_wait(FSYNC_ACTIVE_MAX + i + 1));
+        FTEST_ASSERT(fsync_started[FSYNC_ACTIVE_MAX + i].sync_id == expected_ids[i]);
+        FTEST_ASSERT(memcmp(&fsync_started[FSYNC_ACTIVE_MAX + i].dst, expected_peers[i], sizeof(fuuid_t)) == 0);
+    }
+
+    fsync_engine_release(psync_engine);
+    fmsgbus_unsubscribe(msgbus, FSYNC_REQUEST, (fmsg_handler_t)fsync_started_listener, &agent);
+    src_istream->release(src_istream);
+}
+FTEST_END()
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// sync_engine round trip test
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+enum
+{
+    FSYNC_MEM_AGENT_ID = 43
+};
+
+// Agent of one side. The local data is in memory, the synchronized data is collected in memory.
+typedef struct
+{
+    fsync_agent_t       agent;
+    char const         *path;                   // path of the local data
+    char const         *data;                   // local data (0 - there is no local data)
+    size_t              size;
+    time_t              mod_time;               // modification time of the local data
+    fmem_iostream_t    *received;               // data which is written by the synchronization
+    bool                is_appended;            // received data is the tail of local data
+    char const         *similar_path;           // other local file
+    char const         *similar_data;
+    size_t              similar_size;
+    bool                is_similar_opened;
+    volatile bool       is_completed;
+    volatile bool       is_failed;
+} fsync_mem_agent_t;
+
+static bool fsync_mem_agent_accept(fsync_agent_t *pagent, binn *metainf, fistream_t **pistream, fostream_t **postream)
+{
+    fsync_mem_agent_t *agent = (fsync_mem_agent_t *)pagent;
+    (void)metainf;
+
+    if (agent->received)
+        fmem_iostream_release(agent->received);
+    agent->received = fmem_iostream(FMEM_BLOCK_SIZE);
+    agent->is_appended = false;
+    if (!agent->received)
+        return false;
+
+    *pistream = agent->data ? fmem_const_istream(agent->data, agent->size) : 0;
+    *postream = fmem_ostream(agent->received);
+    return *postream != 0;
+}
+
+static bool fsync_mem_agent_append(fsync_agent_t *pagent, binn *metainf, fistream_t **pistream, fostream_t **postream)
+{
+    fsync_mem_agent_t *agent = (fsync_mem_agent_t *)pagent;
+    (void)metainf;
+
+    if (!agent->data)
+        return false;
+
+    if (agent->received)
+        fmem_iostream_release(agent->received);
+    agent->received = fmem_iostream(FMEM_BLOCK_SIZE);
+    agent->is_appended = true;
+    if (!agent->received)
+        return false;
+
+    *pistream = fmem_const_istream(agent->data, agent->size);
+    *postream = fmem_ostream(agent->received);
+    return *pistream && *postream;
+}
+
+static void fsync_mem_agent_failed(fsync_agent_t *pagent, binn *metainf, ferr_t err, char const *err_msg)
+{
+    (void)metainf;
+    (void)err;
+    (void)err_msg;
+    ((fsync_mem_agent_t *)pagent)->is_failed = true;
+}
+
+static void fsync_mem_agent_complete(fsync_agent_t *pagent, binn *metainf)
+{
+    (void)metainf;
+    ((fsync_mem_agent_t *)pagent)->is_completed = true;
+}
+
+static bool fsync_mem_agent_signature_key(fsync_agent_t *pagent, binn *metainf, fdb_signature_key_t *key)
+{
+    fsync_mem_agent_t *agent = (fsync_mem_agent_t *)pagent;
+    (void)metainf;
+
+    memset(key, 0, sizeof *key);
+    strncpy(key->path, agent->path, sizeof key->path - 1);
+    if (agent->data)
+    {
+        fmd5_context_t ctx;
+        fmd5_init(&ctx);
+        fmd5_update(&ctx, agent->data, (uint32_t)agent->size);
+        fmd5_final(&ctx, &key->digest);
+        key->size = agent->size;
+        key->mod_time = agent->mod_time;
+    }
+    return true;
+}
+
+static void fsync_mem_agent_init(fsync_mem_agent_t *agent, char const *path)
+{
+    memset(agent, 0, sizeof *agent);
+    agent->agent.id = FSYNC_MEM_AGENT_ID;
+    agent->agent.retain = fsync_agent_retain;
+    agent->agent.release = fsync_agent_release;
+    agent->agent.accept = fsync_mem_agent_accept;
+    agent->agent.failed = fsync_mem_agent_failed;
+    agent->agent.complete = fsync_mem_agent_complete;
+    agent->agent.signature_key = fsync_mem_agent_signature_key;
+    agent->path = path;
+}
+
+static fistream_t *fsync_mem_agent_open(fsync_agent_t *pagent, char const *path)
+{
+    fsync_mem_agent_t *agent = (fsync_mem_agent_t *)pagent;
+
+    if (!agent->similar_path || strcmp(agent->similar_path, path) != 0)
+        return 0;
+
+    agent->is_similar_opened = true;
+    return fmem_const_istream(agent->similar_data, agent->similar_size);
+}
+
+// The synchronized data is compared with the expected one. Appended tail is compared with the end of data.
+static bool fsync_mem_agent_is_received(fsync_mem_agent_t *agent, char const *data, size_t size)
+{
+    if (!agent->received)
+        return false;
+
+    if (agent->is_appended)
+    {
+        if (size < agent->size || memcmp(agent->data, data, agent->size) != 0)
+            return false;
+        data += agent->size;
+        size -= agent->size;
+    }
+
+    fistream_t *pistream = fmem_istream(agent->received);
+    if (!pistream)
+        return false;
+
+    char buf[FMEM_BLOCK_SIZE];
+    size_t offset = 0;
+    bool ret = true;
+
+    for(size_t read_size; ret && (read_size = pistream->read(pistream, buf, sizeof buf)) > 0; offset += read_size)
+        ret = offset + read_size <= size && memcmp(data + offset, buf, read_size) == 0;
+
+    pistream->release(pistream);
+
+    return ret && offset == size;
+}
+
+static void fsync_mem_agent_free(fsync_mem_agent_t *agent)
+{
+    if (agent->received)
+        fmem_iostream_release(agent->received);
+    agent->received = 0;
+}
+
+static fuuid_t const fsync_pair_src_uuid = FUUID(0, 5);
+static fuuid_t const fsync_pair_dst_uuid = FUUID(0, 6);
+
+// Messages of the synchronization
+typedef struct
+{
+    uint32_t            num[FSYNC_SIGNATURE_VALID + 1]; // number of messages by type
+    uint64_t            delta_size;                     // stream data which is sent to dst
+    uint64_t            signature_size;                 // stream data which is sent to src
+} fsync_msg_stat_t;
+
+static uint32_t const fsync_msg_stat_types[] =
+{
+    FSTREAM,
+    FSYNC_REQUEST,
+    FSYNC_OK,
+    FSYNC_LITERAL,
+    FSYNC_APPEND,
+    FSYNC_APPEND_REJECT,
+    FSYNC_SKETCH_REQUEST,
+    FSYNC_SKETCH,
+    FSYNC_SIGNATURE_VALID
+};
+
+static pthread_mutex_t fsync_msg_stat_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Messages carry no type. The handler is subscribed with the counter of message type.
+static void fsync_msg_counter(void *param, fmsg_t const *msg)
+{
+    (void)msg;
+    pthread_mutex_lock(&fsync_msg_stat_mutex);
+    ++*(uint32_t *)param;
+    pthread_mutex_unlock(&fsync_msg_stat_mutex);
+}
+
+static void fsync_msg_data_counter(void *param, FMSG_TYPE(stream_data) const *msg)
+{
+    fsync_msg_stat_t *stat = (fsync_msg_stat_t *)param;
+    pthread_mutex_lock(&fsync_msg_stat_mutex);
+    if (memcmp(&msg->hdr.dst, &fsync_pair_dst_uuid, sizeof msg->hdr.dst) == 0)
+        stat->delta_size += msg->size;
+    else if (memcmp(&msg->hdr.dst, &fsync_pair_src_uuid, sizeof msg->hdr.dst) == 0)
+        stat->signature_size += msg->size;
+    pthread_mutex_unlock(&fsync_msg_stat_mutex);
+}
+
+static bool fsync_msg_stat_subscribe(fsync_msg_stat_t *stat)
+{
+    for(size_t i = 0; i < FARRAY_SIZE(fsync_msg_stat_types); ++i)
+    {
+        uint32_t const type = fsync_msg_stat_types[i];
+        if (fmsgbus_subscribe(msgbus, type, fsync_msg_counter, &stat->num[type]) != FSUCCESS)
+            return false;
+    }
+    return fmsgbus_subscribe(msgbus, FSTREAM_DATA, (fmsg_handler_t)fsync_msg_data_counter, stat) == FSUCCESS;
+}
+
+static void fsync_msg_stat_unsubscribe(fsync_msg_stat_t *stat)
+{
+    for(size_t i = 0; i < FARRAY_SIZE(fsync_msg_stat_types); ++i)
+    {
+        uint32_t const type = fsync_msg_stat_types[i];
+        fmsgbus_unsubscribe(msgbus, type, fsync_msg_counter, &stat->num[type]);
+    }
+    fmsgbus_unsubscribe(msgbus, FSTREAM_DATA, (fmsg_handler_t)fsync_msg_data_counter, stat);
+}
+
+// Two engines on one bus. src data is synchronized with the local data of dst.
+typedef struct
+{
+    fsync_engine_t     *src_engine;
+    fsync_engine_t     *dst_engine;
+    fsync_mem_agent_t   src;
+    fsync_mem_agent_t   dst;
+    fsync_msg_stat_t    stat;                   // messages of the last synchronization
+} fsync_pair_t;
+
+static bool fsync_pair_open(fsync_pair_t *pair, fdb_t *src_db, fdb_t *dst_db, char const *path)
+{
+    memset(pair, 0, sizeof *pair);
+    fsync_mem_agent_init(&pair->src, path);
+    fsync_mem_agent_init(&pair->dst, path);
+
+    pair->src_engine = fsync_engine(msgbus, src_db, &fsync_pair_src_uuid);
+    pair->dst_engine = fsync_engine(msgbus, dst_db, &fsync_pair_dst_uuid);
+
+    return pair->src_engine
+        && pair->dst_engine
+        && fsync_msg_stat_subscribe(&pair->stat)
+        && fsync_engine_register_agent(pair->src_engine, &pair->src.agent) == FSUCCESS
+        && fsync_engine_register_agent(pair->dst_engine, &pair->dst.agent) == FSUCCESS;
+}
+
+static void fsync_pair_close(fsync_pair_t *pair)
+{
+    fsync_msg_stat_unsubscribe(&pair->stat);
+    if (pair->src_engine)
+        fsync_engine_release(pair->src_engine);
+    if (pair->dst_engine)
+        fsync_engine_release(pair->dst_engine);
+    fsync_mem_agent_free(&pair->src);
+    fsync_mem_agent_free(&pair->dst);
+}
+
+// src data is synchronized. The synchronization is completed when src receives the answer of dst.
+static bool fsync_pair_sync(fsync_pair_t *pair, char const *data, size_t size)
+{
+    static struct timespec const F10_MSEC = { 0, 10000000 };
+
+    pair->src.data = data;
+    pair->src.size = size;
+    pair->src.is_completed = pair->src.is_failed = false;
+    pair->dst.is_completed = pair->dst.is_failed = false;
+
+    pthread_mutex_lock(&fsync_msg_stat_mutex);
+    memset(&pair->stat, 0, sizeof pair->stat);
+    pthread_mutex_unlock(&fsync_msg_stat_mutex);
+
+    fistream_t *pistream = fmem_const_istream(data, size);
+    if (!pistream)
+        return false;
+
+    ferr_t const rc = fsync_engine_sync(pair->src_engine, &fsync_pair_dst_uuid, FSYNC_MEM_AGENT_ID, 0, pistream, size);
+    pistream->release(pistream);
+    if (rc != FSUCCESS)
+        return false;
+
+    for(int i = 0; i < 6000 && !pair->src.is_completed && !pair->src.is_failed; ++i)
+        nanosleep(&F10_MSEC, NULL);
+
+    // The last stream messages are delivered to all listeners
+    for(int i = 0; i < 10; ++i)
+        nanosleep(&F10_MSEC, NULL);
+
+    return pair->src.is_completed && !pair->src.is_failed;
+}
+
+// The signature of the local data of agent is cached in db
+static bool fsync_signature_is_cached(fsync_mem_agent_t *agent, fdb_t *db, uint64_t size)
+{
+    fdb_signature_key_t key;
+    if (!fsync_mem_agent_signature_key(&agent->agent, 0, &key))
+        return false;
+    frsync_signature_args(size, &key.block_len, &key.strong_len);
+
+    bool ret = false;
+
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(db, &transaction))
+    {
+        fdb_map_t map = { 0 };
+        if (fdb_signatures_map_open(&transaction, &map))
+        {
+            fdb_data_t signature = { 0 };
+            ret = fdb_signature_get(&map, &transaction, &key, &signature);
+            fdb_map_close(&map);
+        }
+        fdb_transaction_abort(&transaction);
+    }
+
+    return ret;
+}
+
+// The signature of changed local data isn't taken from the cache
+FTEST_START(fsync_engine_signature_cache)
+{
+    enum { FDATA_SIZE = 256 * 1024 };
+
+    char *data = malloc(4 * FDATA_SIZE);                                                    FTEST_ASSERT(data);
+    char *base = data;                      // dst data
+    char *changed_base = data + FDATA_SIZE; // dst data which is changed without size and time change
+    char *src_data = data + 2 * FDATA_SIZE;
+    char *other_src_data = data + 3 * FDATA_SIZE;
+
+    frsync_random_data(base, FDATA_SIZE, 38);
+    memcpy(changed_base, base, FDATA_SIZE);
+    frsync_random_data(changed_base + FDATA_SIZE / 2, 4096, 39);
+    memcpy(src_data, base, FDATA_SIZE);
+    frsync_random_data(src_data + FDATA_SIZE / 4, 4096, 40);
+    memcpy(other_src_data, base, FDATA_SIZE);
+    frsync_random_data(other_src_data + 3 * FDATA_SIZE / 4, 4096, 41);
+
+    remove("fsync_dst_db/data.mdb");
+    remove("fsync_dst_db/lock.mdb");
+
+    fdb_t *dst_db = fdb_open("fsync_dst_db", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);        FTEST_ASSERT(dst_db);
+
+    fsync_pair_t pair;
+    FTEST_ASSERT(fsync_pair_open(&pair, 0, dst_db, "file.bin"));
+    pair.dst.data = base;
+    pair.dst.size = FDATA_SIZE;
+    pair.dst.mod_time = 1000;
+
+    // The signature is calculated and cached
+    FTEST_ASSERT(fsync_pair_sync(&pair, src_data, FDATA_SIZE));
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, src_data, FDATA_SIZE));
+    FTEST_ASSERT(fsync_signature_is_cached(&pair.dst, dst_db, FDATA_SIZE));
+
+    // The local data is changed, but its size and time are the same. The signature of old data would break the result.
+    pair.dst.data = changed_base;
+    FTEST_ASSERT(fsync_pair_sync(&pair, other_src_data, FDATA_SIZE));
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, other_src_data, FDATA_SIZE));
+    FTEST_ASSERT(fsync_signature_is_cached(&pair.dst, dst_db, FDATA_SIZE));
+
+    // The stale signature is replaced
+    pair.dst.data = base;
+    FTEST_ASSERT(!fsync_signature_is_cached(&pair.dst, dst_db, FDATA_SIZE));
+
+    fsync_pair_close(&pair);
+    fdb_release(dst_db);
+    free(data);
+}
+FTEST_END()
+
+// Equal data isn't transferred. Small data is sent without signature.
+FTEST_START(fsync_engine_fast_paths)
+{
+    enum { FDATA_SIZE = 1000 };
+
+    char src_data[FDATA_SIZE];
+    char dst_data[FDATA_SIZE];
+    frsync_random_data(src_data, sizeof src_data, 43);
+    frsync_random_data(dst_data, sizeof dst_data, 44);
+
+    fsync_pair_t pair;
+    FTEST_ASSERT(fsync_pair_open(&pair, 0, 0, "file.bin"));
+
+    // Equal data
+    pair.dst.data = src_data;
+    pair.dst.size = sizeof src_data;
+    FTEST_ASSERT(fsync_pair_sync(&pair, src_data, sizeof src_data));
+    FTEST_ASSERT(pair.stat.num[FSYNC_OK] == 1);
+    FTEST_ASSERT(pair.stat.num[FSTREAM] == 0);
+    FTEST_ASSERT(!pair.dst.received);
+
+    // Small data of the same size
+    pair.dst.data = dst_data;
+    FTEST_ASSERT(fsync_pair_sync(&pair, src_data, sizeof src_data));
+    FTEST_ASSERT(pair.stat.num[FSYNC_LITERAL] == 1);
+    FTEST_ASSERT(pair.stat.num[FSTREAM] == 1);
+    FTEST_ASSERT(pair.stat.signature_size == 0);
+    FTEST_ASSERT(pair.stat.delta_size > 0);
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, src_data, sizeof src_data));
+
+    fsync_pair_close(&pair);
+}
+FTEST_END()
+
+// Grown data is appended only if the local data is its prefix
+FTEST_START(fsync_engine_append)
+{
+    enum
+    {
+        FDATA_SIZE = 256 * 1024,
+        FTAIL_SIZE = 64 * 1024
+    };
+
+    char *src_data = malloc(FDATA_SIZE + FTAIL_SIZE);                                       FTEST_ASSERT(src_data);
+    char *dst_data = malloc(FDATA_SIZE);                                                    FTEST_ASSERT(dst_data);
+    frsync_random_data(src_data, FDATA_SIZE + FTAIL_SIZE, 44);
+    memcpy(dst_data, src_data, FDATA_SIZE);
+    dst_data[FDATA_SIZE / 3] ^= 1;
+
+    fsync_pair_t pair;
+    FTEST_ASSERT(fsync_pair_open(&pair, 0, 0, "file.bin"));
+    pair.dst.agent.append = fsync_mem_agent_append;
+    pair.dst.data = dst_data;
+    pair.dst.size = FDATA_SIZE;
+
+    // The prefix is edited. The append is rejected and the whole delta is sent.
+    FTEST_ASSERT(fsync_pair_sync(&pair, src_data, FDATA_SIZE + FTAIL_SIZE));
+    FTEST_ASSERT(pair.stat.num[FSYNC_APPEND] == 1);
+    FTEST_ASSERT(pair.stat.num[FSYNC_APPEND_REJECT] == 1);
+    FTEST_ASSERT(pair.stat.num[FSTREAM] == 2);
+    FTEST_ASSERT(pair.stat.signature_size > 0);
+    FTEST_ASSERT(!pair.dst.is_appended);
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, src_data, FDATA_SIZE + FTAIL_SIZE));
+
+    // The prefix is equal. Only the tail is sent.
+    pair.dst.data = src_data;
+    FTEST_ASSERT(fsync_pair_sync(&pair, src_data, FDATA_SIZE + FTAIL_SIZE));
+    FTEST_ASSERT(pair.stat.num[FSYNC_APPEND] == 1);
+    FTEST_ASSERT(pair.stat.num[FSYNC_APPEND_REJECT] == 0);
+    FTEST_ASSERT(pair.stat.num[FSTREAM] == 1);
+    FTEST_ASSERT(pair.stat.signature_size == 0);
+    FTEST_ASSERT(pair.dst.is_appended);
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, src_data, FDATA_SIZE + FTAIL_SIZE));
+
+    fsync_pair_close(&pair);
+    free(dst_data);
+    free(src_data);
+}
+FTEST_END()
+
+// New data is synchronized by the delta from the similar local file
+FTEST_START(fsync_engine_similar_base)
+{
+    enum { FDATA_SIZE = 512 * 1024 };
+
+    char *a_data = malloc(FDATA_SIZE);                                                      FTEST_ASSERT(a_data);
+    char *b_data = malloc(FDATA_SIZE);                                                      FTEST_ASSERT(b_data);
+    frsync_random_data(a_data, FDATA_SIZE, 47);
+    memcpy(b_data, a_data, FDATA_SIZE);
+    frsync_random_data(b_data + FDATA_SIZE / 2, 4096, 48);
+
+    remove("fsync_dst_db/data.mdb");
+    remove("fsync_dst_db/lock.mdb");
+
+    fdb_t *dst_db = fdb_open("fsync_dst_db", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);        FTEST_ASSERT(dst_db);
+
+    fsync_pair_t pair;
+    FTEST_ASSERT(fsync_pair_open(&pair, 0, dst_db, "a.bin"));
+    pair.dst.agent.open = fsync_mem_agent_open;
+
+    // There is no similar file. The sketch of new data is indexed.
+    FTEST_ASSERT(fsync_pair_sync(&pair, a_data, FDATA_SIZE));
+    FTEST_ASSERT(pair.stat.num[FSYNC_SKETCH_REQUEST] == 1);
+    FTEST_ASSERT(pair.stat.num[FSYNC_LITERAL] == 1);
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, a_data, FDATA_SIZE));
+
+    // The file which was received is the base of other new file
+    pair.dst.path = "b.bin";
+    pair.dst.similar_path = "a.bin";
+    pair.dst.similar_data = a_data;
+    pair.dst.similar_size = FDATA_SIZE;
+    FTEST_ASSERT(fsync_pair_sync(&pair, b_data, FDATA_SIZE));
+    FTEST_ASSERT(pair.stat.num[FSYNC_SKETCH_REQUEST] == 1);
+    FTEST_ASSERT(pair.stat.num[FSYNC_SKETCH] == 1);
+    FTEST_ASSERT(pair.stat.num[FSTREAM] == 2);
+    FTEST_ASSERT(pair.stat.delta_size < FDATA_SIZE / 2);
+    FTEST_ASSERT(pair.dst.is_similar_opened);
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, b_data, FDATA_SIZE));
+
+    fsync_pair_close(&pair);
+    fdb_release(dst_db);
+    free(b_data);
+    free(a_data);
+}
+FTEST_END()
+
+// src keeps the signature of dst data. It isn't transferred again while dst data isn't changed.
+FTEST_START(fsync_engine_remote_signature)
+{
+    enum { FDATA_SIZE = 256 * 1024 };
+
+    char *data = malloc(3 * FDATA_SIZE);                                                    FTEST_ASSERT(data);
+    char *dst_data = data;
+    char *src_data = data + FDATA_SIZE;
+    char *next_src_data = data + 2 * FDATA_SIZE;
+
+    frsync_random_data(dst_data, FDATA_SIZE, 48);
+    memcpy(src_data, dst_data, FDATA_SIZE);
+    frsync_random_data(src_data + FDATA_SIZE / 4, 4096, 49);
+    memcpy(next_src_data, dst_data, FDATA_SIZE);
+    frsync_random_data(next_src_data + 3 * FDATA_SIZE / 4, 4096, 50);
+
+    remove("fsync_src_db/data.mdb");
+    remove("fsync_src_db/lock.mdb");
+
+    fdb_t *src_db = fdb_open("fsync_src_db", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);        FTEST_ASSERT(src_db);
+
+    fsync_pair_t pair;
+    FTEST_ASSERT(fsync_pair_open(&pair, src_db, 0, "file.bin"));
+    pair.dst.data = dst_data;
+    pair.dst.size = FDATA_SIZE;
+    pair.dst.mod_time = 1000;
+
+    // The signature is received and cached by src
+    FTEST_ASSERT(fsync_pair_sync(&pair, src_data, FDATA_SIZE));
+    FTEST_ASSERT(pair.stat.num[FSYNC_SIGNATURE_VALID] == 0);
+    FTEST_ASSERT(pair.stat.signature_size > 0);
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, src_data, FDATA_SIZE));
+
+    // dst confirms the cached signature
+    FTEST_ASSERT(fsync_pair_sync(&pair, next_src_data, FDATA_SIZE));
+    FTEST_ASSERT(pair.stat.num[FSYNC_SIGNATURE_VALID] == 1);
+    FTEST_ASSERT(pair.stat.num[FSTREAM] == 1);
+    FTEST_ASSERT(pair.stat.signature_size == 0);
+    FTEST_ASSERT(fsync_mem_agent_is_received(&pair.dst, next_src_data, FDATA_SIZE));
+
+    fsync_pair_close(&pair);
+    fdb_release(src_db);
+    free(data);
+}
+FTEST_END()
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// cdc_sync_agent test
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static fuuid_t const fcdc_dst_uuid = FUUID(0, 3);
+static pthread_mutex_t fcdc_received_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t fcdc_received_size = 0;
+
+// Streams data which is transferred to dst
+static void fcdc_stream_data_listener(uint64_t *received_size, FMSG_TYPE(stream_data) const *msg)
+{
+    if (fuuid_cmp(&msg->hdr.dst, &fcdc_dst_uuid) == 0)
+    {
+        pthread_mutex_lock(&fcdc_received_mutex);
+        *received_size += msg->size;
+        pthread_mutex_unlock(&fcdc_received_mutex);
+    }
+}
+
+static uint64_t fcdc_received()
+{
+    pthread_mutex_lock(&fcdc_received_mutex);
+    uint64_t const size = fcdc_received_size;
+    pthread_mutex_unlock(&fcdc_received_mutex);
+    return size;
+}
+
+static bool fcdc_file_write(char const *path, char const *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool const ret = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && ret;
+}
+
+// dst file appears when the synchronization is completed
+static bool fcdc_file_wait(char const *path, char const *data, size_t size)
+{
+    static struct timespec const F10_MSEC = { 0, 10000000 };
+
+    uint64_t file_size = 0;
+    for(int i = 0; i < 6000 && !fsfile_size(path, &file_size); ++i)
+        nanosleep(&F10_MSEC, NULL);
+
+    void const *file_data = fsfile_map(path, &file_size);
+    if (!file_data)
+        return false;
+    bool const ret = file_size == size && memcmp(file_data, data, size) == 0;
+    fsfile_unmap(file_data, file_size);
+
+    // The last stream messages are delivered to all listeners
+    for(int i = 0; i < 10; ++i)
+        nanosleep(&F10_MSEC, NULL);
+
+    return ret;
+}
+
+// Chunks of the second file which are found in the first one aren't transferred
+FTEST_START(fcdc_sync_agent)
+{
+    ferr_t rc;
+
+    enum
+    {
+        FCDC_FILE_SIZE  = 2 * 1024 * 1024,
+        FCDC_SHARED     = 3 * 512 * 1024
+    };
+
+    static fuuid_t const src_uuid = FUUID(0, 4);
+
+    char *data = malloc(2 * FCDC_FILE_SIZE - FCDC_SHARED);                                  FTEST_ASSERT(data);
+    frsync_random_data(data, 2 * FCDC_FILE_SIZE - FCDC_SHARED, 42);
+
+    char const *a_data = data;
+    char const *b_data = data + FCDC_FILE_SIZE - FCDC_SHARED;
+
+#ifdef _WIN32
+    mkdir("cdc_src");
+    mkdir("cdc_dst");
+#else
+    mkdir("cdc_src", 0777);
+    mkdir("cdc_dst", 0777);
+#endif
+    remove("cdc_dst/a.bin");
+    remove("cdc_dst/b.bin");
+    FTEST_ASSERT(fcdc_file_write("cdc_src/a.bin", a_data, FCDC_FILE_SIZE));
+    FTEST_ASSERT(fcdc_file_write("cdc_src/b.bin", b_data, FCDC_FILE_SIZE));
+
+    fdb_t *src_db = fdb_open("cdc_src_db", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);          FTEST_ASSERT(src_db);
+    fdb_t *dst_db = fdb_open("cdc_dst_db", 4u, 1u, 16 * 1024 * 1024, FDB_DURABLE);          FTEST_ASSERT(dst_db);
+
+    fsync_engine_t *src_engine = fsync_engine(msgbus, 0, &src_uuid);                        FTEST_ASSERT(src_engine);
+    fsync_engine_t *dst_engine = fsync_engine(msgbus, 0, &fcdc_dst_uuid);                   FTEST_ASSERT(dst_engine);
+
+    fsync_agent_t *src_agent = cdc_sync_agent(src_db, "cdc_src");                           FTEST_ASSERT(src_agent);
+    fsync_agent_t *dst_agent = cdc_sync_agent(dst_db, "cdc_dst");                           FTEST_ASSERT(dst_agent);
+    rc = fsync_engine_register_agent(src_engine, src_agent);                                FTEST_ASSERT(rc == FSUCCESS);
+    rc = fsync_engine_register_agent(dst_engine, dst_agent);                                FTEST_ASSERT(rc == FSUCCESS);
+
+    rc = fmsgbus_subscribe(msgbus, FSTREAM_DATA, (fmsg_handler_t)fcdc_stream_data_listener, &fcdc_received_size);
+    FTEST_ASSERT(rc == FSUCCESS);
+
+    // dst has nothing, the whole file is transferred
+    rc = cdc_sync_agent_sync(src_agent, src_engine, &fcdc_dst_uuid, "a.bin");               FTEST_ASSERT(rc == FSUCCESS);
+    FTEST_ASSERT(fcdc_file_wait("cdc_dst/a.bin", a_data, FCDC_FILE_SIZE));
+    uint64_t const a_received = fcdc_received();
+    FTEST_ASSERT(a_received >= FCDC_FILE_SIZE);
+
+    // The shared part is assembled from the chunks of a.bin
+    rc = cdc_sync_agent_sync(src_agent, src_engine, &fcdc_dst_uuid, "b.bin");               FTEST_ASSERT(rc == FSUCCESS);
+    FTEST_ASSERT(fcdc_file_wait("cdc_dst/b.bin", b_data, FCDC_FILE_SIZE));
+    uint64_t const b_received = fcdc_received() - a_received;
+    FTEST_ASSERT(b_received < FCDC_FILE_SIZE - FCDC_SHARED / 2);
+
+    fmsgbus_unsubscribe(msgbus, FSTREAM_DATA, (fmsg_handler_t)fcdc_stream_data_listener, &fcdc_received_size);
+    fsync_engine_release(src_engine);
+    fsync_engine_release(dst_engine);
+    src_agent->release(src_agent);
+    dst_agent->release(dst_agent);
+    fdb_release(src_db);
+    fdb_release(dst_db);
+
+    remove("cdc_src/a.bin");
+    remove("cdc_src/b.bin");
+    remove("cdc_dst/a.bin");
+    remove("cdc_dst/b.bin");
+    free(data);
+}
+FTEST_END()
+
 FUNIT_TEST_START(fsync)
     assert(fmsgbus_create(&msgbus, FMSGBUS_THREADS_NUM) == FSUCCESS);
 
     FTEST(frsync_algorithm);
+    FTEST(frsync_rollsum);
+    FTEST(frsync_parallel_signature);
+    FTEST(frsync_parallel_delta);
+    FTEST(frsync_native_delta);
+    FTEST(frsync_native_block_len);
+    FTEST(frsync_partial_input);
+    FTEST(frsync_seek_fail);
     FTEST(frstream);
     FTEST(frstream_fail);
+    FTEST(frstream_opposite);
+    FTEST(fcdc_chunking);
+    FTEST(fcdc_sketch);
     FTEST(fsync_engine);
+    FTEST(fsync_engine_stream_fail);
+    FTEST(fsync_engine_pending_cancel);
+    FTEST(fsync_engine_pending_order);
+    FTEST(fsync_engine_signature_cache);
+    FTEST(fsync_engine_fast_paths);
+    FTEST(fsync_engine_append);
+    FTEST(fsync_engine_similar_base);
+    FTEST(fsync_engine_remote_signature);
+    FTEST(fcdc_sync_agent);
 
     fmsgbus_release(msgbus);
 
@@ -58,6 +58,34 @@ FTEST_START(fstream)
 }
 FTEST_END()
 
+FTEST_START(file_mapped_istream)
+{
+    static char const data[] = "1234567890";
+    static char const path[] = "mapped_istream.test";
+
+    FILE *f = fopen(path, "wb");
+    FTEST_ASSERT(f);
+    FTEST_ASSERT(fwrite(data, 1, sizeof data, f) == sizeof data);
+    fclose(f);
+
+    fistream_t *pistream = ffile_mapped_istream(path);
+    FTEST_ASSERT(pistream);
+
+    size_t size = 0;
+    char const *mapped_data = fistream_data(pistream, &size, 0);
+    FTEST_ASSERT(mapped_data && size == sizeof data && memcmp(mapped_data, data, size) == 0);
+
+    char buf[4];
+    FTEST_ASSERT(pistream->seek(pistream, 8));
+    FTEST_ASSERT(pistream->read(pistream, buf, sizeof buf) == 3);
+    FTEST_ASSERT(memcmp(buf, "90", 3) == 0);
+    FTEST_ASSERT(pistream->status(pistream) == FSTREAM_STATUS_EOF);
+
+    pistream->release(pistream);
+    remove(path);
+}
+FTEST_END()
+
 FTEST_START(dir_iterator)
 {
     static char const *dirs[] =
@@ -120,5 +148,6 @@ FTEST_END()
 
 FUNIT_TEST_START(futils)
     FTEST(fstream);
+    FTEST(file_mapped_istream);
     FTEST(dir_iterator);
 FUNIT_TEST_END()
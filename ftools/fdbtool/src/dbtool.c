@@ -9,14 +9,25 @@
 #include <fdb/sync/dirs.h>
 #include <fdb/sync/files.h>
 #include <stdio.h>
+#include <time.h>
 
 enum
 {
     FDB_MAX_READERS = 1,
-    FDB_MAP_SIZE    = 64 * 1024 * 1024,
-    FDB_MAX_DBS     = 8     // config, nodes
+    FDB_MAP_SIZE    = 64 * 1024 * 1024,   // Initial map size. The map is grown automatically.
+    FDB_MAX_DBS     = 32,   // config, nodes, dirs, files tables for each node
+    FDB_FLAGS       = FDB_DURABLE
 };
 
+enum
+{
+    FDBTOOL_BENCH_SCAN_LEN      = 100,      // Number of items in one range scan
+    FDBTOOL_BENCH_VALUE_SIZE    = 100,      // Size of values for puts
+    FDBTOOL_TABLE_NAME_MAX      = 1024
+};
+
+static char const FDBTOOL_BENCH_TABLE[] = "fdbtool/bench";
+
 struct fdbtool
 {
     fdb_t            *db;
@@ -32,7 +43,7 @@ fdbtool_t *fdbtool(char const *dir)
     }
     memset(ptool, 0, sizeof *ptool);
 
-    ptool->db = fdb_open(dir, FDB_MAX_DBS, FDB_MAX_READERS, FDB_MAP_SIZE);
+    ptool->db = fdb_open(dir, FDB_MAX_DBS, FDB_MAX_READERS, FDB_MAP_SIZE, FDB_FLAGS);
     if (!ptool->db)
     {
         FS_ERR("Unable to open the DB");
@@ -84,3 +95,234 @@ void fdbtool_tables(fdbtool_t *dbtool)
         fdb_transaction_abort(&transaction);
     }
 }
+
+static void fdbtool_table_name(fdb_data_t const *key, char *name, size_t size)
+{
+    size_t const len = key->size < size ? key->size : size - 1;
+    strncpy(name, key->data, len);
+    name[len] = 0;
+}
+
+static void fdbtool_print_map_stat(char const *name, fdb_map_stat_t const *stat, size_t page_size)
+{
+    size_t const pages = stat->branch_pages + stat->leaf_pages + stat->overflow_pages;
+    printf("%-48s %10zu %5u %8zu %8zu %8zu %10.2f\n",
+           name,
+           stat->entries,
+           stat->depth,
+           stat->branch_pages,
+           stat->leaf_pages,
+           stat->overflow_pages,
+           (double)pages * page_size / (1024 * 1024));
+}
+
+void fdbtool_stat(fdbtool_t *dbtool)
+{
+    fdb_transaction_t transaction = { 0 };
+    if (!fdb_transaction_start(dbtool->db, &transaction))
+        return;
+
+    fdb_stat_t stat;
+    if (fdb_stat(&transaction, &stat))
+    {
+        printf("Map size:     %zu MB\n", stat.map_size / (1024 * 1024));
+        printf("Page size:    %zu\n", stat.page_size);
+        printf("Used pages:   %zu (%.2f MB, %.1f%% of map)\n",
+               stat.pages,
+               (double)stat.pages * stat.page_size / (1024 * 1024),
+               stat.map_size ? 100.0 * stat.pages * stat.page_size / stat.map_size : 0.0);
+        printf("Free pages:   %zu (%.1f%% of used pages)\n",
+               stat.free_pages,
+               stat.pages ? 100.0 * stat.free_pages / stat.pages : 0.0);
+        printf("Last txn:     %zu\n", stat.last_txn);
+        printf("Readers:      %u/%u\n\n", stat.readers, stat.max_readers);
+
+        printf("%-48s %10s %5s %8s %8s %8s %10s\n", "Table", "Entries", "Depth", "Branch", "Leaf", "Overflow", "Size (MB)");
+
+        fdb_map_t db_map;
+        if (fdb_map_open(&transaction, 0, 0, &db_map))
+        {
+            fdb_map_stat_t map_stat;
+            if (fdb_map_stat(&db_map, &transaction, &map_stat))
+                fdbtool_print_map_stat("<main>", &map_stat, stat.page_size);
+
+            fdb_cursor_t cursor;
+            if (fdb_cursor_open(&db_map, &transaction, &cursor))
+            {
+                fdb_data_t key = { 0 };
+                fdb_data_t value = { 0 };
+                for (bool ret = fdb_cursor_get(&cursor, &key, &value, FDB_FIRST);
+                     ret;
+                     ret = fdb_cursor_get(&cursor, &key, &value, FDB_NEXT))
+                {
+                    char name[FDBTOOL_TABLE_NAME_MAX];
+                    fdbtool_table_name(&key, name, sizeof name);
+
+                    fdb_map_t map;
+                    if (fdb_map_open(&transaction, name, 0, &map))
+                    {
+                        if (fdb_map_stat(&map, &transaction, &map_stat))
+                            fdbtool_print_map_stat(name, &map_stat, stat.page_size);
+                        fdb_map_close(&map);
+                    }
+                }
+                fdb_cursor_close(&cursor);
+            }
+            fdb_map_close(&db_map);
+        }
+    }
+
+    fdb_transaction_abort(&transaction);
+}
+
+bool fdbtool_compact(fdbtool_t *dbtool, char const *dir)
+{
+    if (!dbtool || !dir || !*dir)
+    {
+        printf("Destination directory is required\n");
+        return false;
+    }
+
+    if (!fdb_copy(dbtool->db, dir, true))
+    {
+        printf("DB wasn't compacted\n");
+        return false;
+    }
+
+    printf("Compacted DB is written to \'%s\'. Replace the DB files by it while the node is stopped.\n", dir);
+    return true;
+}
+
+static double fdbtool_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fdbtool_bench_report(char const *name, size_t ops, double time)
+{
+    if (ops && time > 0)
+        printf("%-12s %10zu ops %10.3f s %12.0f ops/s %10.2f us/op\n", name, ops, time, ops / time, time * 1e6 / ops);
+    else
+        printf("%-12s no data\n", name);
+}
+
+// Random gets and range scans of existing keys
+static void fdbtool_bench_table(fdb_transaction_t *transaction, char const *table, uint32_t count)
+{
+    fdb_map_t map;
+    if (!fdb_map_open(transaction, table, 0, &map))
+    {
+        printf("Table \'%s\' isn't found\n", table);
+        return;
+    }
+
+    fdb_data_t *keys = malloc(count * sizeof *keys);
+    if (!keys)
+    {
+        FS_ERR("Unable to allocate memory for keys");
+        fdb_map_close(&map);
+        return;
+    }
+
+    // Keys point to the memory map. They are valid until the transaction end.
+    size_t keys_num = 0;
+
+    fdb_cursor_t cursor;
+    if (fdb_cursor_open(&map, transaction, &cursor))
+    {
+        fdb_data_t key = { 0 };
+        fdb_data_t value = { 0 };
+        for (bool ret = fdb_cursor_get(&cursor, &key, &value, FDB_FIRST);
+             ret && keys_num < count;
+             ret = fdb_cursor_get(&cursor, &key, &value, FDB_NEXT))
+            keys[keys_num++] = key;
+        fdb_cursor_close(&cursor);
+    }
+
+    for (size_t i = keys_num; i > 1; --i)
+    {
+        size_t const j = (size_t)rand() % i;
+        fdb_data_t const tmp = keys[i - 1];
+        keys[i - 1] = keys[j];
+        keys[j] = tmp;
+    }
+
+    double start = fdbtool_time();
+    size_t ops = 0;
+    for (size_t i = 0; i < keys_num; ++i)
+    {
+        fdb_data_t value = { 0 };
+        ops += fdb_map_get(&map, transaction, &keys[i], &value);
+    }
+    fdbtool_bench_report("get", ops, fdbtool_time() - start);
+
+    size_t const scans_num = keys_num / FDBTOOL_BENCH_SCAN_LEN + 1;
+    ops = 0;
+    start = fdbtool_time();
+    if (keys_num && fdb_cursor_open(&map, transaction, &cursor))
+    {
+        for (size_t i = 0; i < scans_num; ++i)
+        {
+            fdb_data_t key = keys[i % keys_num];
+            fdb_data_t value = { 0 };
+            size_t n = 0;
+            for (bool ret = fdb_cursor_get(&cursor, &key, &value, FDB_SET_RANGE);
+                 ret && n < FDBTOOL_BENCH_SCAN_LEN;
+                 ret = fdb_cursor_get(&cursor, &key, &value, FDB_NEXT))
+                ++n;
+            ops += n;
+        }
+        fdb_cursor_close(&cursor);
+    }
+    fdbtool_bench_report("scan items", ops, fdbtool_time() - start);
+
+    free(keys);
+    fdb_map_close(&map);
+}
+
+// Random puts into the temporary table. The transaction is aborted, so the DB isn't changed.
+static void fdbtool_bench_put(fdb_transaction_t *transaction, uint32_t count)
+{
+    fdb_map_t map;
+    if (!fdb_map_open(transaction, FDBTOOL_BENCH_TABLE, FDB_MAP_CREATE | FDB_MAP_INTEGERKEY, &map))
+        return;
+
+    uint8_t value_data[FDBTOOL_BENCH_VALUE_SIZE];
+    memset(value_data, 0xAB, sizeof value_data);
+
+    double const start = fdbtool_time();
+    size_t ops = 0;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t id = (uint32_t)rand();
+        fdb_data_t const key = { sizeof id, &id };
+        fdb_data_t const value = { sizeof value_data, value_data };
+        if (!fdb_map_put(&map, transaction, &key, &value))
+            break;
+        ops++;
+    }
+
+    fdbtool_bench_report("put", ops, fdbtool_time() - start);
+
+    fdb_map_close(&map);
+}
+
+void fdbtool_bench(fdbtool_t *dbtool, char const *table, uint32_t count)
+{
+    if (!count)
+        return;
+
+    srand((unsigned)time(0));
+
+    fdb_transaction_t transaction = { 0 };
+    if (fdb_transaction_start(dbtool->db, &transaction))
+    {
+        if (table && *table)
+            fdbtool_bench_table(&transaction, table, count);
+        fdbtool_bench_put(&transaction, count);
+        fdb_transaction_abort(&transaction);
+    }
+}
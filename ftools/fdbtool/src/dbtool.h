@@ -9,5 +9,8 @@ typedef struct fdbtool fdbtool_t;
 fdbtool_t *fdbtool(char const *dir);
 void       fdbtool_close(fdbtool_t *dbtool);
 void       fdbtool_tables(fdbtool_t *dbtool);
+void       fdbtool_stat(fdbtool_t *dbtool);
+bool       fdbtool_compact(fdbtool_t *dbtool, char const *dir);
+void       fdbtool_bench(fdbtool_t *dbtool, char const *table, uint32_t count);
 
 #endif
@@ -2,17 +2,52 @@
 #include <stdio.h>
 #include <strings.h>
 #include <ctype.h>
+#include <stdlib.h>
+
+enum
+{
+    FBENCH_COUNT = 100000       // Default number of operations for bench command
+};
 
 static void fhelp()
 {
     printf("  exit - exit the DB view\n");
     printf("  help - print help\n");
     printf("  tables - print tables list\n");
+    printf("  stat - print DB and tables statistics\n");
+    printf("  compact DIR - write compacted copy of DB into DIR\n");
+    printf("  bench [TABLE] [COUNT] - measure random gets and range scans of TABLE and random puts\n");
+}
+
+static char *fnext_arg(char **cmd)
+{
+    char *c = *cmd;
+    for(; *c && isspace(*c); ++c);
+    char *arg = c;
+    for(; *c && !isspace(*c); ++c);
+    if (*c) *c++ = 0;
+    *cmd = c;
+    return arg;
+}
+
+static void fcompact(fdbtool_t *ptool, char *cmd)
+{
+    fdbtool_compact(ptool, fnext_arg(&cmd));
+}
+
+static void fbench(fdbtool_t *ptool, char *cmd)
+{
+    char *table = fnext_arg(&cmd);
+    char *count = fnext_arg(&cmd);
+    fdbtool_bench(ptool, table, *count ? (uint32_t)strtoul(count, 0, 10) : FBENCH_COUNT);
 }
 
 static const char CMD_EXIT[4]    = "exit";
 static const char CMD_HELP[4]    = "help";
 static const char CMD_TABLES[6]  = "tables";
+static const char CMD_STAT[4]    = "stat";
+static const char CMD_COMPACT[7] = "compact";
+static const char CMD_BENCH[5]   = "bench";
 
 int main(int argc, char **argv)
 {
@@ -29,6 +64,9 @@ int main(int argc, char **argv)
             else if (strncasecmp(cmd, CMD_EXIT, sizeof CMD_EXIT) == 0)          break;
             else if (strncasecmp(cmd, CMD_HELP, sizeof CMD_HELP) == 0)          fhelp();
             else if (strncasecmp(cmd, CMD_TABLES, sizeof CMD_TABLES) == 0)      fdbtool_tables(ptool);
+            else if (strncasecmp(cmd, CMD_STAT, sizeof CMD_STAT) == 0)          fdbtool_stat(ptool);
+            else if (strncasecmp(cmd, CMD_COMPACT, sizeof CMD_COMPACT) == 0)    fcompact(ptool, cmd + sizeof CMD_COMPACT);
+            else if (strncasecmp(cmd, CMD_BENCH, sizeof CMD_BENCH) == 0)        fbench(ptool, cmd + sizeof CMD_BENCH);
             else                                                                printf("Unknown command\n");
             printf(">");
         }
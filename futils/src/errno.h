@@ -14,7 +14,8 @@ typedef enum ferr
     FERR_NOT_IMPL    = -4,
     FERR_TIMEOUT     = -5,
     FERR_OVERFLOW    = -6,
-    FERR_UNKNOWN     = -7
+    FERR_UNKNOWN     = -7,
+    FERR_AGAIN       = -8
 } ferr_t;
 
 #endif
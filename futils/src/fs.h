@@ -68,5 +68,7 @@ char              fspath_delimiter(char const *path);
 
 bool              fsfile_md5sum(char const *path, fmd5_t *sum);
 bool              fsfile_size(char const *path, uint64_t *size);
+void const       *fsfile_map(char const *path, uint64_t *size);      // Read-only mapping of the whole file into memory
+void              fsfile_unmap(void const *data, uint64_t size);
 
 #endif
@@ -191,16 +191,19 @@ static bool fmsgbus_handlers_retain(fmsgbus_t *pmsgbus, uint32_t msg_type, fvect
     return ret;
 }
 
-static void fmsgbus_handlers_release(fvector_t **handlers)
+static void fmsgbus_handlers_release(fmsgbus_t *pmsgbus, fvector_t **handlers)
 {
     fmsgbus_handler_t **handlers_list = (fmsgbus_handler_t **)fvector_ptr(*handlers);
     size_t const size = fvector_size(*handlers);
 
+    fpush_lock(pmsgbus->handlers_mutex);    // references are retained under the same lock
     for(size_t i = 0; i < size; ++i)
     {
         fmsgbus_handler_t *handler = handlers_list[i];
         fmsgbus_handler_release(handler);
     }
+    fpop_lock();
+
     fvector_clear(handlers);
 }
 
@@ -235,7 +238,7 @@ static ferr_t fmsgbus_subscribe_impl(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg
     return ret;
 }
 
-static ferr_t fmsgbus_unsubscribe_impl(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t fn)
+static ferr_t fmsgbus_unsubscribe_impl(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t fn, void *param)
 {
     ferr_t ret = FSUCCESS;
 
@@ -256,7 +259,8 @@ static ferr_t fmsgbus_unsubscribe_impl(fmsgbus_t *pmsgbus, uint32_t msg_type, fm
         for(size_t i = first; i < last; ++i)
         {
             fmsgbus_msg_handler_t *msg_handler = (fmsgbus_msg_handler_t *)fvector_at(pmsgbus->handlers, i);
-            if (msg_handler->handler->handler == fn)
+            if (msg_handler->handler->handler == fn
+                && msg_handler->handler->param == param)    // the same handler may be subscribed by several objects
             {
                 msg_handler->handler->param = 0;
                 handler = msg_handler->handler;
@@ -321,7 +325,9 @@ static void fmsgbus_msg_handle(fmsgbus_t *msgbus, fvector_t *handlers, uint32_t
     for(size_t i = 0; i < size; ++i)
     {
         fmsgbus_handler_t *handler = handlers_list[i];
-        handler->handler(handler->param, msg);
+        void *param = handler->param;
+        if (param)                          // handler is unsubscribed while the message is handled
+            handler->handler(param, msg);
     }
 }
 
@@ -360,7 +366,7 @@ static void *fmsgbus_thread(void *param)
                 if (fmsgbus_handlers_retain(msgbus, cmsg.msg_type, &thread->retained_handlers))
                 {
                     fmsgbus_msg_handle(msgbus, thread->retained_handlers, cmsg.msg_type, cmsg.msg);
-                    fmsgbus_handlers_release(&thread->retained_handlers);
+                    fmsgbus_handlers_release(msgbus, &thread->retained_handlers);
                 }
             }
             free(cmsg.msg);
@@ -500,7 +506,7 @@ ferr_t fmsgbus_subscribe(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t h
     return fmsgbus_subscribe_impl(pmsgbus, msg_type, handler, param);
 }
 
-ferr_t fmsgbus_unsubscribe(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t handler)
+ferr_t fmsgbus_unsubscribe(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t handler, void *param)
 {
     if (!pmsgbus
         || !handler)
@@ -508,7 +514,7 @@ ferr_t fmsgbus_unsubscribe(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t
         FS_ERR("Invalid argument");
         return FERR_INVALID_ARG;
     }
-    return fmsgbus_unsubscribe_impl(pmsgbus, msg_type, handler);
+    return fmsgbus_unsubscribe_impl(pmsgbus, msg_type, handler, param);
 }
 
 ferr_t fmsgbus_publish(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_t const *msg)
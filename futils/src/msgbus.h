@@ -35,7 +35,7 @@ ferr_t     fmsgbus_create     (fmsgbus_t **ppmsgbus, uint32_t threads_num);
 fmsgbus_t *fmsgbus_retain     (fmsgbus_t *pmsgbus);
 void       fmsgbus_release    (fmsgbus_t *pmsgbus);
 ferr_t     fmsgbus_subscribe  (fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t handler, void *param);
-ferr_t     fmsgbus_unsubscribe(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t handler);
+ferr_t     fmsgbus_unsubscribe(fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_handler_t handler, void *param);
 ferr_t     fmsgbus_publish    (fmsgbus_t *pmsgbus, uint32_t msg_type, fmsg_t const *msg);
 
 #endif
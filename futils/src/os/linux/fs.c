@@ -1,6 +1,10 @@
 #include "../../fs.h"
 #include "../../log.h"
 #include "../../mutex.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 struct fsdir_listener
 {
@@ -60,3 +64,48 @@ bool fsdir_listener_add_path(fsdir_listener_t *listener, char const *path)
 
     return false;
 }
+
+void const *fsfile_map(char const *path, uint64_t *size)
+{
+    if (!path || !size)
+        return 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        FS_ERR("Unable to open the file: \'%s\'", path);
+        return 0;
+    }
+
+    void const *data = 0;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        FS_ERR("Unable to get the file size: \'%s\'", path);
+    else if (!st.st_size)
+        data = "";                          // Empty files can't be mapped
+    else
+    {
+        void *mapping = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+            FS_ERR("Unable to map the file: \'%s\'", path);
+        else
+        {
+            madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+            data = mapping;
+        }
+    }
+
+    close(fd);
+
+    if (data)
+        *size = st.st_size;
+
+    return data;
+}
+
+void fsfile_unmap(void const *data, uint64_t size)
+{
+    if (data && size)
+        munmap((void *)data, size);
+}
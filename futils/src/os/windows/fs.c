@@ -343,3 +343,49 @@ bool fsdir_listener_reg_handler(fsdir_listener_t *listener, fsdir_evt_handler_t
 
     return ret;
 }
+
+void const *fsfile_map(char const *path, uint64_t *size)
+{
+    if (!path || !size)
+        return 0;
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        FS_ERR("Unable to open the file: \'%s\'", path);
+        return 0;
+    }
+
+    void const *data = 0;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+        FS_ERR("Unable to get the file size: \'%s\'", path);
+    else if (!file_size.QuadPart)
+        data = "";                          // Empty files can't be mapped
+    else
+    {
+        HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping)
+        {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+
+        if (!data)
+            FS_ERR("Unable to map the file: \'%s\'", path);
+    }
+
+    CloseHandle(file);
+
+    if (data)
+        *size = file_size.QuadPart;
+
+    return data;
+}
+
+void fsfile_unmap(void const *data, uint64_t size)
+{
+    if (data && size)
+        UnmapViewOfFile(data);
+}
@@ -1,10 +1,17 @@
 #include "stream.h"
 #include "vector.h"
 #include "log.h"
+#include "fs.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#   define O_BINARY 0
+#endif
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // mem_iostream
@@ -442,3 +449,271 @@ fistream_t *fmem_const_istream(char const *data, size_t size)
 
     return (fistream_t *)pistream;
 }
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// file_mapped_istream
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+typedef struct
+{
+    fistream_t          istream;
+    volatile uint32_t   ref_counter;
+    size_t              offset;
+    size_t              size;
+    char const         *data;
+} ffile_mapped_istream_t;
+
+static fistream_t* ffile_mapped_istream_retain(fistream_t *pistream)
+{
+    if (pistream)
+    {
+        ffile_mapped_istream_t *pfile_istream = (ffile_mapped_istream_t *)pistream;
+        pfile_istream->ref_counter++;
+    }
+    else
+        FS_ERR("Invalid istream");
+    return pistream;
+}
+
+static void ffile_mapped_istream_release(fistream_t *pistream)
+{
+    if (pistream)
+    {
+        ffile_mapped_istream_t *pfile_istream = (ffile_mapped_istream_t *)pistream;
+        if (!pfile_istream->ref_counter)
+            FS_ERR("Invalid istream");
+        else if (!--pfile_istream->ref_counter)
+        {
+            fsfile_unmap(pfile_istream->data, pfile_istream->size);
+            memset(pfile_istream, 0, sizeof *pfile_istream);
+            free(pfile_istream);
+        }
+    }
+    else
+        FS_ERR("Invalid istream");
+}
+
+static size_t ffile_mapped_istream_read(fistream_t *pistream, char *data, size_t size)
+{
+    if (!pistream)
+    {
+        FS_ERR("Invalid istream");
+        return 0;
+    }
+    ffile_mapped_istream_t *pfile_istream = (ffile_mapped_istream_t *)pistream;
+
+    size_t const available_size = pfile_istream->size - pfile_istream->offset;
+    if(!available_size)
+        return 0;
+
+    if (size > available_size)
+        size = available_size;
+
+    memcpy(data, pfile_istream->data + pfile_istream->offset, size);
+    pfile_istream->offset += size;
+
+    return size;
+}
+
+static bool ffile_mapped_istream_seek(fistream_t *pistream, size_t pos)
+{
+    if (!pistream)
+    {
+        FS_ERR("Invalid istream");
+        return false;
+    }
+    ffile_mapped_istream_t *pfile_istream = (ffile_mapped_istream_t *)pistream;
+    pfile_istream->offset = pos > pfile_istream->size ? pfile_istream->size : pos;
+    return true;
+}
+
+static fstream_status_t ffile_mapped_istream_status(fistream_t *pistream)
+{
+    ffile_mapped_istream_t *pfile_istream = (ffile_mapped_istream_t *)pistream;
+    return pfile_istream->offset < pfile_istream->size ? FSTREAM_STATUS_OK : FSTREAM_STATUS_EOF;
+}
+
+fistream_t *ffile_mapped_istream(char const *path)
+{
+    if (!path)
+    {
+        FS_ERR("Invalid arguments");
+        return 0;
+    }
+
+    uint64_t size = 0;
+    void const *data = fsfile_map(path, &size);
+    if (!data)
+        return 0;
+
+    if (size > SIZE_MAX)
+    {
+        FS_ERR("File is too big for mapping: \'%s\'", path);
+        fsfile_unmap(data, size);
+        return 0;
+    }
+
+    ffile_mapped_istream_t *pistream = malloc(sizeof(ffile_mapped_istream_t));
+    if (!pistream)
+    {
+        FS_ERR("Unable to allocate memory for istream");
+        fsfile_unmap(data, size);
+        return 0;
+    }
+    memset(pistream, 0, sizeof *pistream);
+
+    pistream->istream.retain = ffile_mapped_istream_retain;
+    pistream->istream.release = ffile_mapped_istream_release;
+    pistream->istream.read = ffile_mapped_istream_read;
+    pistream->istream.seek = ffile_mapped_istream_seek;
+    pistream->istream.status = ffile_mapped_istream_status;
+
+    pistream->ref_counter = 1;
+    pistream->size = (size_t)size;
+    pistream->offset = 0;
+    pistream->data = data;
+
+    return (fistream_t *)pistream;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// file_ostream
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+typedef struct
+{
+    fostream_t          ostream;
+    volatile uint32_t   ref_counter;
+    int                 fd;
+    bool                is_failed;
+} ffile_ostream_t;
+
+static fostream_t* ffile_ostream_retain(fostream_t *postream)
+{
+    if (postream)
+    {
+        ffile_ostream_t *pfile_ostream = (ffile_ostream_t *)postream;
+        pfile_ostream->ref_counter++;
+    }
+    else
+        FS_ERR("Invalid ostream");
+    return postream;
+}
+
+static void ffile_ostream_release(fostream_t *postream)
+{
+    if (postream)
+    {
+        ffile_ostream_t *pfile_ostream = (ffile_ostream_t *)postream;
+        if (!pfile_ostream->ref_counter)
+            FS_ERR("Invalid ostream");
+        else if (!--pfile_ostream->ref_counter)
+        {
+            close(pfile_ostream->fd);
+            memset(pfile_ostream, 0, sizeof *pfile_ostream);
+            free(pfile_ostream);
+        }
+    }
+    else
+        FS_ERR("Invalid ostream");
+}
+
+static size_t ffile_ostream_write(fostream_t *postream, char const *data, size_t size)
+{
+    if (!postream)
+    {
+        FS_ERR("Invalid ostream");
+        return 0;
+    }
+    ffile_ostream_t *pfile_ostream = (ffile_ostream_t *)postream;
+
+    ssize_t const written = write(pfile_ostream->fd, data, size);
+    if (written <= 0)
+    {
+        pfile_ostream->is_failed = true;
+        return 0;
+    }
+
+    return (size_t)written;
+}
+
+static bool ffile_ostream_seek(fostream_t *postream, size_t pos)
+{
+    if (!postream)
+    {
+        FS_ERR("Invalid ostream");
+        return false;
+    }
+    ffile_ostream_t *pfile_ostream = (ffile_ostream_t *)postream;
+    return lseek(pfile_ostream->fd, (off_t)pos, SEEK_SET) != (off_t)-1;
+}
+
+static fstream_status_t ffile_ostream_status(fostream_t *postream)
+{
+    ffile_ostream_t *pfile_ostream = (ffile_ostream_t *)postream;
+    return pfile_ostream->is_failed ? FSTREAM_STATUS_INVALID : FSTREAM_STATUS_OK;
+}
+
+fostream_t *ffile_ostream(char const *path, bool append)
+{
+    if (!path)
+    {
+        FS_ERR("Invalid arguments");
+        return 0;
+    }
+
+    int const fd = open(path, O_CREAT | O_WRONLY | O_BINARY | (append ? O_APPEND : O_TRUNC), 0666);
+    if (fd == -1)
+    {
+        FS_ERR("Unable to open the file: \'%s\'", path);
+        return 0;
+    }
+
+    ffile_ostream_t *postream = malloc(sizeof(ffile_ostream_t));
+    if (!postream)
+    {
+        FS_ERR("Unable to allocate memory for ostream");
+        close(fd);
+        return 0;
+    }
+    memset(postream, 0, sizeof *postream);
+
+    postream->ostream.retain = ffile_ostream_retain;
+    postream->ostream.release = ffile_ostream_release;
+    postream->ostream.write = ffile_ostream_write;
+    postream->ostream.seek = ffile_ostream_seek;
+    postream->ostream.status = ffile_ostream_status;
+
+    postream->ref_counter = 1;
+    postream->fd = fd;
+
+    return (fostream_t *)postream;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+char const *fistream_data(fistream_t *pistream, size_t *size, size_t *offset)
+{
+    if (!pistream || !size)
+        return 0;
+
+    if (pistream->read == fmem_const_istream_read)
+    {
+        fmem_const_istream_t *pmem_istream = (fmem_const_istream_t *)pistream;
+        *size = pmem_istream->size;
+        if (offset)
+            *offset = pmem_istream->offset;
+        return pmem_istream->data;
+    }
+
+    if (pistream->read == ffile_mapped_istream_read)
+    {
+        ffile_mapped_istream_t *pfile_istream = (ffile_mapped_istream_t *)pistream;
+        *size = pfile_istream->size;
+        if (offset)
+            *offset = pfile_istream->offset;
+        return pfile_istream->data;
+    }
+
+    return 0;
+}
@@ -59,5 +59,10 @@ fistream_t      *fmem_istream           (fmem_iostream_t *piostream);
 fostream_t      *fmem_ostream           (fmem_iostream_t *piostream);
 
 fistream_t      *fmem_const_istream     (char const *data, size_t size);
+fistream_t      *ffile_mapped_istream   (char const *path);
+fostream_t      *ffile_ostream          (char const *path, bool append);     // Unbuffered. Written data is visible to readers of the file at once.
+
+// Returns the whole data of memory and mapped istreams and the current read offset. Other istreams have no contiguous data.
+char const      *fistream_data          (fistream_t *pistream, size_t *size, size_t *offset);
 
 #endif